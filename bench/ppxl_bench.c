@@ -0,0 +1,344 @@
+/*
+End-to-end throughput benchmark for ppxl.
+
+Generates a deterministic synthetic corpus in a temporary directory, runs the full `ppxl`
+pipeline once per effect in `--once` mode and reports throughput, per-image latency and
+peak RSS of every run as a single JSON document. The corpus depends only on the options
+(and the seed), so numbers from different builds can be compared directly.
+*/
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <stb_image_write.h>
+
+#ifndef PPXL_BINARY
+#define PPXL_BINARY "./ppxl"
+#endif
+
+#define MAX_RUNS 64
+
+typedef struct {
+    int num_images;
+    int width, height, channels;
+    const char* format;
+    const char* effects[MAX_RUNS]; // one ppxl -e spec per run
+    int num_effects;
+    uint64_t seed;
+    const char* ppxl;
+    const char* output;
+    bool keep;
+} bench_config_t;
+
+static void usage(void) {
+    fprintf(stderr,
+        "Usage: ppxl-bench [--images N] [--width W] [--height H] [--channels 1-4] [--format jpg|png]\n"
+        "                  [--effects <spec>]... [--seed S] [--ppxl <path>] [--output <file>] [--keep]\n"
+        "Every --effects is one run, with a spec as given to ppxl -e (e.g. --effects greyscale --effects 'blur:20,invert').\n");
+}
+
+static int parse_args(int argc, char* argv[], bench_config_t* config) {
+    for (int i = 1; i < argc; i++) {
+        const char* value = (i + 1 < argc)? argv[i + 1]: NULL;
+
+        if (strcmp(argv[i], "--keep") == 0) { config->keep = true; continue; }
+        if (value == NULL) { usage(); return -1; }
+
+        if      (strcmp(argv[i], "--images") == 0)   config->num_images = atoi(value);
+        else if (strcmp(argv[i], "--width") == 0)    config->width = atoi(value);
+        else if (strcmp(argv[i], "--height") == 0)   config->height = atoi(value);
+        else if (strcmp(argv[i], "--channels") == 0) config->channels = atoi(value);
+        else if (strcmp(argv[i], "--format") == 0)   config->format = value;
+        else if (strcmp(argv[i], "--effects") == 0) {
+            if (config->num_effects == MAX_RUNS) {
+                fprintf(stderr, "ppxl-bench: at most %d --effects runs\n", MAX_RUNS);
+                return -1;
+            }
+            config->effects[config->num_effects++] = value;
+        }
+        else if (strcmp(argv[i], "--seed") == 0)     config->seed = strtoull(value, NULL, 10);
+        else if (strcmp(argv[i], "--ppxl") == 0)     config->ppxl = value;
+        else if (strcmp(argv[i], "--output") == 0)   config->output = value;
+        else { usage(); return -1; }
+        i++;
+    }
+
+    if (config->num_images <= 0 || config->width <= 0 || config->height <= 0 ||
+        config->channels < 1 || config->channels > 4 ||
+        (strcmp(config->format, "jpg") != 0 && strcmp(config->format, "png") != 0)) {
+        usage();
+        return -1;
+    }
+
+    return 0;
+}
+
+// xorshift64*: small, fast and identical on every platform.
+static inline uint64_t next_random(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1Dull;
+}
+
+/*
+* @brief Fill `pixels` with a photo-like pattern: per-image gradients, a few solid discs and
+* low-amplitude noise, so that JPEG/PNG encoders see realistic entropy.
+*/
+static void synthesize_image(unsigned char* pixels, int width, int height, int channels, uint64_t seed) {
+    uint64_t state = seed * 0x9E3779B97F4A7C15ull + 1;
+    int base[4], slope_x[4], slope_y[4];
+    for (int c = 0; c < 4; c++) {
+        base[c] = next_random(&state) % 256;
+        slope_x[c] = (int)(next_random(&state) % 512) - 256;
+        slope_y[c] = (int)(next_random(&state) % 512) - 256;
+    }
+
+    enum { NUM_DISCS = 6 };
+    int disc_x[NUM_DISCS], disc_y[NUM_DISCS], disc_r[NUM_DISCS], disc_value[NUM_DISCS];
+    for (int d = 0; d < NUM_DISCS; d++) {
+        disc_x[d] = next_random(&state) % width;
+        disc_y[d] = next_random(&state) % height;
+        disc_r[d] = 1 + next_random(&state) % (1 + (width < height? width: height) / 4);
+        disc_value[d] = next_random(&state) % 256;
+    }
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int disc = -1;
+            for (int d = 0; d < NUM_DISCS; d++) {
+                long dx = x - disc_x[d], dy = y - disc_y[d];
+                if (dx * dx + dy * dy <= (long)disc_r[d] * disc_r[d]) disc = d;
+            }
+
+            uint64_t noise = next_random(&state);
+            unsigned char* pixel = pixels + ((size_t)y * width + x) * channels;
+            for (int c = 0; c < channels; c++) {
+                int value = base[c] + slope_x[c] * x / width + slope_y[c] * y / height;
+                if (disc >= 0) value = (value + disc_value[disc] * (c + 1)) / 2;
+                value += (int)((noise >> (c * 8)) & 15) - 8;
+                if (c == 3) value = 255 - (value & 63); // mostly opaque alpha
+                pixel[c] = (unsigned char)(value < 0? 0: value > 255? 255: value);
+            }
+        }
+    }
+}
+
+static long generate_corpus(const bench_config_t* config, const char* directory) {
+    size_t size = (size_t)config->width * config->height * config->channels;
+    unsigned char* pixels = malloc(size);
+    if (pixels == NULL) {
+        perror("generate_corpus - Failed to allocate image buffer");
+        return -1;
+    }
+
+    long total_bytes = 0;
+    for (int i = 0; i < config->num_images; i++) {
+        synthesize_image(pixels, config->width, config->height, config->channels, config->seed + i);
+
+        char path[1024];
+        if (snprintf(path, sizeof(path), "%s/bench_%05d.%s", directory, i, config->format) >= (int)sizeof(path)) {
+            fprintf(stderr, "generate_corpus: Path too long in '%s'\n", directory);
+            free(pixels);
+            return -1;
+        }
+
+        int result = (strcmp(config->format, "png") == 0)
+            ? stbi_write_png(path, config->width, config->height, config->channels, pixels, config->width * config->channels)
+            : stbi_write_jpg(path, config->width, config->height, config->channels, pixels, 90);
+        if (result == 0) {
+            fprintf(stderr, "generate_corpus: Failed to write '%s'\n", path);
+            free(pixels);
+            return -1;
+        }
+
+        struct stat st;
+        if (stat(path, &st) == 0) total_bytes += st.st_size;
+    }
+
+    free(pixels);
+    return total_bytes;
+}
+
+static int remove_entry(const char* path, const struct stat* st, int flag, struct FTW* ftw) {
+    (void)st; (void)flag; (void)ftw;
+    return remove(path);
+}
+
+static int remove_tree(const char* path) {
+    return nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+// Empties `directory` without removing it.
+static void clear_directory(const char* directory) {
+    remove_tree(directory);
+    mkdir(directory, 0755);
+}
+
+static char* read_file(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char* content = malloc(size + 1);
+    if (content != NULL) {
+        size_t length = fread(content, 1, size, file);
+        while (length > 0 && (content[length - 1] == '\n' || content[length - 1] == '\r')) length--;
+        content[length] = '\0';
+    }
+
+    fclose(file);
+    return content;
+}
+
+/*
+* @brief Write `text` as a JSON string literal.
+*/
+static void write_json_string(FILE* out, const char* text) {
+    fputc('"', out);
+    for (const unsigned char* c = (const unsigned char*)text; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\')
+            fprintf(out, "\\%c", *c);
+        else if (*c < 0x20)
+            fprintf(out, "\\u%04x", *c);
+        else
+            fputc(*c, out);
+    }
+    fputc('"', out);
+}
+
+/*
+* @brief Run ppxl once over the corpus with `effect` and append the run's JSON to `out`.
+*/
+static int run_effect(const bench_config_t* config, const char* root, const char* effect, FILE* out, bool first) {
+    char input[1024], output[1024], summary[1024];
+    snprintf(input, sizeof(input), "%s/in", root);
+    snprintf(output, sizeof(output), "%s/out", root);
+    snprintf(summary, sizeof(summary), "%s/summary.json", root);
+    clear_directory(output);
+    remove(summary);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("run_effect - fork failed");
+        return -1;
+    }
+
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_RDWR);
+        if (devnull >= 0) {
+            dup2(devnull, STDIN_FILENO);
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+        }
+        execl(config->ppxl, "ppxl", input, "-e", effect, "-o", output, "--once", "--summary-json", summary,
+            "--settle-ms", "0", (char*)NULL); // the corpus is complete before ppxl starts
+        _exit(127);
+    }
+
+    int status = 0;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        perror("run_effect - wait4 failed");
+        return -1;
+    }
+
+    int exit_status = WIFEXITED(status)? WEXITSTATUS(status): 128 + WTERMSIG(status);
+    char* result = read_file(summary);
+
+    fprintf(out, "%s\n    {\"effect\": ", first? "": ",");
+    write_json_string(out, effect);
+    fprintf(out, ", \"exit_status\": %d, \"peak_rss_kb\": %ld, \"summary\": %s}",
+        exit_status, usage.ru_maxrss, result? result: "null");
+
+    if (exit_status != 0 || result == NULL)
+        fprintf(stderr, "ppxl-bench: run for '%s' failed (exit status %d)\n", effect, exit_status);
+
+    free(result);
+    return (exit_status == 0 && result != NULL)? 0: -1;
+}
+
+int main(int argc, char* argv[]) {
+    bench_config_t config = {
+        .num_images = 64,
+        .width = 1920, .height = 1080, .channels = 3,
+        .format = "jpg",
+        .num_effects = 0,
+        .seed = 1,
+        .ppxl = PPXL_BINARY,
+        .output = NULL,
+        .keep = false,
+    };
+
+    if (parse_args(argc, argv, &config) != 0)
+        return EXIT_FAILURE;
+    if (config.num_effects == 0) {
+        static const char* defaults[] = { "greyscale", "posterize", "directional_blur" };
+        for (size_t i = 0; i < sizeof(defaults) / sizeof(defaults[0]); i++)
+            config.effects[config.num_effects++] = defaults[i];
+    }
+
+    char root[] = "/tmp/ppxl-bench-XXXXXX";
+    if (mkdtemp(root) == NULL) {
+        perror("ppxl-bench - Cannot create temporary directory");
+        return EXIT_FAILURE;
+    }
+
+    char input[1024];
+    snprintf(input, sizeof(input), "%s/in", root);
+    mkdir(input, 0755);
+
+    fprintf(stderr, "ppxl-bench: generating %d %dx%dx%d %s images in %s\n",
+        config.num_images, config.width, config.height, config.channels, config.format, root);
+    long corpus_bytes = generate_corpus(&config, input);
+    if (corpus_bytes < 0) {
+        if (!config.keep) remove_tree(root);
+        return EXIT_FAILURE;
+    }
+
+    FILE* out = (config.output != NULL)? fopen(config.output, "w"): stdout;
+    if (out == NULL) {
+        perror("ppxl-bench - Cannot open output file");
+        if (!config.keep) remove_tree(root);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(out, "{\n  \"corpus\": {\"images\": %d, \"width\": %d, \"height\": %d, \"channels\": %d, "
+        "\"format\": \"%s\", \"seed\": %llu, \"bytes\": %ld},\n  \"runs\": [",
+        config.num_images, config.width, config.height, config.channels, config.format,
+        (unsigned long long)config.seed, corpus_bytes);
+
+    int exit_status = EXIT_SUCCESS;
+    bool first = true;
+    for (int run = 0; run < config.num_effects; run++) {
+        const char* effect = config.effects[run];
+        fprintf(stderr, "ppxl-bench: running '%s'\n", effect);
+        if (run_effect(&config, root, effect, out, first) != 0)
+            exit_status = EXIT_FAILURE;
+        first = false;
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+    if (out != stdout) fclose(out);
+
+    if (!config.keep) remove_tree(root);
+
+    return exit_status;
+}
@@ -0,0 +1,677 @@
+/*
+Microbenchmarks for the hot kernels of the pipeline, measured in isolation:
+
+    filters   greyscale, posterize, directional_blur,   (per tile size and thread count)
+              gaussian (sigma 1.5 and 20), box,
+              convolve (3x3 and 7x7), lut (posterize + 4 pointwise effects, fused),
+              sobel, canny, median (radius 2 and 16), bilateral,
+              and the planar-capable ones again on planar tiles (`*_planar`)
+    queue     chunk_enqueue / chunk_dequeue             (uncontended and producer/consumer)
+    dict      dict_insert / dict_get                    (string keys, as in reconstruction)
+    object    let / ref / destroy                       (Object runtime)
+
+Every benchmark is warmed up, then repeated; each repetition yields one sample of time (and,
+on x86, TSC cycles) per operation. The report lists min / median / mean / p99 / stddev of
+those samples, so noisy runs are visible instead of being averaged away.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <unistd.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <xxhash.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "image.h"
+#include "filter.h"
+#include "blur.h"
+#include "convolve.h"
+#include "edges.h"
+#include "denoise.h"
+#include "lut.h"
+#include "dict.h"
+#include "Object.h"
+#include "stats.h"
+
+// Never raised: the queues are only stopped by running dry.
+static volatile sig_atomic_t stop = 0;
+
+typedef struct {
+    int warmup;
+    int repetitions;
+    const char* only;
+    int thread_counts[8];
+    int num_thread_counts;
+    int tile_sizes[8];
+    int num_tile_sizes;
+} microbench_config_t;
+
+static microbench_config_t config;
+
+static inline uint64_t read_cycles(void) {
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// #######################################
+// # Measurement harness
+// #######################################
+
+typedef struct {
+    double *ns;
+    double *cycles;
+    int count;
+} samples_t;
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(double* sorted, int count, double p) {
+    int index = (int)ceil(p / 100.0 * count) - 1;
+    if (index < 0) index = 0;
+    if (index >= count) index = count - 1;
+    return sorted[index];
+}
+
+static void report(const char* name, const char* params, samples_t* s, double ops_per_rep, double pixels_per_op) {
+    qsort(s->ns, s->count, sizeof(double), compare_doubles);
+    qsort(s->cycles, s->count, sizeof(double), compare_doubles);
+
+    double mean = 0, variance = 0;
+    for (int i = 0; i < s->count; i++) mean += s->ns[i];
+    mean /= s->count;
+    for (int i = 0; i < s->count; i++) variance += (s->ns[i] - mean) * (s->ns[i] - mean);
+    double stddev = (s->count > 1)? sqrt(variance / (s->count - 1)): 0.0;
+
+    double median = percentile(s->ns, s->count, 50);
+    printf("%-18s %-22s %12.1f %12.1f %12.1f %12.1f %10.1f %12.1f",
+        name, params, s->ns[0], median, mean, percentile(s->ns, s->count, 99), stddev,
+        percentile(s->cycles, s->count, 50));
+
+    // Throughput is derived from the median repetition: ops_per_rep operations in median * ops_per_rep ns.
+    if (pixels_per_op > 0)
+        printf(" %10.1f MP/s\n", pixels_per_op / median * 1e3);
+    else
+        printf(" %10.2f Mop/s\n", 1e3 / median);
+    (void)ops_per_rep;
+}
+
+/*
+* @brief Run `body` `warmup` times unmeasured and `repetitions` times measured.
+* @param body Performs `ops_per_rep` operations on `ctx`.
+* @note Samples are recorded per operation so that batches of different sizes compare directly.
+*/
+static void measure(const char* name, const char* params, void (*body)(void*), void* ctx,
+                    double ops_per_rep, double pixels_per_op) {
+    if (config.only && !strstr(name, config.only))
+        return;
+
+    for (int i = 0; i < config.warmup; i++)
+        body(ctx);
+
+    samples_t s = { malloc(config.repetitions * sizeof(double)), malloc(config.repetitions * sizeof(double)), config.repetitions };
+    for (int i = 0; i < config.repetitions; i++) {
+        uint64_t start_cycles = read_cycles();
+        uint64_t start = now_ns();
+        body(ctx);
+        uint64_t end = now_ns();
+        uint64_t end_cycles = read_cycles();
+
+        s.ns[i] = (double)(end - start) / ops_per_rep;
+        s.cycles[i] = (double)(end_cycles - start_cycles) / ops_per_rep;
+    }
+
+    report(name, params, &s, ops_per_rep, pixels_per_op);
+    free(s.ns);
+    free(s.cycles);
+}
+
+// #######################################
+// # Worker team: runs one job on N threads per repetition
+// #######################################
+
+typedef struct team team_t;
+
+typedef struct {
+    team_t* team;
+    int index;
+} team_member_t;
+
+struct team {
+    int size;
+    pthread_t* threads;
+    team_member_t* members;
+    pthread_barrier_t start, done;
+    void (*job)(int index, void* ctx);
+    void* ctx;
+    bool quit;
+};
+
+static void* team_worker(void* arg) {
+    team_member_t* member = (team_member_t*)arg;
+    team_t* team = member->team;
+
+    while (true) {
+        pthread_barrier_wait(&team->start);
+        if (team->quit) break;
+        team->job(member->index, team->ctx);
+        pthread_barrier_wait(&team->done);
+    }
+
+    return NULL;
+}
+
+static void team_init(team_t* team, int size) {
+    team->size = size;
+    team->quit = false;
+    team->threads = malloc(size * sizeof(pthread_t));
+    team->members = malloc(size * sizeof(team_member_t));
+    pthread_barrier_init(&team->start, NULL, size + 1);
+    pthread_barrier_init(&team->done, NULL, size + 1);
+
+    for (int i = 0; i < size; i++) {
+        team->members[i] = (team_member_t){ team, i };
+        pthread_create(&team->threads[i], NULL, team_worker, &team->members[i]);
+    }
+}
+
+// Run `job` once on every member and wait for all of them.
+static void team_run(team_t* team, void (*job)(int, void*), void* ctx) {
+    team->job = job;
+    team->ctx = ctx;
+    pthread_barrier_wait(&team->start);
+    pthread_barrier_wait(&team->done);
+}
+
+static void team_destroy(team_t* team) {
+    team->quit = true;
+    pthread_barrier_wait(&team->start);
+    for (int i = 0; i < team->size; i++)
+        pthread_join(team->threads[i], NULL);
+
+    pthread_barrier_destroy(&team->start);
+    pthread_barrier_destroy(&team->done);
+    free(team->threads);
+    free(team->members);
+}
+
+// #######################################
+// # Filters
+// #######################################
+
+enum { TILES_PER_THREAD = 16 };
+
+typedef struct {
+    team_t* team;
+    image_chunk_t* tiles; // TILES_PER_THREAD per thread
+    image_chunk_t* planes; // the same tiles, planar
+    image_chunk_t* words;  // the same tiles, u16
+    image_chunk_t* floats; // the same tiles, f32
+    image_chunk_t* greys;  // 1-channel tiles
+    image_chunk_t* rgbas;  // 4-channel tiles
+    int kind;
+    const convolve_kernel_t* kernels; // 3x3 sharpen, 7x7 box
+    const uint8_t* lut;
+    const uint16_t* deep; // the same table at 16 bits, for u16 and f32 tiles
+    unsigned char* maps; // an edge map per tile, `edges` writes a single channel
+    size_t map_size;
+} filter_ctx_t;
+
+static image_chunk_t make_tile(int size, int channels, uint64_t seed) {
+    image_chunk_t chunk;
+    memset(&chunk, 0, sizeof(chunk));
+    chunk.width = size;
+    chunk.height = size;
+    chunk.channels = channels;
+    chunk_set_geometry(&chunk, CHUNK_LAYOUT_INTERLEAVED);
+    chunk.pixel_data = chunk_alloc_pixels(chunk.data_size_bytes);
+    memset(chunk.pixel_data, 0, chunk.data_size_bytes); // the row padding
+
+    uint64_t state = seed * 0x9E3779B97F4A7C15ull + 1;
+    for (int y = 0; y < size; y++) {
+        unsigned char* row = chunk.pixel_data + (size_t)y * chunk.stride;
+        for (size_t i = 0; i < (size_t)size * channels; i++) {
+            state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+            row[i] = (unsigned char)state;
+        }
+    }
+
+    return chunk;
+}
+
+enum { FIRST_PLANAR_KIND = 14, FIRST_U16_KIND = 20, FIRST_F32_KIND = 23, FIRST_GREY_KIND = 26, FIRST_RGBA_KIND = 29 };
+
+static void filter_job(int index, void* arg) {
+    filter_ctx_t* ctx = (filter_ctx_t*)arg;
+    image_chunk_t* tiles = (ctx->kind >= FIRST_RGBA_KIND)? ctx->rgbas: (ctx->kind >= FIRST_GREY_KIND)? ctx->greys:
+                           (ctx->kind >= FIRST_F32_KIND)? ctx->floats: (ctx->kind >= FIRST_U16_KIND)? ctx->words:
+                           (ctx->kind >= FIRST_PLANAR_KIND)? ctx->planes: ctx->tiles;
+    tiles += index * TILES_PER_THREAD;
+
+    for (int i = 0; i < TILES_PER_THREAD; i++) {
+        switch (ctx->kind) {
+            case 0: greyscale(&tiles[i]); break;
+            case 1: posterize(&tiles[i], 4); break;
+            case 2: directional_blur(&tiles[i], 50); break;
+            case 3: gaussian_blur(&tiles[i], 1.5); break;
+            case 4: gaussian_blur(&tiles[i], 20); break;
+            case 5: box_blur(&tiles[i], 4, 1); break;
+            case 6: convolve(&tiles[i], &ctx->kernels[0]); break;
+            case 7: convolve(&tiles[i], &ctx->kernels[1]); break;
+            case 8: apply_lut(&tiles[i], ctx->lut, ctx->deep); break;
+            case 9: edge_map(&tiles[i], ctx->maps + (size_t)(index * TILES_PER_THREAD + i) * ctx->map_size, 0, 0); break;
+            case 10: edge_map(&tiles[i], ctx->maps + (size_t)(index * TILES_PER_THREAD + i) * ctx->map_size, 50, 150); break;
+            case 11: median_filter(&tiles[i], 2); break;
+            case 12: median_filter(&tiles[i], 16); break;
+            case 13: bilateral_filter(&tiles[i], 8, 20); break;
+            case 14: greyscale(&tiles[i]); break;
+            case 15: gaussian_blur(&tiles[i], 1.5); break;
+            case 16: convolve(&tiles[i], &ctx->kernels[0]); break;
+            case 17: apply_lut(&tiles[i], ctx->lut, ctx->deep); break;
+            case 18: median_filter(&tiles[i], 2); break;
+            case 19: box_blur(&tiles[i], 4, 1); break;
+            case 20: case 23: greyscale(&tiles[i]); break;
+            case 21: case 24: gaussian_blur(&tiles[i], 1.5); break;
+            case 22: case 25: apply_lut(&tiles[i], ctx->lut, ctx->deep); break;
+            case 26: case 29: greyscale(&tiles[i]); break;
+            case 27: case 30: directional_blur(&tiles[i], 50); break;
+            case 28: case 31: apply_lut(&tiles[i], ctx->lut, ctx->deep); break;
+        }
+    }
+}
+
+static void filter_body(void* arg) {
+    filter_ctx_t* ctx = (filter_ctx_t*)arg;
+    team_run(ctx->team, filter_job, ctx);
+}
+
+static void bench_filters(void) {
+    static const char* names[] = { "greyscale", "posterize", "directional_blur", "gaussian_1.5", "gaussian_20", "box_4", "convolve_3x3", "convolve_7x7", "lut", "sobel", "canny", "median_2", "median_16", "bilateral",
+                                   "greyscale_planar", "gaussian_1.5_planar", "convolve_3x3_planar", "lut_planar", "median_2_planar", "box_4_planar",
+                                   "greyscale_u16", "gaussian_1.5_u16", "lut_u16", "greyscale_f32", "gaussian_1.5_f32", "lut_f32",
+                                   "greyscale_grey", "directional_blur_grey", "lut_grey", "greyscale_rgba", "directional_blur_rgba", "lut_rgba" };
+    const int num_kinds = sizeof(names) / sizeof(names[0]);
+
+    convolve_kernel_t kernels[2] = {0};
+    convolve_preset("sharpen", &kernels[0]);
+    kernels[1].size = 7;
+    kernels[1].divisor = 49;
+    for (int i = 0; i < 49; i++) kernels[1].coeffs[i] = 1;
+
+    // what `-e posterize,brightness,contrast,gamma,invert` compiles to
+    lut_t lut, next;
+    lut_posterize(lut, 4);
+    lut_brightness(next, 32); lut_compose(lut, next);
+    lut_contrast(next, 1.2);  lut_compose(lut, next);
+    lut_gamma(next, 2.2);     lut_compose(lut, next);
+    lut_invert(next);         lut_compose(lut, next);
+
+    static lut16_t deep, deep_next; // 128 KiB each
+    lut16_posterize(deep, 4);
+    lut16_brightness(deep_next, 32); lut16_compose(deep, deep_next);
+    lut16_contrast(deep_next, 1.2);  lut16_compose(deep, deep_next);
+    lut16_gamma(deep_next, 2.2);     lut16_compose(deep, deep_next);
+    lut16_invert(deep_next);         lut16_compose(deep, deep_next);
+
+    for (int t = 0; t < config.num_thread_counts; t++) {
+        int threads = config.thread_counts[t];
+        team_t team;
+        team_init(&team, threads);
+
+        for (int s = 0; s < config.num_tile_sizes; s++) {
+            int size = config.tile_sizes[s];
+            int num_tiles = threads * TILES_PER_THREAD;
+
+            image_chunk_t* tiles = malloc(num_tiles * sizeof(image_chunk_t));
+            image_chunk_t* planes = malloc(num_tiles * sizeof(image_chunk_t));
+            image_chunk_t* words = malloc(num_tiles * sizeof(image_chunk_t));
+            image_chunk_t* floats = malloc(num_tiles * sizeof(image_chunk_t));
+            image_chunk_t* greys = malloc(num_tiles * sizeof(image_chunk_t));
+            image_chunk_t* rgbas = malloc(num_tiles * sizeof(image_chunk_t));
+            for (int i = 0; i < num_tiles; i++) {
+                tiles[i] = make_tile(size, 3, i + 1);
+                planes[i] = make_tile(size, 3, i + 1);
+                chunk_set_layout(&planes[i], CHUNK_LAYOUT_PLANAR);
+            }
+            for (int i = 0; i < num_tiles; i++) {
+                words[i] = make_tile(size, 3, i + 1);
+                chunk_set_format(&words[i], PIXEL_FORMAT_U16);
+                floats[i] = make_tile(size, 3, i + 1);
+                chunk_set_format(&floats[i], PIXEL_FORMAT_F32);
+            }
+            for (int i = 0; i < num_tiles; i++) {
+                greys[i] = make_tile(size, 1, i + 1);
+                rgbas[i] = make_tile(size, 4, i + 1);
+            }
+            unsigned char* maps = malloc((size_t)num_tiles * size * size);
+
+            for (int kind = 0; kind < num_kinds; kind++) {
+                char params[64];
+                snprintf(params, sizeof(params), "tile=%d threads=%d", size, threads);
+                filter_ctx_t ctx = { &team, tiles, planes, words, floats, greys, rgbas, kind, kernels, lut, deep, maps, (size_t)size * size };
+                measure(names[kind], params, filter_body, &ctx, num_tiles, (double)size * size);
+            }
+
+            for (int i = 0; i < num_tiles; i++) {
+                free(tiles[i].pixel_data);
+                free(planes[i].pixel_data);
+                free(words[i].pixel_data);
+                free(floats[i].pixel_data);
+                free(greys[i].pixel_data);
+                free(rgbas[i].pixel_data);
+            }
+            free(tiles);
+            free(planes);
+            free(words);
+            free(floats);
+            free(greys);
+            free(rgbas);
+            free(maps);
+        }
+
+        team_destroy(&team);
+    }
+}
+
+// #######################################
+// # Chunk queue
+// #######################################
+
+enum { QUEUE_OPS = 1 << 14 };
+
+typedef struct {
+    team_t* team;
+    chunk_queue_t queue;
+    image_chunk_t* chunks;
+    int producers;
+} queue_ctx_t;
+
+static void queue_single_body(void* arg) {
+    queue_ctx_t* ctx = (queue_ctx_t*)arg;
+    for (int i = 0; i < QUEUE_OPS; i++)
+        chunk_enqueue(&ctx->queue, &ctx->chunks[i]);
+    for (int i = 0; i < QUEUE_OPS; i++)
+        chunk_dequeue(&ctx->queue);
+}
+
+// The first half of the team produces, the second half consumes; every side moves QUEUE_OPS chunks.
+static void queue_contended_job(int index, void* arg) {
+    queue_ctx_t* ctx = (queue_ctx_t*)arg;
+    int per_thread = QUEUE_OPS / ctx->producers;
+
+    if (index < ctx->producers) {
+        for (int i = 0; i < per_thread; i++)
+            chunk_enqueue(&ctx->queue, &ctx->chunks[index * per_thread + i]);
+    } else {
+        for (int i = 0; i < per_thread; i++)
+            chunk_dequeue(&ctx->queue);
+    }
+}
+
+static void queue_contended_body(void* arg) {
+    queue_ctx_t* ctx = (queue_ctx_t*)arg;
+    team_run(ctx->team, queue_contended_job, ctx);
+}
+
+static void bench_queue(void) {
+    queue_ctx_t ctx;
+    ctx.chunks = calloc(QUEUE_OPS, sizeof(image_chunk_t));
+    chunk_queue_init(&ctx.queue, QUEUE_CHUNKS, CHUNK_QUEUE_FIFO, &stop);
+
+    measure("chunk_queue", "enq+deq threads=1", queue_single_body, &ctx, 2.0 * QUEUE_OPS, 0);
+
+    for (int t = 0; t < config.num_thread_counts; t++) {
+        int producers = config.thread_counts[t];
+        team_t team;
+        team_init(&team, 2 * producers);
+        ctx.team = &team;
+        ctx.producers = producers;
+
+        char params[64];
+        snprintf(params, sizeof(params), "%dP/%dC", producers, producers);
+        measure("chunk_queue", params, queue_contended_body, &ctx, 2.0 * (QUEUE_OPS / producers * producers), 0);
+
+        team_destroy(&team);
+    }
+
+    chunk_queue_destroy(&ctx.queue);
+
+    // Chunks of 8 images arriving interleaved, as they do with 8 chunker threads.
+    for (int i = 0; i < QUEUE_OPS; i++)
+        ctx.chunks[i].image_seq = i % 8;
+    chunk_queue_init(&ctx.queue, QUEUE_CHUNKS, CHUNK_QUEUE_OLDEST_IMAGE, &stop);
+    measure("chunk_queue", "enq+deq threads=1 oldest-image", queue_single_body, &ctx, 2.0 * QUEUE_OPS, 0);
+    chunk_queue_destroy(&ctx.queue);
+
+    free(ctx.chunks);
+}
+
+// #######################################
+// # Dict
+// #######################################
+
+static size_t hash_string(Object key) {
+    const char* str = get_string_v(key);
+    return XXH64(str, strlen(str), 0);
+}
+
+static int compare_strings(Object a, Object b) {
+    return strcmp(get_string_v(a), get_string_v(b)) == 0;
+}
+
+typedef struct {
+    team_t* team;
+    dict_t dict;
+    Object* keys;
+    int num_keys;
+    int threads;
+} dict_ctx_t;
+
+static Object* make_keys(int count) {
+    Object* keys = malloc(count * sizeof(Object));
+    for (int i = 0; i < count; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "../images/image_%08d.jpg", i);
+        keys[i] = let_string_v(name);
+    }
+    return keys;
+}
+
+static void dict_insert_body(void* arg) {
+    dict_ctx_t* ctx = (dict_ctx_t*)arg;
+    dict_destroy(&ctx->dict);
+    ctx->dict = dict_init(hash_string, compare_strings);
+
+    Object value = let_i64_v(0);
+    for (int i = 0; i < ctx->num_keys; i++)
+        dict_insert(&ctx->dict, ctx->keys[i], value);
+    destroy(value);
+}
+
+static void dict_get_job(int index, void* arg) {
+    dict_ctx_t* ctx = (dict_ctx_t*)arg;
+    for (int i = index; i < ctx->num_keys; i += ctx->threads)
+        dict_get(&ctx->dict, ctx->keys[i], None);
+}
+
+static void dict_get_body(void* arg) {
+    dict_ctx_t* ctx = (dict_ctx_t*)arg;
+    team_run(ctx->team, dict_get_job, ctx);
+}
+
+static void bench_dict(void) {
+    static const int sizes[] = { 64, 4096, 65536 };
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        dict_ctx_t ctx;
+        ctx.num_keys = sizes[s];
+        ctx.keys = make_keys(ctx.num_keys);
+        ctx.dict = dict_init(hash_string, compare_strings);
+
+        char params[64];
+        snprintf(params, sizeof(params), "keys=%d", ctx.num_keys);
+        measure("dict_insert", params, dict_insert_body, &ctx, ctx.num_keys, 0);
+
+        for (int t = 0; t < config.num_thread_counts; t++) {
+            team_t team;
+            ctx.threads = config.thread_counts[t];
+            team_init(&team, ctx.threads);
+            ctx.team = &team;
+
+            snprintf(params, sizeof(params), "keys=%d threads=%d", ctx.num_keys, ctx.threads);
+            measure("dict_get", params, dict_get_body, &ctx, ctx.num_keys, 0);
+
+            team_destroy(&team);
+        }
+
+        dict_destroy(&ctx.dict);
+        for (int i = 0; i < ctx.num_keys; i++)
+            destroy(ctx.keys[i]);
+        free(ctx.keys);
+    }
+}
+
+// #######################################
+// # Object runtime
+// #######################################
+
+enum { OBJECT_OPS = 1 << 14 };
+
+typedef struct {
+    team_t* team;
+    int kind;
+} object_ctx_t;
+
+static void object_job(int index, void* arg) {
+    (void)index;
+    object_ctx_t* ctx = (object_ctx_t*)arg;
+
+    for (int i = 0; i < OBJECT_OPS; i++) {
+        switch (ctx->kind) {
+            case 0: { // let + destroy of a plain value
+                Object obj = let_i64_v(i);
+                destroy(obj);
+                break;
+            }
+            case 1: { // let + ref + destroy x2, the ownership pattern used by dict/dlist
+                Object obj = let_i64_v(i);
+                Object other = ref(obj);
+                destroy(other);
+                destroy(obj);
+                break;
+            }
+            case 2: { // string objects copy their payload
+                Object obj = let_string_v("../images/image.jpg");
+                destroy(obj);
+                break;
+            }
+        }
+    }
+}
+
+static void object_body(void* arg) {
+    object_ctx_t* ctx = (object_ctx_t*)arg;
+    team_run(ctx->team, object_job, ctx);
+}
+
+static void bench_object(void) {
+    static const char* names[] = { "let/destroy", "let/ref/destroy", "let_string" };
+
+    for (int t = 0; t < config.num_thread_counts; t++) {
+        int threads = config.thread_counts[t];
+        team_t team;
+        team_init(&team, threads);
+
+        for (int kind = 0; kind < 3; kind++) {
+            char params[64];
+            snprintf(params, sizeof(params), "threads=%d", threads);
+            object_ctx_t ctx = { &team, kind };
+            measure(names[kind], params, object_body, &ctx, (double)OBJECT_OPS * threads, 0);
+        }
+
+        team_destroy(&team);
+    }
+}
+
+// #######################################
+// # Driver
+// #######################################
+
+static int parse_list(const char* text, int* values, int max) {
+    int count = 0;
+    char* copy = strdup(text);
+    for (char* item = strtok(copy, ","); item != NULL && count < max; item = strtok(NULL, ","))
+        if (atoi(item) > 0) values[count++] = atoi(item);
+    free(copy);
+    return count;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+        "Usage: ppxl-microbench [--warmup N] [--reps N] [--threads 1,2,4] [--tiles 32,64,128,256]\n"
+        "                       [--only <substring>] [filters|queue|dict|object ...]\n");
+}
+
+int main(int argc, char* argv[]) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    config.warmup = 3;
+    config.repetitions = 30;
+    config.only = NULL;
+    config.num_thread_counts = parse_list("1,2,4", config.thread_counts, 8);
+    if (cores > 4) config.thread_counts[config.num_thread_counts++] = (int)cores;
+    config.num_tile_sizes = parse_list("32,64,128,256", config.tile_sizes, 8);
+
+    bool run[4] = { false, false, false, false };
+    bool any = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = (i + 1 < argc)? argv[i + 1]: NULL;
+
+        if      (strcmp(argv[i], "filters") == 0) { run[0] = any = true; continue; }
+        else if (strcmp(argv[i], "queue") == 0)   { run[1] = any = true; continue; }
+        else if (strcmp(argv[i], "dict") == 0)    { run[2] = any = true; continue; }
+        else if (strcmp(argv[i], "object") == 0)  { run[3] = any = true; continue; }
+        else if (value == NULL) { usage(); return EXIT_FAILURE; }
+
+        if      (strcmp(argv[i], "--warmup") == 0)  config.warmup = atoi(value);
+        else if (strcmp(argv[i], "--reps") == 0)    config.repetitions = atoi(value);
+        else if (strcmp(argv[i], "--only") == 0)    config.only = value;
+        else if (strcmp(argv[i], "--threads") == 0) config.num_thread_counts = parse_list(value, config.thread_counts, 8);
+        else if (strcmp(argv[i], "--tiles") == 0)   config.num_tile_sizes = parse_list(value, config.tile_sizes, 8);
+        else { usage(); return EXIT_FAILURE; }
+        i++;
+    }
+
+    if (config.repetitions <= 0 || config.num_thread_counts == 0 || config.num_tile_sizes == 0) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    if (!any) run[0] = run[1] = run[2] = run[3] = true;
+
+    printf("%-18s %-22s %12s %12s %12s %12s %10s %12s %15s\n",
+        "benchmark", "params", "min ns/op", "median", "mean", "p99", "stddev", "cycles/op", "throughput");
+
+    if (run[0]) bench_filters();
+    if (run[1]) bench_queue();
+    if (run[2]) bench_dict();
+    if (run[3]) bench_object();
+
+    return EXIT_SUCCESS;
+}
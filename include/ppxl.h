@@ -0,0 +1,148 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+libppxl: the ppxl pipeline as a library. An engine owns its threads, queues and counters, so a process may run
+several. Images come from a watched input directory (as with the `ppxl` command), from encoded files held in
+memory (`ppxl_submit_buffer`) or from raw frames (`ppxl_submit_pixels`); results of the latter two come back
+through a callback instead of the filesystem.
+
+    ppxl_config_t config = { .effects = "greyscale" };
+    ppxl_engine_t* engine = ppxl_engine_create(&config);
+    ppxl_submit_buffer(engine, jpeg, jpeg_size, NULL, on_complete, request);
+    ...
+    ppxl_engine_destroy(engine);
+
+Effect specs are those of `ppxl -e` (see `effect_graph.h`); a submission may bring its own, which is parsed once
+per engine and reused. A spec with several outputs completes once per output.
+
+Some state is still shared by every engine of a process: the stage and latency statistics (`stats.h`, which
+`--metrics-listen` serves), the trace buffers (`trace.h`) and the priority rules of watched files (`priority.h`).
+Several engines in one process therefore report into the same histograms and classify files by the same rules.
+*/
+
+typedef struct ppxl_engine ppxl_engine_t;
+
+typedef enum {
+    PPXL_FORMAT_U8,  // 0..255
+    PPXL_FORMAT_U16, // 0..65535
+    PPXL_FORMAT_F32, // linear, 1.0 being nominal white
+} ppxl_format_t;
+
+typedef enum {
+    PPXL_OK,
+    PPXL_ERROR_DECODE,   // the buffer is not an image stb_image reads
+    PPXL_ERROR_MEMORY,   // out of memory while cutting the image into tiles
+    PPXL_ERROR_EFFECT,   // an effect failed
+    PPXL_ERROR_ENCODE,   // the result could not be encoded
+    PPXL_ERROR_SHUTDOWN, // the engine was destroyed first
+} ppxl_status_t;
+
+typedef struct {
+    const char* effects;         // default effect spec: watched files and submissions without their own; may be NULL
+    size_t threads;              // chunker and filter threads each; 0: one per core
+    const char* tile_layout;     // "auto" (NULL), "interleaved" or "planar"
+    const char* schedule;        // "oldest-image" (NULL) or "fifo"
+    const char* priority_policy; // "strict" (NULL) or "weighted[:high,normal,low]"
+
+    const char* input_directory;  // watched for images, like `ppxl <input_directory>`; NULL for none
+    const char* output_directory; // where results of watched files are written; required with `input_directory`
+    bool once;                    // take what the input directory holds, without watching it afterwards
+    size_t scan_threads;          // 0: pick from the number of cores
+    unsigned settle_ms;           // quiet time before a scanned file is taken; 0 takes it right away
+} ppxl_config_t;
+
+// One output of one submission. Everything it points to belongs to the engine and is only valid during the callback.
+typedef struct {
+    ppxl_status_t status;
+    const char* output;          // name of the effect graph branch ("processed" unless the spec names its outputs)
+    const void* bytes;           // buffers: the encoded image; frames: packed samples, `width * channels` per row
+    size_t size;
+    int width, height, channels;
+    ppxl_format_t format;        // of the samples (frames), or of the decoded result (buffers)
+} ppxl_result_t;
+
+/*
+* @brief Called once per output of a submission, from one of the engine's threads (or from the thread
+* destroying the engine, for PPXL_ERROR_SHUTDOWN). It must not destroy the engine.
+*/
+typedef void (*ppxl_complete_fn)(const ppxl_result_t* result, void* user);
+
+// A snapshot of an engine's counters; see `ppxl_engine_stats`.
+typedef struct {
+    size_t images_read;      // found in the input directory, or submitted
+    size_t outputs_written;  // outputs written to disk or handed to a callback
+    size_t images_discarded; // images with at least one failed output
+    size_t pixels_written;   // of the outputs written
+    size_t images_pending;   // taken in, and not every output completed yet
+    size_t queued_names, queued_tiles, queued_filtered; // images and tiles waiting for each stage
+    size_t outputs;          // per image, of the engine's effect spec (0 without one)
+    size_t threads;          // chunker threads, and as many filter threads
+    size_t encoder_threads;  // reassembly and encoding (where results are delivered)
+} ppxl_stats_t;
+
+typedef struct {
+    int width, height, channels; // 1 to 4 channels; 2 and 4 have alpha last
+    ppxl_format_t format;
+    size_t stride;               // bytes from a row to the next; 0 for packed rows
+    const void* pixels;
+} ppxl_frame_t;
+
+/*
+* @brief Start an engine. Strings in `config` are copied.
+* @return The engine, or NULL after printing what is wrong with the configuration to stderr.
+*/
+ppxl_engine_t* ppxl_engine_create(const ppxl_config_t* config);
+
+/*
+* @brief Process an encoded image (PNG, JPEG, HDR, ... anything stb_image reads). `bytes` is copied. The result
+* is encoded like the input: JPEG stays JPEG, Radiance HDR stays HDR, anything else becomes PNG (16 bits per
+* sample if the image was deeper than 8).
+* @param effects Effect spec, or NULL for the engine's.
+* @return 0 once queued; -1 if `effects` does not parse (or neither it nor the engine's is given), or out of memory.
+*/
+int ppxl_submit_buffer(ppxl_engine_t* engine, const void* bytes, size_t len, const char* effects,
+                       ppxl_complete_fn complete, void* user);
+
+/*
+* @brief Process a raw frame. Its pixels are copied; results come back as packed samples of the same kind.
+* @return 0 once queued, -1 as for `ppxl_submit_buffer` or if the frame is malformed.
+*/
+int ppxl_submit_pixels(ppxl_engine_t* engine, const ppxl_frame_t* frame, const char* effects,
+                       ppxl_complete_fn complete, void* user);
+
+/*
+* @brief Wait until every image taken in so far (submitted, or found in the input directory, after the initial
+* scan of it) has completed all of its outputs, or until the engine is interrupted or stopped.
+*/
+void ppxl_engine_drain(ppxl_engine_t* engine);
+
+void ppxl_engine_stats(ppxl_engine_t* engine, ppxl_stats_t* stats);
+
+/*
+* @brief Ask the engine to stop, without waiting: its threads wind down and `ppxl_engine_drain` returns. Safe
+* to call from a signal handler.
+*/
+void ppxl_engine_interrupt(ppxl_engine_t* engine);
+
+/*
+* @brief Stop the engine and wait for its threads; images in flight are dropped. Its counters stay readable
+* until it is destroyed; submissions fail from now on.
+*/
+void ppxl_engine_stop(ppxl_engine_t* engine);
+
+/*
+* @brief Stop the engine and free it. Images still in flight are dropped; their submissions complete with
+* PPXL_ERROR_SHUTDOWN.
+*/
+void ppxl_engine_destroy(ppxl_engine_t* engine);
+
+#ifdef __cplusplus
+}
+#endif
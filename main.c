@@ -7,46 +7,124 @@
 #include<stdbool.h>
 #include<sys/stat.h>
 
-#include<image.h>
-#include<image_queue.h>
-#include<file_tracker.h>
-#include<image_chunker.h>
-#include<directory_monitor.h>
-#include<chunk_threader.h>
+#include<ppxl.h>
+#include<effect_graph.h>
 #include<stdatomic.h>
 
-#include "reconstruction.h"
 #include "macros.h"
-
-image_name_queue_t name_queue;
-chunk_queue_t chunker_filtering_queue, filtering_reconstruction_queue;
+#include "stats.h"
+#include "metrics_server.h"
+#include "trace.h"
+#include "priority.h"
 
 const char* input_directory = "../images";
 const char* out_directory = "../filtered_images";
 const char* effects = NULL;
+bool run_once = false;
+const char* summary_json_path = NULL;
+const char* metrics_listen = NULL;
+const char* trace_path = NULL;
+size_t trace_buffer_events = TRACE_DEFAULT_EVENTS_PER_THREAD;
+const char* chunk_schedule = NULL;  // checked by the engine
+const char* tile_layout = NULL;
+const char* priority_policy = NULL;
+size_t scan_threads = 0; // 0: pick from the number of cores
+unsigned settle_ms = 500;
+
+// The engine of this run, for the signal handler.
+static ppxl_engine_t* engine = NULL;
+static volatile sig_atomic_t stopping = 0;
+
+// Number of threads that work on each stage, used to turn busy time into utilization.
+typedef struct {
+    size_t stage_threads[STAGE_COUNT];
+} stats_display_t;
+
+#define STATS_DISPLAY_LINES (4 + 1 + STAGE_COUNT + 1 + QUEUE_COUNT + 1)
+
+static void print_stats(stats_snapshot_t* snapshot, const stats_display_t* display,
+                        const uint64_t* busy_delta, uint64_t interval_ns) {
+    ppxl_stats_t counts;
+    ppxl_engine_stats(engine, &counts);
+    printf("\rTotal Images Read:      %zu\033[K\n", counts.images_read);
+    printf("Total Images Written:   %zu\033[K\n", counts.outputs_written);
+    printf("Total Images Discarded: %zu\033[K\n", counts.images_discarded);
+    printf("Queue Depth:            names %zu | chunks %zu | filtered %zu\033[K\n",
+        counts.queued_names, counts.queued_tiles, counts.queued_filtered);
+
+    printf("%-14s %10s %10s %8s\033[K\n", "Stage", "p50 ms", "p99 ms", "util");
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        double capacity = (double)interval_ns * display->stage_threads[stage];
+        printf("  %-12s %10.3f %10.3f %7.1f%%\033[K\n", stats_stage_name(stage),
+            histogram_percentile(&snapshot->stage[stage], 50) / 1e6,
+            histogram_percentile(&snapshot->stage[stage], 99) / 1e6,
+            (capacity > 0)? 100.0 * busy_delta[stage] / capacity: 0.0);
+    }
 
-atomic_size_t total_images_read = 0;
-atomic_size_t total_images_written = 0;
-atomic_size_t total_images_discarded = 0;
+    printf("%-14s %10s %10s\033[K\n", "Queue Wait", "p50 ms", "p99 ms");
+    for (int queue = 0; queue < QUEUE_COUNT; queue++)
+        printf("  %-12s %10.3f %10.3f\033[K\n", stats_queue_name(queue),
+            histogram_percentile(&snapshot->queue_wait[queue], 50) / 1e6,
+            histogram_percentile(&snapshot->queue_wait[queue], 99) / 1e6);
+
+    printf("%-14s %10.3f %10.3f\033[K\n", "Image Latency",
+        histogram_percentile(&snapshot->image_latency, 50) / 1e6,
+        histogram_percentile(&snapshot->image_latency, 99) / 1e6);
+}
 
 void* update_stats(void* param) {    
-    printf("Total Images Read:      %zu\033[K\n", total_images_read);
-    printf("Total Images Written:   %zu\033[K\n", total_images_written);
-    printf("Total Images Discarded: %zu\033[K\n", total_images_discarded);
-    fflush(stdout); 
-
-    while (!stop_flag) {
-
-        printf("\033[3A");
-        printf("\rTotal Images Read:      %zu\033[K\n", total_images_read);
-        printf("Total Images Written:   %zu\033[K\n", total_images_written);
-        printf("Total Images Discarded: %zu\033[K\n", total_images_discarded);
-        printf("Enter 'e' to Exit: ");
+    const stats_display_t* display = (const stats_display_t*)param;
+    stats_snapshot_t* snapshot = malloc(sizeof(stats_snapshot_t));
+    if (snapshot == NULL) {
+        perror("update_stats - Failed to allocate stats snapshot");
+        return NULL;
+    }
+
+    uint64_t busy_before[STAGE_COUNT] = {0}, busy_delta[STAGE_COUNT] = {0};
+    uint64_t time_before = now_ns();
+    bool first = true;
+
+    // Cursor movement only makes sense on a terminal; log files get a plain line every few seconds.
+    bool tty = isatty(STDOUT_FILENO);
+    uint64_t last_plain = 0;
+
+    while (!stopping) {
+        if (!tty) {
+            uint64_t time_now = now_ns();
+            if (time_now - last_plain >= 5000000000ull) {
+                ppxl_stats_t counts;
+                ppxl_engine_stats(engine, &counts);
+                printf("read %zu written %zu discarded %zu | queues names %zu chunks %zu filtered %zu\n",
+                    counts.images_read, counts.outputs_written, counts.images_discarded,
+                    counts.queued_names, counts.queued_tiles, counts.queued_filtered);
+                fflush(stdout);
+                last_plain = time_now;
+            }
+            usleep(100000);
+            continue;
+        }
+
+        stats_snapshot(snapshot);
+
+        // Utilization is measured over the last refresh interval, percentiles over the whole run.
+        uint64_t time_now = now_ns();
+        for (int stage = 0; stage < STAGE_COUNT; stage++) {
+            uint64_t busy = histogram_sum(&snapshot->stage[stage]);
+            busy_delta[stage] = busy - busy_before[stage];
+            busy_before[stage] = busy;
+        }
+
+        if (!first) printf("\033[%dA", STATS_DISPLAY_LINES);
+        print_stats(snapshot, display, busy_delta, time_now - time_before);
+        if (!run_once) printf("Enter 'e' to Exit: ");
         fflush(stdout); 
 
+        time_before = time_now;
+        first = false;
         usleep(100000);
     }
 
+    free(snapshot);
     return NULL;
 }
 
@@ -71,6 +149,70 @@ void* input_listener(void* param) {
     return NULL;
 }
 
+/*
+* @brief Input images fully processed; the engine counts output files.
+*/
+static size_t images_processed(const ppxl_stats_t* counts) {
+    return counts->outputs_written / counts->outputs;
+}
+
+static void print_summary(stats_snapshot_t* snapshot, uint64_t wall_ns) {
+    double wall_s = wall_ns / 1e9;
+    ppxl_stats_t counts;
+    ppxl_engine_stats(engine, &counts);
+    size_t written = images_processed(&counts);
+    double megapixels = counts.pixels_written / 1e6;
+
+    printf("\nProcessed %zu images into %zu outputs each (%zu discarded) in %.3f s\n",
+        written, counts.outputs, counts.images_discarded, wall_s);
+    printf("Throughput: %.2f images/s, %.2f MP/s\n", (wall_s > 0)? written / wall_s: 0.0, (wall_s > 0)? megapixels / wall_s: 0.0);
+    printf("Image latency: p50 %.2f ms, p99 %.2f ms\n",
+        histogram_percentile(&snapshot->image_latency, 50) / 1e6, histogram_percentile(&snapshot->image_latency, 99) / 1e6);
+    printf("Stage busy time (summed over threads):\n");
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+        printf("  %-12s %10.3f s\n", stats_stage_name(stage), histogram_sum(&snapshot->stage[stage]) / 1e9);
+    fflush(stdout);
+}
+
+/*
+* @brief Write the batch summary as a single JSON object to `path`, for tools such as ppxl-bench.
+*/
+static int write_summary_json(const char* path, stats_snapshot_t* snapshot, uint64_t wall_ns) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        perror("write_summary_json - Cannot open summary file");
+        return -1;
+    }
+
+    double wall_s = wall_ns / 1e9;
+    ppxl_stats_t counts;
+    ppxl_engine_stats(engine, &counts);
+    size_t written = images_processed(&counts);
+    double megapixels = counts.pixels_written / 1e6;
+    histogram_t* latency = &snapshot->image_latency;
+
+    fprintf(file, "{\"images\": %zu, \"outputs\": %zu, \"discarded\": %zu, \"wall_s\": %.6f, ",
+        written, counts.outputs, counts.images_discarded, wall_s);
+    fprintf(file, "\"images_per_s\": %.3f, \"megapixels_per_s\": %.3f, ",
+        (wall_s > 0)? written / wall_s: 0.0, (wall_s > 0)? megapixels / wall_s: 0.0);
+    fprintf(file, "\"latency_ms\": {\"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f, \"mean\": %.3f}, ",
+        histogram_percentile(latency, 50) / 1e6, histogram_percentile(latency, 99) / 1e6,
+        histogram_percentile(latency, 100) / 1e6, histogram_mean(latency) / 1e6);
+    fprintf(file, "\"stage_busy_s\": {");
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+        fprintf(file, "%s\"%s\": %.6f", stage? ", ": "", stats_stage_name(stage), histogram_sum(&snapshot->stage[stage]) / 1e9);
+    fprintf(file, "}, \"stage_p99_ms\": {");
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+        fprintf(file, "%s\"%s\": %.3f", stage? ", ": "", stats_stage_name(stage), histogram_percentile(&snapshot->stage[stage], 99) / 1e6);
+    fprintf(file, "}, \"queue_wait_p99_ms\": {");
+    for (int queue = 0; queue < QUEUE_COUNT; queue++)
+        fprintf(file, "%s\"%s\": %.3f", queue? ", ": "", stats_queue_name(queue), histogram_percentile(&snapshot->queue_wait[queue], 99) / 1e6);
+    fprintf(file, "}}\n");
+
+    fclose(file);
+    return 0;
+}
+
 bool is_directory(const char* path) {
     struct stat path_stat;
     if (stat(path, &path_stat) != 0) {
@@ -80,9 +222,16 @@ bool is_directory(const char* path) {
     return S_ISDIR(path_stat.st_mode);
 }
 
+static void print_usage(void) {
+    fprintf(stderr,
+        "Usage: ppxl <input_directory> -e <[name=]effect[:param...][,effect...][;...]> -o <output_directory> [--once] [--summary-json <file>]\n"
+        "       [--metrics-listen <host:port|unix:path>] [--trace <file> [--trace-buffer <events>]] [--schedule oldest-image|fifo]\n"
+        "       [--tile-layout auto|interleaved|planar] [--scan-threads <n>] [--settle-ms <ms>] [--priority <class>:dir:<subdir>|<class>:prefix:<prefix>]... [--priority-xattr <name>] [--priority-deadline <class>:<ms>]... [--priority-policy strict|weighted[:h,n,l]]\n");
+}
+
 void arg_parse(int argc, char* argv[]) {
     if (argc < 2) {
-        fprintf(stderr, "Usage: ppxl <input_directory> -e <effects> -o <output_directory>\n");
+        print_usage();
         exit(EXIT_FAILURE);
     }
 
@@ -95,9 +244,57 @@ void arg_parse(int argc, char* argv[]) {
         } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
             out_directory = argv[i + 1];
             i++;
+        } else if (strcmp(argv[i], "--once") == 0) {
+            run_once = true;
+        } else if (strcmp(argv[i], "--summary-json") == 0 && i + 1 < argc) {
+            summary_json_path = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "--metrics-listen") == 0 && i + 1 < argc) {
+            metrics_listen = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "--trace-buffer") == 0 && i + 1 < argc) {
+            trace_buffer_events = strtoul(argv[i + 1], NULL, 10);
+            i++;
+        } else if (strcmp(argv[i], "--schedule") == 0 && i + 1 < argc) {
+            chunk_schedule = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "--tile-layout") == 0 && i + 1 < argc) {
+            tile_layout = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "--scan-threads") == 0 && i + 1 < argc) {
+            scan_threads = strtoul(argv[i + 1], NULL, 10);
+            if (scan_threads == 0) {
+                fprintf(stderr, "Error: --scan-threads must be a positive number.\n");
+                exit(EXIT_FAILURE);
+            }
+            i++;
+        } else if (strcmp(argv[i], "--settle-ms") == 0 && i + 1 < argc) {
+            settle_ms = (unsigned)strtoul(argv[i + 1], NULL, 10);
+            i++;
+        } else if (strcmp(argv[i], "--priority") == 0 && i + 1 < argc) {
+            if (priority_add_rule(argv[i + 1]) != 0) {
+                fprintf(stderr, "Error: Invalid priority rule '%s' (expected high|normal|low:dir:<subdir> or high|normal|low:prefix:<prefix>).\n", argv[i + 1]);
+                exit(EXIT_FAILURE);
+            }
+            i++;
+        } else if (strcmp(argv[i], "--priority-xattr") == 0 && i + 1 < argc) {
+            priority_set_xattr(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--priority-deadline") == 0 && i + 1 < argc) {
+            if (priority_set_deadline(argv[i + 1]) != 0) {
+                fprintf(stderr, "Error: Invalid priority deadline '%s' (expected high|normal|low:<ms>).\n", argv[i + 1]);
+                exit(EXIT_FAILURE);
+            }
+            i++;
+        } else if (strcmp(argv[i], "--priority-policy") == 0 && i + 1 < argc) {
+            priority_policy = argv[i + 1];
+            i++;
         } else {
             fprintf(stderr, "Unknown argument: %s\n", argv[i]);
-            fprintf(stderr, "Usage: ppxl <input_directory> -e <effects> -o <output_directory>\n");
+            print_usage();
             exit(EXIT_FAILURE);
         }
     }
@@ -114,52 +311,31 @@ void arg_parse(int argc, char* argv[]) {
 
     if (effects == NULL) {
         fprintf(stderr, "Error: Effects not specified. Use -e <effects> to specify effects.\n");
+        effect_print_available(stderr);
         exit(EXIT_FAILURE);
     }
-}
-
-volatile sig_atomic_t stop_flag = 0;
-
-int Initialization(void) {
-    if (image_name_queue_init(&name_queue) != 0) {
-        FPRINTF(stderr, "Failed to initialize name queue.\n");
-        return EXIT_FAILURE;
-    }
-
-    if (chunk_queue_init(&chunker_filtering_queue) != 0) {
-        FPRINTF(stderr, "Failed to initialize filtering->reconstruction queue.\n");
-        image_name_queue_destroy(&name_queue); 
-        return EXIT_FAILURE;
-    }
 
-    if (chunk_queue_init(&filtering_reconstruction_queue) != 0) {
-        FPRINTF(stderr, "Failed to initialize chunker->filtering queue.\n");
-        image_name_queue_destroy(&name_queue); 
-        chunk_queue_destroy(&chunker_filtering_queue);
-        return EXIT_FAILURE;
+    if (summary_json_path != NULL && !run_once) {
+        fprintf(stderr, "Error: --summary-json is only available together with --once.\n");
+        exit(EXIT_FAILURE);
     }
 
-    if (discarded_images_init() != 0) {
-        FPRINTF(stderr, "Failed to initialize discarded images table.\n");
-        image_name_queue_destroy(&name_queue);
-        chunk_queue_destroy(&chunker_filtering_queue);
-        chunk_queue_destroy(&filtering_reconstruction_queue);
-        return EXIT_FAILURE;
+    if (trace_buffer_events == 0) {
+        fprintf(stderr, "Error: --trace-buffer must be a positive number of events.\n");
+        exit(EXIT_FAILURE);
     }
-
-    return EXIT_SUCCESS;
 }
 
 void cleanup_resources(void) {
-    free_processed_files(); 
-    image_name_queue_destroy(&name_queue);
-    chunk_queue_destroy(&chunker_filtering_queue);
-    chunk_queue_destroy(&filtering_reconstruction_queue);
-    free_discarded_images_table();
+    stats_cleanup();
+    trace_cleanup();
+    priority_cleanup();
 }
 
 void ExitHandler(int signum) {
-    stop_flag = 1;
+    stopping = 1;
+    if (engine != NULL)
+        ppxl_engine_interrupt(engine);
 /*     const char msg[] = "\nSignal received, initiating shutdown...\n";
     write(STDOUT_FILENO, msg, sizeof(msg) - 1); */
 }
@@ -171,30 +347,14 @@ int main(int argc, char* argv[]) {
 
     arg_parse(argc, argv);
 
+    if (trace_path != NULL)
+        trace_init(trace_buffer_events);
+
     const char *directoryPath = input_directory;
     int exit_status = 0;
 
-    long cores = sysconf(_SC_NPROCESSORS_ONLN);
-    const size_t num_chunker_threads = (cores > 1)? (size_t)cores: 2; 
-
-    pthread_t watcher_thread, stats_updater, input_thread;
-    pthread_t *chunker_threads = NULL;
-
-    struct sigaction sa;
-    memset(&sa, 0, sizeof(sa));
-    sa.sa_handler = ExitHandler; 
-    sigfillset(&sa.sa_mask);       
-    sa.sa_flags = 0;                
-
-    if (sigaction(SIGINT, &sa, NULL) == -1) {
-        perror("Failed to register SIGINT handler");
-        return EXIT_FAILURE;
-    }
-
-    if (sigaction(SIGTERM, &sa, NULL) == -1) {
-        perror("Failed to register SIGTERM handler");
-        return EXIT_FAILURE;
-    }
+    pthread_t stats_updater, input_thread, metrics_thread;
+    bool stats_started = false, metrics_started = false, input_started = false;
 
     DIR *dir_check = opendir(directoryPath);
     if (dir_check == NULL) {
@@ -207,136 +367,140 @@ int main(int argc, char* argv[]) {
 
     closedir(dir_check);
 
-    if (Initialization() != EXIT_SUCCESS)
+    // Listen before any work starts: a metrics endpoint that cannot be served is a startup error.
+    int metrics_listener = -1;
+    if (metrics_listen != NULL) {
+        metrics_listener = metrics_server_listen(metrics_listen);
+        if (metrics_listener < 0)
+            return EXIT_FAILURE;
+    }
+
+    ppxl_config_t config = {
+        .effects = effects,
+        .tile_layout = tile_layout,
+        .schedule = chunk_schedule,
+        .priority_policy = priority_policy,
+        .input_directory = input_directory,
+        .output_directory = out_directory,
+        .once = run_once,
+        .scan_threads = scan_threads,
+        .settle_ms = settle_ms,
+    };
+
+    uint64_t start_time = now_ns(), wall_time = 0;
+
+    engine = ppxl_engine_create(&config);
+    if (engine == NULL) {
+        if (metrics_listener >= 0)
+            metrics_server_close(metrics_listener, metrics_listen);
+        cleanup_resources();
         return EXIT_FAILURE;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = ExitHandler; 
+    sigfillset(&sa.sa_mask);       
+    sa.sa_flags = 0;                
 
-    chunker_threads = malloc(num_chunker_threads * sizeof(pthread_t));
-    if (chunker_threads == NULL) {
-        perror("Failed to allocate memory for chunker thread IDs");
+    if (sigaction(SIGINT, &sa, NULL) == -1 || sigaction(SIGTERM, &sa, NULL) == -1) {
+        perror("Failed to register the SIGINT/SIGTERM handlers");
         exit_status = EXIT_FAILURE;
         goto Cleanup;
     }
 
-    PRINTF("Starting input listener thread...\n");
-    if (pthread_create(&input_thread, NULL, input_listener, NULL) != 0) { // <<< Create input thread
-        perror("Failed to create input listener thread");
-        exit_status = EXIT_FAILURE;
-        goto Cleanup;
+    // Batch runs are not interactive; they stop on their own once the input is drained.
+    if (!run_once) {
+        PRINTF("Starting input listener thread...\n");
+        if (pthread_create(&input_thread, NULL, input_listener, NULL) != 0) { // <<< Create input thread
+            perror("Failed to create input listener thread");
+            exit_status = EXIT_FAILURE;
+            goto Cleanup;
+        }
+        input_started = true;
     }
 
     PRINTF("Starting stats updated thread\n");
-    if (pthread_create(&stats_updater, NULL, update_stats, (void *)NULL) != 0) { // Removed watcher_attr
+    ppxl_stats_t counts;
+    ppxl_engine_stats(engine, &counts);
+    stats_display_t stats_display = { .stage_threads = {
+        [STAGE_DECODE] = counts.threads,
+        [STAGE_CHUNK] = counts.threads,
+        [STAGE_FILTER] = counts.threads, // one filter thread per chunker thread
+        [STAGE_RECONSTRUCT] = counts.encoder_threads,
+        [STAGE_ENCODE] = counts.encoder_threads,
+    } };
+    if (pthread_create(&stats_updater, NULL, update_stats, (void *)&stats_display) != 0) { // Removed watcher_attr
         perror("Failed to create stats_updater thread");
         exit_status = EXIT_FAILURE;
         goto Cleanup;
     }
-    
-    PRINTF("Starting image watcher thread for directory: %s\n", directoryPath);
-    if (pthread_create(&watcher_thread, NULL, read_images_from_directory, (void *)directoryPath) != 0) { // Removed watcher_attr
-        perror("Failed to create watcher thread");
-        exit_status = EXIT_FAILURE;
-        goto Cleanup;
-    }
-
-    PRINTF("Starting %zu chunker threads...\n", num_chunker_threads);
-    for (size_t i = 0; i < num_chunker_threads; i++) {
-        if (pthread_create(&chunker_threads[i], NULL, chunk_image_thread, NULL) != 0) {
-            perror("Failed to create a chunker thread");
-
-            stop_flag = 1; 
-
-            broadcast_image_name_queue(&name_queue);
-            broadcast_chunk_queue(&chunker_filtering_queue);
-            broadcast_chunk_queue(&filtering_reconstruction_queue);
-
-            for (size_t j = 0; j < i; j++) 
-                pthread_join(chunker_threads[j], NULL);
-            
-            pthread_join(watcher_thread, NULL);
-            exit_status = EXIT_FAILURE;
-            goto Cleanup;
-        }
-    }
-    
-    // Aliyan TODO: instead of a function call, create threads here (Use thread pool).
-    // Join them later
-    unsigned int num_filter_threads = num_chunker_threads;
-    pthread_t *filter_threads = (pthread_t *) malloc(num_filter_threads * sizeof(pthread_t));
-    PRINTF("Starting %zu image processing threads...\n", num_filter_threads);
-    for (size_t i = 0; i < num_filter_threads; i++) {
-        if (pthread_create(&filter_threads[i], NULL, process_chunk, NULL) != 0) {
-            perror("Failed to create a filter thread");
-
-            stop_flag = 1; 
-
-            broadcast_image_name_queue(&name_queue);
-            broadcast_chunk_queue(&chunker_filtering_queue);
-            broadcast_chunk_queue(&filtering_reconstruction_queue);
-
-            for (size_t j = 0; j < i; j++) 
-                pthread_join(filter_threads[j], NULL);
-            for (size_t j = 0; j < num_chunker_threads; j++) 
-                pthread_join(chunker_threads[j], NULL);
-            
-            pthread_join(watcher_thread, NULL);
+    stats_started = true;
+
+    metrics_server_config_t metrics_config = { .engine = engine, .listen = metrics_listen, .listener = metrics_listener, .pool_workers = counts.encoder_threads };
+    memcpy(metrics_config.stage_threads, stats_display.stage_threads, sizeof(metrics_config.stage_threads));
+    if (metrics_listen != NULL) {
+        PRINTF("Starting metrics server on %s\n", metrics_listen);
+        if (pthread_create(&metrics_thread, NULL, metrics_server_thread, (void *)&metrics_config) != 0) {
+            perror("Failed to create metrics server thread");
             exit_status = EXIT_FAILURE;
             goto Cleanup;
         }
+        metrics_started = true;
     }
 
-    // #################################################################
-    // calls the reconstruction thread which recieves the chunks from the filtering 
-    // stage and reconstructs the image.
-    // The reconstruction thread is not a part of the chunker threads.
-    //
-    pthread_t* recon_thread = init_reconstruction(&filtering_reconstruction_queue);
-    // 
-    // #################################################################
-
     PRINTF("Watcher thread started. Waiting for signal (SIGINT/SIGTERM)...\n");
-    while (!stop_flag) 
-        sleep(1);
+    if (run_once) {
+        ppxl_engine_drain(engine);
+        PRINTF("\nInput directory drained.\n");
+    } else {
+        while (!stopping)
+            usleep(1000000);
+    }
+    wall_time = now_ns() - start_time;
 
     PRINTF("\nShutdown signal received.\n");
-    PRINTF("Attempting to cancel watcher & chunker thread (if possible)...\n");
-    pthread_join(watcher_thread, NULL); 
-
-    PRINTF("Broadcasting to chunker threads...\n");
-    broadcast_image_name_queue(&name_queue);
-    broadcast_chunk_queue(&chunker_filtering_queue);
-    broadcast_chunk_queue(&filtering_reconstruction_queue);
-
-    PRINTF("Waiting for chunker threads to finish...\n");
-    for (size_t i = 0; i < num_chunker_threads; i++) {
-        pthread_join(chunker_threads[i], NULL);
-        PRINTF("Chunker thread %zu finished.\n", i);
-    }
 
-    // join filtering threads here. 
-    PRINTF("Waiting for filtering threads to finish...\n");
-    for (size_t i = 0; i < num_filter_threads; i++) {
-        pthread_join(filter_threads[i], NULL);
-        PRINTF("Filtering thread %zu finished.\n", i);
-    }   
+    Cleanup:
+        stopping = 1;
+        ppxl_engine_stop(engine);
+
+        if (stats_started)
+            pthread_join(stats_updater, NULL);
+
+        if (metrics_started)
+            pthread_join(metrics_thread, NULL);
+        else if (metrics_listener >= 0)
+            metrics_server_close(metrics_listener, metrics_listen);
 
-    // join reconstructio threads here.
-    pthread_join(*recon_thread, NULL);
-    free(recon_thread);
+        if (input_started)
+            pthread_join(input_thread, NULL);
 
-    pthread_join(stats_updater, NULL);
+    if (exit_status == 0) {
+        // Every thread that records events has been joined, so the buffers can be read safely.
+        if (trace_path != NULL && trace_write(trace_path) != 0)
+            exit_status = EXIT_FAILURE;
 
-    pthread_join(input_thread, NULL);
+        if (run_once) {
+            stats_snapshot_t* snapshot = malloc(sizeof(stats_snapshot_t));
+            if (snapshot != NULL) {
+                stats_snapshot(snapshot);
+                print_summary(snapshot, wall_time);
 
-    PRINTF("All chunker threads finished.\n");
+                if (summary_json_path != NULL && write_summary_json(summary_json_path, snapshot, wall_time) != 0)
+                    exit_status = EXIT_FAILURE;
+                free(snapshot);
+            }
+        }
+    }
 
     PRINTF("Cleaning up resources...\n");
 
-    Cleanup:
-        cleanup_resources();
-        free(chunker_threads);
-        chunker_threads = NULL;
+    ppxl_engine_destroy(engine);
+    engine = NULL;
+    cleanup_resources();
 
     PRINTF("Cleanup complete. Exiting.\n");
 
-    return exit_status; 
-}
\ No newline at end of file
+    return exit_status;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include<stdbool.h>
+#include<stddef.h>
+#include<pthread.h>
+#include<image_queue.h>
+
+/*
+Images whose decode failed, or that look truncated, are not discarded right away: the file may still
+be being written. They are put back on the name queue after an exponential backoff
+(DECODE_RETRY_BASE_MS, doubled per attempt) and only discarded once DECODE_RETRY_MAX_ATTEMPTS retries
+have failed. The watcher thread calls `decode_retry_service` to re-enqueue the retries that are due.
+*/
+
+#define DECODE_RETRY_MAX_ATTEMPTS 4
+#define DECODE_RETRY_BASE_MS 250
+
+struct decode_retry;
+
+// An engine's pending retries, by path.
+typedef struct {
+    struct decode_retry* table;
+    size_t waiting; // entries with a pending `due_ns`
+    pthread_mutex_t lock;
+} decode_retries_t;
+
+int decode_retry_init(decode_retries_t* retries);
+
+/*
+* @brief Schedule another decode attempt for `path`.
+* @return 0 if a retry was scheduled, -1 if the retries are used up (the caller discards the image).
+*/
+int decode_retry_schedule(decode_retries_t* retries, const char* path, priority_t priority);
+
+/*
+* @brief Whether the current attempt for `path` is the last one, after which it is discarded.
+*/
+bool decode_retry_is_last_attempt(decode_retries_t* retries, const char* path);
+
+/*
+* @brief Forget `path` after it was decoded successfully.
+*/
+void decode_retry_forget(decode_retries_t* retries, const char* path);
+
+/*
+* @brief Enqueue every retry whose backoff has elapsed.
+* @return The number of retries still waiting.
+*/
+size_t decode_retry_service(decode_retries_t* retries, image_name_queue_t* q);
+
+void decode_retry_cleanup(decode_retries_t* retries);
@@ -1,3 +1,8 @@
 #pragma once
 
-void *read_images_from_directory(void *arg);
\ No newline at end of file
+/*
+* @brief Thread entry point: enqueue every image below the engine's input directory, then keep watching it
+* (unless the engine runs once). Sets `initial_scan_complete` once the first pass has enqueued what it found.
+* @param arg The `ppxl_engine_t*`.
+*/
+void *read_images_from_directory(void *arg);
@@ -0,0 +1,40 @@
+#pragma once
+
+#include<stddef.h>
+#include<stdbool.h>
+#include<signal.h>
+
+/*
+Walks a directory tree with several threads. Each thread lists one directory at a time with
+`getdents64` into a large buffer, and hands every subdirectory it finds back to the shared work list,
+so wide trees (thousands of shard directories) are listed in parallel.
+
+A symbolic link to a regular file is reported as a file; links to directories are not followed.
+*/
+
+typedef struct {
+    /*
+    * @brief Called for every directory, including the starting one, before its entries are listed.
+    * @param relative_path Path relative to the root ("" for the root itself).
+    * @return false to skip the directory and everything below it.
+    */
+    bool (*on_directory)(const char* relative_path, void* context);
+
+    /*
+    * @brief Called for every regular file (or link to one). May be called from several threads at once.
+    */
+    void (*on_file)(const char* relative_path, void* context);
+
+    void* context;
+} scan_callbacks_t;
+
+/*
+* @brief Scan `root/start` and everything below it.
+* @param start Subdirectory relative to `root` to start from, or "" for the whole tree.
+* @param num_threads Number of scanning threads (the caller's thread is not used).
+* @return 0 once every directory is listed; 1 if some could not be (each is reported on stderr); -1 if the scan
+* could not run: the starting directory cannot be opened, or no thread could allocate its buffer.
+* @note Returns early, without visiting the rest of the tree, once `*stop` is set.
+*/
+int scan_tree(const char* root, const char* start, size_t num_threads, const scan_callbacks_t* callbacks,
+              volatile sig_atomic_t* stop);
@@ -2,21 +2,33 @@
 
 #include<uthash.h>
 #include<stdbool.h>
+#include<pthread.h>
 
 typedef void (*char_process_function_ptr)(const char*);
 typedef void (*void_process_function_ptr)(void);
 
 // Structure for the hash table entries
 typedef struct {
-    char name[256];
+    char* name; // path relative to the input directory
     UT_hash_handle hh; 
 /*     char_process_function_ptr add_processed_file;
     char_process_function_ptr was_file_processed;
     void_process_function_ptr free_processed_files; */
 } processed_file_t;
 
-void add_processed_file(const char *filename);
-bool was_file_processed(const char *filename);
-void free_processed_files(void);
+// The files an engine's watcher has seen.
+typedef struct {
+    processed_file_t* files;
+    pthread_mutex_t lock;
+} file_tracker_t;
+
+int file_tracker_init(file_tracker_t* tracker);
 
-extern processed_file_t *processed_files; 
\ No newline at end of file
+/*
+* @brief Remember `filename` as seen.
+* @return true if it was not seen before, i.e. the caller is the one who should process it.
+* @note Thread-safe; the parallel directory scan calls it from several threads.
+*/
+bool add_processed_file(file_tracker_t* tracker, const char *filename);
+bool was_file_processed(file_tracker_t* tracker, const char *filename);
+void free_processed_files(file_tracker_t* tracker);
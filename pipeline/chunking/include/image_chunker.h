@@ -2,5 +2,17 @@
 
 #include<image.h> 
 
-unsigned char *load_image(const char *filename, int *width, int *height, int *channels);
-void *chunk_image_thread(void *arg);
\ No newline at end of file
+/*
+* @brief Decode `filename` at its own depth: u16 for 16-bit PNGs, f32 for Radiance HDR files, u8 otherwise.
+* @return The packed samples (release them with stbi_image_free), or NULL.
+*/
+void *load_image(const char *filename, int *width, int *height, int *channels, pixel_format_t *format);
+
+// `load_image` for an encoded image held in memory.
+void *load_image_from_memory(const unsigned char *bytes, size_t size, int *width, int *height, int *channels, pixel_format_t *format);
+
+/*
+* @brief Thread entry point: decode the images taken off the engine's name queue and cut them into tiles.
+* @param arg The `ppxl_engine_t*`.
+*/
+void *chunk_image_thread(void *arg);
@@ -1,23 +1,51 @@
 #pragma once
 
 #include<pthread.h> 
+#include<stdint.h>
+#include<stddef.h>
+#include<stdatomic.h>
+#include<signal.h>
+
+#include "priority.h"
 
 struct image_name_queue_node;
+struct image_job;
 
 typedef struct image_name_queue_node {
     struct image_name_queue_node* next; 
     char* name;                         
+    uint64_t enqueued_ns;
+    uint64_t deadline_ns;               // taken next once past this; 0 for none (see `priority.h`)
+    priority_t priority;
+    struct image_job* job;              // submissions bring their job; NULL for watched files
 } image_name_queue_node_t;
 
+// One FIFO per priority class; `policy` decides which class the next dequeue serves.
 typedef struct {
-    image_name_queue_node_t* head;          
-    image_name_queue_node_t* tail;          
+    image_name_queue_node_t* head[PRIORITY_COUNT];          
+    image_name_queue_node_t* tail[PRIORITY_COUNT];          
+    priority_policy_t policy;
+    int credit[PRIORITY_COUNT]; // smooth weighted round-robin state
     pthread_mutex_t lock;               
     pthread_cond_t cond_not_empty;      
+    atomic_size_t depth;
+    volatile sig_atomic_t* stop;        // set when the pipeline stops: dequeues stop waiting
 } image_name_queue_t;
 
-int image_name_queue_init(image_name_queue_t* q);
-int enqueue_image_name(image_name_queue_t *q, const char *name);
-char* dequeue_image_name(image_name_queue_t *q);
+int image_name_queue_init(image_name_queue_t* q, const priority_policy_t* policy, volatile sig_atomic_t* stop);
+
+/*
+* @param job The job of a submission, whose reference the queue takes over; NULL for a watched file.
+*/
+int enqueue_image_name(image_name_queue_t *q, const char *name, priority_t priority, struct image_job* job);
+
+/*
+* @brief Blocks until a name is available (or `*q->stop` is set, returning NULL).
+* @param priority Receives the class of the returned image (`high` if it waited past its deadline); may be NULL.
+* @param job Receives the job the name was enqueued with, and its reference.
+*/
+char* dequeue_image_name(image_name_queue_t *q, priority_t* priority, struct image_job** job);
 void broadcast_image_name_queue(image_name_queue_t* q);
+size_t image_name_queue_depth(image_name_queue_t* q);
+// Names still queued are dropped, and their jobs released.
 void image_name_queue_destroy(image_name_queue_t* q);
\ No newline at end of file
@@ -0,0 +1,126 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<stdint.h>
+#include<pthread.h>
+#include<uthash.h>
+#include<decode_retry.h>
+
+#include "macros.h"
+#include "stats.h"
+#include "trace.h"
+
+typedef struct decode_retry {
+    char* path;
+    priority_t priority;
+    int attempts;       // retries scheduled so far
+    uint64_t due_ns;    // 0 while the image is back in the pipeline
+    UT_hash_handle hh;
+} decode_retry_t;
+
+int decode_retry_init(decode_retries_t* retries) {
+    retries->table = NULL;
+    retries->waiting = 0;
+    if (pthread_mutex_init(&retries->lock, NULL) != 0) {
+        perror("decode_retry_init - Cannot initialize mutex");
+        return -1;
+    }
+    return 0;
+}
+
+int decode_retry_schedule(decode_retries_t* retries, const char* path, priority_t priority) {
+    pthread_mutex_lock(&retries->lock);
+
+    decode_retry_t* entry;
+    HASH_FIND_STR(retries->table, path, entry);
+    if (entry == NULL) {
+        entry = calloc(1, sizeof(decode_retry_t));
+        if (entry == NULL || (entry->path = strdup(path)) == NULL) {
+            free(entry);
+            pthread_mutex_unlock(&retries->lock);
+            perror("decode_retry_schedule - Cannot allocate retry entry");
+            return -1;
+        }
+        HASH_ADD_KEYPTR(hh, retries->table, entry->path, strlen(entry->path), entry);
+    }
+
+    if (entry->attempts >= DECODE_RETRY_MAX_ATTEMPTS) {
+        HASH_DEL(retries->table, entry);
+        pthread_mutex_unlock(&retries->lock);
+        free(entry->path);
+        free(entry);
+        return -1;
+    }
+
+    uint64_t backoff_ns = (uint64_t)DECODE_RETRY_BASE_MS * 1000000ull << entry->attempts;
+    entry->attempts++;
+    entry->priority = priority;
+    entry->due_ns = now_ns() + backoff_ns;
+    retries->waiting++;
+    int attempt = entry->attempts;
+    pthread_mutex_unlock(&retries->lock);
+    (void)attempt; // only printed in debug builds
+
+    stats_add(COUNTER_DECODE_RETRIES, 1);
+    TRACE_INSTANT("decode retry", path, -1);
+    PRINTF("Decode of %s postponed, retry %d in %llu ms\n", path, attempt, (unsigned long long)(backoff_ns / 1000000));
+    return 0;
+}
+
+bool decode_retry_is_last_attempt(decode_retries_t* retries, const char* path) {
+    pthread_mutex_lock(&retries->lock);
+    decode_retry_t* entry;
+    HASH_FIND_STR(retries->table, path, entry);
+    bool last = (entry != NULL && entry->attempts >= DECODE_RETRY_MAX_ATTEMPTS);
+    pthread_mutex_unlock(&retries->lock);
+    return last;
+}
+
+void decode_retry_forget(decode_retries_t* retries, const char* path) {
+    pthread_mutex_lock(&retries->lock);
+    decode_retry_t* entry;
+    HASH_FIND_STR(retries->table, path, entry);
+    if (entry != NULL)
+        HASH_DEL(retries->table, entry);
+    pthread_mutex_unlock(&retries->lock);
+
+    if (entry != NULL) {
+        free(entry->path);
+        free(entry);
+    }
+}
+
+size_t decode_retry_service(decode_retries_t* retries, image_name_queue_t* q) {
+    uint64_t now = now_ns();
+
+    pthread_mutex_lock(&retries->lock);
+    decode_retry_t *entry, *tmp;
+    HASH_ITER(hh, retries->table, entry, tmp) {
+        if (entry->due_ns == 0 || entry->due_ns > now)
+            continue;
+
+        if (enqueue_image_name(q, entry->path, entry->priority, NULL) != 0) {
+            FPRINTF(stderr, "decode_retry_service: Cannot enqueue %s\n", entry->path);
+            continue; // try again on the next call
+        }
+        entry->due_ns = 0;
+        retries->waiting--;
+    }
+    size_t remaining = retries->waiting;
+    pthread_mutex_unlock(&retries->lock);
+
+    return remaining;
+}
+
+void decode_retry_cleanup(decode_retries_t* retries) {
+    pthread_mutex_lock(&retries->lock);
+    decode_retry_t *entry, *tmp;
+    HASH_ITER(hh, retries->table, entry, tmp) {
+        HASH_DEL(retries->table, entry);
+        free(entry->path);
+        free(entry);
+    }
+    retries->waiting = 0;
+    pthread_mutex_unlock(&retries->lock);
+    pthread_mutex_destroy(&retries->lock);
+}
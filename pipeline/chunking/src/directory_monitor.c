@@ -1,103 +1,460 @@
 #include<stdio.h> 
 #include<dirent.h>         
 #include<string.h>         
+#include<strings.h>
+#include<errno.h>
 #include<unistd.h>        
+#include<poll.h>
 #include<pthread.h>    
 #include<stdbool.h>      
 #include<signal.h>        
 #include<stdlib.h>     
+#include<time.h>
+#include<sys/stat.h>
+#include<sys/inotify.h>
+#include<uthash.h>
 #include<directory_monitor.h>
+#include<directory_scanner.h>
+#include<decode_retry.h>
 #include<file_tracker.h>
 #include<stdatomic.h>
 #include<image_queue.h>       
 
+#include "engine.h"
 #include "macros.h"
+#include "stats.h"
+#include "trace.h"
 
-extern volatile sig_atomic_t stop_flag; 
-extern atomic_size_t total_images_read;
-extern image_name_queue_t name_queue;
+// Files are taken when their writer closes them (or when they are renamed into place); IN_CREATE is only used for new directories.
+#define WATCH_MASK (IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR)
 
-void *read_images_from_directory(void *arg) {
-    const char *directoryPath = (const char *)arg;
-    struct dirent *entry;
-    DIR *dir = NULL;
+// How often the watcher re-checks settling files and due decode retries.
+#define WATCH_TICK_MS 100
+#define RESCAN_INTERVAL_NS (5 * 1000000000ull)
 
-    dir = opendir(directoryPath);
-    if (dir == NULL) {
-        perror("read_images_from_directory - Cannot open directory");
-        return NULL; 
+// Maps an inotify watch descriptor back to the directory it watches.
+typedef struct {
+    int wd;
+    char* relative_path;
+    UT_hash_handle hh;
+} watch_entry_t;
+
+/*
+A file found by a scan (rather than announced by IN_CLOSE_WRITE) may still be being written. Unless its
+mtime is already older than the settle window, it waits here until its size and mtime have not changed
+for `settle_ms`.
+*/
+typedef struct {
+    char* relative_path;
+    off_t size;
+    struct timespec mtime;
+    uint64_t stable_since_ns;
+    UT_hash_handle hh;
+} settling_file_t;
+
+// The watcher thread's own state; what the pipeline shares is in the engine.
+typedef struct {
+    ppxl_engine_t* engine;
+    const char* input_dir;
+
+    int inotify_fd;
+    watch_entry_t* watches;
+    pthread_mutex_t watches_lock; // the parallel scan adds watches from several threads
+    atomic_bool watch_failed;
+
+    // The output directory relative to the input directory when it lies inside it, so that results are not picked up as input.
+    char* output_relative_path;
+
+    settling_file_t* settling;
+    pthread_mutex_t settling_lock; // the parallel scan adds files from several threads
+} watcher_t;
+
+static const char* image_extensions[] = { ".jpg", ".jpeg", ".png", ".hdr" };
+
+// Matches the whole extension, so `photo.jpg.tmp` or `notjpg` are not picked up.
+static bool has_image_extension(const char* name) {
+    const char* dot = strrchr(name, '.');
+    if (dot == NULL)
+        return false;
+
+    for (size_t i = 0; i < sizeof(image_extensions) / sizeof(image_extensions[0]); i++)
+        if (strcasecmp(dot, image_extensions[i]) == 0) return true;
+    return false;
+}
+
+static char* join_relative(const char* parent, const char* name) {
+    size_t length = strlen(parent) + 1 + strlen(name) + 1;
+    char* path = malloc(length);
+    if (path != NULL)
+        snprintf(path, length, "%s%s%s", parent, parent[0]? "/": "", name);
+    return path;
+}
+
+static bool is_image_path(const char* relative_path) {
+    const char* slash = strrchr(relative_path, '/');
+    return has_image_extension(slash? slash + 1: relative_path);
+}
+
+// Enqueue `relative_path` unless it has been enqueued before.
+static void enqueue_new_image(watcher_t* w, const char* relative_path) {
+    // Allocate first: a file marked as processed is never looked at again, so it must not be lost after that.
+    char* imagePath = join_relative(w->input_dir, relative_path);
+    if (imagePath == NULL) {
+        perror("read_images_from_directory - Cannot allocate image path");
+        return;
+    }
+
+    // Files are tracked by their path relative to the input directory, so that equal names in different subdirectories stay apart.
+    if (!add_processed_file(&w->engine->processed_files, relative_path)) {
+        free(imagePath);
+        return;
     }
+    atomic_fetch_add_explicit(&w->engine->images_read, 1, memory_order_relaxed);
+
+    engine_image_taken(w->engine); // the job the chunker makes for it counts it out
+
+    priority_t priority = priority_classify(imagePath, relative_path);
+    if (enqueue_image_name(&w->engine->name_queue, imagePath, priority, NULL) != 0) {
+        FPRINTF(stderr, "read_images_from_directory: Image name enqueue failed");
+        engine_image_done(w->engine);
+    }
+    free(imagePath);
+}
+
+static bool same_file_state(const settling_file_t* file, const struct stat* st) {
+    return file->size == st->st_size && file->mtime.tv_sec == st->st_mtim.tv_sec && file->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+// True if the file was last modified at least `settle_ms` ago.
+static bool modified_long_ago(const struct stat* st, unsigned settle_ms) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    int64_t age_ms = (int64_t)(now.tv_sec - st->st_mtim.tv_sec) * 1000 + (now.tv_nsec - st->st_mtim.tv_nsec) / 1000000;
+    return age_ms >= (int64_t)settle_ms;
+}
 
-    while ((entry = readdir(dir)) != NULL) {
-        if (stop_flag) break; 
+// A scan found `relative_path`: enqueue it if it is quiet already, otherwise let it settle first.
+static void enqueue_when_settled(watcher_t* w, const char* relative_path) {
+    if (was_file_processed(&w->engine->processed_files, relative_path))
+        return;
 
-        bool should_process = false;
-        char current_filename[256];
-        strncpy(current_filename, entry->d_name, sizeof(current_filename) - 1);
-        current_filename[sizeof(current_filename) - 1] = '\0';
+    char* path = join_relative(w->input_dir, relative_path);
+    if (path == NULL)
+        return;
+    struct stat st;
+    int status = stat(path, &st);
+    free(path);
+    if (status != 0)
+        return; // removed in the meantime
 
-        if (strstr(current_filename, ".jpg") || strstr(current_filename, ".png")) {
-            if (!was_file_processed(current_filename)) {
-                add_processed_file(current_filename);
-                should_process = true;
-                atomic_fetch_add_explicit(&total_images_read, 1, memory_order_relaxed);
-            }
+    unsigned settle_ms = w->engine->settle_ms;
+    if (settle_ms == 0 || modified_long_ago(&st, settle_ms)) {
+        enqueue_new_image(w, relative_path);
+        return;
+    }
+
+    pthread_mutex_lock(&w->settling_lock);
+    settling_file_t* file;
+    HASH_FIND_STR(w->settling, relative_path, file);
+    if (file == NULL && (file = malloc(sizeof(settling_file_t))) != NULL) {
+        if ((file->relative_path = strdup(relative_path)) == NULL) {
+            free(file);
+        } else {
+            file->size = st.st_size;
+            file->mtime = st.st_mtim;
+            file->stable_since_ns = now_ns();
+            HASH_ADD_KEYPTR(hh, w->settling, file->relative_path, strlen(file->relative_path), file);
+        }
+    }
+    pthread_mutex_unlock(&w->settling_lock);
+}
+
+// The writer closed the file, so it is complete: no need to wait for it to settle.
+static void forget_settling(watcher_t* w, const char* relative_path) {
+    pthread_mutex_lock(&w->settling_lock);
+    settling_file_t* file;
+    HASH_FIND_STR(w->settling, relative_path, file);
+    if (file != NULL)
+        HASH_DEL(w->settling, file);
+    pthread_mutex_unlock(&w->settling_lock);
+
+    if (file != NULL) {
+        free(file->relative_path);
+        free(file);
+    }
+}
+
+/*
+* @brief Enqueue every settling file whose size and mtime have not changed for the settle window.
+* @return The number of files still settling.
+*/
+static size_t service_settling(watcher_t* w) {
+    uint64_t now = now_ns();
+    uint64_t settle_ns = (uint64_t)w->engine->settle_ms * 1000000ull;
+    size_t remaining = 0;
+
+    pthread_mutex_lock(&w->settling_lock);
+    settling_file_t *file, *tmp;
+    HASH_ITER(hh, w->settling, file, tmp) {
+        char* path = join_relative(w->input_dir, file->relative_path);
+        struct stat st;
+        bool exists = (path != NULL && stat(path, &st) == 0);
+        free(path);
+
+        if (exists && !same_file_state(file, &st)) {
+            file->size = st.st_size;
+            file->mtime = st.st_mtim;
+            file->stable_since_ns = now;
+            remaining++;
+            continue;
         }
 
-        if (should_process) {
-            char imagePath[1024];
-            snprintf(imagePath, sizeof(imagePath), "%s/%s", directoryPath, current_filename);
-            if (enqueue_image_name(&name_queue, imagePath) != 0) 
-                FPRINTF(stderr, "read_images_from_directory: Image name enqueue failed");
+        if (exists && now - file->stable_since_ns < settle_ns) {
+            remaining++;
+            continue;
         }
+
+        HASH_DEL(w->settling, file);
+        if (exists)
+            enqueue_new_image(w, file->relative_path);
+        free(file->relative_path);
+        free(file);
+    }
+    pthread_mutex_unlock(&w->settling_lock);
+
+    return remaining;
+}
+
+static void free_settling(watcher_t* w) {
+    settling_file_t *file, *tmp;
+    pthread_mutex_lock(&w->settling_lock);
+    HASH_ITER(hh, w->settling, file, tmp) {
+        HASH_DEL(w->settling, file);
+        free(file->relative_path);
+        free(file);
+    }
+    pthread_mutex_unlock(&w->settling_lock);
+}
+
+static void add_watch(watcher_t* w, const char* relative_path) {
+    char* path = join_relative(w->input_dir, relative_path);
+    if (path == NULL)
+        return;
+
+    int wd = inotify_add_watch(w->inotify_fd, path, WATCH_MASK);
+    free(path);
+    if (wd < 0) {
+        if (!atomic_exchange(&w->watch_failed, true))
+            fprintf(stderr, "Cannot watch '%s/%s' (%s); falling back to rescanning every 5 seconds.\n",
+                w->input_dir, relative_path, strerror(errno));
+        return;
+    }
+
+    char* copy = strdup(relative_path);
+    if (copy == NULL)
+        return;
+
+    pthread_mutex_lock(&w->watches_lock);
+    watch_entry_t* entry;
+    HASH_FIND_INT(w->watches, &wd, entry);
+    if (entry != NULL) {
+        // The same directory was added again (e.g. by a rescan), inotify reuses the descriptor.
+        free(entry->relative_path);
+        entry->relative_path = copy;
+    } else if ((entry = malloc(sizeof(watch_entry_t))) != NULL) {
+        entry->wd = wd;
+        entry->relative_path = copy;
+        HASH_ADD_INT(w->watches, wd, entry);
+    } else {
+        free(copy);
+    }
+    pthread_mutex_unlock(&w->watches_lock);
+}
+
+static void remove_watch(watcher_t* w, int wd) {
+    pthread_mutex_lock(&w->watches_lock);
+    watch_entry_t* entry;
+    HASH_FIND_INT(w->watches, &wd, entry);
+    if (entry != NULL) {
+        HASH_DEL(w->watches, entry);
+        free(entry->relative_path);
+        free(entry);
+    }
+    pthread_mutex_unlock(&w->watches_lock);
+}
+
+static void free_watches(watcher_t* w) {
+    watch_entry_t *entry, *tmp;
+    pthread_mutex_lock(&w->watches_lock);
+    HASH_ITER(hh, w->watches, entry, tmp) {
+        HASH_DEL(w->watches, entry);
+        free(entry->relative_path);
+        free(entry);
     }
+    pthread_mutex_unlock(&w->watches_lock);
+}
+
+static void find_output_inside_input(watcher_t* w) {
+    char* input_real = realpath(w->input_dir, NULL);
+    char* output_real = realpath(w->engine->output_directory, NULL);
+
+    if (input_real != NULL && output_real != NULL) {
+        size_t length = strlen(input_real);
+        if (strncmp(output_real, input_real, length) == 0 && output_real[length] == '/')
+            w->output_relative_path = strdup(output_real + length + 1);
+    }
+
+    free(input_real);
+    free(output_real);
+}
+
+static bool on_scanned_directory(const char* relative_path, void* context) {
+    watcher_t* w = (watcher_t*)context;
+    if (w->output_relative_path != NULL && strcmp(relative_path, w->output_relative_path) == 0)
+        return false;
 
-    closedir(dir);
-    dir = NULL; 
-    if (stop_flag) return NULL; 
+    // Watch before listing, so that a file created while the directory is being listed is not missed.
+    if (w->inotify_fd >= 0 && !atomic_load(&w->watch_failed))
+        add_watch(w, relative_path);
+    return true;
+}
 
-    while (!stop_flag) { 
-        dir = opendir(directoryPath);
-        if (dir == NULL) {
-            perror("read_images_from_directory - Cannot open directory for monitoring");
-            if (stop_flag) break;
-            sleep(5); 
-            continue; 
+static void on_scanned_file(const char* relative_path, void* context) {
+    if (is_image_path(relative_path))
+        enqueue_when_settled((watcher_t*)context, relative_path);
+}
+
+// Scan the whole tree below the input directory (or only the subtree `start`) and enqueue every new image.
+static int scan_input(watcher_t* w, const char* start, size_t num_threads) {
+    scan_callbacks_t callbacks = { on_scanned_directory, on_scanned_file, w };
+    return scan_tree(w->input_dir, start, num_threads, &callbacks, &w->engine->stop_flag);
+}
+
+static void handle_events(watcher_t* w) {
+    char buffer[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    ssize_t length = read(w->inotify_fd, buffer, sizeof(buffer));
+    if (length <= 0)
+        return;
+
+    for (char* ptr = buffer; ptr < buffer + length; ) {
+        const struct inotify_event* event = (const struct inotify_event*)ptr;
+        ptr += sizeof(struct inotify_event) + event->len;
+
+        if (event->mask & IN_Q_OVERFLOW) {
+            // Events were dropped; a rescan finds whatever they announced.
+            scan_input(w, "", w->engine->scan_threads);
+            continue;
         }
 
-        while ((entry = readdir(dir)) != NULL) {
-            if (stop_flag) break; 
-            
-            bool should_process = false;
-            char current_filename[256];
-            strncpy(current_filename, entry->d_name, sizeof(current_filename) - 1);
-            current_filename[sizeof(current_filename) - 1] = '\0';
-
-            if (strstr(current_filename, ".jpg") || strstr(current_filename, ".png")) {
-                if (!was_file_processed(current_filename)) {
-                    add_processed_file(current_filename);
-                    atomic_fetch_add_explicit(&total_images_read, 1, memory_order_relaxed);
-                    should_process = true;
-                }
-            }
-
-            if (should_process) {
-                char imagePath[1024];
-                snprintf(imagePath, sizeof(imagePath), "%s/%s", directoryPath, current_filename);
-                if (enqueue_image_name(&name_queue, imagePath) != 0) 
-                    FPRINTF(stderr, "read_images_from_directory: Cannot enqueue image name");
-            }
+        if (event->mask & IN_IGNORED) {
+            remove_watch(w, event->wd);
+            continue;
         }
-        
-        closedir(dir);
-        dir = NULL; 
 
-        if (stop_flag) break;
+        if (event->len == 0)
+            continue;
 
-        sleep(5); 
+        char* relative_path = NULL;
+        pthread_mutex_lock(&w->watches_lock);
+        watch_entry_t* entry;
+        HASH_FIND_INT(w->watches, &event->wd, entry);
+        if (entry != NULL)
+            relative_path = join_relative(entry->relative_path, event->name);
+        pthread_mutex_unlock(&w->watches_lock);
+
+        if (relative_path == NULL)
+            continue;
+
+        if (event->mask & IN_ISDIR) {
+            if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                scan_input(w, relative_path, 1); // watches the new subtree and picks up what is already in it
+        } else if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) && is_image_path(relative_path)) {
+            forget_settling(w, relative_path);
+            enqueue_new_image(w, relative_path);
+        }
+
+        free(relative_path);
     }
+}
+
+static void watcher_cleanup(watcher_t* w) {
+    if (w->inotify_fd >= 0) close(w->inotify_fd);
+    w->inotify_fd = -1;
+    free_watches(w);
+    free_settling(w);
+    free(w->output_relative_path);
+    w->output_relative_path = NULL;
+    pthread_mutex_destroy(&w->watches_lock);
+    pthread_mutex_destroy(&w->settling_lock);
+}
 
-    if (dir != NULL) closedir(dir);
+void *read_images_from_directory(void *arg) {
+    ppxl_engine_t* engine = (ppxl_engine_t*)arg;
+    trace_thread_name("watcher");
+
+    watcher_t watcher = { .engine = engine, .input_dir = engine->input_directory, .inotify_fd = -1 };
+    watcher_t* w = &watcher;
+    atomic_init(&w->watch_failed, false);
+    pthread_mutex_init(&w->watches_lock, NULL);
+    pthread_mutex_init(&w->settling_lock, NULL);
+    find_output_inside_input(w);
+
+    // Batch mode only needs the initial scan.
+    if (!engine->once) {
+        w->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (w->inotify_fd < 0)
+            perror("read_images_from_directory - inotify unavailable, falling back to rescanning");
+    }
+
+    // Directories below the input that cannot be listed are reported by the scan; the rest is processed.
+    if (scan_input(w, "", engine->scan_threads) < 0) {
+        perror("read_images_from_directory - Cannot scan directory");
+        watcher_cleanup(w);
+        engine_scan_complete(engine); // nothing more will come from the directory: do not keep a drain waiting
+        return NULL; 
+    }
+
+    if (!engine->once)
+        engine_scan_complete(engine);
+
+    uint64_t next_rescan_ns = now_ns() + RESCAN_INTERVAL_NS;
+
+    // In batch mode the loop only lets files settle and retries decodes; it is stopped once the pipeline drained.
+    while (!engine->stop_flag) { 
+        size_t settling_files = service_settling(w);
+        decode_retry_service(&engine->decode_retries, &engine->name_queue);
+
+        if (engine->once) {
+            // Every image of the batch has been enqueued once nothing is left settling.
+            if (settling_files == 0)
+                engine_scan_complete(engine);
+            usleep(WATCH_TICK_MS * 1000);
+            continue;
+        }
+
+        if (w->inotify_fd >= 0 && atomic_load(&w->watch_failed)) {
+            // Some directories are not watched, so polling has to cover the whole tree anyway.
+            close(w->inotify_fd);
+            w->inotify_fd = -1;
+            free_watches(w);
+        }
+
+        if (w->inotify_fd >= 0) {
+            struct pollfd pfd = { .fd = w->inotify_fd, .events = POLLIN };
+            if (poll(&pfd, 1, WATCH_TICK_MS) > 0)
+                handle_events(w);
+            continue;
+        }
+
+        usleep(WATCH_TICK_MS * 1000);
+        if (engine->stop_flag || now_ns() < next_rescan_ns) continue;
+
+        if (scan_input(w, "", engine->scan_threads) < 0)
+            perror("read_images_from_directory - Cannot scan directory for monitoring");
+        next_rescan_ns = now_ns() + RESCAN_INTERVAL_NS;
+    }
 
+    watcher_cleanup(w);
     return NULL;
-}
\ No newline at end of file
+}
@@ -0,0 +1,254 @@
+#define _GNU_SOURCE
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<stdint.h>
+#include<stdbool.h>
+#include<signal.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<pthread.h>
+#include<dirent.h>
+#include<sys/stat.h>
+#include<sys/syscall.h>
+#include<directory_scanner.h>
+
+#include "macros.h"
+
+// Large enough that a directory with a few thousand entries is read in one or two system calls.
+#define GETDENTS_BUFFER_SIZE (1 << 20)
+
+// Layout of the records returned by getdents64 (glibc does not expose it).
+typedef struct {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} dirent64_record_t;
+
+typedef struct scan_item {
+    struct scan_item* next;
+    char* relative_path;
+} scan_item_t;
+
+typedef struct {
+    const char* root;
+    const scan_callbacks_t* callbacks;
+    volatile sig_atomic_t* stop;
+
+    scan_item_t* work;   // directories waiting to be listed
+    size_t pending;      // directories queued or being listed; the scan is over when it drops to 0
+    bool incomplete;     // a directory could not be listed or queued
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} scan_t;
+
+static char* join_path(const char* parent, const char* name) {
+    size_t parent_length = strlen(parent);
+    size_t name_length = strlen(name);
+
+    char* path = malloc(parent_length + 1 + name_length + 1);
+    if (path == NULL)
+        return NULL;
+
+    if (parent_length == 0) {
+        memcpy(path, name, name_length + 1);
+    } else {
+        memcpy(path, parent, parent_length);
+        path[parent_length] = '/';
+        memcpy(path + parent_length + 1, name, name_length + 1);
+    }
+    return path;
+}
+
+// Takes ownership of `relative_path`.
+static void push_directory(scan_t* scan, char* relative_path) {
+    scan_item_t* item = malloc(sizeof(scan_item_t));
+    if (item == NULL) {
+        perror("scan_tree - Cannot allocate work item");
+        free(relative_path);
+        pthread_mutex_lock(&scan->lock);
+        scan->incomplete = true;
+        pthread_mutex_unlock(&scan->lock);
+        return;
+    }
+    item->relative_path = relative_path;
+
+    pthread_mutex_lock(&scan->lock);
+    item->next = scan->work;
+    scan->work = item;
+    scan->pending++;
+    pthread_cond_signal(&scan->cond);
+    pthread_mutex_unlock(&scan->lock);
+}
+
+/*
+* @brief The type of an entry whose `d_type` is DT_UNKNOWN (some filesystems do not report it) or DT_LNK,
+* asked for while its directory is still open. A link is a file if it resolves to a regular file; links to
+* directories are not followed, so a link back up the tree cannot make the scan loop.
+*/
+static unsigned char classify_entry(int directory_fd, const char* name, unsigned char type) {
+    struct stat st;
+    if (type == DT_UNKNOWN) {
+        if (fstatat(directory_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+            return DT_UNKNOWN;
+        if (!S_ISLNK(st.st_mode))
+            return S_ISDIR(st.st_mode)? DT_DIR: S_ISREG(st.st_mode)? DT_REG: DT_UNKNOWN;
+    }
+
+    if (fstatat(directory_fd, name, &st, 0) != 0)
+        return DT_UNKNOWN; // dangling
+    return S_ISREG(st.st_mode)? DT_REG: DT_LNK;
+}
+
+/*
+* @brief List one directory, reporting files and queueing subdirectories.
+* @return 0 on success, -1 if the directory cannot be opened.
+*/
+static int list_directory(scan_t* scan, const char* relative_path, char* buffer) {
+    char* full_path = join_path(scan->root, relative_path);
+    if (full_path == NULL)
+        return -1;
+
+    if (scan->callbacks->on_directory && !scan->callbacks->on_directory(relative_path, scan->callbacks->context)) {
+        free(full_path);
+        return 0;
+    }
+
+    int fd = open(full_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    free(full_path);
+    if (fd < 0)
+        return -1;
+
+    long nread = 0;
+    while (!*scan->stop && (nread = syscall(SYS_getdents64, fd, buffer, GETDENTS_BUFFER_SIZE)) > 0) {
+        for (long offset = 0; offset < nread; ) {
+            dirent64_record_t* entry = (dirent64_record_t*)(buffer + offset);
+            offset += entry->d_reclen;
+
+            const char* name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN || type == DT_LNK)
+                type = classify_entry(fd, name, type);
+
+            if (type == DT_DIR) {
+                char* child = join_path(relative_path, name);
+                if (child != NULL)
+                    push_directory(scan, child);
+            } else if (type == DT_REG && scan->callbacks->on_file) {
+                char* child = join_path(relative_path, name);
+                if (child != NULL) {
+                    scan->callbacks->on_file(child, scan->callbacks->context);
+                    free(child);
+                }
+            }
+        }
+    }
+
+    if (nread < 0)
+        perror("scan_tree - getdents64 failed");
+
+    close(fd);
+    return 0;
+}
+
+static void* scan_worker(void* arg) {
+    scan_t* scan = (scan_t*)arg;
+
+    char* buffer = malloc(GETDENTS_BUFFER_SIZE);
+    if (buffer == NULL) {
+        perror("scan_tree - Cannot allocate directory buffer");
+        return NULL; // the other workers finish the scan; if there are none, `scan_tree` finds the work left over
+    }
+
+    pthread_mutex_lock(&scan->lock);
+    while (1) {
+        while (scan->work == NULL && scan->pending > 0)
+            pthread_cond_wait(&scan->cond, &scan->lock);
+
+        if (scan->work == NULL)
+            break; // nothing queued and nobody listing: the tree is done
+
+        scan_item_t* item = scan->work;
+        scan->work = item->next;
+        pthread_mutex_unlock(&scan->lock);
+
+        // After a stop request the remaining items are only drained.
+        bool failed = !*scan->stop && list_directory(scan, item->relative_path, buffer) != 0;
+        if (failed)
+            fprintf(stderr, "scan_tree: Cannot open directory '%s/%s'\n", scan->root, item->relative_path);
+        free(item->relative_path);
+        free(item);
+
+        pthread_mutex_lock(&scan->lock);
+        scan->incomplete |= failed;
+        if (--scan->pending == 0)
+            pthread_cond_broadcast(&scan->cond);
+    }
+    pthread_mutex_unlock(&scan->lock);
+
+    free(buffer);
+    return NULL;
+}
+
+int scan_tree(const char* root, const char* start, size_t num_threads, const scan_callbacks_t* callbacks,
+              volatile sig_atomic_t* stop) {
+    // Fail early (and synchronously) when the starting directory is unusable.
+    char* start_path = join_path(root, start);
+    if (start_path == NULL)
+        return -1;
+    int start_fd = open(start_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    free(start_path);
+    if (start_fd < 0)
+        return -1;
+    close(start_fd);
+
+    scan_t scan = { .root = root, .callbacks = callbacks, .stop = stop, .work = NULL, .pending = 0, .incomplete = false };
+    pthread_mutex_init(&scan.lock, NULL);
+    pthread_cond_init(&scan.cond, NULL);
+
+    char* first = strdup(start);
+    if (first == NULL) {
+        pthread_mutex_destroy(&scan.lock);
+        pthread_cond_destroy(&scan.cond);
+        return -1;
+    }
+    push_directory(&scan, first);
+
+    if (num_threads < 1)
+        num_threads = 1;
+
+    pthread_t* threads = malloc(num_threads * sizeof(pthread_t));
+    size_t started = 0;
+    if (threads != NULL) {
+        for (; started < num_threads; started++)
+            if (pthread_create(&threads[started], NULL, scan_worker, &scan) != 0)
+                break;
+    }
+
+    // Without any helper thread, do the whole scan on the caller's thread.
+    if (started == 0)
+        scan_worker(&scan);
+
+    for (size_t i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+
+    // Work is only left over when no worker could allocate its buffer: nothing was listed.
+    bool ran = scan.work == NULL;
+    while (scan.work != NULL) {
+        scan_item_t* item = scan.work;
+        scan.work = item->next;
+        free(item->relative_path);
+        free(item);
+    }
+
+    pthread_mutex_destroy(&scan.lock);
+    pthread_cond_destroy(&scan.cond);
+    return !ran? -1: scan.incomplete? 1: 0;
+}
@@ -2,32 +2,64 @@
 #include<stdlib.h>     
 #include<string.h>     
 #include<stdbool.h>    
+#include<pthread.h>
 #include<file_tracker.h> 
 
-processed_file_t *processed_files = NULL; 
+int file_tracker_init(file_tracker_t* tracker) {
+    tracker->files = NULL;
+    if (pthread_mutex_init(&tracker->lock, NULL) != 0) {
+        perror("file_tracker_init - Cannot initialize mutex");
+        return -1;
+    }
+    return 0;
+}
 
-void add_processed_file(const char *filename) {
+bool add_processed_file(file_tracker_t* tracker, const char *filename) {
     processed_file_t *entry = malloc(sizeof(processed_file_t));
     if (!entry) {
         perror("add_processed_file - Failed to allocate memory for hash entry");
-        return; 
+        return false; 
+    }
+
+    entry->name = strdup(filename);
+    if (!entry->name) {
+        perror("add_processed_file - Failed to allocate memory for file name");
+        free(entry);
+        return false;
     }
 
-    strncpy(entry->name, filename, sizeof(entry->name) - 1);
-    entry->name[sizeof(entry->name) - 1] = '\0'; 
-    HASH_ADD_STR(processed_files, name, entry);
+    processed_file_t *existing;
+    pthread_mutex_lock(&tracker->lock);
+    HASH_FIND_STR(tracker->files, filename, existing);
+    if (existing == NULL)
+        HASH_ADD_KEYPTR(hh, tracker->files, entry->name, strlen(entry->name), entry);
+    pthread_mutex_unlock(&tracker->lock);
+
+    if (existing != NULL) {
+        free(entry->name);
+        free(entry);
+        return false;
+    }
+
+    return true;
 }
 
-bool was_file_processed(const char *filename) {
+bool was_file_processed(file_tracker_t* tracker, const char *filename) {
     processed_file_t *entry;
-    HASH_FIND_STR(processed_files, filename, entry);
+    pthread_mutex_lock(&tracker->lock);
+    HASH_FIND_STR(tracker->files, filename, entry);
+    pthread_mutex_unlock(&tracker->lock);
     return entry != NULL;
 }
 
-void free_processed_files(void) {
+void free_processed_files(file_tracker_t* tracker) {
     processed_file_t *current_entry, *tmp;
-    HASH_ITER(hh, processed_files, current_entry, tmp) {
-        HASH_DEL(processed_files, current_entry); 
+    pthread_mutex_lock(&tracker->lock);
+    HASH_ITER(hh, tracker->files, current_entry, tmp) {
+        HASH_DEL(tracker->files, current_entry); 
+        free(current_entry->name);
         free(current_entry); 
     }
-}
\ No newline at end of file
+    pthread_mutex_unlock(&tracker->lock);
+    pthread_mutex_destroy(&tracker->lock);
+}
@@ -6,32 +6,107 @@
 #include<math.h>      
 #include<signal.h>     
 #include<pthread.h>    
+#include<sys/stat.h>
+#include<stdatomic.h>
 #include<stb_image.h>  
 #include<image_chunker.h>     
 #include<image_queue.h>      
 #include<image.h>
+#include<decode_retry.h>
+#include<effect_graph.h>
 
+#include "engine.h"
 #include "macros.h"
+#include "stats.h"
+#include "trace.h"
+
+void *load_image(const char *filename, int *width, int *height, int *channels, pixel_format_t *format) {
+    void *data;
+    if (stbi_is_hdr(filename)) {
+        *format = PIXEL_FORMAT_F32;
+        data = stbi_loadf(filename, width, height, channels, 0);
+    } else if (stbi_is_16_bit(filename)) {
+        *format = PIXEL_FORMAT_U16;
+        data = stbi_load_16(filename, width, height, channels, 0);
+    } else {
+        *format = PIXEL_FORMAT_U8;
+        data = stbi_load(filename, width, height, channels, 0);
+    }
+    if (data == NULL) {
+        FPRINTF(stderr, "load_image: Error loading image '%s': %s\n", filename, stbi_failure_reason());
+        return NULL;
+    }
 
-extern volatile sig_atomic_t stop_flag;
-extern image_name_queue_t name_queue;
-extern chunk_queue_t chunker_filtering_queue;
+    struct stat st;
+    if (stat(filename, &st) == 0)
+        stats_add(COUNTER_INPUT_BYTES, st.st_size);
+    stats_add(COUNTER_INFLIGHT_BYTES, (int64_t)*width * *height * *channels * pixel_format_size(*format));
 
-unsigned char *load_image(const char *filename, int *width, int *height, int *channels) {
-    unsigned char *data = stbi_load(filename, width, height, channels, 0);
+    return data;
+}
+
+void *load_image_from_memory(const unsigned char *bytes, size_t size, int *width, int *height, int *channels, pixel_format_t *format) {
+    void *data;
+    if (stbi_is_hdr_from_memory(bytes, (int)size)) {
+        *format = PIXEL_FORMAT_F32;
+        data = stbi_loadf_from_memory(bytes, (int)size, width, height, channels, 0);
+    } else if (stbi_is_16_bit_from_memory(bytes, (int)size)) {
+        *format = PIXEL_FORMAT_U16;
+        data = stbi_load_16_from_memory(bytes, (int)size, width, height, channels, 0);
+    } else {
+        *format = PIXEL_FORMAT_U8;
+        data = stbi_load_from_memory(bytes, (int)size, width, height, channels, 0);
+    }
     if (data == NULL) {
-        FPRINTF(stderr, "load_image: Error loading image '%s': %s\n", filename, stbi_failure_reason());
+        FPRINTF(stderr, "load_image_from_memory: Error decoding %zu bytes: %s\n", size, stbi_failure_reason());
         return NULL;
     }
 
+    stats_add(COUNTER_INPUT_BYTES, (int64_t)size);
+    stats_add(COUNTER_INFLIGHT_BYTES, (int64_t)*width * *height * *channels * pixel_format_size(*format));
+
     return data;
 }
 
-static int create_chunks_internal(const char *original_filename,
+/*
+* @brief Cheap check that a JPEG ends with its EOI marker or a PNG with its IEND chunk.
+* A file that fails it is most likely still being written, so it is retried later instead of
+* occupying a decoder. Other formats are assumed complete.
+*/
+static bool image_file_looks_complete(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL)
+        return false;
+
+    unsigned char head[8], tail[12];
+    bool complete = true;
+    if (fread(head, 1, sizeof(head), file) != sizeof(head) || fseek(file, -(long)sizeof(tail), SEEK_END) != 0
+        || fread(tail, 1, sizeof(tail), file) != sizeof(tail)) {
+        complete = false;
+    } else if (head[0] == 0xFF && head[1] == 0xD8) {
+        // JPEG: some writers pad after EOI, so accept the marker anywhere in the last bytes.
+        complete = false;
+        for (size_t i = 0; i + 1 < sizeof(tail); i++)
+            if (tail[i] == 0xFF && tail[i + 1] == 0xD9) complete = true;
+    } else if (memcmp(head, "\x89PNG\r\n\x1a\n", 8) == 0) {
+        complete = memcmp(tail + 4, "IEND", 4) == 0;
+    }
+
+    fclose(file);
+    return complete;
+}
+
+static int create_chunks_internal(image_job_t *job,
                                               unsigned char *image_data,
-                                              int width, int height, int channels,
-                                              int chunk_width, int chunk_height)
+                                              int width, int height, int channels, pixel_format_t format,
+                                              int chunk_width, int chunk_height,
+                                              uint64_t image_start_ns, uint64_t image_seq)
 {
+    const char *original_filename = job->name;
+    ppxl_engine_t *engine = job->engine;
+    int halo = job->graph->halo;
+    bool planar = job->graph->planar_tiles;
+
     if (!image_data || width <= 0 || height <= 0 || channels <= 0 || chunk_width <= 0 || chunk_height <= 0) {
         FPRINTF(stderr, "Thread %lu: create_chunks_internal: Invalid input parameters for %s.\n", pthread_self(), original_filename);
         return -1;
@@ -56,14 +131,17 @@ static int create_chunks_internal(const char *original_filename,
     int exit_status = 0; // Track if any chunk fails
 
     // channels -> RGB, Grayscale, etc.
-    // RGB contains 3 bytes per pixel (0-255, 0-255, 0-255)
+    // RGB contains 3 samples per pixel, each of pixel_format_size(format) bytes (1 for 0-255)
 
-    size_t bytes_per_pixel = channels;
+    size_t bytes_per_pixel = channels * pixel_format_size(format);
+    planar = planar && format == PIXEL_FORMAT_U8; // planar tiles are u8, see image.h
 
     PRINTF("Thread %lu: Creating %d chunks for %s...\n", pthread_self(), num_chunks_total, original_filename);
 
-    for (int cy = 0; cy < num_chunks_y && !stop_flag; cy++) { // Check stop_flag
-        for (int cx = 0; cx < num_chunks_x && !stop_flag; cx++) { // Check stop_flag
+    for (int cy = 0; cy < num_chunks_y && !engine->stop_flag; cy++) { // Check stop_flag
+        for (int cx = 0; cx < num_chunks_x && !engine->stop_flag; cx++) { // Check stop_flag
+            uint64_t chunk_start = trace_enabled? now_ns(): 0;
+
             // Allocate chunk
             image_chunk_t *chunk = (image_chunk_t*)malloc(sizeof(image_chunk_t));
             if (chunk == NULL) {
@@ -74,24 +152,50 @@ static int create_chunks_internal(const char *original_filename,
 
             chunk->original_image_name = NULL;
             chunk->pixel_data = NULL;
+            chunk->job = job;
+            image_job_retain(job);
 
 
-            chunk->offset_x = cx * chunk_width;
-            chunk->offset_y = cy * chunk_height;
+            size_t core_x = cx * chunk_width;
+            size_t core_y = cy * chunk_height;
 
             /*
                 Boundary values needs to be checked, if the current chunk exceeds the bounds of the image, width or height is
                 effectively subtracted, the chunk obtained will be smalled than `chunk_width`
             */
 
-            chunk->width = (chunk->offset_x + chunk_width > width)? (width - chunk->offset_x): chunk_width;
-            chunk->height = (chunk->offset_y + chunk_height > height)? (height - chunk->offset_y): chunk_height;
+            size_t core_width = (core_x + chunk_width > width)? (width - core_x): chunk_width;
+            size_t core_height = (core_y + chunk_height > height)? (height - core_y): chunk_height;
+
+            /*
+                The halo extends the chunk by up to `halo` pixels of its neighbours on every side, so that neighbourhood
+                effects (blurs, ...) see the same pixels they would in the whole image. It stops at the image border.
+            */
+
+            chunk->halo_left = (core_x < (size_t)halo)? core_x: (size_t)halo;
+            chunk->halo_top = (core_y < (size_t)halo)? core_y: (size_t)halo;
+            chunk->halo_right = (width - core_x - core_width < (size_t)halo)? width - core_x - core_width: (size_t)halo;
+            chunk->halo_bottom = (height - core_y - core_height < (size_t)halo)? height - core_y - core_height: (size_t)halo;
+
+            chunk->offset_x = core_x - chunk->halo_left;
+            chunk->offset_y = core_y - chunk->halo_top;
+            chunk->width = chunk->halo_left + core_width + chunk->halo_right;
+            chunk->height = chunk->halo_top + core_height + chunk->halo_bottom;
             chunk->channels = channels;
+            chunk->format = format;
             chunk->chunk_id = current_chunk_index;
             chunk->original_image_num_chunks = num_chunks_total;
+            chunk->tile_columns = num_chunks_x;
+            chunk->tile_rows = num_chunks_y;
+            chunk->tile_width = chunk_width;
+            chunk->tile_height = chunk_height;
             // Store original image dimensions for reconstruction
             chunk->original_image_width = width;
             chunk->original_image_height = height;
+            chunk->image_start_ns = image_start_ns;
+            chunk->image_seq = image_seq;
+            chunk->priority = job->priority;
+            chunk->resume = NULL;
 
             chunk->original_image_name = strdup(original_filename);
             if (chunk->original_image_name == NULL) {
@@ -102,8 +206,13 @@ static int create_chunks_internal(const char *original_filename,
                 goto cleanup_image;
             }
 
-            chunk->data_size_bytes = chunk->width * chunk->height * bytes_per_pixel;
-            chunk->pixel_data = (unsigned char*)malloc(chunk->data_size_bytes);
+            /*
+                Tile buffers are aligned and their rows padded to `stride` (see `chunk_layout_t` in image.h). Planar
+                tiles are deinterleaved here, during the copy out of the image, rather than by the first effect.
+            */
+
+            chunk_set_geometry(chunk, planar? CHUNK_LAYOUT_PLANAR: CHUNK_LAYOUT_INTERLEAVED);
+            chunk->pixel_data = chunk_alloc_pixels(chunk->data_size_bytes);
             if (chunk->pixel_data == NULL) {
                 perror("create_chunks_internal: Failed to allocate memory for chunk pixel data");
                 free_image_chunk(chunk);
@@ -111,6 +220,7 @@ static int create_chunks_internal(const char *original_filename,
                 exit_status = -1;
                 goto cleanup_image;
             }
+            stats_add(COUNTER_INFLIGHT_BYTES, (int64_t)chunk->data_size_bytes);
 
             /*
                 The pixel data in the orignal image & chunk is saved as a linear sequeunce of bytes, within each byte is contained
@@ -125,77 +235,162 @@ static int create_chunks_internal(const char *original_filename,
             size_t src_bytes_per_row = width * bytes_per_pixel; // bytes per row in the image
             size_t chunk_row_bytes = chunk->width * bytes_per_pixel; // Bytes to copy per row for this chunk
 
-            for(size_t row = 0; row < chunk->height; row++) {
+            if (planar) {
+                deinterleave_rows(image_data + chunk->offset_y * src_bytes_per_row + chunk->offset_x * bytes_per_pixel, src_bytes_per_row,
+                                  chunk->width, chunk->height, channels, chunk->pixel_data, chunk->stride, chunk->plane_size);
+            } else {
+                for(size_t row = 0; row < chunk->height; row++) {
 
-                /*
-                    Writing the bytes row by row, because data for a single chunk is not contigously stored.
-                    `(chunk->offset_y + row) * src_bytes_per_row` is the number of bytes to skip from the start of the image.
-                    `chunk->offset_x * bytes_per_pixel` is the number of bytes to skip from the start of the row
-                */
+                    /*
+                        Writing the bytes row by row, because data for a single chunk is not contigously stored.
+                        `(chunk->offset_y + row) * src_bytes_per_row` is the number of bytes to skip from the start of the image.
+                        `chunk->offset_x * bytes_per_pixel` is the number of bytes to skip from the start of the row
+                    */
 
-                unsigned char *src_ptr = image_data + (chunk->offset_y + row) * src_bytes_per_row + chunk->offset_x * bytes_per_pixel;
+                    unsigned char *src_ptr = image_data + (chunk->offset_y + row) * src_bytes_per_row + chunk->offset_x * bytes_per_pixel;
 
-                /*
-                    The destination pointer only needs to calculate the pointer offset for the current row; Since,
-                    only the chunk width number of bytes needs to be written
+                    /*
+                        The destination pointer only needs to calculate the pointer offset for the current row; Since,
+                        only the chunk width number of bytes needs to be written
 
-                */
+                    */
 
-                unsigned char *dst_ptr = chunk->pixel_data + row * chunk_row_bytes; // Use chunk_row_bytes for destination offset
+                    unsigned char *dst_ptr = chunk->pixel_data + row * chunk->stride; // rows are padded to the stride, see image.h
 
 
-                memcpy(dst_ptr, src_ptr, chunk_row_bytes); // Copy only the chunk's width worth of bytes
+                    memcpy(dst_ptr, src_ptr, chunk_row_bytes); // Copy only the chunk's width worth of bytes
+                    memset(dst_ptr + chunk_row_bytes, 0, chunk->stride - chunk_row_bytes);
+                }
             }
 
             // Enqueueing the chunk as it is created
 
             chunk->processing_status = CHUNK_STATUS_CREATED;
-            if (chunk_enqueue(&chunker_filtering_queue, chunk) != 0) {
+            if (chunk_enqueue(&engine->chunker_filtering_queue, chunk) != 0) {
                 FPRINTF(stderr, "Thread %lu: create_chunks_internal: Failed to enqueue chunk %d for %s\n",
                         pthread_self(), current_chunk_index, original_filename);
                 free_image_chunk(chunk);
                 chunk = NULL;
                 exit_status = -1;
                 goto cleanup_image; 
-            } else {
-
             }
+            TRACE_COMPLETE("chunk", original_filename, current_chunk_index, chunk_start, now_ns());
 
             current_chunk_index++;
         }
     }
 
     cleanup_image: 
-        if (stop_flag) exit_status = -1; 
+        if (engine->stop_flag) exit_status = -1; 
 
         if (exit_status == 0) 
             /* PRINTF("Thread %lu: Finished creating %d chunks for %s.\n", pthread_self(), current_chunk_index, original_filename) */;
         else {
             //FPRINTF(stderr, "Thread %lu: Failed or stopped during chunk creation for %s (processed %d chunks).\n", pthread_self(), original_filename, current_chunk_index);
-            discarded_images_table_add(original_filename);
+            image_job_discard(job, -1, engine->stop_flag? DISCARD_SHUTDOWN: DISCARD_CHUNKING);
         }
 
     return exit_status; 
 }
 
+/*
+* @brief Decode the job's image: a watched file (unless it looks truncated and has attempts left), or the
+* encoded bytes of a submission. A raw frame is already decoded; it is handed over as it is.
+* @return The packed samples, or NULL.
+*/
+static unsigned char* decode_job(image_job_t* job, int* width, int* height, int* channels, pixel_format_t* format) {
+    ppxl_engine_t* engine = job->engine;
+    unsigned char* image_data = NULL;
+
+    if (job->source == JOB_SOURCE_PIXELS) {
+        *width = job->width;
+        *height = job->height;
+        *channels = job->channels;
+        *format = job->format;
+        image_data = job->input;
+        job->input = NULL;
+        return image_data;
+    }
+
+    uint64_t decode_start = now_ns();
+    if (job->source == JOB_SOURCE_BUFFER) {
+        image_data = load_image_from_memory(job->input, job->input_size, width, height, channels, format);
+        free(job->input); // only the result is needed from here on
+        job->input = NULL;
+    } else if (image_file_looks_complete(job->name) || decode_retry_is_last_attempt(&engine->decode_retries, job->name)) {
+        // A truncated file is not decoded until its last attempt; by then it is decoded whatever it looks like.
+        image_data = load_image(job->name, width, height, channels, format);
+    } else {
+        return NULL;
+    }
+
+    uint64_t decode_end = now_ns();
+    stats_record_stage(STAGE_DECODE, decode_end - decode_start);
+    TRACE_COMPLETE("decode", job->name, -1, decode_start, decode_end);
+    return image_data;
+}
+
+static void free_decoded(image_job_t* job, unsigned char* image_data, size_t size) {
+    if (job->source == JOB_SOURCE_PIXELS)
+        free(image_data);
+    else
+        stbi_image_free(image_data);
+    stats_add(COUNTER_INFLIGHT_BYTES, -(int64_t)size);
+}
+
 void *chunk_image_thread(void *arg) {
-    while(!stop_flag) {
+    ppxl_engine_t* engine = (ppxl_engine_t*)arg;
+    trace_thread_name("chunker");
 
-        char* filename = dequeue_image_name(&name_queue);    
+    while(!engine->stop_flag) {
+
+        priority_t priority = PRIORITY_NORMAL;
+        image_job_t* job = NULL;
+        char* filename = dequeue_image_name(&engine->name_queue, &priority, &job);    
         if (filename == NULL) {
             FPRINTF(stderr, "Chunk Image Thread: Cannot proceed - filename = NULL\n");
             free(filename);
             continue;
         }
 
+        // Watched files get their job here; submissions come with theirs.
+        if (job == NULL && (job = image_job_for_file(engine, filename, priority)) == NULL) {
+            FPRINTF(stderr, "Chunk Image Thread: Cannot allocate the job of %s\n", filename);
+            atomic_fetch_add_explicit(&engine->images_discarded, 1, memory_order_relaxed);
+            stats_record_discard(DISCARD_CHUNKING);
+            engine_image_done(engine);
+            free(filename);
+            continue;
+        }
+        free(filename);
+        job->priority = priority; // raised if it waited past its deadline
+
         int width, height, channels;
-        
-        unsigned char* image_data = load_image(filename, &width, &height, &channels);    
+        pixel_format_t format = PIXEL_FORMAT_U8;
+
+        // Images are numbered in the order chunkers take them off the name queue (i.e. arrival order).
+        uint64_t image_seq = atomic_fetch_add_explicit(&engine->next_image_seq, 1, memory_order_relaxed);
+        job->image_seq = image_seq;
+        uint64_t image_start = now_ns();
+        unsigned char* image_data = decode_job(job, &width, &height, &channels, &format);
+
         if (image_data == NULL) {
+            // The file may still be being written: try again later, and only give up once the retries are used up.
+            if (job->source == JOB_SOURCE_FILE && !engine->stop_flag
+                && decode_retry_schedule(&engine->decode_retries, job->name, priority) == 0) {
+                job->retry = true;
+                image_job_release(job);
+                continue;
+            }
+
             FPRINTF(stderr, "Chunk Image Thread: Cannot proceed - Image Data = NULL\n");
-            free(filename);
+            // Count it as discarded so that `--once` does not wait for it forever.
+            image_job_discard(job, -1, DISCARD_DECODE);
+            image_job_release(job);
             continue;
         }
+        if (job->source == JOB_SOURCE_FILE)
+            decode_retry_forget(&engine->decode_retries, job->name);
 
         const int fixed_chunk_width = 128; 
         const int fixed_chunk_height = 128; 
@@ -204,25 +399,27 @@ void *chunk_image_thread(void *arg) {
         int calc_chunk_height = (height < fixed_chunk_height)? height: fixed_chunk_height;
 
         PRINTF("Chunker thread %lu: Processing %s with target chunk size: %dx%d\n",
-            pthread_self(), filename, calc_chunk_width, calc_chunk_height);
+            pthread_self(), job->name, calc_chunk_width, calc_chunk_height);
 
+        uint64_t chunk_start = now_ns();
         int output = create_chunks_internal(
-            filename,
+            job,
             image_data,
-            width, height, channels,
-            calc_chunk_width, calc_chunk_height 
+            width, height, channels, format,
+            calc_chunk_width, calc_chunk_height,
+            image_start, image_seq
         );
+        stats_record_stage(STAGE_CHUNK, now_ns() - chunk_start);
 
         if (output != 0) 
-            FPRINTF(stderr, "Chunker thread failed for %s.\n", filename);
+            FPRINTF(stderr, "Chunker thread failed for %s.\n", job->name);
 
-        stbi_image_free(image_data);
+        free_decoded(job, image_data, (size_t)width * height * channels * pixel_format_size(format));
         image_data = NULL;
-        free(filename); 
-        filename = NULL;
+        image_job_release(job); // the chunks hold their own references
     }
 
     PRINTF("Chunker thread finished successfully.\n");
     
     return NULL;
-}
\ No newline at end of file
+}
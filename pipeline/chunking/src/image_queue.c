@@ -5,17 +5,24 @@
 #include<pthread.h>    
 #include<errno.h>      
 #include<image_queue.h>       
+#include<image.h>
 
 #include "macros.h"
+#include "stats.h"
+#include "trace.h"
 
-extern volatile sig_atomic_t stop_flag;
-
-int image_name_queue_init(image_name_queue_t* q) {
-    if (q == NULL) 
+int image_name_queue_init(image_name_queue_t* q, const priority_policy_t* policy, volatile sig_atomic_t* stop) {
+    if (q == NULL || policy == NULL || stop == NULL) 
         return EINVAL; 
 
-    q->head = NULL;
-    q->tail = NULL;
+    for (int i = 0; i < PRIORITY_COUNT; i++) {
+        q->head[i] = NULL;
+        q->tail[i] = NULL;
+        q->credit[i] = 0;
+    }
+    q->policy = *policy;
+    q->stop = stop;
+    atomic_init(&q->depth, 0);
 
     if (pthread_mutex_init(&q->lock, NULL) != 0) {
         perror("image_name_queue_init: Failed to initialize mutex");
@@ -31,8 +38,8 @@ int image_name_queue_init(image_name_queue_t* q) {
     return 0;
 }
 
-int enqueue_image_name(image_name_queue_t *q, const char *name) {
-    if (q == NULL || name == NULL) 
+int enqueue_image_name(image_name_queue_t *q, const char *name, priority_t priority, struct image_job* job) {
+    if (q == NULL || name == NULL || priority < 0 || priority >= PRIORITY_COUNT) 
         return EINVAL;
 
     image_name_queue_node_t *new_node = (image_name_queue_node_t*)malloc(sizeof(image_name_queue_node_t));
@@ -41,6 +48,8 @@ int enqueue_image_name(image_name_queue_t *q, const char *name) {
         return -1;
     }
     new_node->next = NULL;
+    new_node->priority = priority;
+    new_node->job = job;
 
     new_node->name = strdup(name);
     if (new_node->name == NULL) {
@@ -50,11 +59,14 @@ int enqueue_image_name(image_name_queue_t *q, const char *name) {
     }
 
     pthread_mutex_lock(&q->lock);
+    new_node->enqueued_ns = now_ns();
+    uint64_t deadline = priority_deadline_ns(priority);
+    new_node->deadline_ns = deadline? new_node->enqueued_ns + deadline: 0;
 
-    if (q->tail == NULL) {
+    if (q->tail[priority] == NULL) {
         
         // very unlikely to happen
-        if (q->head != NULL) {
+        if (q->head[priority] != NULL) {
             FPRINTF(stderr, "enqueue_image_name: Queue inconsistency detected (tail is NULL, head is not)\n");
             pthread_mutex_unlock(&q->lock);
             free(new_node->name);
@@ -62,49 +74,118 @@ int enqueue_image_name(image_name_queue_t *q, const char *name) {
             return -1; 
         }
 
-        q->head = new_node;
-        q->tail = new_node;
+        q->head[priority] = new_node;
+        q->tail[priority] = new_node;
     } 
     
     else { 
-        q->tail->next = new_node;
-        q->tail = new_node;
+        q->tail[priority]->next = new_node;
+        q->tail[priority] = new_node;
     }
 
+    atomic_store_explicit(&q->depth, atomic_load_explicit(&q->depth, memory_order_relaxed) + 1, memory_order_relaxed);
     pthread_cond_signal(&q->cond_not_empty);
     pthread_mutex_unlock(&q->lock);
 
+    TRACE_INSTANT("name enqueue", name, -1);
     PRINTF("image name enqueued successfully: %s\n", name); // Debugging
 
     return 0;
 }
 
-char* dequeue_image_name(image_name_queue_t *q) {
+/*
+* @brief Pick the class to serve next, or -1 if every class is empty. Caller holds `q->lock`.
+* @note Weighted mode is smooth weighted round-robin: each non-empty class earns its weight in credit,
+* the richest class is served and pays back the total. Over any window every backlogged class gets a
+* share proportional to its weight, and the picks are interleaved rather than bursty.
+*/
+static int next_priority(image_name_queue_t* q) {
+    if (q->policy.mode == PRIORITY_STRICT) {
+        for (int i = 0; i < PRIORITY_COUNT; i++)
+            if (q->head[i] != NULL) return i;
+        return -1;
+    }
+
+    int chosen = -1;
+    int total = 0;
+    for (int i = 0; i < PRIORITY_COUNT; i++) {
+        if (q->head[i] == NULL) continue;
+
+        q->credit[i] += (int)q->policy.weights[i];
+        total += (int)q->policy.weights[i];
+        if (chosen < 0 || q->credit[i] > q->credit[chosen])
+            chosen = i;
+    }
+
+    if (chosen >= 0)
+        q->credit[chosen] -= total;
+    return chosen;
+}
+
+/*
+* @brief The class whose head is furthest past its deadline, or -1 if none is overdue. Caller holds `q->lock`.
+* @note Heads are enough: within a class, deadlines grow in queue order.
+*/
+static int overdue_priority(image_name_queue_t* q, uint64_t now) {
+    int overdue = -1;
+    for (int i = 0; i < PRIORITY_COUNT; i++) {
+        const image_name_queue_node_t* head = q->head[i];
+        if (head != NULL && head->deadline_ns != 0 && head->deadline_ns <= now
+            && (overdue < 0 || head->deadline_ns < q->head[overdue]->deadline_ns))
+            overdue = i;
+    }
+    return overdue;
+}
+
+char* dequeue_image_name(image_name_queue_t *q, priority_t* priority, struct image_job** job) {
     if (q == NULL) 
         return NULL; 
 
     pthread_mutex_lock(&q->lock);
 
-    while (q->head == NULL && !stop_flag) 
+    // An overdue image goes first and leaves the round-robin credits alone.
+    int class = overdue_priority(q, now_ns());
+    bool overdue = (class >= 0);
+    if (!overdue)
+        class = next_priority(q);
+    while (class < 0 && !*q->stop) {
         pthread_cond_wait(&q->cond_not_empty, &q->lock);
+        class = overdue_priority(q, now_ns());
+        overdue = (class >= 0);
+        if (!overdue)
+            class = next_priority(q);
+    }
 
-    if (stop_flag && q->head == NULL) { 
+    if (class < 0) { 
         pthread_mutex_unlock(&q->lock);
         PRINTF("dequeue: Stop flag detected, returning NULL.\n"); 
         return NULL; 
     }
 
-    image_name_queue_node_t* dequeue_node = q->head;
+    image_name_queue_node_t* dequeue_node = q->head[class];
     char* name = dequeue_node->name; 
 
-    q->head = dequeue_node->next;
+    q->head[class] = dequeue_node->next;
 
-    if (q->head == NULL) 
-        q->tail = NULL;
+    if (q->head[class] == NULL) {
+        q->tail[class] = NULL;
+        q->credit[class] = 0; // an idle class does not bank credit
+    }
 
+    atomic_store_explicit(&q->depth, atomic_load_explicit(&q->depth, memory_order_relaxed) - 1, memory_order_relaxed);
     pthread_mutex_unlock(&q->lock);
 
+    stats_record_queue_wait(QUEUE_NAMES, now_ns() - dequeue_node->enqueued_ns);
+    if (overdue) {
+        stats_add(COUNTER_DEADLINE_MISSES, 1);
+        TRACE_INSTANT("deadline passed", name, -1);
+    }
+    if (priority != NULL)
+        *priority = overdue? PRIORITY_HIGH: dequeue_node->priority;
+    if (job != NULL)
+        *job = dequeue_node->job;
     free(dequeue_node); 
+    TRACE_INSTANT("name dequeue", name, -1);
 
     PRINTF("image name dequeued successfully: %s\n", name); 
 
@@ -117,22 +198,29 @@ void broadcast_image_name_queue(image_name_queue_t* q) {
     pthread_mutex_unlock(&q->lock);
 }
 
+size_t image_name_queue_depth(image_name_queue_t* q) {
+    return atomic_load_explicit(&q->depth, memory_order_relaxed);
+}
+
 void image_name_queue_destroy(image_name_queue_t* q) {
     if (q == NULL) 
         return;
 
-    image_name_queue_node_t* curr = q->head;
-    image_name_queue_node_t* temp;
+    for (int i = 0; i < PRIORITY_COUNT; i++) {
+        image_name_queue_node_t* curr = q->head[i];
+        image_name_queue_node_t* temp;
 
-    while(curr != NULL) {
-        free(curr->name); 
-        temp = curr;
-        curr = curr->next;
-        free(temp);  
-    }
+        while(curr != NULL) {
+            free(curr->name); 
+            image_job_release(curr->job);
+            temp = curr;
+            curr = curr->next;
+            free(temp);  
+        }
 
-    q->head = NULL;
-    q->tail = NULL;
+        q->head[i] = NULL;
+        q->tail[i] = NULL;
+    }
 
     pthread_mutex_destroy(&q->lock);
     pthread_cond_destroy(&q->cond_not_empty);
@@ -0,0 +1,661 @@
+#include "engine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "image_chunker.h"
+#include "chunk_threader.h"
+#include "directory_monitor.h"
+#include "reconstruction.h"
+#include "stb_image.h"
+#include "macros.h"
+#include "trace.h"
+
+#define DRAIN_POLL_MS 100
+
+// #######################################
+// # Effect graphs
+// #######################################
+
+// The counters of outputs named `name`, created on first use. The caller holds `graphs_lock`.
+static engine_output_t* output_for_name(ppxl_engine_t* engine, const char* name) {
+    engine_output_t* output;
+    HASH_FIND_STR(engine->outputs, name, output);
+    if (output == NULL && (output = calloc(1, sizeof(engine_output_t))) != NULL) {
+        if ((output->name = strdup(name)) == NULL) {
+            free(output);
+            return NULL;
+        }
+        HASH_ADD_KEYPTR(hh, engine->outputs, output->name, strlen(output->name), output);
+    }
+    return output;
+}
+
+// Resolve the counters of every branch of `entry`. The caller holds `graphs_lock`.
+static int link_outputs(ppxl_engine_t* engine, engine_graph_t* entry) {
+    entry->outputs = calloc(entry->graph.num_branches, sizeof(engine_output_t*));
+    if (entry->outputs == NULL)
+        return -1;
+
+    for (size_t b = 0; b < entry->graph.num_branches; b++)
+        if ((entry->outputs[b] = output_for_name(engine, entry->graph.branches[b].name)) == NULL)
+            return -1;
+    return 0;
+}
+
+static const engine_graph_t* graph_for_spec(ppxl_engine_t* engine, const char* spec) {
+    pthread_mutex_lock(&engine->graphs_lock);
+    engine_graph_t* entry;
+    HASH_FIND_STR(engine->graphs, spec, entry);
+    if (entry == NULL && (entry = calloc(1, sizeof(engine_graph_t))) != NULL) {
+        if ((entry->spec = strdup(spec)) == NULL || effect_graph_parse(spec, &entry->graph) != 0) {
+            free(entry->spec);
+            free(entry);
+            entry = NULL;
+        } else if (link_outputs(engine, entry) != 0) {
+            fprintf(stderr, "Error: Out of memory while setting up the outputs of '%s'.\n", spec);
+            effect_graph_free(&entry->graph);
+            free(entry->outputs);
+            free(entry->spec);
+            free(entry);
+            entry = NULL;
+        } else {
+            effect_graph_set_tile_layout(&entry->graph, engine->tile_layout);
+            HASH_ADD_KEYPTR(hh, engine->graphs, entry->spec, strlen(entry->spec), entry);
+        }
+    }
+    pthread_mutex_unlock(&engine->graphs_lock);
+
+    return entry;
+}
+
+const engine_graph_t* engine_graph_for(ppxl_engine_t* engine, const char* spec) {
+    if (spec == NULL) {
+        if (engine->graph == NULL)
+            fprintf(stderr, "Error: Effects not specified, and the engine has none configured.\n");
+        return engine->graph;
+    }
+    return graph_for_spec(engine, spec);
+}
+
+static void free_graphs(ppxl_engine_t* engine) {
+    engine_graph_t *entry, *tmp;
+    HASH_ITER(hh, engine->graphs, entry, tmp) {
+        HASH_DEL(engine->graphs, entry);
+        effect_graph_free(&entry->graph);
+        free(entry->outputs);
+        free(entry->spec);
+        free(entry);
+    }
+
+    engine_output_t *output, *next;
+    HASH_ITER(hh, engine->outputs, output, next) {
+        HASH_DEL(engine->outputs, output);
+        free(output->name);
+        free(output);
+    }
+}
+
+// #######################################
+// # Jobs
+// #######################################
+
+static image_job_t* job_create(ppxl_engine_t* engine, const engine_graph_t* entry, job_source_t source, priority_t priority) {
+    image_job_t* job = calloc(1, sizeof(image_job_t));
+    if (job == NULL)
+        return NULL;
+
+    const effect_graph_t* graph = &entry->graph;
+    job->delivered = calloc(graph->num_branches, sizeof(bool));
+    if (job->delivered == NULL || pthread_mutex_init(&job->lock, NULL) != 0) {
+        free(job->delivered);
+        free(job);
+        return NULL;
+    }
+
+    job->engine = engine;
+    job->graph = graph;
+    job->outputs = entry->outputs;
+    job->source = source;
+    job->priority = priority;
+    job->outputs_left = graph->num_branches;
+    atomic_init(&job->refs, 1);
+    atomic_init(&job->discarded, false);
+    return job;
+}
+
+image_job_t* image_job_for_file(ppxl_engine_t* engine, const char* path, priority_t priority) {
+    image_job_t* job = job_create(engine, engine->graph, JOB_SOURCE_FILE, priority);
+    if (job != NULL && (job->name = strdup(path)) == NULL) {
+        image_job_release(job);
+        return NULL;
+    }
+    return job;
+}
+
+// Take output `branch` for delivery; false if it has been delivered already.
+static bool claim_output(image_job_t* job, int branch) {
+    pthread_mutex_lock(&job->lock);
+    bool pending = !job->delivered[branch];
+    job->delivered[branch] = true;
+    pthread_mutex_unlock(&job->lock);
+    return pending;
+}
+
+// The callback runs outside the lock, so that the outputs of one image are delivered in parallel.
+static void complete_output(image_job_t* job, int branch, ppxl_result_t* result) {
+    if (job->complete != NULL) {
+        result->output = job->graph->branches[branch].name;
+        job->complete(result, job->user);
+    }
+
+    pthread_mutex_lock(&job->lock);
+    bool last = --job->outputs_left == 0;
+    bool failed = job->counted;
+    pthread_mutex_unlock(&job->lock);
+    if (last && !job->retry) {
+        if (!failed) // before the image is counted out, which may wake `ppxl_engine_drain`
+            atomic_fetch_add_explicit(&job->engine->images_processed, 1, memory_order_relaxed);
+        engine_image_done(job->engine);
+    }
+}
+
+static void fail_output(image_job_t* job, int branch, ppxl_status_t status) {
+    if (!claim_output(job, branch))
+        return;
+
+    ppxl_result_t result = { .status = status };
+    complete_output(job, branch, &result);
+}
+
+void image_job_deliver(image_job_t* job, int branch, ppxl_result_t* result) {
+    if (!claim_output(job, branch))
+        return;
+
+    ppxl_result_t written = { .status = PPXL_OK };
+    complete_output(job, branch, result? result: &written);
+}
+
+/*
+* @brief Tiles of a discarded image stop at the next stage they reach, and no tile of it may reach
+* reconstruction any more. So what is held further on goes now: the tiles parked at its global and local
+* effects, and, through an error chunk, the tiles reconstruction already collected.
+*/
+static void purge_image(image_job_t* job) {
+    effect_graph_drop_image(job->graph, job->image_seq);
+
+    image_chunk_t* marker = calloc(1, sizeof(image_chunk_t));
+    if (marker == NULL || (marker->original_image_name = strdup(job->name)) == NULL) {
+        FPRINTF(stderr, "Error: Cannot allocate the chunk that drops %s\n", job->name);
+        free(marker);
+        return;
+    }
+
+    marker->processing_status = CHUNK_STATUS_ERROR;
+    marker->image_seq = job->image_seq;
+    marker->priority = job->priority;
+    marker->job = job;
+    image_job_retain(job);
+    if (chunk_enqueue(&job->engine->filtering_reconstruction_queue, marker) != 0)
+        free_image_chunk(marker);
+}
+
+static ppxl_status_t status_for(discard_reason_t reason) {
+    switch (reason) {
+        case DISCARD_DECODE:   return PPXL_ERROR_DECODE;
+        case DISCARD_CHUNKING: return PPXL_ERROR_MEMORY;
+        case DISCARD_EFFECT:   return PPXL_ERROR_EFFECT;
+        case DISCARD_ENCODE:   return PPXL_ERROR_ENCODE;
+        default:               return PPXL_ERROR_SHUTDOWN;
+    }
+}
+
+void image_job_discard(image_job_t* job, int branch, discard_reason_t reason) {
+    if (job == NULL)
+        return;
+
+    pthread_mutex_lock(&job->lock);
+    bool first = !job->counted;
+    job->counted = true;
+    pthread_mutex_unlock(&job->lock);
+
+    if (first) {
+        atomic_fetch_add_explicit(&job->engine->images_discarded, 1, memory_order_relaxed);
+        stats_record_discard(reason);
+    }
+
+    if (branch >= 0) {
+        fail_output(job, branch, status_for(reason));
+        return;
+    }
+
+    bool purge = !atomic_exchange_explicit(&job->discarded, true, memory_order_relaxed);
+    for (size_t b = 0; b < job->graph->num_branches; b++)
+        fail_output(job, (int)b, status_for(reason));
+    if (purge)
+        purge_image(job);
+}
+
+void image_job_retain(struct image_job* job) {
+    if (job != NULL)
+        atomic_fetch_add_explicit(&job->refs, 1, memory_order_relaxed);
+}
+
+void image_job_release(struct image_job* job) {
+    if (job == NULL || atomic_fetch_sub_explicit(&job->refs, 1, memory_order_acq_rel) != 1)
+        return;
+
+    // the image is gone: whatever was not delivered never will be
+    for (size_t b = 0; b < job->graph->num_branches; b++)
+        fail_output(job, (int)b, PPXL_ERROR_SHUTDOWN);
+
+    if (job->source == JOB_SOURCE_PIXELS && job->input != NULL)
+        stats_add(COUNTER_INFLIGHT_BYTES, -(int64_t)job->input_size);
+    free(job->input);
+    free(job->name);
+    free(job->delivered);
+    pthread_mutex_destroy(&job->lock);
+    free(job);
+}
+
+// #######################################
+// # Engine
+// #######################################
+
+void engine_image_taken(ppxl_engine_t* engine) {
+    pthread_mutex_lock(&engine->pending_lock);
+    engine->images_pending++;
+    pthread_mutex_unlock(&engine->pending_lock);
+}
+
+void engine_image_done(ppxl_engine_t* engine) {
+    pthread_mutex_lock(&engine->pending_lock);
+    if (--engine->images_pending == 0)
+        pthread_cond_broadcast(&engine->drained);
+    pthread_mutex_unlock(&engine->pending_lock);
+}
+
+void engine_scan_complete(ppxl_engine_t* engine) {
+    if (atomic_load(&engine->initial_scan_complete))
+        return;
+
+    pthread_mutex_lock(&engine->pending_lock);
+    atomic_store(&engine->initial_scan_complete, true);
+    pthread_cond_broadcast(&engine->drained);
+    pthread_mutex_unlock(&engine->pending_lock);
+}
+
+// The caller holds `pending_lock`.
+static bool is_drained(ppxl_engine_t* engine) {
+    return engine->images_pending == 0 && (engine->input_directory == NULL || atomic_load(&engine->initial_scan_complete));
+}
+
+static int parse_tile_layout(const char* name, tile_layout_policy_t* layout) {
+    if (name == NULL || strcmp(name, "auto") == 0)
+        *layout = TILE_LAYOUT_AUTO;
+    else if (strcmp(name, "interleaved") == 0)
+        *layout = TILE_LAYOUT_INTERLEAVED;
+    else if (strcmp(name, "planar") == 0)
+        *layout = TILE_LAYOUT_PLANAR;
+    else {
+        fprintf(stderr, "Error: Unknown tile layout '%s' (expected auto, interleaved or planar).\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_schedule(const char* name, chunk_queue_policy_t* schedule) {
+    if (name == NULL || strcmp(name, "oldest-image") == 0)
+        *schedule = CHUNK_QUEUE_OLDEST_IMAGE;
+    else if (strcmp(name, "fifo") == 0)
+        *schedule = CHUNK_QUEUE_FIFO;
+    else {
+        fprintf(stderr, "Error: Unknown schedule '%s' (expected oldest-image or fifo).\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+static char* copy_string(const char* str, bool* failed) {
+    if (str == NULL)
+        return NULL;
+    char* copy = strdup(str);
+    if (copy == NULL)
+        *failed = true;
+    return copy;
+}
+
+// Tear down what `ppxl_engine_create` set up; the threads have been stopped.
+static void free_engine(ppxl_engine_t* engine) {
+    // Dropping what is still queued releases the jobs of those images, which may complete submissions.
+    image_name_queue_destroy(&engine->name_queue);
+    chunk_queue_destroy(&engine->chunker_filtering_queue);
+    chunk_queue_destroy(&engine->filtering_reconstruction_queue);
+    free_graphs(engine);
+
+    decode_retry_cleanup(&engine->decode_retries);
+    free_processed_files(&engine->processed_files);
+    pthread_mutex_destroy(&engine->graphs_lock);
+    pthread_mutex_destroy(&engine->pending_lock);
+    pthread_cond_destroy(&engine->drained);
+
+    free(engine->chunkers);
+    free(engine->filters);
+    free(engine->effects);
+    free(engine->input_directory);
+    free(engine->output_directory);
+    free(engine);
+}
+
+static int start_threads(ppxl_engine_t* engine) {
+    engine->running = true;
+
+    if (engine->input_directory != NULL) {
+        PRINTF("Starting image watcher thread for directory: %s\n", engine->input_directory);
+        if (pthread_create(&engine->watcher, NULL, read_images_from_directory, engine) != 0) {
+            perror("Failed to create watcher thread");
+            return -1;
+        }
+        engine->watching = true;
+    }
+
+    PRINTF("Starting %zu chunker threads...\n", engine->num_threads);
+    for (size_t i = 0; i < engine->num_threads; i++) {
+        if (pthread_create(&engine->chunkers[engine->num_chunkers], NULL, chunk_image_thread, engine) != 0) {
+            perror("Failed to create a chunker thread");
+            return -1;
+        }
+        engine->num_chunkers++;
+    }
+
+    PRINTF("Starting %zu image processing threads...\n", engine->num_threads);
+    for (size_t i = 0; i < engine->num_threads; i++) {
+        if (pthread_create(&engine->filters[engine->num_filters], NULL, process_chunk, engine) != 0) {
+            perror("Failed to create a filter thread");
+            return -1;
+        }
+        engine->num_filters++;
+    }
+
+    // The reconstruction thread is not a part of the chunker threads.
+    engine->reconstruction = init_reconstruction(engine);
+    return 0;
+}
+
+ppxl_engine_t* ppxl_engine_create(const ppxl_config_t* config) {
+    tile_layout_policy_t tile_layout;
+    chunk_queue_policy_t schedule;
+    priority_policy_t priority_policy = PRIORITY_DEFAULT_POLICY;
+
+    if (config == NULL || parse_tile_layout(config->tile_layout, &tile_layout) != 0 || parse_schedule(config->schedule, &schedule) != 0)
+        return NULL;
+
+    if (config->priority_policy != NULL && priority_parse_policy(config->priority_policy, &priority_policy) != 0) {
+        fprintf(stderr, "Error: Invalid priority policy '%s' (expected strict or weighted[:high,normal,low]).\n", config->priority_policy);
+        return NULL;
+    }
+
+    if (config->input_directory != NULL && (config->output_directory == NULL || config->effects == NULL)) {
+        fprintf(stderr, "Error: An input directory needs an output directory and effects.\n");
+        return NULL;
+    }
+
+    struct stat st;
+    if (config->input_directory != NULL
+        && (stat(config->input_directory, &st) != 0 || !S_ISDIR(st.st_mode) || access(config->input_directory, R_OK | X_OK) != 0)) {
+        fprintf(stderr, "Error: Input directory '%s' is not a readable directory.\n", config->input_directory);
+        return NULL;
+    }
+
+    ppxl_engine_t* engine = calloc(1, sizeof(ppxl_engine_t));
+    if (engine == NULL) {
+        perror("ppxl_engine_create - Cannot allocate engine");
+        return NULL;
+    }
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    engine->num_threads = config->threads? config->threads: (cores > 1)? (size_t)cores: 2;
+    // Listing directories mostly waits on the filesystem, so use a few threads even on small machines.
+    engine->scan_threads = config->scan_threads? config->scan_threads: (cores > 4)? (size_t)cores: 4;
+    engine->settle_ms = config->settle_ms;
+    engine->once = config->once;
+    engine->tile_layout = tile_layout;
+    atomic_init(&engine->initial_scan_complete, false);
+
+    bool failed = false;
+    engine->effects = copy_string(config->effects, &failed);
+    engine->input_directory = copy_string(config->input_directory, &failed);
+    engine->output_directory = copy_string(config->output_directory, &failed);
+    engine->chunkers = malloc(engine->num_threads * sizeof(pthread_t));
+    engine->filters = malloc(engine->num_threads * sizeof(pthread_t));
+
+    if (failed || engine->chunkers == NULL || engine->filters == NULL)
+        goto FailAlloc;
+    if (image_name_queue_init(&engine->name_queue, &priority_policy, &engine->stop_flag) != 0)
+        goto FailAlloc;
+    if (chunk_queue_init(&engine->chunker_filtering_queue, QUEUE_CHUNKS, schedule, &engine->stop_flag) != 0)
+        goto FailNames;
+    if (chunk_queue_init(&engine->filtering_reconstruction_queue, QUEUE_FILTERED, CHUNK_QUEUE_FIFO, &engine->stop_flag) != 0)
+        goto FailChunks;
+    if (file_tracker_init(&engine->processed_files) != 0)
+        goto FailFiltered;
+    if (decode_retry_init(&engine->decode_retries) != 0)
+        goto FailTracker;
+    if (pthread_mutex_init(&engine->graphs_lock, NULL) != 0)
+        goto FailRetries;
+    if (pthread_mutex_init(&engine->pending_lock, NULL) != 0)
+        goto FailGraphsLock;
+    if (pthread_cond_init(&engine->drained, NULL) != 0)
+        goto FailJobsLock;
+
+    if (engine->effects != NULL && (engine->graph = graph_for_spec(engine, engine->effects)) == NULL) {
+        free_engine(engine);
+        return NULL;
+    }
+
+    if (start_threads(engine) != 0) {
+        ppxl_engine_stop(engine);
+        free_engine(engine);
+        return NULL;
+    }
+
+    return engine;
+
+    FailJobsLock:   pthread_mutex_destroy(&engine->pending_lock);
+    FailGraphsLock: pthread_mutex_destroy(&engine->graphs_lock);
+    FailRetries:    decode_retry_cleanup(&engine->decode_retries);
+    FailTracker:    free_processed_files(&engine->processed_files);
+    FailFiltered:   chunk_queue_destroy(&engine->filtering_reconstruction_queue);
+    FailChunks:     chunk_queue_destroy(&engine->chunker_filtering_queue);
+    FailNames:      image_name_queue_destroy(&engine->name_queue);
+    FailAlloc:
+        fprintf(stderr, "Error: Cannot initialize the engine.\n");
+        free(engine->chunkers);
+        free(engine->filters);
+        free(engine->effects);
+        free(engine->input_directory);
+        free(engine->output_directory);
+        free(engine);
+        return NULL;
+}
+
+void ppxl_engine_stop(ppxl_engine_t* engine) {
+    if (!engine->running)
+        return;
+
+    engine->stop_flag = 1;
+    if (engine->watching)
+        pthread_join(engine->watcher, NULL);
+
+    PRINTF("Broadcasting to chunker threads...\n");
+    broadcast_image_name_queue(&engine->name_queue);
+    broadcast_chunk_queue(&engine->chunker_filtering_queue);
+    broadcast_chunk_queue(&engine->filtering_reconstruction_queue);
+
+    for (size_t i = 0; i < engine->num_chunkers; i++)
+        pthread_join(engine->chunkers[i], NULL);
+    for (size_t i = 0; i < engine->num_filters; i++)
+        pthread_join(engine->filters[i], NULL);
+
+    if (engine->reconstruction != NULL) {
+        pthread_join(*engine->reconstruction, NULL);
+        free(engine->reconstruction);
+        engine->reconstruction = NULL;
+    }
+
+    engine->watching = false;
+    engine->running = false;
+}
+
+void ppxl_engine_drain(ppxl_engine_t* engine) {
+    pthread_mutex_lock(&engine->pending_lock);
+    while (!is_drained(engine) && !engine->stop_flag) {
+        // `ppxl_engine_interrupt` cannot signal from a signal handler, so the flag is polled as well
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += DRAIN_POLL_MS * 1000000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&engine->drained, &engine->pending_lock, &until);
+    }
+    pthread_mutex_unlock(&engine->pending_lock);
+}
+
+void ppxl_engine_stats(ppxl_engine_t* engine, ppxl_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->images_read = atomic_load_explicit(&engine->images_read, memory_order_relaxed);
+    stats->outputs_written = atomic_load_explicit(&engine->outputs_written, memory_order_relaxed);
+    stats->images_discarded = atomic_load_explicit(&engine->images_discarded, memory_order_relaxed);
+    stats->pixels_written = atomic_load_explicit(&engine->pixels_written, memory_order_relaxed);
+
+    pthread_mutex_lock(&engine->pending_lock);
+    stats->images_pending = engine->images_pending;
+    pthread_mutex_unlock(&engine->pending_lock);
+
+    stats->queued_names = image_name_queue_depth(&engine->name_queue);
+    stats->queued_tiles = chunk_queue_depth(&engine->chunker_filtering_queue);
+    stats->queued_filtered = chunk_queue_depth(&engine->filtering_reconstruction_queue);
+    stats->outputs = engine->graph? engine->graph->graph.num_branches: 0;
+    stats->threads = engine->num_threads;
+    stats->encoder_threads = RECONSTRUCTION_THREADS - 1; // the pool of the reconstruction thread
+}
+
+void ppxl_engine_interrupt(ppxl_engine_t* engine) {
+    engine->stop_flag = 1;
+}
+
+void ppxl_engine_destroy(ppxl_engine_t* engine) {
+    if (engine == NULL)
+        return;
+
+    ppxl_engine_stop(engine);
+    free_engine(engine);
+}
+
+// #######################################
+// # Submissions
+// #######################################
+
+// Queue the job of a submission; on failure the job is dropped without calling back.
+static int submit_job(ppxl_engine_t* engine, image_job_t* job) {
+    if (engine->stop_flag || enqueue_image_name(&engine->name_queue, job->name, job->priority, job) != 0) {
+        job->complete = NULL;
+        image_job_release(job);
+        return -1;
+    }
+
+    atomic_fetch_add_explicit(&engine->images_read, 1, memory_order_relaxed);
+    return 0;
+}
+
+// Results are encoded like the input; whatever is not JPEG or Radiance HDR becomes PNG.
+static const char* extension_for(const unsigned char* bytes, size_t len) {
+    if (len >= 2 && bytes[0] == 0xFF && bytes[1] == 0xD8)
+        return ".jpg";
+    if (stbi_is_hdr_from_memory(bytes, (int)len))
+        return ".hdr";
+    return ".png";
+}
+
+int ppxl_submit_buffer(ppxl_engine_t* engine, const void* bytes, size_t len, const char* effects,
+                       ppxl_complete_fn complete, void* user) {
+    if (engine == NULL || bytes == NULL || len == 0 || len > INT_MAX) // stb_image takes the size as an int
+        return -1;
+
+    const engine_graph_t* entry = engine_graph_for(engine, effects);
+    if (entry == NULL)
+        return -1;
+
+    image_job_t* job = job_create(engine, entry, JOB_SOURCE_BUFFER, PRIORITY_NORMAL);
+    if (job == NULL)
+        return -1;
+    engine_image_taken(engine); // releasing the job counts it out again
+
+    char name[64];
+    snprintf(name, sizeof(name), "buffer-%llu%s",
+             (unsigned long long)atomic_fetch_add_explicit(&engine->next_submission, 1, memory_order_relaxed),
+             extension_for(bytes, len));
+    job->name = strdup(name);
+    job->input = malloc(len);
+    if (job->name == NULL || job->input == NULL) {
+        image_job_release(job); // nothing to call back yet: `complete` is not set
+        return -1;
+    }
+
+    memcpy(job->input, bytes, len);
+    job->input_size = len;
+    job->complete = complete;
+    job->user = user;
+    return submit_job(engine, job);
+}
+
+int ppxl_submit_pixels(ppxl_engine_t* engine, const ppxl_frame_t* frame, const char* effects,
+                       ppxl_complete_fn complete, void* user) {
+    if (engine == NULL || frame == NULL || frame->pixels == NULL || frame->width <= 0 || frame->height <= 0
+        || frame->channels < 1 || frame->channels > 4 || frame->format < PPXL_FORMAT_U8 || frame->format > PPXL_FORMAT_F32)
+        return -1;
+
+    size_t row = (size_t)frame->width * frame->channels * pixel_format_size((pixel_format_t)frame->format);
+    size_t stride = frame->stride? frame->stride: row;
+    if (stride < row)
+        return -1;
+
+    const engine_graph_t* entry = engine_graph_for(engine, effects);
+    if (entry == NULL)
+        return -1;
+
+    image_job_t* job = job_create(engine, entry, JOB_SOURCE_PIXELS, PRIORITY_NORMAL);
+    if (job == NULL)
+        return -1;
+    engine_image_taken(engine); // releasing the job counts it out again
+
+    char name[64];
+    snprintf(name, sizeof(name), "frame-%llu",
+             (unsigned long long)atomic_fetch_add_explicit(&engine->next_submission, 1, memory_order_relaxed));
+    job->name = strdup(name);
+    job->input = malloc(row * frame->height);
+    if (job->name == NULL || job->input == NULL) {
+        image_job_release(job);
+        return -1;
+    }
+
+    for (int y = 0; y < frame->height; y++)
+        memcpy(job->input + (size_t)y * row, (const unsigned char*)frame->pixels + (size_t)y * stride, row);
+    job->input_size = row * frame->height;
+    stats_add(COUNTER_INFLIGHT_BYTES, (int64_t)job->input_size);
+
+    job->width = frame->width;
+    job->height = frame->height;
+    job->channels = frame->channels;
+    job->format = (pixel_format_t)frame->format;
+    job->complete = complete;
+    job->user = user;
+    return submit_job(engine, job);
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <uthash.h>
+
+#include "ppxl.h"
+#include "image.h"
+#include "image_queue.h"
+#include "file_tracker.h"
+#include "decode_retry.h"
+#include "effect_graph.h"
+#include "priority.h"
+#include "stats.h"
+
+/*
+The state of one pipeline, which every stage reaches through the engine (thread arguments) or through the job
+of the image it works on (`chunk->job`). Only statistics, tracing and the priority rules of watched files are
+shared by the whole process.
+
+Every image in flight is a job. The chunker creates the jobs of watched files once it takes their name off the
+name queue; submissions bring theirs. Each chunk holds a reference to its job, so the job lives until the last
+chunk of the image is gone, whether it was written, dropped or still queued at shutdown. A job completes once
+every output of its effect graph is delivered: written (watched files) or handed to the callback (submissions),
+or failed. An output that is still pending when the last reference goes fails with PPXL_ERROR_SHUTDOWN.
+*/
+
+typedef enum {
+    JOB_SOURCE_FILE,   // a watched file, read from and written to disk
+    JOB_SOURCE_BUFFER, // an encoded image in memory
+    JOB_SOURCE_PIXELS, // a raw frame
+} job_source_t;
+
+typedef struct image_job {
+    ppxl_engine_t* engine;
+    const effect_graph_t* graph;
+    struct engine_output** outputs; // counters of each branch of `graph`
+    char* name;                    // file path, or a generated "buffer-N.<ext>" (the extension picks the encoder) / "frame-N"
+    job_source_t source;
+    priority_t priority;
+    uint64_t image_seq;            // set by the chunker that takes the job, see `image_chunk_t`
+
+    unsigned char* input;          // BUFFER: the encoded image; PIXELS: packed samples; NULL for files
+    size_t input_size;
+    int width, height, channels;   // PIXELS only
+    pixel_format_t format;
+
+    ppxl_complete_fn complete;     // submissions only
+    void* user;
+    bool retry;                    // released to be decoded again later: the image is not done
+
+    atomic_int refs;
+    atomic_bool discarded;         // chunks still on their way are dropped
+    pthread_mutex_t lock;          // guards what follows
+    bool counted;                  // counted as discarded
+    bool* delivered;               // by branch
+    size_t outputs_left;
+} image_job_t;
+
+// Counters of the outputs of one name (the branch name, which is also the file suffix), summed over every spec.
+typedef struct engine_output {
+    char* name;
+    atomic_size_t written;   // written to disk or handed to a callback
+    atomic_size_t pixels;
+    atomic_size_t bytes;     // encoded (files, buffers) or packed samples (frames)
+    UT_hash_handle hh;
+} engine_output_t;
+
+typedef struct {
+    char* spec;
+    effect_graph_t graph;
+    engine_output_t** outputs; // by branch
+    UT_hash_handle hh;
+} engine_graph_t;
+
+struct ppxl_engine {
+    volatile sig_atomic_t stop_flag;
+
+    image_name_queue_t name_queue;
+    chunk_queue_t chunker_filtering_queue;
+    chunk_queue_t filtering_reconstruction_queue;
+
+    // effect graphs by spec, parsed once; `graph` is the configured one (NULL if none)
+    engine_graph_t* graphs;
+    engine_output_t* outputs; // by name; entries are added with the graphs that name them, and never removed
+    pthread_mutex_t graphs_lock; // guards both tables
+    const engine_graph_t* graph;
+    tile_layout_policy_t tile_layout;
+
+    char* effects;
+    char* input_directory;
+    char* output_directory;
+    bool once;
+    size_t scan_threads;
+    unsigned settle_ms;
+
+    file_tracker_t processed_files;
+    decode_retries_t decode_retries;
+    atomic_bool initial_scan_complete; // the first pass over the input directory has enqueued every image it found
+
+    atomic_size_t images_read;
+    atomic_size_t images_processed;    // every output written
+    atomic_size_t outputs_written;
+    atomic_size_t images_discarded;
+    atomic_size_t pixels_written;
+    atomic_uint_fast64_t next_image_seq;
+    atomic_uint_fast64_t next_submission;
+
+    // images taken in (found in the input directory, or submitted) that have not completed every output yet
+    size_t images_pending;
+    pthread_mutex_t pending_lock;
+    pthread_cond_t drained;
+
+    size_t num_threads;       // chunker threads, and as many filter threads
+    pthread_t watcher;
+    pthread_t* chunkers;
+    pthread_t* filters;
+    size_t num_chunkers, num_filters; // started so far
+    pthread_t* reconstruction;
+    bool watching;
+    bool running;
+};
+
+/*
+* @brief Count an image the engine has taken in, before it is queued, and out again once it is done. A job
+* counts its image out when its last output completes (unless it is released to be retried).
+*/
+void engine_image_taken(ppxl_engine_t* engine);
+void engine_image_done(ppxl_engine_t* engine);
+
+/*
+* @brief The first pass over the input directory has queued every image it found.
+*/
+void engine_scan_complete(ppxl_engine_t* engine);
+
+/*
+* @brief The effect graph of `spec`, parsed on first use (NULL: the configured one).
+* @return NULL after printing what is wrong with the spec, or if neither it nor the configured one is given.
+*/
+const engine_graph_t* engine_graph_for(ppxl_engine_t* engine, const char* spec);
+
+/*
+* @brief Create the job of a watched file that a chunker took off the name queue; it starts with one reference.
+*/
+image_job_t* image_job_for_file(ppxl_engine_t* engine, const char* path, priority_t priority);
+
+/*
+* @brief Drop the image: count it as discarded (once), and fail output `branch`, or every pending output if
+* `branch` is negative. Only the latter stops its remaining chunks, and has reconstruction let go of the tiles
+* it already collected.
+*/
+void image_job_discard(image_job_t* job, int branch, discard_reason_t reason);
+
+/*
+* @brief Deliver output `branch`: hand `result` to the callback of a submission. Outputs already delivered are left alone.
+*/
+void image_job_deliver(image_job_t* job, int branch, ppxl_result_t* result);
+
+static inline bool image_job_discarded(const image_job_t* job) {
+    return job != NULL && atomic_load_explicit(&job->discarded, memory_order_relaxed);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "image.h"
+
+/*
+Separable blurs. Every blur is a list of 1D passes run over the rows of the tile, after which the tile is
+transposed (in cache-sized blocks) and the same passes run over the rows again, so that the vertical
+passes also stream through contiguous memory. Box passes use running sums, so their cost per pixel does
+not depend on the radius; large Gaussians are approximated by three box passes for the same reason.
+
+Planar tiles are blurred one plane at a time, with the passes run down the columns instead (the plane is
+transposed for the horizontal ones): all columns advance together a row at a time, which vectorizes where
+a single channel's running sum along a row cannot. Both layouts give the same bytes.
+
+The passes run in float for every sample format (u8, u16 and f32 tiles only differ in how rows are loaded
+and stored), so 16-bit and HDR tiles are blurred at their own depth.
+
+Samples outside the tile are clamped to its edge. Inside an image the tile's halo (see `effect_graph.h`)
+must be at least `*_blur_halo()` pixels wide for the result to match a blur of the whole image.
+*/
+
+#define GAUSSIAN_EXACT_MAX_SIGMA 3.0 // above this, the Gaussian is approximated by three box passes
+#define GAUSSIAN_MAX_SIGMA 100.0
+#define BOX_BLUR_MAX_RADIUS 512
+#define BOX_BLUR_MAX_PASSES 5
+
+int gaussian_blur(image_chunk_t* chunk, double sigma);
+int box_blur(image_chunk_t* chunk, int radius, int passes);
+
+// how far, in pixels, each blur reads around a pixel
+int gaussian_blur_halo(double sigma);
+int box_blur_halo(int radius, int passes);
@@ -2,4 +2,8 @@
 
 void assign_threads_to_chunk(void);
 
+/*
+* @brief Thread entry point: run the effect graph of every tile taken off the engine's chunk queue.
+* @param arg The `ppxl_engine_t*`.
+*/
 void *process_chunk(void *arg);
\ No newline at end of file
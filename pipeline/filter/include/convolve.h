@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "image.h"
+
+/*
+2D convolution with an integer kernel: `out = sum(coeff * in) / divisor + bias`, clamped to 0..255.
+3x3, 5x5 and 7x7 kernels run through specializations whose tap loops are fully unrolled; every tap
+is a multiply-add over a whole padded row in int32, which the compiler vectorizes. Other sizes up to
+`CONVOLVE_MAX_SIZE` use a generic loop with the same structure.
+*/
+
+#define CONVOLVE_MAX_SIZE 15
+
+typedef struct {
+    int size;                                             // odd, the kernel is size x size
+    int32_t coeffs[CONVOLVE_MAX_SIZE * CONVOLVE_MAX_SIZE]; // row-major
+    int32_t divisor;                                      // never 0
+    int32_t bias;
+} convolve_kernel_t;
+
+/*
+* @brief Fill `kernel` with a named preset: "sharpen", "emboss", "edge" or "smooth".
+* @return 0 on success; -1 if the name is unknown.
+*/
+int convolve_preset(const char* name, convolve_kernel_t* kernel);
+
+int convolve(image_chunk_t* chunk, const convolve_kernel_t* kernel);
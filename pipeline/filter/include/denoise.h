@@ -0,0 +1,29 @@
+#pragma once
+
+#include "image.h"
+
+/*
+Noise reduction whose cost per pixel does not grow with the radius.
+
+`median_filter` is the Perreault–Hébert sliding histogram: every column keeps a histogram of the 2r+1
+pixels above and below the current row, and the window's histogram moves one pixel right by adding the
+column entering it and subtracting the one leaving it. Histograms are two-level (16 coarse bins, 256
+fine ones), so the median is found in at most 32 steps, and the 256-bin additions are flat uint16 loops
+the compiler vectorizes.
+
+`bilateral_filter` is the bilateral grid approximation (Paris and Durand): pixels are accumulated into a
+coarse 3D grid over position (cells of sigma_s pixels) and intensity (cells of sigma_r levels), the grid
+is blurred, and every pixel reads its result back by trilinear interpolation. Intensity is the pixel's
+luma, so colours are smoothed together; an alpha channel is left as it is. Grid cells are laid out on
+image coordinates, so tiles with the halo below give the same result as the whole image.
+*/
+
+#define MEDIAN_MAX_RADIUS 127 // window counts must fit in 16 bits
+#define BILATERAL_MAX_SIGMA_S 32
+
+int median_filter(image_chunk_t* chunk, int radius);
+
+int bilateral_filter(image_chunk_t* chunk, double sigma_s, double sigma_r);
+
+// How far from a pixel the grid cells it reads collect theirs from: half a cell, 2 cells of blur, 1 of interpolation.
+int bilateral_halo(double sigma_s);
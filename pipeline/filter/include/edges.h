@@ -0,0 +1,33 @@
+#pragma once
+
+#include "image.h"
+
+/*
+Edge detection on the luma of a tile, producing a single-channel tile.
+
+Without thresholds the result is the Sobel gradient magnitude, |gx| + |gy| divided by 4 and saturated
+at 255. With thresholds it is a Canny edge map (0 or 255): gradients are thinned to one pixel by
+non-maximum suppression along their direction, then pixels above `high` are edges, and pixels above
+`low` are edges when connected to one. Thresholds are on the |gx| + |gy| scale, 0..2040.
+
+Gradients are int16 and computed a whole row at a time from a padded copy of the luma, with no branches
+in the row loops, so the compiler vectorizes them. Connectivity for the `low` threshold is followed as
+far as the tile and its halo reach: a weak edge only linked to a strong one through another tile is
+dropped.
+*/
+
+#define EDGES_MAX_THRESHOLD 2040
+
+// Halo the detector needs: 1 pixel for the Sobel kernel, plus 1 for non-maximum suppression.
+int edges_halo(bool thresholds);
+
+/*
+* @brief Write the edge map of `chunk` (width x height, one byte per pixel) to `out`.
+* @param high 0 for the gradient magnitude, otherwise the upper Canny threshold (with `low` <= `high`).
+*/
+int edge_map(const image_chunk_t* chunk, unsigned char* out, int low, int high);
+
+/*
+* @brief Replace `chunk`'s pixels by their edge map; the chunk has a single channel afterwards.
+*/
+int edges(image_chunk_t* chunk, int low, int high);
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "image.h"
+#include "tone.h"
+
+/*
+An effect graph describes every output produced from one decoded image. It is parsed from the `-e` spec:
+
+    -e greyscale                                   one output, `<name>_processed.<ext>`
+    -e "out1=greyscale;out2=posterize:4;out3=greyscale,blur:20"
+
+Each `;`-separated branch names an output (used as the file suffix) and lists its effects, applied left to
+right. Branches with a common prefix of effects share it: the spec above runs greyscale once per tile and
+feeds the result both to out1 and to out3's blur. A tile is only copied where branches diverge, and the
+last consumer at every divergence point takes the tile itself.
+
+Most effects work on tiles as they stream through the filter threads. Effects that need the whole image
+(such as `resize`) run in reconstruction once the branch's tiles have been reassembled, so they must come
+after every tile effect of their branch: `-e "thumb=greyscale,resize:256x256"`.
+
+Runs of pointwise effects (posterize, brightness, ...) are composed into a single lookup table per branch
+when the spec is parsed, and appear as one `lut` effect in the graph; next to an effect that can absorb
+such a table (`lut3d`), they disappear into it.
+
+Neighbourhood effects (blurs, ...) read pixels around the one they write. Tiles are therefore cut with a
+halo of neighbouring pixels wide enough for the longest chain of such effects in the graph (their radii add
+up along a chain), and every tile effect processes the halo as well, so the tile's own pixels come out as
+if the whole image had been filtered. A chain may read at most EFFECT_MAX_HALO pixels around a pixel; past
+that, tiles would be mostly halo, and the spec is rejected when it is parsed.
+
+Global effects (`autolevels`, `equalize`, ...) derive a table per channel from the histogram of the whole
+image. A tile reaching one is counted into a partial histogram and parked there. The filter thread that
+counts the image's last tile merges the partials, builds the tables, and carries on with its own tile right
+away, while it hands the parked ones back to the filter queue, most recent (and most likely still cached)
+first; they resume after the global effect instead of going round through reconstruction. Pointwise
+effects right after a global effect are folded into its tables.
+
+Local effects (`clahe`) wait the same way, but each tile computes its own mapping while it is counted, and
+the tables applied in the second phase blend those of neighbouring tiles.
+
+Effects flagged `planar` also work on planar tiles (see `chunk_layout_t`), one channel at a time. Where a run
+of at least two of them starts, tiles are deinterleaved once and stay planar until an effect that needs
+interleaved pixels, or reconstruction, which re-interleaves them. When every chain starts with such a run,
+the chunker cuts the tiles as planes in the first place.
+
+Tiles of 16-bit and HDR images hold u16 or f32 samples (see `pixel_format_t`). Effects flagged `high_depth`
+take them as they are; before any other effect, the tile is converted to u8 once, and continues as u8.
+Whole-image effects work the same way on the reassembled image.
+*/
+
+#define EFFECT_MAX_PARAMS 4
+#define EFFECT_DEFAULT_OUTPUT "processed"
+#define EFFECT_PLANAR_MIN_RUN 2 // planar effects in a row that pay for deinterleaving a tile
+#define EFFECT_MAX_HALO 512      // pixels; four times the width of a tile
+
+typedef enum {
+    TILE_LAYOUT_AUTO,        // planar for runs of at least EFFECT_PLANAR_MIN_RUN planar effects (default)
+    TILE_LAYOUT_INTERLEAVED, // never deinterleave
+    TILE_LAYOUT_PLANAR,      // every planar effect runs on planes
+} tile_layout_policy_t;
+
+typedef struct effect_desc effect_desc_t;
+
+typedef struct {
+    const effect_desc_t* desc;
+    double params[EFFECT_MAX_PARAMS];
+    int num_params;
+    void* data;       // parameters that do not fit `params` (e.g. a convolution kernel), allocated by `parse`; owned by the graph
+    size_t data_size;
+} effect_t;
+
+struct effect_desc {
+    const char* name;
+    int min_params;
+    int max_params;
+    double defaults[EFFECT_MAX_PARAMS];
+    const char* usage;                                          // e.g. "posterize[:levels]"
+    const char* (*parse)(effect_t* effect, char* args);         // replaces the numeric parsing of the text after the name's ':' (NULL if none); optional
+    const char* (*validate)(const effect_t* effect);            // NULL if the parameters are fine, otherwise why not; optional
+    int (*halo)(const effect_t* effect);                        // how far around a pixel a tile effect reads; optional (0)
+    int (*apply)(const effect_t* effect, image_chunk_t* chunk); // tile effects: EXIT_SUCCESS or EXIT_FAILURE
+    void (*build_lut)(const effect_t* effect, lut_t lut, lut16_t deep); // pointwise tile effects, fused into one table at both depths (see `lut.h`)
+    bool (*absorb_lut)(effect_t* effect, const uint8_t lut[256], bool before); // folds adjacent pointwise effects into this one if it can; optional
+    void (*global_lut)(const effect_t* effect, const image_histogram_t* histogram, int channels, lut_t luts[TONE_MAX_CHANNELS]); // global effects
+    void (*tile_lut)(const effect_t* effect, const image_histogram_t* histogram, int channels, size_t pixels,
+                     lut_t luts[TONE_MAX_CHANNELS]);             // local effects: one tile's mapping from its own histogram
+    int (*apply_image)(const effect_t* effect, image_t* image); // whole-image effects, run in reconstruction; may replace the pixels
+    bool planar;                                                // `apply` also takes planar tiles
+    bool high_depth;                                            // `apply` or `apply_image` also takes u16 and f32 samples
+};
+
+typedef struct effect_node {
+    effect_t effect;                 // unused for the root
+    struct effect_node** children;
+    size_t num_children;
+    int* outputs;                    // branches whose chain ends here
+    size_t num_outputs;
+    bool planar;                     // the effect runs on planar tiles; otherwise on interleaved ones
+} effect_node_t;
+
+typedef struct {
+    char* name;
+    effect_t* effects;
+    size_t num_effects;
+    size_t num_tile_effects; // `effects` holds the tile effects first, then the whole-image ones
+} effect_branch_t;
+
+typedef struct {
+    effect_branch_t* branches;
+    size_t num_branches;
+    effect_node_t root;
+    int halo; // width of the halo tiles need, see above
+    bool planar_tiles; // the chunker cuts planar tiles, see above
+    struct effect_gathers* gathers; // tiles parked at global and local effects, per image
+} effect_graph_t;
+
+/*
+* @brief Parse an effect spec into `graph`.
+* @return 0 on success; -1 after printing what is wrong with the spec to stderr.
+*/
+int effect_graph_parse(const char* spec, effect_graph_t* graph);
+void effect_graph_free(effect_graph_t* graph);
+
+/*
+* @brief Choose again which effects run on planar tiles; `effect_graph_parse` applies TILE_LAYOUT_AUTO.
+*/
+void effect_graph_set_tile_layout(effect_graph_t* graph, tile_layout_policy_t policy);
+
+/*
+* @brief Run every branch of `graph` on `chunk` and hand each result to `emit`, with `chunk->branch` set.
+* Tiles parked at a global or local effect are handed to `requeue` once their image's statistics are complete, and
+* continue from there when they are passed back in (`chunk->resume` is set).
+* @note Takes ownership of `chunk`; `emit` and `requeue` take ownership of the chunks they receive.
+* @return EXIT_SUCCESS, or EXIT_FAILURE if an effect failed.
+*/
+int effect_graph_run(const effect_graph_t* graph, image_chunk_t* chunk,
+                     void (*emit)(image_chunk_t* chunk), void (*requeue)(image_chunk_t* chunk));
+
+/*
+* @brief Free the tiles of image `image_seq` parked at global and local effects whose statistics are still
+* incomplete, once the image is discarded; tiles of it that arrive later are not parked (`chunk->job`).
+*/
+void effect_graph_drop_image(const effect_graph_t* graph, uint64_t image_seq);
+
+/*
+* @brief Free a tile instead of running it, releasing the global or local effect it was parked at, if any.
+*/
+void effect_graph_drop_tile(const effect_graph_t* graph, image_chunk_t* chunk);
+
+/*
+* @brief Apply the whole-image effects of `branch` to its reassembled `image`.
+* @return EXIT_SUCCESS, or EXIT_FAILURE if an effect failed.
+*/
+int effect_graph_finish(const effect_graph_t* graph, int branch, image_t* image);
+
+/*
+* @brief Print the names and parameters of every known effect.
+*/
+void effect_print_available(FILE* out);
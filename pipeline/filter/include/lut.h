@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "image.h"
+
+/*
+Pointwise effects (each output value depends only on the same channel's input value) are described by
+a 256-entry lookup table. Consecutive pointwise effects of a branch are composed into a single table
+when the effect graph is parsed, so a chain of them costs one lookup per value, whatever its length.
+Tables apply to the colour channels; an alpha channel is left as it is.
+
+u16 and f32 tiles keep their depth: they read a 65536-entry table of the same effects evaluated at 16 bits
+(`lut16_t`), directly for u16 and by linear interpolation between entries for f32. Steps such as `threshold`
+or `posterize` therefore stay steps, where reading the 8-bit table between its entries would make ramps.
+The parameters of the 16-bit tables are on the 8-bit scale of the effects, as given in a spec.
+*/
+
+typedef uint8_t lut_t[256];
+typedef uint16_t lut16_t[65536];
+
+void lut_identity(lut_t lut);
+
+// `lut` becomes `next` applied after `lut`
+void lut_compose(lut_t lut, const lut_t next);
+
+void lut_posterize(lut_t lut, int levels);
+void lut_brightness(lut_t lut, double delta);
+void lut_contrast(lut_t lut, double factor);
+void lut_gamma(lut_t lut, double gamma);
+void lut_invert(lut_t lut);
+void lut_threshold(lut_t lut, double level);
+void lut_levels(lut_t lut, double black, double white, double gamma);
+
+void lut16_identity(lut16_t lut);
+void lut16_compose(lut16_t lut, const lut16_t next);
+
+void lut16_posterize(lut16_t lut, int levels);
+void lut16_brightness(lut16_t lut, double delta);
+void lut16_contrast(lut16_t lut, double factor);
+void lut16_gamma(lut16_t lut, double gamma);
+void lut16_invert(lut16_t lut);
+void lut16_threshold(lut16_t lut, double level);
+void lut16_levels(lut16_t lut, double black, double white, double gamma);
+
+/*
+* @brief Map the colour samples of `chunk` through `lut`, or through `deep` for u16 and f32 tiles.
+* @param deep The same mapping at 16 bits; may be NULL for u8 tiles only.
+*/
+int apply_lut(image_chunk_t* chunk, const lut_t lut, const lut16_t deep);
+
+// One table per channel, alpha included (`luts[channel]`).
+int apply_channel_luts(image_chunk_t* chunk, const lut_t* luts);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "image.h"
+#include "lut.h"
+
+/*
+3D colour lookup tables, as exported by grading tools in the `.cube` format. The cube is loaded once, into
+lattice points of four 16-bit values (R, G, B, padding) so that each corner is one aligned 8-byte load.
+Each output pixel is interpolated tetrahedrally from four corners of the lattice cell around it. Where the
+cell starts and how far into it a value lies is looked up per channel in 256-entry tables. A 1D table
+applied before the cube (`pre`) is folded into those lookups, and one applied after it (`post`) into the
+final store, so that neighbouring pointwise effects cost nothing extra.
+*/
+
+#define LUT3D_MAX_SIZE 256
+
+typedef struct {
+    int size;                   // lattice points per axis
+    float domain_min[3];
+    float domain_max[3];
+    lut_t pre;                  // pointwise effects before the cube
+    lut_t post;                 // pointwise effects after the cube
+    uint32_t offset[3][256];    // per channel and input value: lattice index of the lower cell corner, along that axis
+    uint16_t frac[3][256];      // per channel and input value: position inside the cell, 0..1024
+    uint16_t points[][4];       // size^3 lattice points, red varying fastest; values 0..255 << 6
+} lut3d_t;
+
+/*
+* @brief Load a `.cube` file. `LUT_3D_INPUT_RANGE min max` sets the domain of all three channels, as
+* `DOMAIN_MIN`/`DOMAIN_MAX` do per channel; other unknown keywords are skipped with a warning.
+* @param size_bytes Set to the size of the returned allocation.
+* @return The table (the caller frees it), or NULL after printing why the file cannot be used.
+*/
+lut3d_t* lut3d_load(const char* path, size_t* size_bytes);
+
+// `pre`/`post` are composed with whatever the table already applies before/after the cube
+void lut3d_compose_pre(lut3d_t* lut3d, const lut_t pre);
+void lut3d_compose_post(lut3d_t* lut3d, const lut_t post);
+
+int apply_lut3d(image_chunk_t* chunk, const lut3d_t* lut3d);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+Separable resampling of whole images: a horizontal pass into a temporary image, then a vertical pass.
+The per-axis filter taps are computed once per call, widened by the scale factor when shrinking so that
+downscaling averages over every source pixel instead of skipping some (no aliasing), and stored as 14-bit
+fixed-point weights so that the inner loops are plain integer multiply-adds the compiler vectorizes.
+*/
+
+typedef enum {
+    RESAMPLE_BOX,
+    RESAMPLE_BILINEAR,
+    RESAMPLE_LANCZOS3,
+    RESAMPLE_KERNEL_COUNT
+} resample_kernel_t;
+
+#define RESAMPLE_DEFAULT_KERNEL RESAMPLE_LANCZOS3
+
+const char* resample_kernel_name(resample_kernel_t kernel);
+
+/*
+* @brief Look up a kernel by name ("box", "bilinear" or "lanczos").
+* @return 0 on success; -1 if the name is unknown.
+*/
+int resample_kernel_from_name(const char* name, resample_kernel_t* kernel);
+
+/*
+* @brief Resample `src` (`src_width` x `src_height`, interleaved) into `dst` (`dst_width` x `dst_height`, same channels).
+* @return EXIT_SUCCESS, or EXIT_FAILURE if the temporary buffers cannot be allocated.
+*/
+int resample(const unsigned char* src, size_t src_width, size_t src_height, int channels,
+             unsigned char* dst, size_t dst_width, size_t dst_height, resample_kernel_t kernel);
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "image.h"
+#include "lut.h"
+
+/*
+Tone effects that depend on statistics of the whole image (auto-levels, white balance, histogram
+equalization). They run in two phases: every tile first counts its pixels into a partial histogram, and
+once the image's last tile has been counted, the partials are merged and turned into one table per
+channel, which is then applied to every tile like any pointwise effect. See `effect_graph.h` for how
+tiles wait between the two phases.
+
+CLAHE (contrast-limited adaptive histogram equalization) works the same way on the chunker's tile grid:
+every tile turns its own clipped histogram into a mapping in phase 1, and in phase 2 each pixel blends
+the mappings of the four tiles whose centres surround it, so that no seams show between tiles.
+*/
+
+#define TONE_MAX_CHANNELS 4
+
+typedef struct {
+    uint32_t counts[TONE_MAX_CHANNELS][256];
+} image_histogram_t;
+
+/*
+* @brief Count the colour values of `chunk`'s own pixels (not its halo) into `histogram`, which is cleared first.
+* @return The number of pixels counted.
+*/
+size_t image_histogram_of_chunk(image_histogram_t* histogram, const image_chunk_t* chunk);
+
+// `into` += `other`
+void image_histogram_merge(image_histogram_t* into, const image_histogram_t* other);
+
+/*
+* @brief Merge `partials[0..count)` pairwise, in log2(count) rounds, into `partials[0]`.
+*/
+void image_histogram_reduce(image_histogram_t* partials, size_t count);
+
+// The colour channels of an image with `channels` channels: the last one is alpha when there are 2 or 4.
+int tone_colour_channels(int channels);
+
+/*
+* Each builder fills one table per channel of an image with `channels` channels; an alpha channel gets the identity.
+* `clip` is the percentage of pixels allowed to saturate at each end of the range.
+*/
+
+// Stretches the range shared by the colour channels to 0..255, which keeps their balance.
+void tone_autolevels(const image_histogram_t* histogram, int channels, double clip, lut_t luts[TONE_MAX_CHANNELS]);
+
+// Stretches every colour channel to 0..255 on its own, which also removes a colour cast.
+void tone_whitebalance(const image_histogram_t* histogram, int channels, double clip, lut_t luts[TONE_MAX_CHANNELS]);
+
+// Spreads every channel's values so that their cumulative distribution becomes linear.
+void tone_equalize(const image_histogram_t* histogram, int channels, lut_t luts[TONE_MAX_CHANNELS]);
+
+/*
+* @brief Equalize one tile's `histogram` of `pixels` pixels, with no value allowed more than `clip` times its even share
+* (the excess is spread over all values); this limits how much noise in flat areas gets amplified.
+*/
+void tone_clahe_tile(const image_histogram_t* histogram, int channels, size_t pixels, double clip, lut_t luts[TONE_MAX_CHANNELS]);
+
+/*
+* @brief Map every pixel of `chunk`, halo included, by blending the mappings of the four nearest tiles of its image.
+* @param tile_luts One set of tables per tile of the image, by `chunk_id`.
+*/
+int apply_clahe(image_chunk_t* chunk, const lut_t (*tile_luts)[TONE_MAX_CHANNELS]);
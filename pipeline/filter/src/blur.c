@@ -0,0 +1,293 @@
+#include "blur.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "macros.h"
+
+#define MAX_PASSES (BOX_BLUR_MAX_PASSES > 3? BOX_BLUR_MAX_PASSES: 3)
+#define MAX_CHANNELS 4
+#define TRANSPOSE_BLOCK 16 // pixels; a 16x16 block of RGBA floats is 4 KiB
+
+typedef struct {
+    int radius;
+    float* weights; // 2 * radius + 1 taps, or NULL for a box
+} blur_pass_t;
+
+typedef struct {
+    blur_pass_t passes[MAX_PASSES];
+    int num_passes;
+} blur_plan_t;
+
+static inline int clamp_index(int i, int n) {
+    return i < 0? 0: i >= n? n - 1: i;
+}
+
+// Running-sum box filter over one row of `n` interleaved pixels.
+static void box_line(const float* in, float* out, int n, int channels, int radius) {
+    float scale = 1.0f / (2 * radius + 1);
+    double sum[MAX_CHANNELS] = {0};
+
+    for (int j = -radius; j <= radius; j++)
+        for (int c = 0; c < channels; c++)
+            sum[c] += in[clamp_index(j, n) * channels + c];
+
+    for (int i = 0; i < n; i++) {
+        for (int c = 0; c < channels; c++)
+            out[i * channels + c] = (float)(sum[c] * scale);
+
+        const float* enter = in + clamp_index(i + radius + 1, n) * channels;
+        const float* leave = in + clamp_index(i - radius, n) * channels;
+        for (int c = 0; c < channels; c++)
+            sum[c] += enter[c] - leave[c];
+    }
+}
+
+static void kernel_line(const float* in, float* out, int n, int channels, int radius, const float* weights) {
+    for (int i = 0; i < n; i++) {
+        float sum[MAX_CHANNELS] = {0};
+
+        if (i >= radius && i + radius < n) { // no clamping needed in the middle of the row
+            const float* first = in + (i - radius) * channels;
+            for (int k = 0; k <= 2 * radius; k++)
+                for (int c = 0; c < channels; c++)
+                    sum[c] += weights[k] * first[k * channels + c];
+        } else {
+            for (int k = 0; k <= 2 * radius; k++) {
+                const float* pixel = in + clamp_index(i + k - radius, n) * channels;
+                for (int c = 0; c < channels; c++)
+                    sum[c] += weights[k] * pixel[c];
+            }
+        }
+
+        for (int c = 0; c < channels; c++)
+            out[i * channels + c] = sum[c];
+    }
+}
+
+// Run every pass of `plan` over each of the `rows` rows of `*a`; the result ends up in `*a`, `*b` is scratch.
+static void run_passes(const blur_plan_t* plan, float** a, float** b, int width, int rows, int channels) {
+    for (int p = 0; p < plan->num_passes; p++) {
+        const blur_pass_t* pass = &plan->passes[p];
+        for (int y = 0; y < rows; y++) {
+            const float* in = *a + (size_t)y * width * channels;
+            float* out = *b + (size_t)y * width * channels;
+            if (pass->weights == NULL) box_line(in, out, width, channels, pass->radius);
+            else                       kernel_line(in, out, width, channels, pass->radius, pass->weights);
+        }
+        float* swap = *a; *a = *b; *b = swap;
+    }
+}
+
+/*
+* The same filters down the columns of a single-channel image: every column is a line of its own, and all
+* of them advance together, one row at a time, so the work vectorizes across the row. Each line sees the
+* same operations, in the same order, as it would in `box_line` or `kernel_line`.
+*/
+static void box_columns(const float* in, float* out, int width, int rows, int radius, double* sum) {
+    float scale = 1.0f / (2 * radius + 1);
+
+    for (int x = 0; x < width; x++) sum[x] = 0;
+    for (int j = -radius; j <= radius; j++) {
+        const float* row = in + (size_t)clamp_index(j, rows) * width;
+        for (int x = 0; x < width; x++) sum[x] += row[x];
+    }
+
+    for (int y = 0; y < rows; y++) {
+        float* row = out + (size_t)y * width;
+        for (int x = 0; x < width; x++) row[x] = (float)(sum[x] * scale);
+
+        const float* enter = in + (size_t)clamp_index(y + radius + 1, rows) * width;
+        const float* leave = in + (size_t)clamp_index(y - radius, rows) * width;
+        for (int x = 0; x < width; x++) sum[x] += enter[x] - leave[x];
+    }
+}
+
+static void kernel_columns(const float* in, float* out, int width, int rows, int radius, const float* weights) {
+    for (int y = 0; y < rows; y++) {
+        float* row = out + (size_t)y * width;
+        for (int x = 0; x < width; x++) row[x] = 0;
+
+        for (int k = 0; k <= 2 * radius; k++) {
+            const float* tap = in + (size_t)clamp_index(y + k - radius, rows) * width;
+            const float weight = weights[k];
+            for (int x = 0; x < width; x++) row[x] += weight * tap[x];
+        }
+    }
+}
+
+static void run_passes_down(const blur_plan_t* plan, float** a, float** b, int width, int rows, double* sum) {
+    for (int p = 0; p < plan->num_passes; p++) {
+        const blur_pass_t* pass = &plan->passes[p];
+        if (pass->weights == NULL) box_columns(*a, *b, width, rows, pass->radius, sum);
+        else                       kernel_columns(*a, *b, width, rows, pass->radius, pass->weights);
+        float* swap = *a; *a = *b; *b = swap;
+    }
+}
+
+// `in` is `width` x `height`, `out` becomes `height` x `width`.
+static void transpose(const float* in, float* out, int width, int height, int channels) {
+    for (int by = 0; by < height; by += TRANSPOSE_BLOCK) {
+        for (int bx = 0; bx < width; bx += TRANSPOSE_BLOCK) {
+            int y_end = by + TRANSPOSE_BLOCK < height? by + TRANSPOSE_BLOCK: height;
+            int x_end = bx + TRANSPOSE_BLOCK < width? bx + TRANSPOSE_BLOCK: width;
+            for (int y = by; y < y_end; y++)
+                for (int x = bx; x < x_end; x++)
+                    for (int c = 0; c < channels; c++)
+                        out[((size_t)x * height + y) * channels + c] = in[((size_t)y * width + x) * channels + c];
+        }
+    }
+}
+
+/*
+* Tiles are blurred in float whatever their samples are; these move the rows of one sample type in and out,
+* rounding and saturating integer samples on the way back. f32 ones are stored as they are, highlights above
+* 1.0 included.
+*/
+#define DEFINE_ROWS_IO(SUFFIX, TYPE, ROUND, STORE)                                                      \
+static void load_rows_##SUFFIX(const unsigned char* restrict pixels, size_t stride, size_t row, int height, float* restrict out) { \
+    for (int y = 0; y < height; y++) {                                                                  \
+        const TYPE* in = (const TYPE*)(pixels + (size_t)y * stride);                                    \
+        for (size_t i = 0; i < row; i++) out[y * row + i] = in[i];                                      \
+    }                                                                                                   \
+}                                                                                                       \
+static void store_rows_##SUFFIX(const float* restrict in, size_t row, int height, unsigned char* restrict pixels, size_t stride) { \
+    for (int y = 0; y < height; y++) {                                                                  \
+        TYPE* out = (TYPE*)(pixels + (size_t)y * stride);                                               \
+        for (size_t i = 0; i < row; i++) {                                                              \
+            float value = in[y * row + i] + (ROUND);                                                    \
+            out[i] = (STORE);                                                                           \
+        }                                                                                               \
+    }                                                                                                   \
+}
+
+DEFINE_ROWS_IO(u8,  uint8_t,  0.5f, (uint8_t)(value < 0? 0: value > 255? 255: value))
+DEFINE_ROWS_IO(u16, uint16_t, 0.5f, (uint16_t)(value < 0? 0: value > 65535? 65535: value))
+DEFINE_ROWS_IO(f32, float,    0,    value)
+
+static const struct {
+    void (*load)(const unsigned char* pixels, size_t stride, size_t row, int height, float* out);
+    void (*store)(const float* in, size_t row, int height, unsigned char* pixels, size_t stride);
+} rows_io[] = {
+    [PIXEL_FORMAT_U8]  = { load_rows_u8,  store_rows_u8 },
+    [PIXEL_FORMAT_U16] = { load_rows_u16, store_rows_u16 },
+    [PIXEL_FORMAT_F32] = { load_rows_f32, store_rows_f32 },
+};
+
+static int run_plan(image_chunk_t* chunk, const blur_plan_t* plan) {
+    if (!chunk || !chunk->pixel_data) {
+        FPRINTF(stderr, "Error: chunk or pixel_data is NULL\n");
+        return EXIT_FAILURE;
+    }
+    if (chunk->channels > MAX_CHANNELS) {
+        FPRINTF(stderr, "Error: blur supports up to %d channels\n", MAX_CHANNELS);
+        return EXIT_FAILURE;
+    }
+
+    // planar tiles are blurred one plane at a time, as single-channel images
+    bool planar = chunk->layout == CHUNK_LAYOUT_PLANAR;
+    int width = chunk->width;
+    int height = chunk->height;
+    int channels = planar? 1: chunk->channels;
+    int planes = planar? chunk->channels: 1;
+    size_t row = (size_t)width * channels;
+    size_t count = row * height;
+
+    float* a = malloc(count * sizeof(float));
+    float* b = malloc(count * sizeof(float));
+    double* sum = planar? malloc((width > height? width: height) * sizeof(double)): NULL;
+    if (!a || !b || (planar && !sum)) {
+        FPRINTF(stderr, "Error: failed to allocate blur buffers\n");
+        free(a);
+        free(b);
+        free(sum);
+        return EXIT_FAILURE;
+    }
+
+    for (int p = 0; p < planes; p++) {
+        unsigned char* pixels = planar? chunk_plane(chunk, p): chunk->pixel_data;
+
+        rows_io[chunk->format].load(pixels, chunk->stride, row, height, a);
+
+        if (planar) { // a single channel: run the passes down the columns, where they vectorize
+            transpose(a, b, width, height, 1);
+            run_passes_down(plan, &b, &a, height, width, sum); // horizontal, on the transposed plane
+            transpose(b, a, height, width, 1);
+            run_passes_down(plan, &a, &b, width, height, sum); // vertical
+        } else {
+            run_passes(plan, &a, &b, width, height, channels);  // horizontal
+            transpose(a, b, width, height, channels);
+            run_passes(plan, &b, &a, height, width, channels);  // vertical, on the transposed tile
+            transpose(b, a, height, width, channels);
+        }
+
+        rows_io[chunk->format].store(a, row, height, pixels, chunk->stride);
+    }
+
+    free(a);
+    free(b);
+    free(sum);
+    return EXIT_SUCCESS;
+}
+
+/*
+* Box radii whose three passes best match a Gaussian of standard deviation `sigma`
+* (Kovesi, "Fast Almost-Gaussian Filtering").
+*/
+static void gaussian_boxes(double sigma, int radii[3]) {
+    const int n = 3;
+    double ideal = sqrt(12.0 * sigma * sigma / n + 1);
+    int lower = (int)floor(ideal);
+    if (lower % 2 == 0) lower--;
+    int upper = lower + 2;
+    int m = (int)lround((12.0 * sigma * sigma - n * lower * lower - 4.0 * n * lower - 3.0 * n) / (-4.0 * lower - 4));
+
+    for (int i = 0; i < n; i++)
+        radii[i] = ((i < m)? lower: upper) / 2;
+}
+
+int gaussian_blur_halo(double sigma) {
+    if (sigma <= GAUSSIAN_EXACT_MAX_SIGMA)
+        return (int)ceil(3 * sigma);
+
+    int radii[3];
+    gaussian_boxes(sigma, radii);
+    return radii[0] + radii[1] + radii[2];
+}
+
+int box_blur_halo(int radius, int passes) {
+    return radius * passes;
+}
+
+int gaussian_blur(image_chunk_t* chunk, double sigma) {
+    blur_plan_t plan = {0};
+
+    if (sigma > GAUSSIAN_EXACT_MAX_SIGMA) {
+        int radii[3];
+        gaussian_boxes(sigma, radii);
+        for (int i = 0; i < 3; i++)
+            plan.passes[plan.num_passes++] = (blur_pass_t){ radii[i], NULL };
+        return run_plan(chunk, &plan);
+    }
+
+    int radius = (int)ceil(3 * sigma);
+    float weights[2 * (int)(3 * GAUSSIAN_EXACT_MAX_SIGMA + 1) + 1];
+    float total = 0;
+    for (int k = -radius; k <= radius; k++) {
+        weights[k + radius] = expf(-(float)(k * k) / (float)(2 * sigma * sigma));
+        total += weights[k + radius];
+    }
+    for (int k = 0; k <= 2 * radius; k++)
+        weights[k] /= total;
+
+    plan.passes[plan.num_passes++] = (blur_pass_t){ radius, weights };
+    return run_plan(chunk, &plan);
+}
+
+int box_blur(image_chunk_t* chunk, int radius, int passes) {
+    blur_plan_t plan = {0};
+    for (int i = 0; i < passes && i < BOX_BLUR_MAX_PASSES; i++)
+        plan.passes[plan.num_passes++] = (blur_pass_t){ radius, NULL };
+    return run_plan(chunk, &plan);
+}
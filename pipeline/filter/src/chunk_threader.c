@@ -6,52 +6,56 @@
 #include <image_chunker.h>
 #include <chunk_threader.h>
 #include <filter.h>
+#include <effect_graph.h>
 
+#include "engine.h"
 #include "macros.h"
+#include "stats.h"
+#include "trace.h"
 
-extern volatile sig_atomic_t stop_flag;
-extern const char* out_directory;
-extern const char* effects;
+static void emit_filtered_chunk(image_chunk_t* chunk) {
+    // Enqueue the filtered chunk into the next queue
+    if (chunk_enqueue(&chunk->job->engine->filtering_reconstruction_queue, chunk) != 0) {
+        FPRINTF(stderr, "Error: Failed to enqueue filtered chunk (ID: %d).\n", chunk->chunk_id);
+        free_image_chunk(chunk); // Free the chunk if enqueueing fails
+    }
+}
+
+// Tiles parked at a global or local effect go back to the front of the pipeline's filter stage, see `effect_graph.h`
+static void requeue_parked_chunk(image_chunk_t* chunk) {
+    if (chunk_enqueue(&chunk->job->engine->chunker_filtering_queue, chunk) != 0) {
+        FPRINTF(stderr, "Error: Failed to requeue parked chunk (ID: %d).\n", chunk->chunk_id);
+        free_image_chunk(chunk);
+    }
+}
 
 void *process_chunk(void *arg) {
-    while (!stop_flag) {
-        image_chunk_t *chunk = chunk_dequeue(&chunker_filtering_queue);
-        
+    ppxl_engine_t* engine = (ppxl_engine_t*)arg;
+    trace_thread_name("filter");
+
+    while (!engine->stop_flag) {
+        image_chunk_t *chunk = chunk_dequeue(&engine->chunker_filtering_queue);
         
-        if (chunk == NULL || stop_flag || discarded_images_table_contains(chunk->original_image_name)) {
-            // If the queue is empty, image discarded, wait or check for stop_flag
+        if (chunk == NULL) 
+            continue; // the queue is empty and the pipeline stopping
+
+        if (engine->stop_flag || image_job_discarded(chunk->job)) {
+            effect_graph_drop_tile(chunk->job->graph, chunk);
             continue;
         }
-        
-        if (!effects) {
-            stop_flag =1;
-            continue;;
-        }
-        
-        int filter_result = EXIT_FAILURE;
-        if (strcmp(effects, "greyscale") == 0) {
-            filter_result = greyscale(chunk);
-        } else if (strcmp(effects, "posterize") == 0) {
-            filter_result = posterize(chunk, 4);
-        } else if (strcmp(effects, "directional_blur") == 0) {
-            filter_result = directional_blur(chunk, 50);
-        } else {
-            FPRINTF(stderr, "Unknown effect: %s\n", effects);
-            stop_flag = 1;
-            continue;;
-        }
 
-        if (filter_result != EXIT_SUCCESS) {
-            stop_flag = 1;
-            continue;;
-        }
-        
-        // Enqueue the filtered chunk into the next queue
-        if (chunk_enqueue(&filtering_reconstruction_queue, chunk) != 0) {
-            FPRINTF(stderr, "Error: Failed to enqueue filtered chunk (ID: %d).\n", chunk->chunk_id);
-            free_image_chunk(chunk); // Free the chunk if enqueueing fails
-            chunk = NULL;
-        }
+        // the run hands the chunk on, so hold the job for as long as a failure may need it
+        image_job_t* job = chunk->job;
+        image_job_retain(job);
+
+        uint64_t filter_start = now_ns();
+        int filter_result = effect_graph_run(job->graph, chunk, emit_filtered_chunk, requeue_parked_chunk);
+        stats_record_stage(STAGE_FILTER, now_ns() - filter_start);
+
+        // an effect failed (or ran out of memory) on one of the image's tiles: the image is lost, the pipeline goes on
+        if (filter_result != EXIT_SUCCESS)
+            image_job_discard(job, -1, DISCARD_EFFECT);
+        image_job_release(job);
     }
 
     return NULL;
@@ -0,0 +1,133 @@
+#include "convolve.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "macros.h"
+
+static const struct {
+    const char* name;
+    int32_t coeffs[9];
+    int32_t divisor;
+    int32_t bias;
+} presets[] = {
+    { "sharpen", {  0, -1,  0, -1,  5, -1,  0, -1,  0 },  1, 0 },
+    { "emboss",  { -2, -1,  0, -1,  1,  1,  0,  1,  2 },  1, 0 },
+    { "edge",    { -1, -1, -1, -1,  8, -1, -1, -1, -1 },  1, 0 },
+    { "smooth",  {  1,  2,  1,  2,  4,  2,  1,  2,  1 }, 16, 0 },
+};
+
+int convolve_preset(const char* name, convolve_kernel_t* kernel) {
+    for (size_t i = 0; i < sizeof(presets) / sizeof(presets[0]); i++) {
+        if (strcmp(name, presets[i].name) == 0) {
+            memset(kernel, 0, sizeof(*kernel));
+            kernel->size = 3;
+            memcpy(kernel->coeffs, presets[i].coeffs, sizeof(presets[i].coeffs));
+            kernel->divisor = presets[i].divisor;
+            kernel->bias = presets[i].bias;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+* @brief Copy the tile (or one plane of it) into `padded`, with `radius` extra rows/columns on every side
+* repeating its edge pixels, so that the kernels below never need to check bounds.
+*/
+static void pad_tile(const unsigned char* pixels, size_t stride, int width, int height, int channels, int radius,
+                     unsigned char* padded) {
+    size_t padded_row = (size_t)(width + 2 * radius) * channels;
+
+    for (int y = -radius; y < height + radius; y++) {
+        int sy = y < 0? 0: y >= height? height - 1: y;
+        const unsigned char* src = pixels + (size_t)sy * stride;
+        unsigned char* dst = padded + (size_t)(y + radius) * padded_row;
+
+        for (int x = 0; x < radius; x++) {
+            memcpy(dst + x * channels, src, channels);
+            memcpy(dst + (size_t)(radius + width + x) * channels, src + (size_t)(width - 1) * channels, channels);
+        }
+        memcpy(dst + (size_t)radius * channels, src, (size_t)width * channels);
+    }
+}
+
+static inline void store_row(unsigned char* out, const int32_t* acc, size_t length, float scale, int32_t bias) {
+    for (size_t i = 0; i < length; i++) {
+        float value = acc[i] * scale + bias + 0.5f;
+        out[i] = (unsigned char)(value < 0? 0: value > 255? 255: value);
+    }
+}
+
+/*
+* One output row: for every tap, accumulate `coeff * row` over the whole row. With `SIZE` known at compile
+* time the two tap loops unroll completely and only the contiguous inner loop remains.
+*/
+#define DEFINE_CONVOLVE_ROW(NAME, SIZE)                                                              \
+static void NAME(const unsigned char* padded, size_t padded_row, int channels, int size,            \
+                 const int32_t* coeffs, int32_t* acc, size_t length) {                              \
+    const int n = (SIZE)? (SIZE): size;                                                             \
+    memset(acc, 0, length * sizeof(int32_t));                                                       \
+    for (int ky = 0; ky < n; ky++) {                                                                \
+        const unsigned char* row = padded + (size_t)ky * padded_row;                                \
+        for (int kx = 0; kx < n; kx++) {                                                            \
+            const int32_t coeff = coeffs[ky * n + kx];                                              \
+            const unsigned char* in = row + (size_t)kx * channels;                                  \
+            for (size_t i = 0; i < length; i++)                                                     \
+                acc[i] += coeff * in[i];                                                            \
+        }                                                                                           \
+    }                                                                                               \
+}
+
+DEFINE_CONVOLVE_ROW(convolve_row_3, 3)
+DEFINE_CONVOLVE_ROW(convolve_row_5, 5)
+DEFINE_CONVOLVE_ROW(convolve_row_7, 7)
+DEFINE_CONVOLVE_ROW(convolve_row_n, 0)
+
+typedef void (*convolve_row_fn)(const unsigned char*, size_t, int, int, const int32_t*, int32_t*, size_t);
+
+int convolve(image_chunk_t* chunk, const convolve_kernel_t* kernel) {
+    if (!chunk || !chunk->pixel_data) {
+        FPRINTF(stderr, "Error: chunk or pixel_data is NULL\n");
+        return EXIT_FAILURE;
+    }
+
+    // planar tiles are convolved one plane at a time, as single-channel images
+    bool planar = chunk->layout == CHUNK_LAYOUT_PLANAR;
+    int radius = kernel->size / 2;
+    int channels = planar? 1: chunk->channels;
+    int planes = planar? chunk->channels: 1;
+    size_t length = chunk->width * channels;
+    size_t padded_row = (chunk->width + 2 * radius) * channels;
+
+    unsigned char* padded = malloc(padded_row * (chunk->height + 2 * radius));
+    int32_t* acc = malloc(length * sizeof(int32_t));
+    if (!padded || !acc) {
+        FPRINTF(stderr, "Error: failed to allocate convolution buffers\n");
+        free(padded);
+        free(acc);
+        return EXIT_FAILURE;
+    }
+
+    convolve_row_fn row_fn = convolve_row_n;
+    switch (kernel->size) {
+        case 3: row_fn = convolve_row_3; break;
+        case 5: row_fn = convolve_row_5; break;
+        case 7: row_fn = convolve_row_7; break;
+    }
+
+    float scale = 1.0f / kernel->divisor;
+    for (int p = 0; p < planes; p++) {
+        unsigned char* pixels = planar? chunk_plane(chunk, p): chunk->pixel_data;
+        pad_tile(pixels, chunk->stride, chunk->width, chunk->height, channels, radius, padded);
+
+        for (size_t y = 0; y < chunk->height; y++) {
+            row_fn(padded + y * padded_row, padded_row, channels, kernel->size, kernel->coeffs, acc, length);
+            store_row(pixels + y * chunk->stride, acc, length, scale, kernel->bias);
+        }
+    }
+
+    free(padded);
+    free(acc);
+    return EXIT_SUCCESS;
+}
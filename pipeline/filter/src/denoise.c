@@ -0,0 +1,251 @@
+#include "denoise.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "macros.h"
+
+// #######################################
+// # Median
+// #######################################
+
+typedef struct {
+    uint16_t coarse[16]; // coarse[b] counts the values b * 16 .. b * 16 + 15
+    uint16_t fine[256];
+} median_hist_t;
+
+static inline void hist_insert(median_hist_t* h, uint8_t value) {
+    h->coarse[value >> 4]++;
+    h->fine[value]++;
+}
+
+static inline void hist_remove(median_hist_t* h, uint8_t value) {
+    h->coarse[value >> 4]--;
+    h->fine[value]--;
+}
+
+// `into` += `add` - `sub`
+static inline void hist_slide(median_hist_t* restrict into, const median_hist_t* restrict add, const median_hist_t* restrict sub) {
+    for (int b = 0; b < 16; b++) into->coarse[b] += add->coarse[b] - sub->coarse[b];
+    for (int v = 0; v < 256; v++) into->fine[v] += add->fine[v] - sub->fine[v];
+}
+
+static inline void hist_add(median_hist_t* restrict into, const median_hist_t* restrict add) {
+    for (int b = 0; b < 16; b++) into->coarse[b] += add->coarse[b];
+    for (int v = 0; v < 256; v++) into->fine[v] += add->fine[v];
+}
+
+// The value with `rank` values below it: a walk over the coarse bins, then over the 16 fine ones of the right bin.
+static inline uint8_t hist_select(const median_hist_t* h, int rank) {
+    int bin = 0, seen = 0;
+    while (seen + h->coarse[bin] <= rank) seen += h->coarse[bin++];
+
+    int value = bin << 4;
+    while (seen + h->fine[value] <= rank) seen += h->fine[value++];
+    return (uint8_t)value;
+}
+
+static inline int clamp_index(int i, int size) {
+    return i < 0? 0: i >= size? size - 1: i;
+}
+
+/*
+* One channel of the tile, whose values are `step` bytes apart in rows `stride` bytes apart (`channels` and
+* the row size when interleaved, 1 and the plane stride when planar); rows and columns beyond the tile repeat
+* its edge pixels.
+*/
+static void median_channel(const unsigned char* src, unsigned char* dst, size_t stride, int step, int width, int height,
+                           int radius, median_hist_t* columns, median_hist_t* window) {
+    int rank = (2 * radius + 1) * (2 * radius + 1) / 2;
+    #define PIXEL(y, x) src[(size_t)clamp_index(y, height) * stride + (size_t)(x) * step]
+
+    memset(columns, 0, width * sizeof(median_hist_t));
+    for (int x = 0; x < width; x++)
+        for (int dy = -radius; dy <= radius; dy++) hist_insert(&columns[x], PIXEL(dy, x));
+
+    for (int y = 0; y < height; y++) {
+        if (y > 0) {
+            for (int x = 0; x < width; x++) {
+                hist_remove(&columns[x], PIXEL(y - radius - 1, x));
+                hist_insert(&columns[x], PIXEL(y + radius, x));
+            }
+        }
+
+        memset(window, 0, sizeof(median_hist_t));
+        for (int dx = -radius; dx <= radius; dx++) hist_add(window, &columns[clamp_index(dx, width)]);
+
+        unsigned char* out = dst + (size_t)y * stride;
+        out[0] = hist_select(window, rank);
+        for (int x = 1; x < width; x++) {
+            int entering = clamp_index(x + radius, width), leaving = clamp_index(x - radius - 1, width);
+            if (entering != leaving) hist_slide(window, &columns[entering], &columns[leaving]);
+            out[(size_t)x * step] = hist_select(window, rank);
+        }
+    }
+    #undef PIXEL
+}
+
+int median_filter(image_chunk_t* chunk, int radius) {
+    if (!chunk || !chunk->pixel_data) {
+        FPRINTF(stderr, "Error: chunk or pixel_data is NULL\n");
+        return EXIT_FAILURE;
+    }
+    if (radius < 1 || radius > MEDIAN_MAX_RADIUS) {
+        FPRINTF(stderr, "Error: median radius %d out of range\n", radius);
+        return EXIT_FAILURE;
+    }
+
+    int width = chunk->width, height = chunk->height, channels = chunk->channels;
+    bool planar = chunk->layout == CHUNK_LAYOUT_PLANAR;
+    unsigned char* dst = chunk_alloc_pixels(chunk->data_size_bytes);
+    median_hist_t* columns = malloc((width + 1) * sizeof(median_hist_t)); // + 1 for the window
+    if (dst == NULL || columns == NULL) {
+        free(dst);
+        free(columns);
+        return EXIT_FAILURE;
+    }
+
+    memset(dst, 0, chunk->data_size_bytes); // the padding of rows
+
+    for (int c = 0; c < channels; c++) {
+        size_t first = planar? c * chunk->plane_size: (size_t)c;
+        median_channel(chunk->pixel_data + first, dst + first, chunk->stride, planar? 1: channels, width, height,
+                       radius, columns, &columns[width]);
+    }
+
+    free(columns);
+    free(chunk->pixel_data);
+    chunk->pixel_data = dst;
+    return EXIT_SUCCESS;
+}
+
+// #######################################
+// # Bilateral grid
+// #######################################
+
+#define GRID_PAD 3 // cells around the splatted ones: 2 for the blur, 1 for interpolation
+
+int bilateral_halo(double sigma_s) {
+    return (int)ceil(3.5 * sigma_s);
+}
+
+typedef struct {
+    float* cells;
+    int width, height, depth;   // cells along x, y and intensity
+    int components;             // colour sums, then the weight
+    long origin_x, origin_y;    // image position (in cells) of cell 0
+} grid_t;
+
+static inline float* grid_cell(const grid_t* grid, long x, long y, long z) {
+    return grid->cells + (((size_t)y * grid->width + x) * grid->depth + z) * grid->components;
+}
+
+// [1 4 6 4 1] / 16 along the `n` cells of one line, `stride` floats apart
+static void blur_line(float* line, int n, size_t stride, int components, float* tmp) {
+    static const float taps[5] = { 1 / 16.f, 4 / 16.f, 6 / 16.f, 4 / 16.f, 1 / 16.f };
+
+    for (int i = 0; i < n; i++) {
+        float* out = tmp + (size_t)i * components;
+        for (int k = 0; k < components; k++) out[k] = 0;
+        for (int t = -2; t <= 2; t++) {
+            if (i + t < 0 || i + t >= n) continue;
+            const float* in = line + (size_t)(i + t) * stride;
+            for (int k = 0; k < components; k++) out[k] += taps[t + 2] * in[k];
+        }
+    }
+    for (int i = 0; i < n; i++)
+        memcpy(line + (size_t)i * stride, tmp + (size_t)i * components, components * sizeof(float));
+}
+
+static void blur_grid(grid_t* grid, float* tmp) {
+    size_t z_stride = grid->components, x_stride = grid->depth * z_stride, y_stride = grid->width * x_stride;
+
+    for (int y = 0; y < grid->height; y++)
+        for (int z = 0; z < grid->depth; z++) blur_line(grid_cell(grid, 0, y, z), grid->width, x_stride, grid->components, tmp);
+    for (int x = 0; x < grid->width; x++)
+        for (int z = 0; z < grid->depth; z++) blur_line(grid_cell(grid, x, 0, z), grid->height, y_stride, grid->components, tmp);
+    for (int y = 0; y < grid->height; y++)
+        for (int x = 0; x < grid->width; x++) blur_line(grid_cell(grid, x, y, 0), grid->depth, z_stride, grid->components, tmp);
+}
+
+static inline float pixel_luma(const unsigned char* pixel, int channels) {
+    return (channels >= 3)? (299 * pixel[0] + 587 * pixel[1] + 114 * pixel[2]) / 1000: pixel[0];
+}
+
+int bilateral_filter(image_chunk_t* chunk, double sigma_s, double sigma_r) {
+    if (!chunk || !chunk->pixel_data) {
+        FPRINTF(stderr, "Error: chunk or pixel_data is NULL\n");
+        return EXIT_FAILURE;
+    }
+
+    int width = chunk->width, height = chunk->height, channels = chunk->channels;
+    int colour = (channels == 2 || channels == 4)? channels - 1: channels;
+    double to_cell = 1.0 / sigma_s, to_level = 1.0 / sigma_r;
+
+    grid_t grid;
+    grid.components = colour + 1;
+    grid.origin_x = lround(chunk->offset_x * to_cell) - GRID_PAD;
+    grid.origin_y = lround(chunk->offset_y * to_cell) - GRID_PAD;
+    grid.width = (int)(lround((chunk->offset_x + width - 1) * to_cell) - grid.origin_x) + GRID_PAD + 1;
+    grid.height = (int)(lround((chunk->offset_y + height - 1) * to_cell) - grid.origin_y) + GRID_PAD + 1;
+    grid.depth = (int)lround(255 * to_level) + 2 * GRID_PAD + 1;
+
+    int longest = grid.width > grid.height? grid.width: grid.height;
+    if (grid.depth > longest) longest = grid.depth;
+    grid.cells = calloc((size_t)grid.width * grid.height * grid.depth * grid.components, sizeof(float));
+    float* tmp = malloc((size_t)longest * grid.components * sizeof(float));
+    if (grid.cells == NULL || tmp == NULL) {
+        free(grid.cells);
+        free(tmp);
+        return EXIT_FAILURE;
+    }
+
+    // splat every pixel into its nearest cell
+    for (int y = 0; y < height; y++) {
+        long cy = lround((chunk->offset_y + y) * to_cell) - grid.origin_y;
+        const unsigned char* pixel = chunk->pixel_data + (size_t)y * chunk->stride;
+        for (int x = 0; x < width; x++, pixel += channels) {
+            long cx = lround((chunk->offset_x + x) * to_cell) - grid.origin_x;
+            long cz = lround(pixel_luma(pixel, channels) * to_level) + GRID_PAD;
+            float* cell = grid_cell(&grid, cx, cy, cz);
+            for (int k = 0; k < colour; k++) cell[k] += pixel[k];
+            cell[colour] += 1;
+        }
+    }
+
+    blur_grid(&grid, tmp);
+
+    // slice: read every pixel back by trilinear interpolation at its own position and intensity
+    for (int y = 0; y < height; y++) {
+        double fy = (chunk->offset_y + y) * to_cell - grid.origin_y;
+        long iy = (long)fy;
+        float wy = (float)(fy - iy);
+        unsigned char* pixel = chunk->pixel_data + (size_t)y * chunk->stride;
+
+        for (int x = 0; x < width; x++, pixel += channels) {
+            double fx = (chunk->offset_x + x) * to_cell - grid.origin_x;
+            double fz = pixel_luma(pixel, channels) * to_level + GRID_PAD;
+            long ix = (long)fx, iz = (long)fz;
+            float wx = (float)(fx - ix), wz = (float)(fz - iz);
+
+            float sums[4] = {0}; // up to 3 colour sums and the weight
+            for (int corner = 0; corner < 8; corner++) {
+                int dx = corner & 1, dy = (corner >> 1) & 1, dz = corner >> 2;
+                float weight = (dx? wx: 1 - wx) * (dy? wy: 1 - wy) * (dz? wz: 1 - wz);
+                const float* cell = grid_cell(&grid, ix + dx, iy + dy, iz + dz);
+                for (int k = 0; k <= colour; k++) sums[k] += weight * cell[k];
+            }
+
+            if (sums[colour] <= 0) continue;
+            for (int k = 0; k < colour; k++) {
+                float value = sums[k] / sums[colour];
+                pixel[k] = (unsigned char)(value < 0? 0: value > 255? 255: lroundf(value));
+            }
+        }
+    }
+
+    free(grid.cells);
+    free(tmp);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,213 @@
+#include "edges.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "macros.h"
+#include "stats.h"
+
+// tan(22.5°) and tan(67.5°) in 1/32768ths, to pick the direction of a gradient
+#define TAN_22_5 13573
+#define TAN_67_5 79109
+
+enum { NOT_EDGE = 0, WEAK = 1, STRONG = 2 };
+
+int edges_halo(bool thresholds) {
+    return thresholds? 2: 1;
+}
+
+/*
+* @brief Luma of the tile (same weights as `greyscale`) with one extra row/column on every side repeating
+* its edge pixels, so that the Sobel kernel never needs to check bounds.
+*/
+static int16_t* padded_luma(const image_chunk_t* chunk) {
+    size_t width = chunk->width, height = chunk->height, padded_row = width + 2;
+    int channels = chunk->channels;
+    int16_t* luma = malloc(padded_row * (height + 2) * sizeof(int16_t));
+    if (luma == NULL)
+        return NULL;
+
+    for (size_t y = 0; y < height; y++) {
+        const unsigned char* src = chunk->pixel_data + y * chunk->stride;
+        int16_t* dst = luma + (y + 1) * padded_row + 1;
+
+        if (channels >= 3) {
+            for (size_t x = 0; x < width; x++, src += channels)
+                dst[x] = (int16_t)((299 * src[0] + 587 * src[1] + 114 * src[2]) / 1000);
+        } else {
+            for (size_t x = 0; x < width; x++, src += channels)
+                dst[x] = src[0];
+        }
+        dst[-1] = dst[0];
+        dst[width] = dst[width - 1];
+    }
+    memcpy(luma, luma + padded_row, padded_row * sizeof(int16_t));
+    memcpy(luma + (height + 1) * padded_row, luma + height * padded_row, padded_row * sizeof(int16_t));
+    return luma;
+}
+
+// One row of Sobel gradients; `above`, `row` and `below` are padded luma rows (pixel x is at x + 1).
+static void sobel_row(const int16_t* restrict above, const int16_t* restrict row, const int16_t* restrict below,
+                      size_t width, int16_t* restrict gx, int16_t* restrict gy) {
+    for (size_t x = 0; x < width; x++) {
+        int16_t left = above[x] + 2 * row[x] + below[x];
+        int16_t right = above[x + 2] + 2 * row[x + 2] + below[x + 2];
+        int16_t up = above[x] + 2 * above[x + 1] + above[x + 2];
+        int16_t down = below[x] + 2 * below[x + 1] + below[x + 2];
+        gx[x] = right - left;
+        gy[x] = down - up;
+    }
+}
+
+static void magnitude_row(const int16_t* restrict gx, const int16_t* restrict gy, size_t width, int16_t* restrict magnitude) {
+    for (size_t x = 0; x < width; x++) {
+        int16_t ax = gx[x] < 0? -gx[x]: gx[x];
+        int16_t ay = gy[x] < 0? -gy[x]: gy[x];
+        magnitude[x] = ax + ay;
+    }
+}
+
+static int sobel_magnitude(const int16_t* luma, size_t width, size_t height, unsigned char* out) {
+    int16_t* rows = malloc(3 * width * sizeof(int16_t));
+    if (rows == NULL)
+        return EXIT_FAILURE;
+    int16_t *gx = rows, *gy = rows + width, *magnitude = rows + 2 * width;
+
+    for (size_t y = 0; y < height; y++) {
+        const int16_t* row = luma + (y + 1) * (width + 2);
+        sobel_row(row - (width + 2), row, row + (width + 2), width, gx, gy);
+        magnitude_row(gx, gy, width, magnitude);
+
+        unsigned char* dst = out + y * width;
+        for (size_t x = 0; x < width; x++) {
+            int16_t value = magnitude[x] >> 2;
+            dst[x] = (unsigned char)(value > 255? 255: value);
+        }
+    }
+
+    free(rows);
+    return EXIT_SUCCESS;
+}
+
+/*
+* @brief Keep the gradients that are the largest along their own direction, classify them against the
+* thresholds, then grow the strong edges into the weak ones they touch.
+*/
+static int canny(const int16_t* luma, size_t width, size_t height, int low, int high, unsigned char* out) {
+    size_t count = width * height;
+    int16_t* gradients = malloc(3 * count * sizeof(int16_t));
+    size_t* stack = malloc(count * sizeof(size_t));
+    if (gradients == NULL || stack == NULL) {
+        free(gradients);
+        free(stack);
+        return EXIT_FAILURE;
+    }
+    int16_t *gx = gradients, *gy = gradients + count, *magnitude = gradients + 2 * count;
+    unsigned char* state = out; // classified in place, then turned into 0/255
+
+    for (size_t y = 0; y < height; y++) {
+        const int16_t* row = luma + (y + 1) * (width + 2);
+        sobel_row(row - (width + 2), row, row + (width + 2), width, gx + y * width, gy + y * width);
+        magnitude_row(gx + y * width, gy + y * width, width, magnitude + y * width);
+    }
+
+    size_t top = 0;
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            size_t i = y * width + x;
+            int m = magnitude[i];
+            state[i] = NOT_EDGE;
+            if (m <= low)
+                continue;
+
+            // the two neighbours across the edge; outside the tile counts as no gradient
+            int ax = gx[i] < 0? -gx[i]: gx[i];
+            int ay = gy[i] < 0? -gy[i]: gy[i];
+            int dx, dy;
+            if ((ay << 15) < ax * TAN_22_5)      { dx = 1; dy = 0; }
+            else if ((ay << 15) > ax * TAN_67_5) { dx = 0; dy = 1; }
+            else                                 { dx = ((gx[i] ^ gy[i]) < 0)? -1: 1; dy = 1; }
+
+            long px = (long)x - dx, py = (long)y - dy, qx = (long)x + dx, qy = (long)y + dy;
+            int before = (px >= 0 && px < (long)width && py >= 0)? magnitude[py * width + px]: 0;
+            int after = (qx >= 0 && qx < (long)width && qy < (long)height)? magnitude[qy * width + qx]: 0;
+            if (m <= before || m < after)
+                continue;
+
+            if (m > high) {
+                state[i] = STRONG;
+                stack[top++] = i;
+            } else {
+                state[i] = WEAK;
+            }
+        }
+    }
+
+    while (top > 0) {
+        size_t i = stack[--top];
+        size_t x = i % width, y = i / width;
+        for (size_t ny = (y > 0? y - 1: 0); ny <= y + 1 && ny < height; ny++) {
+            for (size_t nx = (x > 0? x - 1: 0); nx <= x + 1 && nx < width; nx++) {
+                size_t n = ny * width + nx;
+                if (state[n] == WEAK) {
+                    state[n] = STRONG;
+                    stack[top++] = n;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) out[i] = (state[i] == STRONG)? 255: 0;
+
+    free(gradients);
+    free(stack);
+    return EXIT_SUCCESS;
+}
+
+int edge_map(const image_chunk_t* chunk, unsigned char* out, int low, int high) {
+    if (!chunk || !chunk->pixel_data || !out) {
+        FPRINTF(stderr, "Error: chunk, pixel_data or output is NULL\n");
+        return EXIT_FAILURE;
+    }
+
+    int16_t* luma = padded_luma(chunk);
+    if (luma == NULL)
+        return EXIT_FAILURE;
+
+    int result = (high > 0)? canny(luma, chunk->width, chunk->height, low, high, out)
+                           : sobel_magnitude(luma, chunk->width, chunk->height, out);
+    free(luma);
+    return result;
+}
+
+int edges(image_chunk_t* chunk, int low, int high) {
+    if (!chunk || !chunk->pixel_data) {
+        FPRINTF(stderr, "Error: chunk or pixel_data is NULL\n");
+        return EXIT_FAILURE;
+    }
+
+    image_chunk_t target = *chunk;
+    target.channels = 1;
+    chunk_set_geometry(&target, CHUNK_LAYOUT_INTERLEAVED);
+
+    // the map is packed, then spread over the rows of an aligned single-channel tile
+    size_t width = chunk->width, height = chunk->height;
+    unsigned char* map = malloc(width * height);
+    target.pixel_data = chunk_alloc_pixels(target.data_size_bytes);
+    if (map == NULL || target.pixel_data == NULL || edge_map(chunk, map, low, high) != EXIT_SUCCESS) {
+        free(map);
+        free(target.pixel_data);
+        return EXIT_FAILURE;
+    }
+    for (size_t y = 0; y < height; y++) {
+        unsigned char* row = target.pixel_data + y * target.stride;
+        memcpy(row, map + y * width, width);
+        memset(row + width, 0, target.stride - width);
+    }
+    free(map);
+
+    stats_add(COUNTER_INFLIGHT_BYTES, (int64_t)target.data_size_bytes - (int64_t)chunk->data_size_bytes);
+    free(chunk->pixel_data);
+    *chunk = target;
+    return EXIT_SUCCESS;
+}
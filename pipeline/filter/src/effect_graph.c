@@ -0,0 +1,1189 @@
+#include "effect_graph.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <pthread.h>
+#include <uthash.h>
+
+#include "filter.h"
+#include "resample.h"
+#include "blur.h"
+#include "convolve.h"
+#include "denoise.h"
+#include "edges.h"
+#include "lut.h"
+#include "lut3d.h"
+#include "tone.h"
+#include "engine.h"
+#include "macros.h"
+#include "stats.h"
+#include "trace.h"
+
+// #######################################
+// # Effect registry
+// #######################################
+
+static int apply_greyscale(const effect_t* effect, image_chunk_t* chunk) {
+    (void)effect;
+    return greyscale(chunk);
+}
+
+static void lut_for_posterize(const effect_t* effect, lut_t lut, lut16_t deep) {
+    lut_posterize(lut, (int)effect->params[0]);
+    lut16_posterize(deep, (int)effect->params[0]);
+}
+static void lut_for_brightness(const effect_t* effect, lut_t lut, lut16_t deep) {
+    lut_brightness(lut, effect->params[0]);
+    lut16_brightness(deep, effect->params[0]);
+}
+static void lut_for_contrast(const effect_t* effect, lut_t lut, lut16_t deep) {
+    lut_contrast(lut, effect->params[0]);
+    lut16_contrast(deep, effect->params[0]);
+}
+static void lut_for_gamma(const effect_t* effect, lut_t lut, lut16_t deep) {
+    lut_gamma(lut, effect->params[0]);
+    lut16_gamma(deep, effect->params[0]);
+}
+static void lut_for_invert(const effect_t* effect, lut_t lut, lut16_t deep) {
+    (void)effect;
+    lut_invert(lut);
+    lut16_invert(deep);
+}
+static void lut_for_threshold(const effect_t* effect, lut_t lut, lut16_t deep) {
+    lut_threshold(lut, effect->params[0]);
+    lut16_threshold(deep, effect->params[0]);
+}
+static void lut_for_levels(const effect_t* effect, lut_t lut, lut16_t deep) {
+    lut_levels(lut, effect->params[0], effect->params[1], effect->params[2]);
+    lut16_levels(deep, effect->params[0], effect->params[1], effect->params[2]);
+}
+
+// The `data` of a fused run of pointwise effects: its table at both depths.
+typedef struct {
+    lut_t table;
+    lut16_t deep;
+} fused_lut_t;
+
+static int apply_fused_lut(const effect_t* effect, image_chunk_t* chunk) {
+    const fused_lut_t* fused = (const fused_lut_t*)effect->data;
+    return apply_lut(chunk, fused->table, fused->deep);
+}
+
+static const effect_desc_t fused_lut_desc = { .name = "lut", .apply = apply_fused_lut, .planar = true, .high_depth = true };
+
+static int apply_lut3d_effect(const effect_t* effect, image_chunk_t* chunk) {
+    return apply_lut3d(chunk, (const lut3d_t*)effect->data);
+}
+
+static bool absorb_into_lut3d(effect_t* effect, const uint8_t lut[256], bool before) {
+    if (before) lut3d_compose_pre((lut3d_t*)effect->data, lut);
+    else        lut3d_compose_post((lut3d_t*)effect->data, lut);
+    return true;
+}
+
+static void global_autolevels(const effect_t* effect, const image_histogram_t* histogram, int channels, lut_t luts[TONE_MAX_CHANNELS]) {
+    tone_autolevels(histogram, channels, effect->params[0], luts);
+}
+
+static void global_whitebalance(const effect_t* effect, const image_histogram_t* histogram, int channels, lut_t luts[TONE_MAX_CHANNELS]) {
+    tone_whitebalance(histogram, channels, effect->params[0], luts);
+}
+
+static void global_equalize(const effect_t* effect, const image_histogram_t* histogram, int channels, lut_t luts[TONE_MAX_CHANNELS]) {
+    (void)effect;
+    tone_equalize(histogram, channels, luts);
+}
+
+// A global effect keeps the pointwise effects that follow it as a table in `data`, applied after its own ones.
+// Those before it change the statistics it is computed from, so they stay where they are.
+static bool absorb_after_global(effect_t* effect, const uint8_t lut[256], bool before) {
+    if (before)
+        return false;
+
+    if (effect->data == NULL) {
+        effect->data = malloc(sizeof(lut_t));
+        if (effect->data == NULL)
+            return false;
+        effect->data_size = sizeof(lut_t);
+        lut_identity(effect->data);
+    }
+    lut_compose(effect->data, lut);
+    return true;
+}
+
+static void tile_clahe(const effect_t* effect, const image_histogram_t* histogram, int channels, size_t pixels, lut_t luts[TONE_MAX_CHANNELS]) {
+    tone_clahe_tile(histogram, channels, pixels, effect->params[0], luts);
+}
+
+static const char* validate_clahe(const effect_t* effect) {
+    double clip = effect->params[0];
+    return (clip >= 1 && clip <= 256)? NULL: "clip limit must be between 1 and 256";
+}
+
+static const char* validate_clip(const effect_t* effect) {
+    double clip = effect->params[0];
+    return (clip >= 0 && clip < 50)? NULL: "clip must be a percentage from 0 up to (not including) 50";
+}
+
+// `path.cube`, loaded here, once
+static const char* parse_lut3d(effect_t* effect, char* args) {
+    if (args == NULL || *args == '\0')
+        return "missing path to a .cube file";
+
+    effect->data = lut3d_load(args, &effect->data_size);
+    return (effect->data != NULL)? NULL: "cannot load the LUT";
+}
+
+static int apply_directional_blur(const effect_t* effect, image_chunk_t* chunk) {
+    return directional_blur(chunk, (int)effect->params[0]);
+}
+
+static int apply_gaussian(const effect_t* effect, image_chunk_t* chunk) {
+    return gaussian_blur(chunk, effect->params[0]);
+}
+
+static int apply_box(const effect_t* effect, image_chunk_t* chunk) {
+    return box_blur(chunk, (int)effect->params[0], (int)effect->params[1]);
+}
+
+static int halo_directional_blur(const effect_t* effect) {
+    return (int)effect->params[0] - 1; // reads `length - 1` pixels to the right
+}
+
+static int halo_gaussian(const effect_t* effect) {
+    return gaussian_blur_halo(effect->params[0]);
+}
+
+static int halo_box(const effect_t* effect) {
+    return box_blur_halo((int)effect->params[0], (int)effect->params[1]);
+}
+
+static const char* validate_gaussian(const effect_t* effect) {
+    double sigma = effect->params[0];
+    return (sigma > 0 && sigma <= GAUSSIAN_MAX_SIGMA)? NULL: "sigma must be greater than 0 and at most 100";
+}
+
+static const char* validate_box(const effect_t* effect) {
+    double radius = effect->params[0], passes = effect->params[1];
+    if (radius < 1 || radius > BOX_BLUR_MAX_RADIUS || radius != (int)radius)
+        return "radius must be an integer between 1 and 512";
+    return (passes >= 1 && passes <= BOX_BLUR_MAX_PASSES && passes == (int)passes)? NULL: "passes must be an integer between 1 and 5";
+}
+
+static int apply_convolve(const effect_t* effect, image_chunk_t* chunk) {
+    return convolve(chunk, (const convolve_kernel_t*)effect->data);
+}
+
+static int halo_convolve(const effect_t* effect) {
+    return ((const convolve_kernel_t*)effect->data)->size / 2;
+}
+
+// `preset|c/c/c/...[:divisor[:bias]]`; fractional coefficients are kept to 1/256
+static const char* parse_convolve(effect_t* effect, char* args) {
+    if (args == NULL)
+        return "missing kernel";
+
+    convolve_kernel_t* kernel = calloc(1, sizeof(convolve_kernel_t));
+    if (kernel == NULL)
+        return "out of memory";
+    effect->data = kernel;
+    effect->data_size = sizeof(convolve_kernel_t);
+
+    char* options = strchr(args, ':');
+    if (options != NULL) *options++ = '\0';
+
+    double coeffs[CONVOLVE_MAX_SIZE * CONVOLVE_MAX_SIZE];
+    double divisor = 0, bias = 0, sum = 0;
+    int count = 0;
+    bool integral = true;
+
+    if (convolve_preset(args, kernel) == 0) {
+        count = kernel->size * kernel->size;
+        for (int i = 0; i < count; i++) coeffs[i] = kernel->coeffs[i];
+        divisor = kernel->divisor;
+        bias = kernel->bias;
+    } else {
+        char* saveptr = NULL;
+        for (char* token = strtok_r(args, "/", &saveptr); token != NULL; token = strtok_r(NULL, "/", &saveptr)) {
+            if (count == CONVOLVE_MAX_SIZE * CONVOLVE_MAX_SIZE)
+                return "kernel has too many coefficients";
+            char* end;
+            coeffs[count] = strtod(token, &end);
+            if (end == token || *end != '\0')
+                return "unknown preset or invalid coefficient (presets: sharpen, emboss, edge, smooth)";
+            count++;
+        }
+    }
+
+    int size = 1;
+    while (size * size < count) size += 2;
+    if (count == 0 || size * size != count)
+        return "kernel must have 9, 25, 49, ... coefficients (an odd square)";
+
+    for (int i = 0; i < count; i++) sum += coeffs[i];
+    if (divisor == 0) divisor = (sum != 0)? sum: 1;
+
+    if (options != NULL) {
+        char* end;
+        char* bias_text = strchr(options, ':');
+        if (bias_text != NULL) *bias_text++ = '\0';
+        if (*options != '\0') {
+            divisor = strtod(options, &end);
+            if (end == options || *end != '\0' || divisor == 0) return "divisor must be a non-zero number";
+        }
+        if (bias_text != NULL) {
+            bias = strtod(bias_text, &end);
+            if (end == bias_text || *end != '\0') return "invalid bias";
+        }
+    }
+
+    for (int i = 0; i < count; i++) integral = integral && coeffs[i] == (int32_t)coeffs[i];
+    integral = integral && divisor == (int32_t)divisor;
+    double scale = integral? 1: 256;
+
+    kernel->size = size;
+    for (int i = 0; i < count; i++) kernel->coeffs[i] = (int32_t)lround(coeffs[i] * scale);
+    kernel->divisor = (int32_t)lround(divisor * scale);
+    kernel->bias = (int32_t)lround(bias);
+    return (kernel->divisor != 0)? NULL: "divisor is too small";
+}
+
+static int apply_median(const effect_t* effect, image_chunk_t* chunk) {
+    return median_filter(chunk, (int)effect->params[0]);
+}
+
+static int halo_median(const effect_t* effect) {
+    return (int)effect->params[0];
+}
+
+static const char* validate_median(const effect_t* effect) {
+    double radius = effect->params[0];
+    return (radius >= 1 && radius <= MEDIAN_MAX_RADIUS && radius == (int)radius)? NULL: "radius must be an integer between 1 and 127";
+}
+
+static int apply_bilateral(const effect_t* effect, image_chunk_t* chunk) {
+    return bilateral_filter(chunk, effect->params[0], effect->params[1]);
+}
+
+static int halo_bilateral(const effect_t* effect) {
+    return bilateral_halo(effect->params[0]);
+}
+
+static const char* validate_bilateral(const effect_t* effect) {
+    double sigma_s = effect->params[0], sigma_r = effect->params[1];
+    if (sigma_s < 1 || sigma_s > BILATERAL_MAX_SIGMA_S)
+        return "sigma_s must be between 1 and 32";
+    return (sigma_r >= 1 && sigma_r <= 255)? NULL: "sigma_r must be between 1 and 255";
+}
+
+static int apply_edges(const effect_t* effect, image_chunk_t* chunk) {
+    return edges(chunk, (int)effect->params[0], (int)effect->params[1]);
+}
+
+static int halo_edges(const effect_t* effect) {
+    return edges_halo(effect->num_params > 0);
+}
+
+static const char* validate_edges(const effect_t* effect) {
+    if (effect->num_params == 0)
+        return NULL;
+    double low = effect->params[0], high = effect->params[1];
+    if (effect->num_params != 2)
+        return "give both thresholds, or neither for the gradient magnitude";
+    return (low >= 0 && high >= 1 && low <= high && high <= EDGES_MAX_THRESHOLD)? NULL: "thresholds must satisfy 0 <= low <= high <= 2040, with high >= 1";
+}
+
+static const char* validate_brightness(const effect_t* effect) {
+    double delta = effect->params[0];
+    return (delta >= -255 && delta <= 255)? NULL: "delta must be between -255 and 255";
+}
+
+static const char* validate_contrast(const effect_t* effect) {
+    double factor = effect->params[0];
+    return (factor >= 0 && factor <= 10)? NULL: "factor must be between 0 and 10";
+}
+
+static const char* validate_gamma(const effect_t* effect) {
+    double gamma = effect->params[0];
+    return (gamma >= 0.01 && gamma <= 10)? NULL: "gamma must be between 0.01 and 10";
+}
+
+static const char* validate_threshold(const effect_t* effect) {
+    double level = effect->params[0];
+    return (level >= 0 && level <= 256)? NULL: "level must be between 0 and 256";
+}
+
+static const char* validate_levels(const effect_t* effect) {
+    double black = effect->params[0], white = effect->params[1], gamma = effect->params[2];
+    if (black < 0 || white > 255 || black >= white)
+        return "black and white must satisfy 0 <= black < white <= 255";
+    return (gamma >= 0.01 && gamma <= 10)? NULL: "gamma must be between 0.01 and 10";
+}
+
+static const char* validate_posterize(const effect_t* effect) {
+    double levels = effect->params[0];
+    return (levels >= 2 && levels <= 256 && levels == (int)levels)? NULL: "levels must be an integer between 2 and 256";
+}
+
+static const char* validate_line_size(const effect_t* effect) {
+    double line = effect->params[0];
+    return (line >= 1 && line <= EFFECT_MAX_HALO && line == (int)line)? NULL: "line size must be an integer between 1 and 512";
+}
+
+// `[kernel]` at the end of resize/scale
+static const char* parse_kernel(const char* text, double* param) {
+    resample_kernel_t kernel = RESAMPLE_DEFAULT_KERNEL;
+    if (text != NULL && resample_kernel_from_name(text, &kernel) != 0)
+        return "kernel must be box, bilinear or lanczos";
+    *param = kernel;
+    return NULL;
+}
+
+// `WxH[:kernel]`; either side may be left out (or 0) to keep the aspect ratio
+static const char* parse_resize(effect_t* effect, char* args) {
+    if (args == NULL)
+        return "missing WxH";
+
+    char* kernel = strchr(args, ':');
+    if (kernel != NULL) *kernel++ = '\0';
+
+    char* x = strchr(args, 'x');
+    if (x == NULL)
+        return "size must be given as WxH";
+    *x = '\0';
+
+    char* end;
+    effect->params[0] = (*args == '\0')? 0: strtod(args, &end);
+    if (*args != '\0' && *end != '\0') return "invalid width";
+    effect->params[1] = (x[1] == '\0')? 0: strtod(x + 1, &end);
+    if (x[1] != '\0' && *end != '\0') return "invalid height";
+
+    effect->num_params = 3;
+    return parse_kernel(kernel, &effect->params[2]);
+}
+
+// `factor[:kernel]`
+static const char* parse_scale(effect_t* effect, char* args) {
+    if (args == NULL)
+        return "missing factor";
+
+    char* kernel = strchr(args, ':');
+    if (kernel != NULL) *kernel++ = '\0';
+
+    char* end;
+    effect->params[0] = strtod(args, &end);
+    if (end == args || *end != '\0') return "invalid factor";
+
+    effect->num_params = 2;
+    return parse_kernel(kernel, &effect->params[1]);
+}
+
+static const char* validate_resize(const effect_t* effect) {
+    double width = effect->params[0], height = effect->params[1];
+    if (width < 0 || height < 0 || width > 65535 || height > 65535 || width != (int)width || height != (int)height)
+        return "width and height must be integers up to 65535";
+    return (width == 0 && height == 0)? "give at least one of width and height": NULL;
+}
+
+static const char* validate_scale(const effect_t* effect) {
+    double factor = effect->params[0];
+    return (factor > 0 && factor <= 16)? NULL: "factor must be greater than 0 and at most 16";
+}
+
+static int resize_image(image_t* image, size_t width, size_t height, resample_kernel_t kernel) {
+    if (width == 0) width = 1;
+    if (height == 0) height = 1;
+    if (width == image->width && height == image->height)
+        return EXIT_SUCCESS;
+
+    unsigned char* pixels = malloc(width * height * image->channels);
+    if (pixels == NULL)
+        return EXIT_FAILURE;
+
+    if (resample(image->pixel_data, image->width, image->height, image->channels, pixels, width, height, kernel) != EXIT_SUCCESS) {
+        free(pixels);
+        return EXIT_FAILURE;
+    }
+
+    stats_add(COUNTER_INFLIGHT_BYTES, (int64_t)width * height * image->channels - (int64_t)image->width * image->height * image->channels);
+    free(image->pixel_data);
+    image->pixel_data = pixels;
+    image->width = width;
+    image->height = height;
+    return EXIT_SUCCESS;
+}
+
+static int apply_resize(const effect_t* effect, image_t* image) {
+    size_t width = (size_t)effect->params[0];
+    size_t height = (size_t)effect->params[1];
+    if (width == 0) width = (size_t)llround((double)image->width * height / image->height);
+    if (height == 0) height = (size_t)llround((double)image->height * width / image->width);
+    return resize_image(image, width, height, (resample_kernel_t)effect->params[2]);
+}
+
+static int apply_scale(const effect_t* effect, image_t* image) {
+    double factor = effect->params[0];
+    return resize_image(image, (size_t)llround(image->width * factor), (size_t)llround(image->height * factor),
+                        (resample_kernel_t)effect->params[1]);
+}
+
+static const effect_desc_t effect_registry[] = {
+    { .name = "greyscale",        .usage = "greyscale",
+      .apply = apply_greyscale, .planar = true, .high_depth = true },
+    { .name = "posterize",        .max_params = 1, .defaults = {4},  .usage = "posterize[:levels]",
+      .validate = validate_posterize, .build_lut = lut_for_posterize },
+    { .name = "brightness",       .max_params = 1, .defaults = {32}, .usage = "brightness[:delta]",
+      .validate = validate_brightness, .build_lut = lut_for_brightness },
+    { .name = "contrast",         .max_params = 1, .defaults = {1.2}, .usage = "contrast[:factor]",
+      .validate = validate_contrast, .build_lut = lut_for_contrast },
+    { .name = "gamma",            .max_params = 1, .defaults = {2.2}, .usage = "gamma[:gamma]",
+      .validate = validate_gamma, .build_lut = lut_for_gamma },
+    { .name = "invert",           .usage = "invert",
+      .build_lut = lut_for_invert },
+    { .name = "threshold",        .max_params = 1, .defaults = {128}, .usage = "threshold[:level]",
+      .validate = validate_threshold, .build_lut = lut_for_threshold },
+    { .name = "levels",           .max_params = 3, .defaults = {0, 255, 1}, .usage = "levels[:black[:white[:gamma]]]",
+      .validate = validate_levels, .build_lut = lut_for_levels },
+    { .name = "directional_blur", .max_params = 1, .defaults = {50}, .usage = "directional_blur[:length]",
+      .validate = validate_line_size, .halo = halo_directional_blur, .apply = apply_directional_blur },
+    { .name = "blur",             .max_params = 1, .defaults = {50}, .usage = "blur[:length]",
+      .validate = validate_line_size, .halo = halo_directional_blur, .apply = apply_directional_blur },
+    { .name = "gaussian",         .max_params = 1, .defaults = {2},  .usage = "gaussian[:sigma]",
+      .validate = validate_gaussian, .halo = halo_gaussian, .apply = apply_gaussian, .planar = true, .high_depth = true },
+    { .name = "box",              .max_params = 2, .defaults = {3, 1}, .usage = "box[:radius[:passes]]",
+      .validate = validate_box, .halo = halo_box, .apply = apply_box, .planar = true, .high_depth = true },
+    { .name = "convolve",         .usage = "convolve:<sharpen|emboss|edge|smooth|c/c/c/...>[:divisor[:bias]]",
+      .parse = parse_convolve, .halo = halo_convolve, .apply = apply_convolve, .planar = true },
+    { .name = "autolevels",       .max_params = 1, .defaults = {0.5}, .usage = "autolevels[:clip%]",
+      .validate = validate_clip, .global_lut = global_autolevels, .absorb_lut = absorb_after_global },
+    { .name = "whitebalance",     .max_params = 1, .defaults = {0.5}, .usage = "whitebalance[:clip%]",
+      .validate = validate_clip, .global_lut = global_whitebalance, .absorb_lut = absorb_after_global },
+    { .name = "equalize",         .usage = "equalize",
+      .global_lut = global_equalize, .absorb_lut = absorb_after_global },
+    { .name = "clahe",            .max_params = 1, .defaults = {2}, .usage = "clahe[:clip]",
+      .validate = validate_clahe, .tile_lut = tile_clahe },
+    { .name = "median",           .max_params = 1, .defaults = {2}, .usage = "median[:radius]",
+      .validate = validate_median, .halo = halo_median, .apply = apply_median, .planar = true },
+    { .name = "bilateral",        .max_params = 2, .defaults = {8, 20}, .usage = "bilateral[:sigma_s[:sigma_r]]",
+      .validate = validate_bilateral, .halo = halo_bilateral, .apply = apply_bilateral },
+    { .name = "edges",            .max_params = 2, .usage = "edges[:low:high]",
+      .validate = validate_edges, .halo = halo_edges, .apply = apply_edges },
+    { .name = "lut3d",            .usage = "lut3d:<file.cube>",
+      .parse = parse_lut3d, .apply = apply_lut3d_effect, .absorb_lut = absorb_into_lut3d },
+    { .name = "resize",           .usage = "resize:WxH[:box|bilinear|lanczos]",
+      .parse = parse_resize, .validate = validate_resize, .apply_image = apply_resize },
+    { .name = "scale",            .usage = "scale:factor[:box|bilinear|lanczos]",
+      .parse = parse_scale, .validate = validate_scale, .apply_image = apply_scale },
+};
+
+#define NUM_EFFECTS (sizeof(effect_registry) / sizeof(effect_registry[0]))
+
+static const effect_desc_t* find_effect(const char* name, size_t length) {
+    for (size_t i = 0; i < NUM_EFFECTS; i++) {
+        if (strlen(effect_registry[i].name) == length && strncmp(effect_registry[i].name, name, length) == 0)
+            return &effect_registry[i];
+    }
+    return NULL;
+}
+
+void effect_print_available(FILE* out) {
+    fprintf(out, "Available effects:");
+    for (size_t i = 0; i < NUM_EFFECTS; i++)
+        fprintf(out, " %s", effect_registry[i].usage);
+    fprintf(out, "\n");
+}
+
+// #######################################
+// # Parsing
+// #######################################
+
+static char* trim(char* str) {
+    while (isspace((unsigned char)*str)) str++;
+    char* end = str + strlen(str);
+    while (end > str && isspace((unsigned char)end[-1])) end--;
+    *end = '\0';
+    return str;
+}
+
+// `name[:param[:param...]]`
+static int parse_effect(char* text, effect_t* effect) {
+    char* colon = strchr(text, ':');
+    size_t name_length = colon? (size_t)(colon - text): strlen(text);
+
+    effect->desc = find_effect(text, name_length);
+    if (effect->desc == NULL) {
+        fprintf(stderr, "Error: Unknown effect '%.*s'.\n", (int)name_length, text);
+        effect_print_available(stderr);
+        return -1;
+    }
+
+    memcpy(effect->params, effect->desc->defaults, sizeof(effect->params));
+    effect->num_params = 0;
+
+    if (effect->desc->parse != NULL) {
+        const char* problem = effect->desc->parse(effect, colon? colon + 1: NULL);
+        if (problem != NULL) {
+            fprintf(stderr, "Error: %s: %s (usage: %s).\n", effect->desc->name, problem, effect->desc->usage);
+            return -1;
+        }
+        colon = NULL; // parsed
+    }
+
+    for (char* arg = colon; arg != NULL; arg = strchr(arg, ':')) {
+        arg++; // skip ':'
+        if (effect->num_params == effect->desc->max_params) {
+            fprintf(stderr, "Error: Too many parameters for '%s' (usage: %s).\n", effect->desc->name, effect->desc->usage);
+            return -1;
+        }
+
+        char* end;
+        double value = strtod(arg, &end);
+        if (end == arg || (*end != ':' && *end != '\0')) {
+            fprintf(stderr, "Error: Invalid parameter '%s' for '%s' (usage: %s).\n", arg, effect->desc->name, effect->desc->usage);
+            return -1;
+        }
+        effect->params[effect->num_params++] = value;
+    }
+
+    if (effect->num_params < effect->desc->min_params) {
+        fprintf(stderr, "Error: Missing parameters for '%s' (usage: %s).\n", effect->desc->name, effect->desc->usage);
+        return -1;
+    }
+
+    const char* problem = effect->desc->validate? effect->desc->validate(effect): NULL;
+    if (problem != NULL) {
+        fprintf(stderr, "Error: %s: %s.\n", effect->desc->name, problem);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+* @brief Replace every run of pointwise effects in `branch` by a single `lut` effect whose table is their composition.
+*/
+static int fuse_pointwise(effect_branch_t* branch) {
+    size_t kept = 0;
+
+    for (size_t e = 0; e < branch->num_effects; ) {
+        if (branch->effects[e].desc->build_lut == NULL) {
+            branch->effects[kept++] = branch->effects[e++];
+            continue;
+        }
+
+        fused_lut_t* table = malloc(sizeof(fused_lut_t));
+        fused_lut_t* next = malloc(sizeof(fused_lut_t));
+        if (table == NULL || next == NULL) {
+            free(table);
+            free(next);
+            return -1;
+        }
+        lut_identity(table->table);
+        lut16_identity(table->deep);
+
+        size_t run_start = e;
+        for (; e < branch->num_effects && branch->effects[e].desc->build_lut != NULL; e++) {
+            branch->effects[e].desc->build_lut(&branch->effects[e], next->table, next->deep);
+            lut_compose(table->table, next->table);
+            lut16_compose(table->deep, next->deep);
+        }
+        free(next);
+
+        branch->num_tile_effects -= e - run_start; // pointwise effects are tile effects; the fused one is added back below
+
+        // fold the table into a neighbour that can take it, the one before first
+        effect_t* previous = (kept > 0)? &branch->effects[kept - 1]: NULL;
+        effect_t* following = (e < branch->num_effects)? &branch->effects[e]: NULL;
+        if ((previous != NULL && previous->desc->absorb_lut != NULL && previous->desc->absorb_lut(previous, table->table, false))
+         || (following != NULL && following->desc->absorb_lut != NULL && following->desc->absorb_lut(following, table->table, true))) {
+            free(table);
+            continue;
+        }
+
+        effect_t fused = { .desc = &fused_lut_desc, .data = table, .data_size = sizeof(fused_lut_t) };
+        branch->effects[kept++] = fused;
+        branch->num_tile_effects += 1;
+    }
+
+    memset(&branch->effects[kept], 0, (branch->num_effects - kept) * sizeof(effect_t));
+    branch->num_effects = kept;
+    return 0;
+}
+
+// Global and local effects wait for all of their image's tiles, see `effect_graph.h`
+static bool is_gathered(const effect_desc_t* desc) {
+    return desc->global_lut != NULL || desc->tile_lut != NULL;
+}
+
+// `[name=]effect[,effect...]`
+static int parse_branch(char* text, effect_branch_t* branch, size_t index) {
+    char* chain = text;
+    char* equals = strchr(text, '=');
+    if (equals != NULL) {
+        *equals = '\0';
+        char* name = trim(text);
+        chain = equals + 1;
+
+        if (*name == '\0' || strpbrk(name, "/\\") != NULL) {
+            fprintf(stderr, "Error: Output name '%s' must be non-empty and must not contain path separators.\n", name);
+            return -1;
+        }
+        branch->name = strdup(name);
+    } else if (index == 0) {
+        branch->name = strdup(EFFECT_DEFAULT_OUTPUT);
+    } else {
+        char name[32];
+        snprintf(name, sizeof(name), "out%zu", index + 1);
+        branch->name = strdup(name);
+    }
+    if (branch->name == NULL)
+        return -1;
+
+    size_t capacity = 1;
+    for (const char* c = chain; *c; c++) capacity += (*c == ',');
+    branch->effects = calloc(capacity + 1, sizeof(effect_t)); // + 1 for an effect that fails to parse, see effect_graph_free
+    if (branch->effects == NULL)
+        return -1;
+
+    char* saveptr = NULL;
+    for (char* token = strtok_r(chain, ",", &saveptr); token != NULL; token = strtok_r(NULL, ",", &saveptr)) {
+        token = trim(token);
+        if (*token == '\0') continue;
+        effect_t* effect = &branch->effects[branch->num_effects];
+        if (parse_effect(token, effect) != 0)
+            return -1;
+
+        if (effect->desc->apply != NULL || effect->desc->build_lut != NULL || is_gathered(effect->desc)) {
+            if (branch->num_tile_effects != branch->num_effects) {
+                fprintf(stderr, "Error: '%s' must come before whole-image effects such as '%s' in output '%s'.\n",
+                    effect->desc->name, branch->effects[branch->num_tile_effects].desc->name, branch->name);
+                return -1;
+            }
+            branch->num_tile_effects++;
+        }
+        branch->num_effects++;
+    }
+
+    if (branch->num_effects == 0) {
+        fprintf(stderr, "Error: Output '%s' has no effects.\n", branch->name);
+        return -1;
+    }
+    return fuse_pointwise(branch);
+}
+
+// #######################################
+// # Graph (a trie over the branches' effect chains)
+// #######################################
+
+typedef struct {
+    uint64_t image_seq;
+    const effect_node_t* node; // the global or local effect
+} gather_key_t;
+
+// One image's tiles at one global or local effect, from its first tile counted to its last one resumed.
+typedef struct gather {
+    gather_key_t key;
+    int expected;                  // tiles of the image
+    int counted;
+    int remaining;                 // tiles that have yet to apply the tables
+    image_histogram_t* partials;   // global effects: one histogram per tile, by `chunk_id`
+    lut_t (*tile_luts)[TONE_MAX_CHANNELS]; // local effects: one mapping per tile, by `chunk_id`
+    image_chunk_t** parked;        // tiles waiting for the tables, in arrival order
+    lut_t luts[TONE_MAX_CHANNELS]; // global effects: the image's tables
+    UT_hash_handle hh;
+} gather_t;
+
+struct effect_gathers {
+    pthread_mutex_t lock;
+    gather_t* table;
+};
+
+static void free_gather(gather_t* gather) {
+    for (int i = 0; i < gather->counted; i++)
+        if (gather->parked[i] != NULL) free_image_chunk(gather->parked[i]);
+    free(gather->parked);
+    free(gather->partials);
+    free(gather->tile_luts);
+    free(gather);
+}
+
+static bool has_gathered_effect(const effect_graph_t* graph) {
+    for (size_t i = 0; i < graph->num_branches; i++)
+        for (size_t e = 0; e < graph->branches[i].num_tile_effects; e++)
+            if (is_gathered(graph->branches[i].effects[e].desc)) return true;
+    return false;
+}
+
+static bool same_effect(const effect_t* a, const effect_t* b) {
+    return (a->desc == b->desc || (a->desc->apply != NULL && a->desc->apply == b->desc->apply)) // `blur` is `directional_blur`
+        && a->num_params == b->num_params && memcmp(a->params, b->params, sizeof(a->params)) == 0
+        && a->data_size == b->data_size && (a->data_size == 0 || memcmp(a->data, b->data, a->data_size) == 0);
+}
+
+static effect_node_t* child_for(effect_node_t* node, const effect_t* effect) {
+    for (size_t i = 0; i < node->num_children; i++)
+        if (same_effect(&node->children[i]->effect, effect)) return node->children[i];
+
+    effect_node_t** children = realloc(node->children, (node->num_children + 1) * sizeof(effect_node_t*));
+    if (children == NULL)
+        return NULL;
+    node->children = children;
+
+    effect_node_t* child = calloc(1, sizeof(effect_node_t));
+    if (child == NULL)
+        return NULL;
+    child->effect = *effect;
+    node->children[node->num_children++] = child;
+    return child;
+}
+
+static int add_output(effect_node_t* node, int branch) {
+    int* outputs = realloc(node->outputs, (node->num_outputs + 1) * sizeof(int));
+    if (outputs == NULL)
+        return -1;
+    node->outputs = outputs;
+    node->outputs[node->num_outputs++] = branch;
+    return 0;
+}
+
+static void free_node(effect_node_t* node) {
+    for (size_t i = 0; i < node->num_children; i++) {
+        free_node(node->children[i]);
+        free(node->children[i]);
+    }
+    free(node->children);
+    free(node->outputs);
+}
+
+int effect_graph_parse(const char* spec, effect_graph_t* graph) {
+    memset(graph, 0, sizeof(*graph));
+
+    char* text = strdup(spec);
+    if (text == NULL)
+        return -1;
+
+    size_t capacity = 1;
+    for (const char* c = spec; *c; c++) capacity += (*c == ';');
+    graph->branches = calloc(capacity, sizeof(effect_branch_t));
+    if (graph->branches == NULL) {
+        free(text);
+        return -1;
+    }
+
+    int status = 0;
+    char* saveptr = NULL;
+    for (char* token = strtok_r(text, ";", &saveptr); token != NULL && status == 0; token = strtok_r(NULL, ";", &saveptr)) {
+        if (*trim(token) == '\0') continue;
+        effect_branch_t* branch = &graph->branches[graph->num_branches];
+        status = parse_branch(token, branch, graph->num_branches);
+        graph->num_branches++; // count it even on failure, so that effect_graph_free releases it
+    }
+    free(text);
+
+    if (status == 0 && graph->num_branches == 0) {
+        fprintf(stderr, "Error: No effects given.\n");
+        status = -1;
+    }
+
+    for (size_t i = 0; i < graph->num_branches && status == 0; i++) {
+        for (size_t j = 0; j < i; j++) {
+            if (strcmp(graph->branches[i].name, graph->branches[j].name) == 0) {
+                fprintf(stderr, "Error: Output name '%s' is used twice.\n", graph->branches[i].name);
+                status = -1;
+                break;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < graph->num_branches && status == 0; i++) {
+        effect_node_t* node = &graph->root;
+        for (size_t e = 0; e < graph->branches[i].num_tile_effects && node != NULL; e++)
+            node = child_for(node, &graph->branches[i].effects[e]);
+        if (node == NULL || add_output(node, (int)i) != 0)
+            status = -1;
+    }
+
+    // radii add up along a chain; the halo must cover the widest chain
+    for (size_t i = 0; i < graph->num_branches && status == 0; i++) {
+        int halo = 0;
+        for (size_t e = 0; e < graph->branches[i].num_tile_effects; e++) {
+            const effect_t* effect = &graph->branches[i].effects[e];
+            if (effect->desc->halo != NULL) halo += effect->desc->halo(effect);
+        }
+        if (halo > EFFECT_MAX_HALO) {
+            fprintf(stderr, "Error: The effects of output '%s' read %d pixels around each pixel, at most %d are allowed.\n",
+                graph->branches[i].name, halo, EFFECT_MAX_HALO);
+            status = -1;
+        }
+        if (halo > graph->halo) graph->halo = halo;
+    }
+
+    if (status == 0)
+        effect_graph_set_tile_layout(graph, TILE_LAYOUT_AUTO);
+
+    if (status == 0 && has_gathered_effect(graph)) {
+        graph->gathers = calloc(1, sizeof(struct effect_gathers));
+        if (graph->gathers == NULL || pthread_mutex_init(&graph->gathers->lock, NULL) != 0) {
+            free(graph->gathers);
+            graph->gathers = NULL;
+            status = -1;
+        }
+    }
+
+    if (status != 0)
+        effect_graph_free(graph);
+    return status;
+}
+
+// Planar effects in a row from `node` on, along the chain where the run is longest.
+static int planar_run(const effect_node_t* node) {
+    if (!node->effect.desc->planar)
+        return 0;
+
+    int longest = 0;
+    for (size_t i = 0; i < node->num_children; i++) {
+        int run = planar_run(node->children[i]);
+        if (run > longest) longest = run;
+    }
+    return 1 + longest;
+}
+
+static void plan_layouts(effect_node_t* node, bool parent_planar, tile_layout_policy_t policy) {
+    for (size_t i = 0; i < node->num_children; i++) {
+        effect_node_t* child = node->children[i];
+        bool capable = child->effect.desc->planar;
+
+        switch (policy) {
+            case TILE_LAYOUT_INTERLEAVED: child->planar = false; break;
+            case TILE_LAYOUT_PLANAR:      child->planar = capable; break;
+            default: // already planar costs nothing; otherwise the run must pay for the deinterleaving
+                child->planar = capable && (parent_planar || planar_run(child) >= EFFECT_PLANAR_MIN_RUN);
+        }
+        plan_layouts(child, child->planar, policy);
+    }
+}
+
+void effect_graph_set_tile_layout(effect_graph_t* graph, tile_layout_policy_t policy) {
+    plan_layouts(&graph->root, false, policy);
+
+    graph->planar_tiles = graph->root.num_children > 0 && graph->root.num_outputs == 0;
+    for (size_t i = 0; i < graph->root.num_children; i++)
+        graph->planar_tiles = graph->planar_tiles && graph->root.children[i]->planar;
+}
+
+void effect_graph_free(effect_graph_t* graph) {
+    // Parked tiles go first: releasing them may complete their jobs, which still read the branches.
+    if (graph->gathers != NULL) { // images that never completed (discarded, or still in flight at shutdown)
+        gather_t *gather, *tmp;
+        HASH_ITER(hh, graph->gathers->table, gather, tmp) {
+            HASH_DEL(graph->gathers->table, gather);
+            free_gather(gather);
+        }
+        pthread_mutex_destroy(&graph->gathers->lock);
+        free(graph->gathers);
+    }
+
+    for (size_t i = 0; i < graph->num_branches; i++) {
+        // every effect, including a partly parsed one, was zeroed by calloc; the trie only borrows `data`
+        for (size_t e = 0; e <= graph->branches[i].num_effects && graph->branches[i].effects; e++)
+            free(graph->branches[i].effects[e].data);
+        free(graph->branches[i].name);
+        free(graph->branches[i].effects);
+    }
+    free(graph->branches);
+    free_node(&graph->root);
+    memset(graph, 0, sizeof(*graph));
+}
+
+// #######################################
+// # Running
+// #######################################
+
+static image_chunk_t* clone_chunk(const image_chunk_t* chunk) {
+    image_chunk_t* clone = malloc(sizeof(image_chunk_t));
+    if (clone == NULL)
+        return NULL;
+
+    *clone = *chunk;
+    clone->original_image_name = strdup(chunk->original_image_name);
+    clone->pixel_data = chunk_alloc_pixels(chunk->data_size_bytes); // the clone stays aligned
+    if (clone->original_image_name == NULL || clone->pixel_data == NULL) {
+        free(clone->original_image_name);
+        free(clone->pixel_data);
+        free(clone);
+        return NULL;
+    }
+
+    memcpy(clone->pixel_data, chunk->pixel_data, chunk->data_size_bytes);
+    stats_add(COUNTER_INFLIGHT_BYTES, (int64_t)chunk->data_size_bytes);
+    image_job_retain(clone->job);
+    return clone;
+}
+
+typedef struct {
+    const effect_graph_t* graph;
+    void (*emit)(image_chunk_t*);
+    void (*requeue)(image_chunk_t*);
+} run_context_t;
+
+static int run_node(const run_context_t* ctx, const effect_node_t* node, image_chunk_t* chunk);
+
+/*
+* @brief Pass the tile on to every child of `node` and every output ending there.
+* Every consumer but the last one gets its own copy; the last one takes `chunk` itself.
+*/
+static int pass_on(const run_context_t* ctx, const effect_node_t* node, image_chunk_t* chunk) {
+    size_t consumers = node->num_children + node->num_outputs;
+    size_t served = 0;
+    int status = EXIT_SUCCESS;
+
+    for (size_t i = 0; i < node->num_children; i++) {
+        image_chunk_t* input = (++served == consumers)? chunk: clone_chunk(chunk);
+        if (input == NULL || run_node(ctx, node->children[i], input) != EXIT_SUCCESS)
+            status = EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < node->num_outputs; i++) {
+        image_chunk_t* output = (++served == consumers)? chunk: clone_chunk(chunk);
+        if (output == NULL) {
+            status = EXIT_FAILURE;
+            continue;
+        }
+        output->branch = node->outputs[i];
+        ctx->emit(output);
+    }
+
+    return status;
+}
+
+/*
+* @brief Count `chunk` into its image's statistics at the global or local effect `node` and park it there.
+* @return NULL once parked, or if out of memory (`*status` is then EXIT_FAILURE). The image's last tile
+* instead gets the completed gather back: its tables are built, the other tiles are on their way back
+* through `requeue`, and `chunk` is still the caller's.
+*/
+static gather_t* gather_tile(const run_context_t* ctx, const effect_node_t* node, image_chunk_t* chunk, int* status) {
+    struct effect_gathers* gathers = ctx->graph->gathers;
+    const effect_desc_t* desc = node->effect.desc;
+    bool local = desc->tile_lut != NULL;
+    uint64_t start = trace_enabled? now_ns(): 0;
+
+    // the per-tile work of phase 1 happens here, outside the lock
+    image_histogram_t partial;
+    lut_t mapping[TONE_MAX_CHANNELS];
+    size_t pixels = image_histogram_of_chunk(&partial, chunk);
+    if (local) desc->tile_lut(&node->effect, &partial, chunk->channels, pixels, mapping);
+
+    gather_key_t key;
+    memset(&key, 0, sizeof(key)); // hashed as bytes, padding included
+    key.image_seq = chunk->image_seq;
+    key.node = node;
+
+    pthread_mutex_lock(&gathers->lock);
+    if (image_job_discarded(chunk->job)) { // checked under the lock, see `effect_graph_drop_image`
+        pthread_mutex_unlock(&gathers->lock);
+        free_image_chunk(chunk);
+        return NULL;
+    }
+
+    gather_t* gather;
+    HASH_FIND(hh, gathers->table, &key, sizeof(key), gather);
+    if (gather == NULL) {
+        gather = calloc(1, sizeof(gather_t));
+        if (gather != NULL) {
+            gather->key = key;
+            gather->expected = chunk->original_image_num_chunks;
+            if (local) gather->tile_luts = malloc(gather->expected * sizeof(*gather->tile_luts));
+            else       gather->partials = malloc(gather->expected * sizeof(image_histogram_t));
+            gather->parked = calloc(gather->expected, sizeof(image_chunk_t*));
+            if ((gather->partials == NULL && gather->tile_luts == NULL) || gather->parked == NULL) {
+                free_gather(gather);
+                gather = NULL;
+            } else {
+                HASH_ADD(hh, gathers->table, key, sizeof(key), gather);
+            }
+        }
+    }
+
+    if (gather == NULL || chunk->chunk_id < 0 || chunk->chunk_id >= gather->expected) {
+        pthread_mutex_unlock(&gathers->lock);
+        FPRINTF(stderr, "Error: Out of memory collecting the histogram of %s\n", chunk->original_image_name);
+        free_image_chunk(chunk);
+        *status = EXIT_FAILURE;
+        return NULL;
+    }
+
+    if (local) memcpy(gather->tile_luts[chunk->chunk_id], mapping, sizeof(mapping));
+    else       gather->partials[chunk->chunk_id] = partial;
+    gather->parked[gather->counted] = chunk;
+    bool complete = ++gather->counted == gather->expected;
+    pthread_mutex_unlock(&gathers->lock);
+    TRACE_COMPLETE("histogram", chunk->original_image_name, chunk->chunk_id, start, now_ns());
+
+    if (!complete)
+        return NULL;
+
+    // every tile has been counted, so no other thread touches the gather until the parked tiles resume
+    if (!local) {
+        image_histogram_reduce(gather->partials, gather->counted);
+        desc->global_lut(&node->effect, &gather->partials[0], chunk->channels, gather->luts);
+        if (node->effect.data != NULL) { // pointwise effects folded into this one
+            for (int c = 0; c < tone_colour_channels(chunk->channels); c++)
+                lut_compose(gather->luts[c], (const uint8_t*)node->effect.data);
+        }
+        free(gather->partials);
+        gather->partials = NULL;
+    }
+
+    // `chunk` counts as well: the gather cannot be released while the others are handed back
+    gather->remaining = gather->expected;
+    gather->parked[gather->counted - 1] = NULL;
+    for (int i = gather->counted - 2; i >= 0; i--) { // most recently parked, most likely still cached, first
+        image_chunk_t* tile = gather->parked[i];
+        gather->parked[i] = NULL;
+        tile->resume = gather;
+        ctx->requeue(tile);
+    }
+    return gather;
+}
+
+// One of a completed gather's tiles is done with its tables; the last one frees the gather.
+static void release_gather(struct effect_gathers* gathers, gather_t* gather) {
+    pthread_mutex_lock(&gathers->lock);
+    bool last = --gather->remaining == 0;
+    if (last) HASH_DEL(gathers->table, gather);
+    pthread_mutex_unlock(&gathers->lock);
+
+    if (last) free_gather(gather);
+}
+
+/*
+* @brief Apply a completed gather's tables to one of its tiles; the last one releases the gather.
+*/
+static int apply_gathered(const run_context_t* ctx, gather_t* gather, image_chunk_t* chunk) {
+    struct effect_gathers* gathers = ctx->graph->gathers;
+    const effect_desc_t* desc = gather->key.node->effect.desc;
+
+    uint64_t start = trace_enabled? now_ns(): 0;
+    int result = (desc->tile_lut != NULL)? apply_clahe(chunk, (const lut_t (*)[TONE_MAX_CHANNELS])gather->tile_luts)
+                                         : apply_channel_luts(chunk, (const lut_t*)gather->luts);
+    TRACE_COMPLETE(desc->name, chunk->original_image_name, chunk->chunk_id, start, now_ns());
+
+    release_gather(gathers, gather);
+    return result;
+}
+
+/*
+* @brief Apply `node`'s effect, then pass the tile on.
+*/
+static int run_node(const run_context_t* ctx, const effect_node_t* node, image_chunk_t* chunk) {
+    int result;
+
+    if (chunk->format != PIXEL_FORMAT_U8 && !node->effect.desc->high_depth) {
+        uint64_t start = trace_enabled? now_ns(): 0;
+        if (chunk_set_format(chunk, PIXEL_FORMAT_U8) != EXIT_SUCCESS) {
+            free_image_chunk(chunk);
+            return EXIT_FAILURE;
+        }
+        TRACE_COMPLETE("quantize", chunk->original_image_name, chunk->chunk_id, start, now_ns());
+    }
+
+    // planar tiles are u8: deeper ones stay interleaved, even for planar effects
+    chunk_layout_t layout = (node->planar && chunk->format == PIXEL_FORMAT_U8)? CHUNK_LAYOUT_PLANAR: CHUNK_LAYOUT_INTERLEAVED;
+    if (chunk->layout != layout) {
+        uint64_t start = trace_enabled? now_ns(): 0;
+        if (chunk_set_layout(chunk, layout) != EXIT_SUCCESS) {
+            free_image_chunk(chunk);
+            return EXIT_FAILURE;
+        }
+        TRACE_COMPLETE(node->planar? "deinterleave": "interleave", chunk->original_image_name, chunk->chunk_id, start, now_ns());
+    }
+
+    if (is_gathered(node->effect.desc)) {
+        int status = EXIT_SUCCESS;
+        gather_t* gather = gather_tile(ctx, node, chunk, &status);
+        if (gather == NULL)
+            return status; // parked, until the image's last tile comes in
+        result = apply_gathered(ctx, gather, chunk);
+    } else {
+        uint64_t start = trace_enabled? now_ns(): 0;
+        result = node->effect.desc->apply(&node->effect, chunk);
+        TRACE_COMPLETE(node->effect.desc->name, chunk->original_image_name, chunk->chunk_id, start, now_ns());
+    }
+
+    if (result != EXIT_SUCCESS) {
+        free_image_chunk(chunk);
+        return EXIT_FAILURE;
+    }
+    return pass_on(ctx, node, chunk);
+}
+
+int effect_graph_run(const effect_graph_t* graph, image_chunk_t* chunk,
+                     void (*emit)(image_chunk_t* chunk), void (*requeue)(image_chunk_t* chunk)) {
+    run_context_t ctx = { .graph = graph, .emit = emit, .requeue = requeue };
+
+    if (chunk->resume != NULL) { // back from a global or local effect
+        gather_t* gather = chunk->resume;
+        const effect_node_t* node = gather->key.node; // the gather may be gone after applying
+        chunk->resume = NULL;
+
+        if (apply_gathered(&ctx, gather, chunk) != EXIT_SUCCESS) {
+            free_image_chunk(chunk);
+            return EXIT_FAILURE;
+        }
+        return pass_on(&ctx, node, chunk);
+    }
+
+    return pass_on(&ctx, &graph->root, chunk);
+}
+
+void effect_graph_drop_image(const effect_graph_t* graph, uint64_t image_seq) {
+    struct effect_gathers* gathers = graph->gathers;
+    if (gathers == NULL)
+        return;
+
+    // Completed gathers are left to their tiles, which release them whether they run or are dropped.
+    gather_t *gather, *tmp, *dropped = NULL;
+    pthread_mutex_lock(&gathers->lock);
+    HASH_ITER(hh, gathers->table, gather, tmp) {
+        if (gather->key.image_seq == image_seq && gather->counted < gather->expected) {
+            HASH_DEL(gathers->table, gather);
+            gather->hh.next = dropped;
+            dropped = gather;
+        }
+    }
+    pthread_mutex_unlock(&gathers->lock);
+
+    for (; dropped != NULL; dropped = tmp) {
+        tmp = dropped->hh.next;
+        free_gather(dropped);
+    }
+}
+
+void effect_graph_drop_tile(const effect_graph_t* graph, image_chunk_t* chunk) {
+    if (chunk->resume != NULL)
+        release_gather(graph->gathers, chunk->resume);
+    free_image_chunk(chunk);
+}
+
+int effect_graph_finish(const effect_graph_t* graph, int branch, image_t* image) {
+    const effect_branch_t* b = &graph->branches[branch];
+
+    for (size_t e = b->num_tile_effects; e < b->num_effects; e++) {
+        const effect_t* effect = &b->effects[e];
+        if (!effect->desc->high_depth && image_set_format(image, PIXEL_FORMAT_U8) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+
+        uint64_t start = trace_enabled? now_ns(): 0;
+        int result = effect->desc->apply_image(effect, image);
+        TRACE_COMPLETE(effect->desc->name, NULL, -1, start, now_ns());
+
+        if (result != EXIT_SUCCESS) {
+            FPRINTF(stderr, "Error: %s failed on output '%s'\n", effect->desc->name, b->name);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -2,11 +2,48 @@
 
 #include <stdio.h>
 
+#include "lut.h"
 #include "macros.h"
 
 #define MIN(a,b) a>b ? b : a 
 
-extern chunk_queue_t filtering_reconstruction_queue;
+/*
+* The interleaved loop, for one sample type and channel count (3, or 4 with alpha, which is left as it is):
+* `MIX` makes grey of `r`, `g` and `b`. For u8 and u16 it is 0.299 R + 0.587 G + 0.114 B in exact integer
+* arithmetic (the division by a constant becomes a multiply).
+*/
+#define DEFINE_GREYSCALE_ROWS(NAME, TYPE, CHANNELS, MIX)                                        \
+static void NAME(unsigned char* pixels, size_t stride, int width, int height) {                 \
+    for (int y = 0; y < height; y++) {                                                          \
+        TYPE* pixel = (TYPE*)(pixels + (size_t)y * stride);                                     \
+        for (int i = 0; i < width * (CHANNELS); i += (CHANNELS)) {                              \
+            TYPE r = pixel[i + 0], g = pixel[i + 1], b = pixel[i + 2];                          \
+            TYPE gray = (TYPE)(MIX);                                                            \
+            pixel[i + 0] = gray;                                                                \
+            pixel[i + 1] = gray;                                                                \
+            pixel[i + 2] = gray;                                                                \
+        }                                                                                       \
+    }                                                                                           \
+}
+
+#define MIX_INTEGER (299u * r + 587u * g + 114u * b) / 1000
+#define MIX_FLOAT   0.299f * r + 0.587f * g + 0.114f * b
+
+DEFINE_GREYSCALE_ROWS(greyscale_u8_3,  uint8_t,  3, MIX_INTEGER)
+DEFINE_GREYSCALE_ROWS(greyscale_u8_4,  uint8_t,  4, MIX_INTEGER)
+DEFINE_GREYSCALE_ROWS(greyscale_u16_3, uint16_t, 3, MIX_INTEGER)
+DEFINE_GREYSCALE_ROWS(greyscale_u16_4, uint16_t, 4, MIX_INTEGER)
+DEFINE_GREYSCALE_ROWS(greyscale_f32_3, float,    3, MIX_FLOAT)
+DEFINE_GREYSCALE_ROWS(greyscale_f32_4, float,    4, MIX_FLOAT)
+
+typedef void (*greyscale_rows_fn)(unsigned char*, size_t, int, int);
+
+// by format, then RGB / RGBA
+static const greyscale_rows_fn greyscale_rows[3][2] = {
+    [PIXEL_FORMAT_U8]  = { greyscale_u8_3,  greyscale_u8_4 },
+    [PIXEL_FORMAT_U16] = { greyscale_u16_3, greyscale_u16_4 },
+    [PIXEL_FORMAT_F32] = { greyscale_f32_3, greyscale_f32_4 },
+};
 
 int greyscale(image_chunk_t* chunk) {
     
@@ -24,17 +61,87 @@ int greyscale(image_chunk_t* chunk) {
     int height = chunk->height;
     int channels = chunk->channels;
 
-    for (int i=0; i<width*height*channels; i+=channels) {
-        unsigned char* pixel = chunk->pixel_data;
-        unsigned char gray = (unsigned char)(0.299 * pixel[i+0] + 0.587 * pixel[i+1] + 0.114 * pixel[i+2]); // assuming RGB
-        pixel[i+0] = gray;
-        pixel[i+1] = gray;
-        pixel[i+2] = gray;
+    if (channels < 3) // already grey (or grey and alpha), e.g. after `edges`
+        return EXIT_SUCCESS;
+
+    if (chunk->layout == CHUNK_LAYOUT_PLANAR) { // whole planes at once, padding included: no shuffles, and it vectorizes
+        unsigned char* restrict r = chunk_plane(chunk, 0);
+        unsigned char* restrict g = chunk_plane(chunk, 1);
+        unsigned char* restrict b = chunk_plane(chunk, 2);
+        for (size_t i = 0; i < chunk->plane_size; i++) {
+            unsigned char gray = (unsigned char)((299 * r[i] + 587 * g[i] + 114 * b[i]) / 1000);
+            r[i] = gray;
+            g[i] = gray;
+            b[i] = gray;
+        }
+        return EXIT_SUCCESS;
     }
 
+    greyscale_rows[chunk->format][channels == 4](chunk->pixel_data, chunk->stride, width, height);
+
     return EXIT_SUCCESS;
 }
 
+/*
+* Running sums along one row: the window of pixel x is x .. x + line_size - 1, cut at the end of the row, so
+* every step adds the pixel entering it and takes out the one leaving it, whatever the length. Pixels are
+* replaced in place, the one leaving being kept aside first. With alpha (the last channel) the colours are
+* averaged premultiplied, weighted by their alpha, so transparent pixels do not bleed their colour into
+* opaque ones; the alpha is averaged as it is.
+*/
+#define DEFINE_DIRECTIONAL_BLUR_ROW(NAME, CHANNELS, ALPHA)                                      \
+static void NAME(unsigned char* pixel, int width, int line_size) {                              \
+    enum { COLOUR = (ALPHA)? (CHANNELS) - 1: (CHANNELS) };                                      \
+    int sums[CHANNELS] = {0}; /* colours, premultiplied with alpha, then alpha */               \
+    int count = line_size < width? line_size: width;                                            \
+                                                                                                \
+    for (int x = 0; x < count; x++) {                                                           \
+        const unsigned char* in = pixel + x * (CHANNELS);                                       \
+        int weight = (ALPHA)? in[COLOUR]: 1;                                                    \
+        for (int c = 0; c < COLOUR; c++) sums[c] += in[c] * weight;                             \
+        if (ALPHA) sums[COLOUR] += weight;                                                      \
+    }                                                                                           \
+                                                                                                \
+    for (int x = 0; x < width; x++) {                                                           \
+        unsigned char* out = pixel + x * (CHANNELS);                                            \
+        unsigned char leaving[CHANNELS];                                                        \
+        for (int c = 0; c < (CHANNELS); c++) leaving[c] = out[c];                               \
+                                                                                                \
+        if (!(ALPHA)) {                                                                         \
+            for (int c = 0; c < COLOUR; c++) out[c] = sums[c] / count;                          \
+        } else {                                                                                \
+            if (sums[COLOUR] > 0)                                                               \
+                for (int c = 0; c < COLOUR; c++) out[c] = sums[c] / sums[COLOUR];               \
+            out[COLOUR] = sums[COLOUR] / count;                                                 \
+        }                                                                                       \
+                                                                                                \
+        int weight = (ALPHA)? leaving[COLOUR]: 1;                                               \
+        for (int c = 0; c < COLOUR; c++) sums[c] -= leaving[c] * weight;                        \
+        if (ALPHA) sums[COLOUR] -= weight;                                                      \
+                                                                                                \
+        if (x + line_size < width) {                                                            \
+            const unsigned char* in = pixel + (x + line_size) * (CHANNELS);                     \
+            weight = (ALPHA)? in[COLOUR]: 1;                                                    \
+            for (int c = 0; c < COLOUR; c++) sums[c] += in[c] * weight;                         \
+            if (ALPHA) sums[COLOUR] += weight;                                                  \
+        } else {                                                                                \
+            count--;                                                                            \
+        }                                                                                       \
+    }                                                                                           \
+}
+
+DEFINE_DIRECTIONAL_BLUR_ROW(directional_blur_row_1, 1, false)
+DEFINE_DIRECTIONAL_BLUR_ROW(directional_blur_row_2, 2, true)
+DEFINE_DIRECTIONAL_BLUR_ROW(directional_blur_row_3, 3, false)
+DEFINE_DIRECTIONAL_BLUR_ROW(directional_blur_row_4, 4, true)
+
+typedef void (*directional_blur_row_fn)(unsigned char*, int, int);
+
+// by channel count - 1
+static const directional_blur_row_fn directional_blur_rows[4] = {
+    directional_blur_row_1, directional_blur_row_2, directional_blur_row_3, directional_blur_row_4,
+};
+
 int directional_blur(image_chunk_t* chunk, int line_size) {
     if (!chunk) {
         FPRINTF(stderr, "Error: chunk is NULL\n");
@@ -44,63 +151,38 @@ int directional_blur(image_chunk_t* chunk, int line_size) {
         FPRINTF(stderr, "Error: pixel_data is NULL\n");
         return EXIT_FAILURE;
     }
-
-    int width = chunk->width;
-    int height = chunk->height;
-    int channels = chunk->channels;
-    unsigned char* src = chunk->pixel_data;
-    unsigned char* dst = malloc(width * height * channels);
-    if (!dst) {
-        FPRINTF(stderr, "Error: failed to allocate blur buffer\n");
+    if (chunk->channels < 1 || chunk->channels > 4 || line_size < 1) {
+        FPRINTF(stderr, "Error: %d channels or line size %d not supported\n", chunk->channels, line_size);
         return EXIT_FAILURE;
     }
 
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            int total_r = 0, total_g = 0, total_b = 0, count = 0;
-            for (int k = 0; k < line_size; ++k) {
-                int nx = x + k;
-                if (nx >= width) break;
-                int idx = (y * width + nx) * channels;
-                total_r += src[idx + 0];
-                total_g += src[idx + 1];
-                total_b += src[idx + 2];
-                count++;
-            }
-            int out_idx = (y * width + x) * channels;
-            dst[out_idx + 0] = total_r / count;
-            dst[out_idx + 1] = total_g / count;
-            dst[out_idx + 2] = total_b / count;
-        }
-    }
-
-    memcpy(chunk->pixel_data, dst, width * height * channels);
-    free(dst);
+    directional_blur_row_fn row_fn = directional_blur_rows[chunk->channels - 1];
+    for (size_t y = 0; y < chunk->height; ++y)
+        row_fn(chunk->pixel_data + y * chunk->stride, chunk->width, line_size);
     return EXIT_SUCCESS;
 }
 
+// The same table as the `posterize` effect, so an alpha channel is left as it is.
 int posterize(image_chunk_t* chunk, int levels) {
     if (!chunk) {
         FPRINTF(stderr, "Error: chunk is NULL\n");
         return EXIT_FAILURE;
     }
-    if (!chunk->pixel_data) {
-        FPRINTF(stderr, "Error: pixel_data is NULL\n");
+    if (levels < 1 || levels > 256) {
+        FPRINTF(stderr, "Error: %d posterize levels\n", levels);
         return EXIT_FAILURE;
     }
 
-    int width = chunk->width;
-    int height = chunk->height;
-    int channels = chunk->channels;
-    unsigned char* pixel = chunk->pixel_data;
-
-    int step = 256 / levels;
-
-    for (int i = 0; i < width * height * channels; i += channels) {
-        for (int c = 0; c < channels; ++c) {
-            pixel[i + c] = (pixel[i + c] / step) * step;
-        }
-    }
+    lut_t lut;
+    lut_posterize(lut, levels);
+    if (chunk->format == PIXEL_FORMAT_U8)
+        return apply_lut(chunk, lut, NULL);
 
-    return EXIT_SUCCESS;
-}
\ No newline at end of file
+    uint16_t* deep = malloc(sizeof(lut16_t));
+    if (deep == NULL)
+        return EXIT_FAILURE;
+    lut16_posterize(deep, levels);
+    int status = apply_lut(chunk, lut, deep);
+    free(deep);
+    return status;
+}
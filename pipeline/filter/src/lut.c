@@ -0,0 +1,209 @@
+#include "lut.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "macros.h"
+
+static inline uint8_t clamp_value(double value) {
+    return (uint8_t)(value < 0? 0: value > 255? 255: lround(value));
+}
+
+void lut_identity(lut_t lut) {
+    for (int v = 0; v < 256; v++) lut[v] = (uint8_t)v;
+}
+
+void lut_compose(lut_t lut, const lut_t next) {
+    for (int v = 0; v < 256; v++) lut[v] = next[lut[v]];
+}
+
+void lut_posterize(lut_t lut, int levels) {
+    int step = 256 / levels;
+    for (int v = 0; v < 256; v++) lut[v] = (uint8_t)((v / step) * step);
+}
+
+void lut_brightness(lut_t lut, double delta) {
+    for (int v = 0; v < 256; v++) lut[v] = clamp_value(v + delta);
+}
+
+void lut_contrast(lut_t lut, double factor) {
+    for (int v = 0; v < 256; v++) lut[v] = clamp_value((v - 128) * factor + 128);
+}
+
+void lut_gamma(lut_t lut, double gamma) {
+    for (int v = 0; v < 256; v++) lut[v] = clamp_value(255.0 * pow(v / 255.0, 1.0 / gamma));
+}
+
+void lut_invert(lut_t lut) {
+    for (int v = 0; v < 256; v++) lut[v] = (uint8_t)(255 - v);
+}
+
+void lut_threshold(lut_t lut, double level) {
+    for (int v = 0; v < 256; v++) lut[v] = (v >= level)? 255: 0;
+}
+
+void lut_levels(lut_t lut, double black, double white, double gamma) {
+    for (int v = 0; v < 256; v++) {
+        double t = (v - black) / (white - black);
+        t = t < 0? 0: t > 1? 1: t;
+        lut[v] = clamp_value(255.0 * pow(t, 1.0 / gamma));
+    }
+}
+
+// 16-bit tables: 257 takes an 8-bit level (and the effects' parameters) to the same level in 16 bits.
+static inline uint16_t clamp_value16(double value) {
+    return (uint16_t)(value < 0? 0: value > 65535? 65535: lround(value));
+}
+
+void lut16_identity(lut16_t lut) {
+    for (int v = 0; v < 65536; v++) lut[v] = (uint16_t)v;
+}
+
+void lut16_compose(lut16_t lut, const lut16_t next) {
+    for (int v = 0; v < 65536; v++) lut[v] = next[lut[v]];
+}
+
+void lut16_posterize(lut16_t lut, int levels) {
+    int step = 257 * (256 / levels);
+    for (int v = 0; v < 65536; v++) lut[v] = (uint16_t)((v / step) * step);
+}
+
+void lut16_brightness(lut16_t lut, double delta) {
+    for (int v = 0; v < 65536; v++) lut[v] = clamp_value16(v + 257 * delta);
+}
+
+void lut16_contrast(lut16_t lut, double factor) {
+    for (int v = 0; v < 65536; v++) lut[v] = clamp_value16((v - 257 * 128) * factor + 257 * 128);
+}
+
+void lut16_gamma(lut16_t lut, double gamma) {
+    for (int v = 0; v < 65536; v++) lut[v] = clamp_value16(65535.0 * pow(v / 65535.0, 1.0 / gamma));
+}
+
+void lut16_invert(lut16_t lut) {
+    for (int v = 0; v < 65536; v++) lut[v] = (uint16_t)(65535 - v);
+}
+
+void lut16_threshold(lut16_t lut, double level) {
+    for (int v = 0; v < 65536; v++) lut[v] = (v >= 257 * level)? 65535: 0;
+}
+
+void lut16_levels(lut16_t lut, double black, double white, double gamma) {
+    for (int v = 0; v < 65536; v++) {
+        double t = (v / 257.0 - black) / (white - black);
+        t = t < 0? 0: t > 1? 1: t;
+        lut[v] = clamp_value16(65535.0 * pow(t, 1.0 / gamma));
+    }
+}
+
+/*
+* u16 samples index the 16-bit table. f32 samples are clamped to 0..1 and read it between its entries, by linear
+* interpolation, so they keep their precision everywhere except across a step, which is 1/65535 wide.
+*/
+static inline uint16_t lut_u16(const uint16_t* lut, uint16_t value) {
+    return lut[value];
+}
+
+static inline float lut_f32(const uint16_t* lut, float value) {
+    float position = (value > 0? (value < 1? value: 1): 0) * 65535;
+    int i = (int)position;
+    if (i > 65534) i = 65534;
+    return (lut[i] + ((float)lut[i + 1] - lut[i]) * (position - i)) * (1.0f / 65535);
+}
+
+static inline uint8_t lut_u8(const lut_t lut, uint8_t value) {
+    return lut[value];
+}
+
+// One loop per sample type and channel count; with 2 or 4 channels the last is alpha and is skipped.
+#define DEFINE_APPLY_LUT_ROWS(NAME, TYPE, LUT, CHANNELS, MAP)                                           \
+static void NAME(unsigned char* pixels, size_t stride, int width, int height, const void* table) {      \
+    enum { COLOUR = ((CHANNELS) == 2 || (CHANNELS) == 4)? (CHANNELS) - 1: (CHANNELS) };                 \
+    const LUT* lut = (const LUT*)table;                                                                 \
+    for (int y = 0; y < height; y++) {                                                                  \
+        TYPE* pixel = (TYPE*)(pixels + (size_t)y * stride);                                             \
+        for (int i = 0; i < width * (CHANNELS); i += (CHANNELS))                                        \
+            for (int c = 0; c < COLOUR; c++)                                                            \
+                pixel[i + c] = MAP(lut, pixel[i + c]);                                                  \
+    }                                                                                                   \
+}
+
+DEFINE_APPLY_LUT_ROWS(apply_lut_u8_2,  uint8_t,  uint8_t,  2, lut_u8)
+DEFINE_APPLY_LUT_ROWS(apply_lut_u8_4,  uint8_t,  uint8_t,  4, lut_u8)
+DEFINE_APPLY_LUT_ROWS(apply_lut_u16_1, uint16_t, uint16_t, 1, lut_u16)
+DEFINE_APPLY_LUT_ROWS(apply_lut_u16_2, uint16_t, uint16_t, 2, lut_u16)
+DEFINE_APPLY_LUT_ROWS(apply_lut_u16_3, uint16_t, uint16_t, 3, lut_u16)
+DEFINE_APPLY_LUT_ROWS(apply_lut_u16_4, uint16_t, uint16_t, 4, lut_u16)
+DEFINE_APPLY_LUT_ROWS(apply_lut_f32_1, float,    uint16_t, 1, lut_f32)
+DEFINE_APPLY_LUT_ROWS(apply_lut_f32_2, float,    uint16_t, 2, lut_f32)
+DEFINE_APPLY_LUT_ROWS(apply_lut_f32_3, float,    uint16_t, 3, lut_f32)
+DEFINE_APPLY_LUT_ROWS(apply_lut_f32_4, float,    uint16_t, 4, lut_f32)
+
+typedef void (*apply_lut_rows_fn)(unsigned char*, size_t, int, int, const void*);
+
+// by format, then channel count - 1; u8 without alpha takes the flat pass instead
+static const apply_lut_rows_fn apply_lut_rows[3][4] = {
+    [PIXEL_FORMAT_U8]  = { NULL,            apply_lut_u8_2,  NULL,            apply_lut_u8_4 },
+    [PIXEL_FORMAT_U16] = { apply_lut_u16_1, apply_lut_u16_2, apply_lut_u16_3, apply_lut_u16_4 },
+    [PIXEL_FORMAT_F32] = { apply_lut_f32_1, apply_lut_f32_2, apply_lut_f32_3, apply_lut_f32_4 },
+};
+
+int apply_lut(image_chunk_t* chunk, const lut_t lut, const lut16_t deep) {
+    if (!chunk || !chunk->pixel_data) {
+        FPRINTF(stderr, "Error: chunk or pixel_data is NULL\n");
+        return EXIT_FAILURE;
+    }
+    if (chunk->format != PIXEL_FORMAT_U8 && deep == NULL) {
+        FPRINTF(stderr, "Error: no 16-bit table for a u16 or f32 tile\n");
+        return EXIT_FAILURE;
+    }
+
+    unsigned char* pixel = chunk->pixel_data;
+    int channels = chunk->channels;
+    size_t count = chunk->data_size_bytes; // rows, padding included: a multiple of CHUNK_ALIGNMENT
+
+    if (chunk->layout == CHUNK_LAYOUT_PLANAR) // the colour planes back to back, and never alpha
+        count = chunk->plane_size * ((channels == 2 || channels == 4)? channels - 1: channels);
+
+    if (chunk->layout == CHUNK_LAYOUT_PLANAR || (chunk->format == PIXEL_FORMAT_U8 && (channels == 1 || channels == 3))) {
+        // no alpha: one flat pass, no tail
+        for (size_t i = 0; i < count; i += 4) {
+            uint8_t a = lut[pixel[i]], b = lut[pixel[i + 1]], c = lut[pixel[i + 2]], d = lut[pixel[i + 3]];
+            pixel[i] = a; pixel[i + 1] = b; pixel[i + 2] = c; pixel[i + 3] = d;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    // u16 and f32 tiles are always interleaved, see `chunk_layout_t`
+    apply_lut_rows[chunk->format][channels - 1](pixel, chunk->stride, chunk->width, chunk->height,
+        (chunk->format == PIXEL_FORMAT_U8)? (const void*)lut: (const void*)deep);
+    return EXIT_SUCCESS;
+}
+
+int apply_channel_luts(image_chunk_t* chunk, const lut_t* luts) {
+    if (!chunk || !chunk->pixel_data) {
+        FPRINTF(stderr, "Error: chunk or pixel_data is NULL\n");
+        return EXIT_FAILURE;
+    }
+
+    unsigned char* pixel = chunk->pixel_data;
+    size_t row = chunk->width * chunk->channels;
+    int channels = chunk->channels;
+
+    if (channels == 3) {
+        const uint8_t *r = luts[0], *g = luts[1], *b = luts[2];
+        for (size_t y = 0; y < chunk->height; y++, pixel += chunk->stride) {
+            for (size_t i = 0; i < row; i += 3) {
+                uint8_t red = r[pixel[i]], green = g[pixel[i + 1]], blue = b[pixel[i + 2]];
+                pixel[i] = red; pixel[i + 1] = green; pixel[i + 2] = blue;
+            }
+        }
+        return EXIT_SUCCESS;
+    }
+
+    for (size_t y = 0; y < chunk->height; y++, pixel += chunk->stride)
+        for (size_t i = 0; i < row; i += channels)
+            for (int c = 0; c < channels; c++)
+                pixel[i + c] = luts[c][pixel[i + c]];
+    return EXIT_SUCCESS;
+}
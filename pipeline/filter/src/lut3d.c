@@ -0,0 +1,201 @@
+#include "lut3d.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "macros.h"
+
+#define FRAC_BITS 10
+#define FRAC_ONE (1 << FRAC_BITS)
+#define POINT_SHIFT 6 // lattice values are stored as 0..255 << 6 (fits in int32 once multiplied by a fraction)
+
+// Recompute where every (pre-mapped) input value falls in the lattice.
+static void update_offsets(lut3d_t* lut3d) {
+    int n = lut3d->size;
+    uint32_t stride[3] = { 1, (uint32_t)n, (uint32_t)n * n };
+
+    for (int c = 0; c < 3; c++) {
+        float range = lut3d->domain_max[c] - lut3d->domain_min[c];
+        uint32_t* offset = lut3d->offset[c];
+        uint16_t* frac = lut3d->frac[c];
+
+        for (int v = 0; v < 256; v++) {
+            float t = (lut3d->pre[v] / 255.0f - lut3d->domain_min[c]) / range;
+            t = t < 0? 0: t > 1? 1: t;
+
+            float position = t * (n - 1);
+            int cell = (int)position;
+            if (cell > n - 2) cell = n - 2; // the top value sits at the far end of the last cell
+
+            offset[v] = cell * stride[c];
+            frac[v] = (uint16_t)lroundf((position - cell) * FRAC_ONE);
+        }
+    }
+}
+
+void lut3d_compose_pre(lut3d_t* lut3d, const lut_t pre) {
+    // `pre` runs first: the new table is the old one applied to pre's output
+    lut_t composed;
+    for (int v = 0; v < 256; v++) composed[v] = lut3d->pre[pre[v]];
+    memcpy(lut3d->pre, composed, sizeof(composed));
+    update_offsets(lut3d);
+}
+
+void lut3d_compose_post(lut3d_t* lut3d, const lut_t post) {
+    lut_compose(lut3d->post, post);
+}
+
+static char* skip_space(char* text) {
+    while (isspace((unsigned char)*text)) text++;
+    return text;
+}
+
+lut3d_t* lut3d_load(const char* path, size_t* size_bytes) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error: Cannot open LUT '%s': ", path);
+        perror(NULL);
+        return NULL;
+    }
+
+    lut3d_t* lut3d = NULL;
+    float domain_min[3] = {0, 0, 0}, domain_max[3] = {1, 1, 1};
+    size_t expected = 0, loaded = 0;
+    const char* problem = NULL;
+    char line[512];
+    int line_number = 0;
+
+    while (problem == NULL && fgets(line, sizeof(line), file) != NULL) {
+        line_number++;
+        char* text = skip_space(line);
+        if (*text == '\0' || *text == '#')
+            continue;
+
+        if (isalpha((unsigned char)*text)) {
+            int n;
+            float low, high;
+            if (strncmp(text, "TITLE", 5) == 0) {
+                continue;
+            } else if (sscanf(text, "LUT_3D_SIZE %d", &n) == 1) {
+                if (lut3d != NULL) { problem = "LUT_3D_SIZE given twice"; break; }
+                if (n < 2 || n > LUT3D_MAX_SIZE) { problem = "LUT_3D_SIZE must be between 2 and 256"; break; }
+                expected = (size_t)n * n * n;
+                *size_bytes = sizeof(lut3d_t) + expected * sizeof(lut3d->points[0]);
+                lut3d = calloc(1, *size_bytes);
+                if (lut3d == NULL) { problem = "out of memory"; break; }
+                lut3d->size = n;
+            } else if (sscanf(text, "DOMAIN_MIN %f %f %f", &domain_min[0], &domain_min[1], &domain_min[2]) == 3) {
+                continue;
+            } else if (sscanf(text, "DOMAIN_MAX %f %f %f", &domain_max[0], &domain_max[1], &domain_max[2]) == 3) {
+                continue;
+            } else if (sscanf(text, "LUT_3D_INPUT_RANGE %f %f", &low, &high) == 2) {
+                for (int c = 0; c < 3; c++) { // the older form of DOMAIN_MIN/MAX, the same for every channel
+                    domain_min[c] = low;
+                    domain_max[c] = high;
+                }
+            } else if (strncmp(text, "LUT_1D_SIZE", 11) == 0) {
+                problem = "1D .cube files are not supported";
+            } else {
+                // keywords of other tools (LUT_IN_VIDEO_RANGE, ...) do not change the table; the points follow
+                size_t length = strcspn(text, " \t\r\n");
+                fprintf(stderr, "Warning: %s:%d: ignoring unknown keyword '%.*s'.\n", path, line_number, (int)length, text);
+            }
+            continue;
+        }
+
+        float rgb[3];
+        if (sscanf(text, "%f %f %f", &rgb[0], &rgb[1], &rgb[2]) != 3) { problem = "expected three numbers"; break; }
+        if (lut3d == NULL) { problem = "data before LUT_3D_SIZE"; break; }
+        if (loaded == expected) { problem = "more points than LUT_3D_SIZE^3"; break; }
+
+        for (int c = 0; c < 3; c++) {
+            float value = rgb[c] < 0? 0: rgb[c] > 1? 1: rgb[c];
+            lut3d->points[loaded][c] = (uint16_t)lroundf(value * 255.0f * (1 << POINT_SHIFT));
+        }
+        loaded++;
+    }
+    fclose(file);
+
+    if (problem == NULL && lut3d == NULL) problem = "missing LUT_3D_SIZE";
+    if (problem == NULL && loaded != expected) problem = "fewer points than LUT_3D_SIZE^3";
+    for (int c = 0; c < 3 && problem == NULL; c++)
+        if (!(domain_max[c] > domain_min[c])) problem = "DOMAIN_MAX must be greater than DOMAIN_MIN";
+
+    if (problem != NULL) {
+        fprintf(stderr, "Error: %s:%d: %s.\n", path, line_number, problem);
+        free(lut3d);
+        return NULL;
+    }
+
+    memcpy(lut3d->domain_min, domain_min, sizeof(domain_min));
+    memcpy(lut3d->domain_max, domain_max, sizeof(domain_max));
+    lut_identity(lut3d->pre);
+    lut_identity(lut3d->post);
+    update_offsets(lut3d);
+    return lut3d;
+}
+
+/*
+* @brief Tetrahedral interpolation of the cell at `base`: the cell is split into six tetrahedra along its
+* main diagonal, and the order of the three fractions selects the one containing the point.
+*/
+static inline void interpolate(const lut3d_t* lut3d, uint8_t r, uint8_t g, uint8_t b, uint8_t out[3]) {
+    const uint32_t n = lut3d->size;
+    const uint32_t dr = 1, dg = n, db = n * n;
+    const uint32_t base = lut3d->offset[0][r] + lut3d->offset[1][g] + lut3d->offset[2][b];
+    const int32_t fr = lut3d->frac[0][r], fg = lut3d->frac[1][g], fb = lut3d->frac[2][b];
+
+    const uint16_t* c000 = lut3d->points[base];
+    const uint16_t* c111 = lut3d->points[base + dr + dg + db];
+    const uint16_t *first, *second; // the two corners between c000 and c111
+    int32_t f0, f1, f2;             // largest, middle and smallest fraction
+
+    if (fr >= fg) {
+        if (fg >= fb)      { first = lut3d->points[base + dr]; second = lut3d->points[base + dr + dg]; f0 = fr; f1 = fg; f2 = fb; }
+        else if (fr >= fb) { first = lut3d->points[base + dr]; second = lut3d->points[base + dr + db]; f0 = fr; f1 = fb; f2 = fg; }
+        else               { first = lut3d->points[base + db]; second = lut3d->points[base + dr + db]; f0 = fb; f1 = fr; f2 = fg; }
+    } else {
+        if (fb >= fg)      { first = lut3d->points[base + db]; second = lut3d->points[base + dg + db]; f0 = fb; f1 = fg; f2 = fr; }
+        else if (fb >= fr) { first = lut3d->points[base + dg]; second = lut3d->points[base + dg + db]; f0 = fg; f1 = fb; f2 = fr; }
+        else               { first = lut3d->points[base + dg]; second = lut3d->points[base + dr + dg]; f0 = fg; f1 = fr; f2 = fb; }
+    }
+
+    for (int c = 0; c < 3; c++) {
+        int32_t value = ((int32_t)c000[c] << FRAC_BITS)
+                      + f0 * ((int32_t)first[c] - c000[c])
+                      + f1 * ((int32_t)second[c] - first[c])
+                      + f2 * ((int32_t)c111[c] - second[c]);
+        value = (value + (1 << (FRAC_BITS + POINT_SHIFT - 1))) >> (FRAC_BITS + POINT_SHIFT);
+        out[c] = lut3d->post[value < 0? 0: value > 255? 255: value];
+    }
+}
+
+int apply_lut3d(image_chunk_t* chunk, const lut3d_t* lut3d) {
+    if (!chunk || !chunk->pixel_data) {
+        FPRINTF(stderr, "Error: chunk or pixel_data is NULL\n");
+        return EXIT_FAILURE;
+    }
+
+    size_t row = (size_t)chunk->width * chunk->channels;
+    int channels = chunk->channels;
+
+    for (size_t y = 0; y < chunk->height; y++) {
+        unsigned char* pixel = chunk->pixel_data + y * chunk->stride;
+        if (channels >= 3) {
+            for (size_t i = 0; i < row; i += channels)
+                interpolate(lut3d, pixel[i], pixel[i + 1], pixel[i + 2], &pixel[i]);
+            continue;
+        }
+
+        // grey (and grey + alpha): look the grey value up on the cube's diagonal and keep the luma of the result
+        for (size_t i = 0; i < row; i += channels) {
+            uint8_t rgb[3];
+            interpolate(lut3d, pixel[i], pixel[i], pixel[i], rgb);
+            pixel[i] = (uint8_t)((299 * rgb[0] + 587 * rgb[1] + 114 * rgb[2]) / 1000);
+        }
+    }
+    return EXIT_SUCCESS;
+}
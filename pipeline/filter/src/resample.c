@@ -0,0 +1,251 @@
+#include "resample.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "macros.h"
+
+#define WEIGHT_BITS 14
+#define WEIGHT_ROUND (1 << (WEIGHT_BITS - 1))
+#define TRANSPOSE_BLOCK 32 // pixels; a 32x32 block of RGBA bytes is 4 KiB
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static const struct {
+    const char* name;
+    double support; // radius of the kernel, in source pixels at scale 1
+} kernels[RESAMPLE_KERNEL_COUNT] = {
+    [RESAMPLE_BOX]      = { "box",      0.5 },
+    [RESAMPLE_BILINEAR] = { "bilinear", 1.0 },
+    [RESAMPLE_LANCZOS3] = { "lanczos",  3.0 },
+};
+
+const char* resample_kernel_name(resample_kernel_t kernel) {
+    return (kernel >= 0 && kernel < RESAMPLE_KERNEL_COUNT)? kernels[kernel].name: "unknown";
+}
+
+int resample_kernel_from_name(const char* name, resample_kernel_t* kernel) {
+    for (int k = 0; k < RESAMPLE_KERNEL_COUNT; k++) {
+        if (strcmp(name, kernels[k].name) == 0) {
+            *kernel = (resample_kernel_t)k;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static inline double sinc(double x) {
+    if (x == 0.0) return 1.0;
+    x *= M_PI;
+    return sin(x) / x;
+}
+
+static double kernel_weight(resample_kernel_t kernel, double x) {
+    switch (kernel) {
+        case RESAMPLE_BOX:      return (x >= -0.5 && x < 0.5)? 1.0: 0.0;
+        case RESAMPLE_BILINEAR: x = fabs(x); return (x < 1.0)? 1.0 - x: 0.0;
+        case RESAMPLE_LANCZOS3: return (fabs(x) < 3.0)? sinc(x) * sinc(x / 3.0): 0.0;
+        default:                return 0.0;
+    }
+}
+
+// The taps of one axis: output pixel `i` reads `count[i]` source pixels from `start[i]`, weighted by `weights[i * max_taps ...]`.
+typedef struct {
+    int* start;
+    int* count;
+    int16_t* weights;
+    int max_taps;
+} taps_t;
+
+static void free_taps(taps_t* taps) {
+    free(taps->start);
+    free(taps->count);
+    free(taps->weights);
+    taps->start = taps->count = NULL;
+    taps->weights = NULL;
+}
+
+static int compute_taps(taps_t* taps, size_t src_size, size_t dst_size, resample_kernel_t kernel) {
+    double ratio = (double)src_size / dst_size;
+    double filter_scale = (ratio > 1.0)? ratio: 1.0; // widen the kernel when shrinking
+    double support = kernels[kernel].support * filter_scale;
+
+    taps->max_taps = (int)ceil(support) * 2 + 1;
+    taps->start = malloc(dst_size * sizeof(int));
+    taps->count = malloc(dst_size * sizeof(int));
+    taps->weights = calloc(dst_size * taps->max_taps, sizeof(int16_t));
+    double* scratch = malloc(taps->max_taps * sizeof(double));
+    if (!taps->start || !taps->count || !taps->weights || !scratch) {
+        free(scratch);
+        free_taps(taps);
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < dst_size; i++) {
+        double center = (i + 0.5) * ratio;
+        int lo = (int)floor(center - support);
+        int hi = (int)ceil(center + support);
+        if (lo < 0) lo = 0;
+        if (hi > (int)src_size) hi = (int)src_size;
+        if (hi - lo > taps->max_taps) hi = lo + taps->max_taps;
+
+        double total = 0.0;
+        for (int j = lo; j < hi; j++) {
+            scratch[j - lo] = kernel_weight(kernel, (j + 0.5 - center) / filter_scale);
+            total += scratch[j - lo];
+        }
+
+        int16_t* weights = &taps->weights[i * taps->max_taps];
+        if (total == 0.0) { // cannot happen for the kernels above, but never divide by zero
+            lo = (int)center < (int)src_size? (int)center: (int)src_size - 1;
+            hi = lo + 1;
+            scratch[0] = total = 1.0;
+        }
+
+        // quantize, then push the rounding error into the largest tap so that the weights sum to exactly 1.0
+        int sum = 0, largest = 0;
+        for (int j = 0; j < hi - lo; j++) {
+            weights[j] = (int16_t)lround(scratch[j] / total * (1 << WEIGHT_BITS));
+            sum += weights[j];
+            if (weights[j] > weights[largest]) largest = j;
+        }
+        weights[largest] += (1 << WEIGHT_BITS) - sum;
+
+        taps->start[i] = lo;
+        taps->count[i] = hi - lo;
+    }
+
+    free(scratch);
+    return EXIT_SUCCESS;
+}
+
+static inline unsigned char clamp_pixel(int32_t value) {
+    value >>= WEIGHT_BITS;
+    return (unsigned char)(value < 0? 0: value > 255? 255: value);
+}
+
+// Rows are contiguous, so the inner loop runs over a whole row at once and vectorizes.
+static void vertical_pass(const unsigned char* src, size_t width, int channels,
+                          unsigned char* dst, size_t dst_height, const taps_t* taps, int32_t* acc) {
+    size_t row_length = width * channels;
+
+    for (size_t y = 0; y < dst_height; y++) {
+        for (size_t i = 0; i < row_length; i++) acc[i] = WEIGHT_ROUND;
+
+        const int16_t* weights = &taps->weights[y * taps->max_taps];
+        for (int k = 0; k < taps->count[y]; k++) {
+            const unsigned char* row = src + (size_t)(taps->start[y] + k) * row_length;
+            int32_t weight = weights[k];
+            for (size_t i = 0; i < row_length; i++)
+                acc[i] += weight * row[i];
+        }
+
+        unsigned char* out = dst + y * row_length;
+        for (size_t i = 0; i < row_length; i++)
+            out[i] = clamp_pixel(acc[i]);
+    }
+}
+
+// `in` is `width` x `height`, `out` becomes `height` x `width`; `channels` is a constant in each caller below.
+static inline void transpose_pixels(const unsigned char* in, unsigned char* out, size_t width, size_t height, int channels) {
+    for (size_t by = 0; by < height; by += TRANSPOSE_BLOCK) {
+        for (size_t bx = 0; bx < width; bx += TRANSPOSE_BLOCK) {
+            size_t y_end = by + TRANSPOSE_BLOCK < height? by + TRANSPOSE_BLOCK: height;
+            size_t x_end = bx + TRANSPOSE_BLOCK < width? bx + TRANSPOSE_BLOCK: width;
+            for (size_t y = by; y < y_end; y++)
+                for (size_t x = bx; x < x_end; x++)
+                    for (int c = 0; c < channels; c++)
+                        out[(x * height + y) * channels + c] = in[(y * width + x) * channels + c];
+        }
+    }
+}
+
+static void transpose(const unsigned char* in, unsigned char* out, size_t width, size_t height, int channels) {
+    switch (channels) {
+        case 1:  transpose_pixels(in, out, width, height, 1); break;
+        case 2:  transpose_pixels(in, out, width, height, 2); break;
+        case 3:  transpose_pixels(in, out, width, height, 3); break;
+        case 4:  transpose_pixels(in, out, width, height, 4); break;
+        default: transpose_pixels(in, out, width, height, channels); break;
+    }
+}
+
+// Along a row, the taps of one pixel are a few samples `channels` apart, which does not vectorize; so the
+// rows are transposed into columns, resized by `vertical_pass`, and transposed back.
+static int horizontal_pass(const unsigned char* src, size_t src_width, size_t height, int channels,
+                           unsigned char* dst, size_t dst_width, const taps_t* taps, int32_t* acc) {
+    unsigned char* columns = malloc(src_width * height * channels);
+    unsigned char* resized = malloc(dst_width * height * channels);
+    if (columns == NULL || resized == NULL) {
+        free(columns);
+        free(resized);
+        return EXIT_FAILURE;
+    }
+
+    transpose(src, columns, src_width, height, channels);
+    vertical_pass(columns, height, channels, resized, dst_width, taps, acc);
+    transpose(resized, dst, height, dst_width, channels);
+
+    free(columns);
+    free(resized);
+    return EXIT_SUCCESS;
+}
+
+int resample(const unsigned char* src, size_t src_width, size_t src_height, int channels,
+             unsigned char* dst, size_t dst_width, size_t dst_height, resample_kernel_t kernel) {
+    if (src_width == dst_width && src_height == dst_height) {
+        memcpy(dst, src, src_width * src_height * channels);
+        return EXIT_SUCCESS;
+    }
+
+    taps_t horizontal = {0}, vertical = {0};
+    unsigned char* temp = NULL;
+    int32_t* acc = NULL;
+    int status = EXIT_FAILURE;
+
+    // each pass is skipped when its axis keeps its size
+    bool resize_x = src_width != dst_width;
+    bool resize_y = src_height != dst_height;
+
+    if (resize_x && compute_taps(&horizontal, src_width, dst_width, kernel) != EXIT_SUCCESS)
+        goto done;
+    if (resize_y && compute_taps(&vertical, src_height, dst_height, kernel) != EXIT_SUCCESS)
+        goto done;
+
+    // one row of either pass: a transposed source column for the horizontal one
+    size_t acc_length = (src_height > dst_width? src_height: dst_width) * channels;
+    acc = malloc(acc_length * sizeof(int32_t));
+    if (acc == NULL)
+        goto done;
+
+    if (!resize_y) {
+        status = horizontal_pass(src, src_width, src_height, channels, dst, dst_width, &horizontal, acc);
+        goto done;
+    }
+
+    const unsigned char* columns = src;
+    if (resize_x) {
+        temp = malloc(dst_width * src_height * channels);
+        if (temp == NULL || horizontal_pass(src, src_width, src_height, channels, temp, dst_width, &horizontal, acc) != EXIT_SUCCESS)
+            goto done;
+        columns = temp;
+    }
+
+    vertical_pass(columns, dst_width, channels, dst, dst_height, &vertical, acc);
+    status = EXIT_SUCCESS;
+
+done:
+    if (status != EXIT_SUCCESS) {
+        FPRINTF(stderr, "Error: failed to allocate resampling buffers\n");
+    }
+    free(acc);
+    free(temp);
+    free_taps(&horizontal);
+    free_taps(&vertical);
+    return status;
+}
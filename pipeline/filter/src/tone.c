@@ -0,0 +1,234 @@
+#include "tone.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "macros.h"
+
+size_t image_histogram_of_chunk(image_histogram_t* histogram, const image_chunk_t* chunk) {
+    memset(histogram, 0, sizeof(*histogram));
+
+    int channels = chunk->channels;
+    int colour = tone_colour_channels(channels);
+    size_t core_width = chunk->width - chunk->halo_left - chunk->halo_right;
+    size_t core_height = chunk->height - chunk->halo_top - chunk->halo_bottom;
+    size_t stride = chunk->stride;
+
+    for (size_t y = 0; y < core_height; y++) {
+        const unsigned char* pixel = chunk->pixel_data + (chunk->halo_top + y) * stride + chunk->halo_left * channels;
+        const unsigned char* end = pixel + core_width * channels;
+
+        if (channels == 3) {
+            for (; pixel < end; pixel += 3) {
+                histogram->counts[0][pixel[0]]++;
+                histogram->counts[1][pixel[1]]++;
+                histogram->counts[2][pixel[2]]++;
+            }
+            continue;
+        }
+
+        for (; pixel < end; pixel += channels)
+            for (int c = 0; c < colour; c++) histogram->counts[c][pixel[c]]++;
+    }
+    return core_width * core_height;
+}
+
+void image_histogram_merge(image_histogram_t* into, const image_histogram_t* other) {
+    uint32_t* a = &into->counts[0][0];
+    const uint32_t* b = &other->counts[0][0];
+    for (size_t i = 0; i < TONE_MAX_CHANNELS * 256; i++) a[i] += b[i];
+}
+
+void image_histogram_reduce(image_histogram_t* partials, size_t count) {
+    for (size_t step = 1; step < count; step *= 2)
+        for (size_t i = 0; i + step < count; i += 2 * step)
+            image_histogram_merge(&partials[i], &partials[i + step]);
+}
+
+int tone_colour_channels(int channels) {
+    return (channels == 2 || channels == 4)? channels - 1: channels;
+}
+
+// The first and last values once `clip` percent of `total` has been cut off each end; low == high for a flat image.
+static void clipped_range(const uint64_t counts[256], double clip, int* low, int* high) {
+    uint64_t total = 0;
+    for (int v = 0; v < 256; v++) total += counts[v];
+
+    uint64_t cut = (uint64_t)(total * clip / 100.0);
+    uint64_t seen = 0;
+    for (*low = 0; *low < 255 && (seen += counts[*low]) <= cut; (*low)++);
+    seen = 0;
+    for (*high = 255; *high > 0 && (seen += counts[*high]) <= cut; (*high)--);
+}
+
+static void stretch(lut_t lut, int low, int high) {
+    if (high <= low) {
+        lut_identity(lut);
+        return;
+    }
+    for (int v = 0; v < 256; v++) {
+        int value = ((v - low) * 255 + (high - low) / 2) / (high - low);
+        lut[v] = (uint8_t)(v <= low? 0: v >= high? 255: value);
+    }
+}
+
+static void identity_alpha(int channels, lut_t luts[TONE_MAX_CHANNELS]) {
+    for (int c = tone_colour_channels(channels); c < TONE_MAX_CHANNELS; c++) lut_identity(luts[c]);
+}
+
+void tone_autolevels(const image_histogram_t* histogram, int channels, double clip, lut_t luts[TONE_MAX_CHANNELS]) {
+    int colour = tone_colour_channels(channels);
+    uint64_t joint[256] = {0};
+    for (int c = 0; c < colour; c++)
+        for (int v = 0; v < 256; v++) joint[v] += histogram->counts[c][v];
+
+    int low, high;
+    clipped_range(joint, clip, &low, &high);
+    for (int c = 0; c < colour; c++) stretch(luts[c], low, high);
+    identity_alpha(channels, luts);
+}
+
+void tone_whitebalance(const image_histogram_t* histogram, int channels, double clip, lut_t luts[TONE_MAX_CHANNELS]) {
+    int colour = tone_colour_channels(channels);
+    for (int c = 0; c < colour; c++) {
+        uint64_t counts[256];
+        for (int v = 0; v < 256; v++) counts[v] = histogram->counts[c][v];
+
+        int low, high;
+        clipped_range(counts, clip, &low, &high);
+        stretch(luts[c], low, high);
+    }
+    identity_alpha(channels, luts);
+}
+
+void tone_equalize(const image_histogram_t* histogram, int channels, lut_t luts[TONE_MAX_CHANNELS]) {
+    int colour = tone_colour_channels(channels);
+    for (int c = 0; c < colour; c++) {
+        const uint32_t* counts = histogram->counts[c];
+        uint64_t total = 0, first = 0;
+        for (int v = 0; v < 256; v++) total += counts[v];
+        for (int v = 0; v < 256 && first == 0; v++) first = counts[v]; // pixels of the darkest value present map to 0
+
+        if (total == first) {
+            lut_identity(luts[c]);
+            continue;
+        }
+
+        uint64_t cumulative = 0;
+        for (int v = 0; v < 256; v++) {
+            cumulative += counts[v];
+            uint64_t above = (cumulative > first)? cumulative - first: 0;
+            luts[c][v] = (uint8_t)((above * 255 + (total - first) / 2) / (total - first));
+        }
+    }
+    identity_alpha(channels, luts);
+}
+
+void tone_clahe_tile(const image_histogram_t* histogram, int channels, size_t pixels, double clip, lut_t luts[TONE_MAX_CHANNELS]) {
+    int colour = tone_colour_channels(channels);
+    uint64_t limit = (uint64_t)(clip * pixels / 256);
+    if (limit < 1) limit = 1;
+
+    for (int c = 0; c < colour; c++) {
+        uint64_t counts[256], excess = 0;
+        for (int v = 0; v < 256; v++) {
+            counts[v] = histogram->counts[c][v];
+            if (counts[v] > limit) {
+                excess += counts[v] - limit;
+                counts[v] = limit;
+            }
+        }
+
+        // spread the excess evenly, the remainder one by one over evenly spaced values
+        uint64_t share = excess / 256, rest = excess % 256;
+        for (int v = 0; v < 256; v++) counts[v] += share;
+        if (rest > 0) {
+            uint64_t step = 256 / rest;
+            for (uint64_t v = 0; v < 256 && rest > 0; v += step, rest--) counts[v]++;
+        }
+
+        uint64_t cumulative = 0;
+        for (int v = 0; v < 256; v++) {
+            cumulative += counts[v];
+            uint64_t value = (pixels > 0)? (cumulative * 255 + pixels / 2) / pixels: (uint64_t)v;
+            luts[c][v] = (uint8_t)(value > 255? 255: value);
+        }
+    }
+    identity_alpha(channels, luts);
+}
+
+typedef struct {
+    uint32_t first;  // the tile whose centre is at or before the pixel
+    uint32_t second; // the next one (the same one past the outermost centres)
+    uint32_t weight; // of `second`, out of 256
+} blend_t;
+
+// Twice the centre of tile `index` along an axis of `extent` pixels; the last tile may be shorter than `tile`.
+static size_t tile_centre2(size_t index, size_t tile, size_t extent) {
+    size_t start = index * tile;
+    size_t size = (extent - start < tile)? extent - start: tile;
+    return 2 * start + size;
+}
+
+// Where a pixel at `position` lies between the centres of tiles of size `tile` along an axis of `extent` pixels
+static blend_t blend_at(size_t position, size_t tile, size_t tiles, size_t extent) {
+    blend_t blend = { 0, 0, 0 };
+    size_t pixel2 = 2 * position + 1; // twice the pixel's centre, like the tiles'
+    size_t first = position / tile;
+    if (pixel2 < tile_centre2(first, tile, extent)) {
+        if (first == 0)
+            return blend; // before the first centre
+        first--;
+    }
+
+    if (first >= tiles - 1) {
+        blend.first = blend.second = (uint32_t)(tiles - 1);
+        return blend;
+    }
+
+    size_t from = tile_centre2(first, tile, extent), to = tile_centre2(first + 1, tile, extent);
+    blend.first = (uint32_t)first;
+    blend.second = (uint32_t)(first + 1);
+    blend.weight = (uint32_t)((pixel2 - from) * 256 / (to - from));
+    return blend;
+}
+
+int apply_clahe(image_chunk_t* chunk, const lut_t (*tile_luts)[TONE_MAX_CHANNELS]) {
+    if (!chunk || !chunk->pixel_data || !tile_luts) {
+        FPRINTF(stderr, "Error: chunk, pixel_data or tile mappings are NULL\n");
+        return EXIT_FAILURE;
+    }
+
+    int channels = chunk->channels;
+    int colour = tone_colour_channels(channels);
+    size_t columns = (size_t)chunk->tile_columns;
+
+    blend_t* across = malloc(chunk->width * sizeof(blend_t));
+    if (across == NULL)
+        return EXIT_FAILURE;
+    for (size_t x = 0; x < chunk->width; x++)
+        across[x] = blend_at(chunk->offset_x + x, chunk->tile_width, columns, (size_t)chunk->original_image_width);
+
+    for (size_t y = 0; y < chunk->height; y++) {
+        blend_t down = blend_at(chunk->offset_y + y, chunk->tile_height, (size_t)chunk->tile_rows,
+                                (size_t)chunk->original_image_height);
+        const lut_t (*upper)[TONE_MAX_CHANNELS] = tile_luts + down.first * columns;
+        const lut_t (*lower)[TONE_MAX_CHANNELS] = tile_luts + down.second * columns;
+        uint32_t wy = down.weight;
+        unsigned char* pixel = chunk->pixel_data + y * chunk->stride;
+
+        for (size_t x = 0; x < chunk->width; x++, pixel += channels) {
+            blend_t b = across[x];
+            uint32_t wx = b.weight;
+            for (int c = 0; c < colour; c++) {
+                uint8_t v = pixel[c];
+                uint32_t top = upper[b.first][c][v] * (256 - wx) + upper[b.second][c][v] * wx;
+                uint32_t bottom = lower[b.first][c][v] * (256 - wx) + lower[b.second][c][v] * wx;
+                pixel[c] = (uint8_t)((top * (256 - wy) + bottom * wy + 32768) >> 16);
+            }
+        }
+    }
+
+    free(across);
+    return EXIT_SUCCESS;
+}
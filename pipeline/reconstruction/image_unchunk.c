@@ -3,13 +3,10 @@
 #include "image_unchunk.h"
 #include <stb_image_write.h>
 #include <stdatomic.h>
+#include <strings.h>
 #include <macros.h>
-
-extern atomic_size_t total_images_written;
-
-char *generate_suffix(const char **effects, int num_effects) {
-    return strdup("processed"); // simple for now
-}
+#include "stats.h"
+#include "trace.h"
 
 /*
 * @brief Get the directory part of a given path.
@@ -122,17 +119,18 @@ char *result_path(const char *output_directory, const char *original_path, const
     return new_path;
 }
 
-/* Creates an empty image with the specified `width`, `height`, and number of `channels`.
+/* Creates an empty image with the specified `width`, `height`, number of `channels` and sample `format`.
 * @note The pixel data is initialized to zero.
 */
-static inline image_t create_empty_image(int width, int height, int channels) {
+static inline image_t create_empty_image(int width, int height, int channels, pixel_format_t format) {
     image_t image;
     image.width = width;
     image.height = height;
     image.channels = channels;
+    image.format = format;
 
-    image.pixel_data = (unsigned char *)malloc(sizeof(unsigned char) * width * height * channels);
-    memset(image.pixel_data, 0, width * height * channels);
+    image.pixel_data = (unsigned char *)calloc(image_size_bytes(&image), 1);
+    stats_add(COUNTER_INFLIGHT_BYTES, (int64_t)image_size_bytes(&image));
 
     return image;
 }
@@ -144,16 +142,185 @@ static inline size_t convert_to_index(int x, int y, size_t width, size_t cell_si
     return (y * width + x) * cell_size;
 }
 
-void write_image(image_t image, const char *path) {
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+} encode_buffer_t;
+
+// stb_image_write callback: append the encoded bytes to an in-memory buffer.
+static void append_encoded(void* context, void* data, int size) {
+    encode_buffer_t* buffer = (encode_buffer_t*)context;
+    if (buffer->data == NULL && buffer->capacity != 0)
+        return; // an earlier allocation failed
+
+    if (buffer->size + size > buffer->capacity) {
+        size_t capacity = buffer->capacity? buffer->capacity: 64 * 1024;
+        while (capacity < buffer->size + size)
+            capacity *= 2;
+
+        unsigned char* grown = realloc(buffer->data, capacity);
+        if (grown == NULL) {
+            free(buffer->data);
+            buffer->data = NULL;
+            buffer->capacity = 1;
+            return;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+static bool has_extension(const char* path, const char* extension) {
+    const char* dot = strrchr(path, '.');
+    return dot != NULL && strcasecmp(dot, extension) == 0;
+}
+
+// PNG keeps 16 bits (and f32 becomes 16 bits), Radiance HDR takes floats, JPEG only 8 bits.
+static pixel_format_t output_format(const char* path, pixel_format_t format) {
+    if (has_extension(path, ".hdr"))
+        return PIXEL_FORMAT_F32;
+    if (has_extension(path, ".png") && format != PIXEL_FORMAT_U8)
+        return PIXEL_FORMAT_U16;
+    return PIXEL_FORMAT_U8;
+}
+
+static void put_u32(unsigned char* out, uint32_t value) {
+    out[0] = value >> 24; out[1] = value >> 16; out[2] = value >> 8; out[3] = value;
+}
+
+static uint32_t png_crc(const unsigned char* data, size_t size, uint32_t crc) {
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+    }
+    return crc;
+}
+
+static void write_png_chunk(stbi_write_func* func, void* context, const char* type, const unsigned char* data, size_t size) {
+    unsigned char header[8], footer[4];
+    put_u32(header, (uint32_t)size);
+    memcpy(header + 4, type, 4);
+    put_u32(footer, ~png_crc(data, size, png_crc(header + 4, 4, ~0u)));
+
+    func(context, header, sizeof(header));
+    if (size > 0) func(context, (void*)data, (int)size);
+    func(context, footer, sizeof(footer));
+}
+
+/*
+* @brief A 16-bit PNG, which stb_image_write does not produce: samples are stored big-endian, every row with
+* the Sub filter (the difference to the same byte of the previous pixel), and compressed with stb's zlib.
+*/
+static int write_png16_to_func(stbi_write_func* func, void* context, int width, int height, int channels, const uint16_t* pixels) {
+    static const unsigned char colour_types[5] = { 0, 0, 4, 2, 6 }; // grey, grey + alpha, RGB, RGBA
+    size_t row_bytes = (size_t)width * channels * 2, pixel_bytes = (size_t)channels * 2;
+
+    unsigned char* filtered = malloc((row_bytes + 1) * height);
+    if (filtered == NULL)
+        return 0;
+    for (int y = 0; y < height; y++) {
+        unsigned char* out = filtered + (size_t)y * (row_bytes + 1);
+        const uint16_t* in = pixels + (size_t)y * width * channels;
+        *out++ = 1; // Sub
+        for (size_t i = 0; i < (size_t)width * channels; i++) {
+            out[2 * i] = in[i] >> 8;
+            out[2 * i + 1] = in[i] & 0xFF;
+        }
+        for (size_t i = row_bytes; i-- > pixel_bytes; ) out[i] -= out[i - pixel_bytes];
+    }
+
+    int compressed_size = 0;
+    unsigned char* compressed = stbi_zlib_compress(filtered, (int)((row_bytes + 1) * height), &compressed_size, stbi_write_png_compression_level);
+    free(filtered);
+    if (compressed == NULL)
+        return 0;
+
+    unsigned char header[13];
+    put_u32(header, width);
+    put_u32(header + 4, height);
+    header[8] = 16;
+    header[9] = colour_types[channels];
+    header[10] = header[11] = header[12] = 0; // deflate, adaptive filtering, no interlacing
+
+    func(context, (void*)"\x89PNG\r\n\x1a\n", 8);
+    write_png_chunk(func, context, "IHDR", header, sizeof(header));
+    write_png_chunk(func, context, "IDAT", compressed, compressed_size);
+    write_png_chunk(func, context, "IEND", NULL, 0);
+    free(compressed);
+    return 1;
+}
+
+unsigned char* encode_image(image_t image, const char *name, size_t *size) {
+    assert(name != NULL && size != NULL);
+
+    // The channel count is the image's own, which effects may have changed (e.g. `edges` leaves one).
+    encode_buffer_t encoded = {NULL, 0, 0};
+    uint64_t encode_start = trace_enabled? now_ns(): 0;
+
+    // samples the format cannot hold are converted into a copy
+    image_t output = image;
+    output.format = output_format(name, image.format);
+    if (output.format != image.format) {
+        output.pixel_data = malloc(image_size_bytes(&output));
+        if (output.pixel_data == NULL)
+            return NULL;
+        convert_samples(image.pixel_data, image.format, output.pixel_data, output.format, image.width * image.height * image.channels);
+    }
+
+    int result;
+    if (output.format == PIXEL_FORMAT_F32)
+        result = stbi_write_hdr_to_func(append_encoded, &encoded, output.width, output.height, output.channels, (const float*)output.pixel_data);
+    else if (output.format == PIXEL_FORMAT_U16)
+        result = write_png16_to_func(append_encoded, &encoded, output.width, output.height, output.channels, (const uint16_t*)output.pixel_data);
+    else if (has_extension(name, ".png"))
+        result = stbi_write_png_to_func(append_encoded, &encoded, output.width, output.height, output.channels, output.pixel_data, output.width * output.channels);
+    else
+        result = stbi_write_jpg_to_func(append_encoded, &encoded, output.width, output.height, output.channels, output.pixel_data, 100);
+    if (output.pixel_data != image.pixel_data)
+        free(output.pixel_data);
+    TRACE_COMPLETE("encode", name, -1, encode_start, now_ns());
+
+    if (result == 0 || encoded.data == NULL) {
+        free(encoded.data);
+        return NULL;
+    }
+
+    *size = encoded.size;
+    return encoded.data;
+}
+
+int write_image(image_t image, const char *path, size_t *written) {
     // write the image to a file
     assert(path != NULL);
 
-    int result = stbi_write_jpg(path, image.width, image.height, image.channels, image.pixel_data, 100);
-    
-    // int result = stbi_write_png(path, image.width, image.height, image.channels, image.pixel_data, image.width * image.channels);
-    assert(result != 0);
-    atomic_fetch_add_explicit(&total_images_written, 1, memory_order_relaxed);
+    // Encode into memory first, so that encoding and file I/O show up separately in a trace.
+    size_t size = 0;
+    unsigned char* encoded = encode_image(image, path, &size);
+    if (encoded == NULL) {
+        FPRINTF(stderr, "write_image - Cannot encode %s\n", path);
+        return -1;
+    }
+
+    uint64_t write_start = trace_enabled? now_ns(): 0;
+    int status = 0;
+    FILE* file = fopen(path, "wb");
+    if (file == NULL || fwrite(encoded, 1, size, file) != size) {
+        perror("write_image - Cannot write output image");
+        status = -1;
+    }
+    if (file != NULL)
+        fclose(file);
+    TRACE_COMPLETE("write", path, -1, write_start, now_ns());
+    if (status == 0 && written != NULL)
+        *written = size;
+
+    free(encoded);
     fflush(stdout);
+    return status;
 }
 
 image_t image_from_chunks(dlist_t *chunks) {
@@ -165,21 +332,30 @@ image_t image_from_chunks(dlist_t *chunks) {
     int width = get_image_chunk(node->data)->original_image_width;
     int height = get_image_chunk(node->data)->original_image_height;
     int channels = get_image_chunk(node->data)->channels;
-    image_t image = create_empty_image(width, height, channels);
+    pixel_format_t format = get_image_chunk(node->data)->format;
+    image_t image = create_empty_image(width, height, channels, format);
 
-    size_t cell_size = channels;
+    size_t cell_size = channels * pixel_format_size(format);
 
     while (node != NULL) {
         image_chunk_t *chunk = get_image_chunk(node->data);
         assert(chunk->pixel_data != NULL);
 
-        for (int y = 0; y < chunk->height; ++y) {
-            for (int x = 0; x < chunk->width; ++x) {
-
-                size_t src_index = convert_to_index(x, y, chunk->width, cell_size);
-                size_t dst_index = convert_to_index(chunk->offset_x + x, chunk->offset_y + y, width, cell_size);
-
-                memcpy(image.pixel_data + dst_index, chunk->pixel_data + src_index, cell_size);
+        // copy the tile without its halo, one row at a time
+        size_t core_width = chunk->width - chunk->halo_left - chunk->halo_right;
+        size_t core_height = chunk->height - chunk->halo_top - chunk->halo_bottom;
+        size_t dst_origin = convert_to_index(chunk->offset_x + chunk->halo_left, chunk->offset_y + chunk->halo_top, width, cell_size);
+
+        if (chunk->layout == CHUNK_LAYOUT_PLANAR) { // re-interleaved on the way into the image (planar tiles are u8)
+            const unsigned char* core = chunk->pixel_data + chunk->halo_top * chunk->stride + chunk->halo_left;
+            interleave_rows(core, chunk->stride, chunk->plane_size, core_width, core_height, channels,
+                            image.pixel_data + dst_origin, width * cell_size);
+        } else {
+            for (size_t y = chunk->halo_top; y < chunk->halo_top + core_height; ++y) {
+                size_t src_index = y * chunk->stride + chunk->halo_left * cell_size;
+                size_t dst_index = convert_to_index(chunk->offset_x + chunk->halo_left, chunk->offset_y + y, width, cell_size);
+
+                memcpy(image.pixel_data + dst_index, chunk->pixel_data + src_index, core_width * cell_size);
             }
         }
 
@@ -193,6 +369,8 @@ void cleanup_image(image_t *image) {
     // free the image
     assert(image != NULL);
 
+    if (image->pixel_data != NULL)
+        stats_add(COUNTER_INFLIGHT_BYTES, -(int64_t)image_size_bytes(image));
     free(image->pixel_data);
     image->pixel_data = NULL;
     image->width = 0;
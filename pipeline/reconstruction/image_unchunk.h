@@ -11,7 +11,6 @@
 #include "dlist.h"
 #include "image.h"
 
-char *generate_suffix(const char **effects, int num_effects);
 
 /* Generates a new path for the output file.
 * @param output_dir The directory where the output file will be saved.
@@ -33,12 +32,23 @@ char *result_path(const char *output_directory, const char *original_path, const
 image_t image_from_chunks(dlist_t *chunks);
 
 /*
-* @brief Write an image to a file.
+* @brief Encode an image into memory.
+* @param name Decides the format by its extension: a PNG for `.png`, a Radiance HDR for `.hdr`, otherwise a JPEG
+* of quality 100, with as many channels as `image` has (1 to 4; JPEG drops an alpha channel). PNGs of u16 and
+* f32 images have 16 bits per sample; JPEGs always have 8.
+* @param size Receives the size of the encoded image.
+* @return The encoded bytes (release them with free()), or NULL if encoding failed.
+*/
+unsigned char* encode_image(image_t image, const char *name, size_t *size);
+
+/*
+* @brief Write an image to a file, encoded as `encode_image` does for `path`.
 * @param *image The image to write.
 * @param *path The path to the output file.
-* @note The function uses stb_image_write to write the image in PNG format.
+* @param *written Receives the size of the written file; may be NULL.
+* @return 0, or -1 if the image could not be encoded or written.
 */
-void write_image(image_t image, const char *path);
+int write_image(image_t image, const char *path, size_t *written);
 
 /*
 * @brief Given the image_t structure, it frees the data contained with in it. 
@@ -3,28 +3,80 @@
 /*
 You should read `dict.h` before going through this file. To brief, the `dict_t` is a hash table that maps keys to values, where both are the instnaces of `Object`. 
 
-Here, the keys are the image names (of type `const char*`), and the values their corresponding list of chunks (implemented by `dlist_t`), which ultimately stores the objects of `image_chunk_t`.
+Here, the keys are the outputs being assembled (of type `image_key_t`: the image name together with the branch of the effect graph, since every branch produces its own output from the same image), and the values their corresponding list of chunks (implemented by `dlist_t`), which ultimately stores the objects of `image_chunk_t`.
 
-The `dlist_t`, `const char*`, and the `image_chunk_t` all support the `Object` interface (defined in `Object.h`, `image.h`, and in `dlist.h`), so we can use them directly in `dict_t`.  
+The `dlist_t`, `image_key_t`, and the `image_chunk_t` all support the `Object` interface (defined in `dlist.h`, here, and in `image.h`), so we can use them directly in `dict_t`.  
 
-The only thing remaining is to provide `hash_func` and `compare_func` for the `dict_t` to work with `const char*`. The `hash_func` is a simple hash function that uses the CityHash library to hash the string, and the `compare_func` is a simple string comparison function.
+The only thing remaining is to provide `hash_func` and `compare_func` for the `dict_t` to work with `image_key_t`. The `hash_func` hashes the name with xxHash and mixes in the branch, and the `compare_func` compares both.
 */
 
-static inline size_t hash_string(Object key) { 
-    const char* str = get_string_v(key);
-    assert(str != NULL);
+typedef struct {
+    const char* name; // borrowed from the first chunk of the output, which outlives the dict entry
+    int branch;
+} image_key_t;
+
+DType image_key_type = {"image-key", sizeof(image_key_t), NULL, NULL};
+DEFINE_TYPE(image_key, image_key_type, image_key_t)
+
+static inline Object let_key_for(const image_chunk_t* chunk) {
+    image_key_t key = { chunk->original_image_name, chunk->branch };
+    return let_image_key_v(key);
+}
+
+static inline size_t hash_key(Object key) { 
+    const image_key_t* k = get_image_key(key);
+    assert(k != NULL && k->name != NULL);
     
     // recall that the function "borrows" the Object, so no need to `destroy` it
-    return XXH64(str, strlen(str), 0); // 0 is the seed, you can change it if needed
+    return XXH64(k->name, strlen(k->name), (XXH64_hash_t)k->branch); // the branch seeds the hash
 }
 
-static inline int compare_strings(Object a, Object b) {
-    const char* str1 = get_string_v(a);
-    const char* str2 = get_string_v(b);
-    assert(str1 != NULL && str2 != NULL);
+static inline int compare_keys(Object a, Object b) {
+    const image_key_t* k1 = get_image_key(a);
+    const image_key_t* k2 = get_image_key(b);
+    assert(k1 != NULL && k2 != NULL);
 
     // recall that the function "borrows" the Object, so no need to `destroy` it
-    return strcmp(str1, str2) == 0;
+    return k1->branch == k2->branch && strcmp(k1->name, k2->name) == 0;
+}
+
+/*
+* @brief The directory an image is written to: the output directory, plus the subdirectory the image
+* came from relative to the input directory (created if needed), so that the input layout is mirrored.
+* @note The caller frees the returned string.
+*/
+static char* output_directory_for(const ppxl_engine_t* engine, const char* original_path) {
+    const char* input_directory = engine->input_directory;
+    const char* out_directory = engine->output_directory;
+    size_t input_length = strlen(input_directory);
+    const char* relative = original_path;
+    if (strncmp(original_path, input_directory, input_length) == 0 && original_path[input_length] == '/')
+        relative = original_path + input_length + 1;
+
+    const char* last_slash = strrchr(relative, '/');
+    if (last_slash == NULL)
+        return strdup(out_directory); // image at the top of the input directory
+
+    size_t subdir_length = last_slash - relative;
+    size_t length = strlen(out_directory) + 1 + subdir_length + 1;
+    char* dir = malloc(length);
+    if (dir == NULL)
+        return NULL;
+    snprintf(dir, length, "%s/%.*s", out_directory, (int)subdir_length, relative);
+
+    // mkdir -p; other pool workers may be creating the same directories concurrently.
+    for (char* p = dir + strlen(out_directory) + 1; ; p++) {
+        if (*p == '/' || *p == '\0') {
+            char saved = *p;
+            *p = '\0';
+            if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+                perror("output_directory_for - Cannot create output directory");
+            *p = saved;
+            if (saved == '\0') break;
+        }
+    }
+
+    return dir;
 }
 
 // ################################################
@@ -33,6 +85,71 @@ static inline int compare_strings(Object a, Object b) {
 // # calling the `init_reconstruction` function.
 // ################################################
 
+/*
+* @brief Count an output as written. Called before it is delivered: delivering the last output of the last
+* pending image wakes `ppxl_engine_drain`, whose caller reads these counters.
+*/
+static void count_output(image_job_t* job, int branch, const image_t* image, size_t bytes, uint64_t image_start) {
+    ppxl_engine_t* engine = job->engine;
+    engine_output_t* output = job->outputs[branch];
+    size_t pixels = image->width * image->height;
+    stats_record_image_latency(now_ns() - image_start);
+    atomic_fetch_add_explicit(&output->pixels, pixels, memory_order_relaxed);
+    atomic_fetch_add_explicit(&output->bytes, bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&output->written, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&engine->pixels_written, pixels, memory_order_relaxed);
+    atomic_fetch_add_explicit(&engine->outputs_written, 1, memory_order_relaxed);
+}
+
+// Watched files: write the output next to the others of its input subdirectory.
+static int write_output_file(image_job_t* job, int branch, image_t* image, uint64_t image_start) {
+    const char* suffix = job->graph->branches[branch].name;
+    char* path = output_directory_for(job->engine, job->name);
+    char* output_path = result_path(path? path: job->engine->output_directory, job->name, suffix);
+    free(path);
+
+    size_t size = 0;
+    int status = write_image(*image, output_path, &size);
+    free(output_path);
+    if (status != 0) {
+        image_job_discard(job, branch, DISCARD_ENCODE);
+        return -1;
+    }
+
+    count_output(job, branch, image, size, image_start);
+    image_job_deliver(job, branch, NULL);
+    return 0;
+}
+
+// Submissions: hand the output to the callback, encoded like the input (buffers) or as it is (frames).
+static int deliver_output(image_job_t* job, int branch, image_t* image, uint64_t image_start) {
+    ppxl_result_t result = {
+        .status = PPXL_OK,
+        .width = (int)image->width,
+        .height = (int)image->height,
+        .channels = (int)image->channels,
+        .format = (ppxl_format_t)image->format,
+    };
+
+    unsigned char* encoded = NULL;
+    if (job->source == JOB_SOURCE_BUFFER) {
+        encoded = encode_image(*image, job->name, &result.size);
+        if (encoded == NULL) {
+            image_job_discard(job, branch, DISCARD_ENCODE);
+            return -1;
+        }
+        result.bytes = encoded;
+    } else {
+        result.bytes = image->pixel_data;
+        result.size = image_size_bytes(image);
+    }
+
+    count_output(job, branch, image, result.size, image_start);
+    image_job_deliver(job, branch, &result);
+    free(encoded);
+    return 0;
+}
+
 /*
 * @brief This function will be passed to the thread pool, along with the dlist instance, wrapped inside the Object instance (which is also the parameter of this function). 
 * @param obj The Object instance that wraps the dlist instance.
@@ -41,18 +158,29 @@ void task_function(Object obj) {
     assert(!is_none(obj));
     dlist_t *chunks_list = get_dlist(obj);
 
+    uint64_t reconstruct_start = now_ns();
     image_t image = image_from_chunks(chunks_list);
+    uint64_t reconstruct_end = now_ns();
+    stats_record_stage(STAGE_RECONSTRUCT, reconstruct_end - reconstruct_start);
+
+    const image_chunk_t* first = get_image_chunk(chunks_list->head->data);
+    image_job_t* job = first->job; // the chunks in the list hold it until the task is over
+    TRACE_COMPLETE("reconstruct", first->original_image_name, -1, reconstruct_start, reconstruct_end);
+    uint64_t image_start = first->image_start_ns;
+    int branch = first->branch;
+    if (effect_graph_finish(job->graph, branch, &image) != EXIT_SUCCESS) {
+        image_job_discard(job, branch, DISCARD_EFFECT);
+        cleanup_image(&image);
+        return;
+    }
 
-    const char* path = out_directory;
-    const char* org_name = get_image_chunk(chunks_list->head->data)->original_image_name;
-    char* suffix = generate_suffix(NULL, 0);
-    char* output_path = result_path(path, org_name, suffix);
-
-    write_image(image, output_path);
+    uint64_t encode_start = now_ns();
+    if (job->source == JOB_SOURCE_FILE)
+        write_output_file(job, branch, &image, image_start);
+    else
+        deliver_output(job, branch, &image, image_start);
+    stats_record_stage(STAGE_ENCODE, now_ns() - encode_start);
     cleanup_image(&image);
-
-    free(output_path);
-    free(suffix);
 }
 
 static thread_pool_t* init_threadpool() {
@@ -66,16 +194,16 @@ static void shutdown_and_free_threadpool(thread_pool_t* pool) {
 }
 
 
-static void insert_chunk(dict_t* dict, Object img_name, Object chunk_obj) {
-    if (!dict_contains(dict, img_name)) {
+static void insert_chunk(dict_t* dict, Object img_key, Object chunk_obj) {
+    if (!dict_contains(dict, img_key)) {
         dlist_t dlist = dlist_init();
         Object value = let_dlist(&dlist);
         
-        dict_insert(dict, img_name, value); // dict takes the ownership of the object. 
+        dict_insert(dict, img_key, value); // dict takes the ownership of the object. 
         destroy(value); // release the reference count
     }
     
-    Object value = dict_get(dict, img_name, None); // we borrow the object here. no need to destroy
+    Object value = dict_get(dict, img_key, None); // we borrow the object here. no need to destroy
     assert(!is_none(value));
 
     dlist_t *dlist = get_dlist(value);
@@ -84,9 +212,9 @@ static void insert_chunk(dict_t* dict, Object img_name, Object chunk_obj) {
     dlist_insert_last(dlist, chunk_obj); // dlist takes the ownership of the object
 }
 
-static void remove_image(dict_t* dict, Object img_name) {
-    if (dict_contains(dict, img_name)) {
-        Object value = dict_delete(dict, img_name); // it transfers the ownership
+static void remove_image(dict_t* dict, Object img_key) {
+    if (dict_contains(dict, img_key)) {
+        Object value = dict_delete(dict, img_key); // it transfers the ownership
         destroy(value); // free the dlist 
     }
 }
@@ -94,18 +222,22 @@ static void remove_image(dict_t* dict, Object img_name) {
 static bool handle_corrupted_chunk(dict_t *dict, image_chunk_t *chunk) {
     if (!chunk) { return true; }
 
-    if (chunk->processing_status != CHUNK_STATUS_ERROR) { return false; }
+    if (chunk->processing_status != CHUNK_STATUS_ERROR && !image_job_discarded(chunk->job)) { return false; }
 
-    Object img_name = let_string_v(chunk->original_image_name);
-    remove_image(dict, img_name);
+    // an error chunk (or a discarded image) spoils the image for every branch: what was collected of it goes
+    for (size_t branch = 0; branch < chunk->job->graph->num_branches; branch++) {
+        image_key_t key = { chunk->original_image_name, (int)branch };
+        Object img_key = let_image_key_v(key);
+        remove_image(dict, img_key);
+        destroy(img_key);
+    }
 
     free_image_chunk(chunk);
-    destroy(img_name);
     return true;
 }
 
-static bool enough_chunks(dict_t* dict, Object img_name) {
-    Object value = dict_get(dict, img_name, None); // we borrow the value
+static bool enough_chunks(dict_t* dict, Object img_key) {
+    Object value = dict_get(dict, img_key, None); // we borrow the value
 
     if (is_none(value)) { 
         return 0; 
@@ -124,36 +256,42 @@ static bool enough_chunks(dict_t* dict, Object img_name) {
     return chunk_count == dlist->size;
 }
 
-static void try_schedule_reconstruction(dict_t* dict, thread_pool_t* pool, Object img_name) {
-    if (!enough_chunks(dict, img_name)) { return; }
+static void try_schedule_reconstruction(dict_t* dict, thread_pool_t* pool, Object img_key) {
+    if (!enough_chunks(dict, img_key)) { return; }
 
-    Object dlist_obj = dict_delete(dict, img_name); // we get the ownership 
-    thread_pool_add_task(pool, task_function, dlist_obj); // pool takes the ownership of dlist_obj
+    Object dlist_obj = dict_delete(dict, img_key); // we get the ownership 
+    priority_t priority = get_image_chunk(get_dlist(dlist_obj)->head->data)->priority;
+    thread_pool_add_task_priority(pool, task_function, dlist_obj, priority); // pool takes the ownership of dlist_obj
     destroy(dlist_obj); // release the count
 }
 
 void *reconstruction_thread(void *arg) {
-    chunk_queue_t *processed_queue = (chunk_queue_t *)arg;
-    dict_t dict = dict_init(hash_string, compare_strings);
+    ppxl_engine_t *engine = (ppxl_engine_t *)arg;
+    chunk_queue_t *processed_queue = &engine->filtering_reconstruction_queue;
+    trace_thread_name("reconstruction");
+    dict_t dict = dict_init(hash_key, compare_keys);
 
     // create threadpool with n - 1 threads (1 is the reconstruction thread itself)
     thread_pool_t *pool = init_threadpool(); 
 
     image_chunk_t *chunk; // container to store the pointers to the chunks
 
-    while (!stop_flag) {
+    while (!engine->stop_flag) {
         chunk = chunk_dequeue(processed_queue);
         
         if (handle_corrupted_chunk(&dict, chunk)) { continue; }
 
-        Object img_name = let_string_v(chunk->original_image_name);
+        Object img_key = let_key_for(chunk);
         Object chunk_obj = let_image_chunk(chunk);
 
-        insert_chunk(&dict, img_name, chunk_obj); 
+        uint64_t insert_start = trace_enabled? now_ns(): 0;
+        insert_chunk(&dict, img_key, chunk_obj); 
+        TRACE_COMPLETE("insert", chunk->original_image_name, chunk->chunk_id, insert_start, now_ns());
+        destroy(chunk_obj); // the dlist holds its own reference now
 
         // check if we have enough chunks to reconstruct the image
-        try_schedule_reconstruction(&dict, pool, img_name);
-        destroy(img_name);
+        try_schedule_reconstruction(&dict, pool, img_key);
+        destroy(img_key);
         free(chunk);
     }
 
@@ -162,8 +300,8 @@ void *reconstruction_thread(void *arg) {
     return NULL;
 }
 
-pthread_t* init_reconstruction(chunk_queue_t *processed_queue) {
+pthread_t* init_reconstruction(ppxl_engine_t *engine) {
     pthread_t* thread = (pthread_t*)malloc(sizeof(pthread_t));
-    pthread_create(thread, NULL, reconstruction_thread, processed_queue);
+    pthread_create(thread, NULL, reconstruction_thread, engine);
     return thread;
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <xxhash.h>
@@ -7,6 +8,8 @@
 #include <signal.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <sys/stat.h>
 
 #include "Object.h"
 #include "dict.h"
@@ -14,11 +17,12 @@
 #include "image.h"
 #include "image_unchunk.h"
 #include "thread_pool.h"
+#include "stats.h"
+#include "trace.h"
+#include "effect_graph.h"
+#include "engine.h"
 
 #define RECONSTRUCTION_THREADS 4
 
-extern volatile sig_atomic_t stop_flag;
-extern const char* out_directory;
-
-// initialize reconstruction module in a separate thread.
-pthread_t* init_reconstruction(chunk_queue_t *processed_queue);
\ No newline at end of file
+// initialize reconstruction module in a separate thread, which reassembles the tiles of `engine`'s filtered queue.
+pthread_t* init_reconstruction(ppxl_engine_t *engine);
\ No newline at end of file
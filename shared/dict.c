@@ -96,6 +96,8 @@ void dict_destroy(dict_t* dict) {
     dict->capacity = 0;
 
     pthread_mutex_destroy(dict->lock);
+    free(dict->lock);
+    dict->lock = NULL;
 }
 
 static int should_resize(dict_t *dict) {
@@ -154,12 +156,12 @@ int dict_contains(dict_t * dict, Object key) {
 }
 
 Object dict_get(dict_t *dict, Object key, Object default_value) {
-    pthread_mutex_lock(dict->lock);
-    
-    if (!dict || is_none(key) || !dict_contains(dict, key)) {
+    if (!dict || is_none(key)) {
         return default_value;
     }
 
+    pthread_mutex_lock(dict->lock);
+
     kv_pair_t *pair = find_pair(dict, key, NULL);
     if (!pair) { 
         pthread_mutex_unlock(dict->lock);
@@ -171,12 +173,12 @@ Object dict_get(dict_t *dict, Object key, Object default_value) {
 }
 
 Object dict_delete(dict_t *dict, Object key) {
-    pthread_mutex_lock(dict->lock);
-    
-    if (!dict || is_none(key) || !dict_contains(dict, key)) {
+    if (!dict || is_none(key)) {
         return None;
     }
 
+    pthread_mutex_lock(dict->lock);
+
     int i;
     dlist_t *list = find_chain(dict, key);
     if (!list) {
@@ -229,4 +231,6 @@ void dict_resize(dict_t *dict, size_t new_capacity) {
     darray_destroy(&dict->buckets);
     dict->buckets = new_dict.buckets;
     dict->capacity = new_dict.capacity;
+
+    pthread_mutex_unlock(dict->lock);
 }
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "histogram.h"
+
+static inline size_t bucket_index(uint64_t value) {
+    if (value < HISTOGRAM_SUB_COUNT)
+        return (size_t)value;
+
+    int exponent = 63 - __builtin_clzll(value);
+    size_t sub = (value >> (exponent - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_COUNT - 1);
+    return ((size_t)(exponent - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS) + sub;
+}
+
+// Largest value that lands in bucket `index`.
+static inline uint64_t bucket_upper_bound(size_t index) {
+    if (index < HISTOGRAM_SUB_COUNT)
+        return index;
+
+    int exponent = (int)(index >> HISTOGRAM_SUB_BITS) + HISTOGRAM_SUB_BITS - 1;
+    uint64_t sub = index & (HISTOGRAM_SUB_COUNT - 1);
+    uint64_t width = 1ull << (exponent - HISTOGRAM_SUB_BITS);
+    return ((HISTOGRAM_SUB_COUNT + sub) << (exponent - HISTOGRAM_SUB_BITS)) + (width - 1);
+}
+
+void histogram_reset(histogram_t *h) {
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+        atomic_store_explicit(&h->counts[i], 0, memory_order_relaxed);
+    atomic_store_explicit(&h->total, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->sum, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->max, 0, memory_order_relaxed);
+}
+
+void histogram_record(histogram_t *h, uint64_t value) {
+    atomic_fetch_add_explicit(&h->counts[bucket_index(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->total, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum, value, memory_order_relaxed);
+
+    uint64_t current = atomic_load_explicit(&h->max, memory_order_relaxed);
+    while (value > current &&
+           !atomic_compare_exchange_weak_explicit(&h->max, &current, value, memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+static inline void add_local(atomic_uint_fast64_t *counter, uint64_t value) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+void histogram_record_local(histogram_t *h, uint64_t value) {
+    add_local(&h->counts[bucket_index(value)], 1);
+    add_local(&h->total, 1);
+    add_local(&h->sum, value);
+
+    if (value > atomic_load_explicit(&h->max, memory_order_relaxed))
+        atomic_store_explicit(&h->max, value, memory_order_relaxed);
+}
+
+void histogram_merge(histogram_t *dst, histogram_t *src) {
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        uint64_t count = atomic_load_explicit(&src->counts[i], memory_order_relaxed);
+        if (count) atomic_fetch_add_explicit(&dst->counts[i], count, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&dst->total, atomic_load_explicit(&src->total, memory_order_relaxed), memory_order_relaxed);
+    atomic_fetch_add_explicit(&dst->sum, atomic_load_explicit(&src->sum, memory_order_relaxed), memory_order_relaxed);
+
+    uint64_t max = atomic_load_explicit(&src->max, memory_order_relaxed);
+    if (max > atomic_load_explicit(&dst->max, memory_order_relaxed))
+        atomic_store_explicit(&dst->max, max, memory_order_relaxed);
+}
+
+uint64_t histogram_percentile(histogram_t *h, double p) {
+    uint64_t total = atomic_load_explicit(&h->total, memory_order_relaxed);
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)((p / 100.0) * total + 0.5);
+    if (rank == 0) rank = 1;
+    if (rank > total) rank = total;
+
+    uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += atomic_load_explicit(&h->counts[i], memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t bound = bucket_upper_bound(i);
+            return (bound < max)? bound: max;
+        }
+    }
+
+    return max;
+}
+
+uint64_t histogram_count_at_or_below(histogram_t *h, uint64_t value) {
+    uint64_t count = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS && bucket_upper_bound(i) <= value; i++)
+        count += atomic_load_explicit(&h->counts[i], memory_order_relaxed);
+    return count;
+}
+
+uint64_t histogram_count(histogram_t *h) {
+    return atomic_load_explicit(&h->total, memory_order_relaxed);
+}
+
+uint64_t histogram_sum(histogram_t *h) {
+    return atomic_load_explicit(&h->sum, memory_order_relaxed);
+}
+
+double histogram_mean(histogram_t *h) {
+    uint64_t total = atomic_load_explicit(&h->total, memory_order_relaxed);
+    return total? (double)atomic_load_explicit(&h->sum, memory_order_relaxed) / total: 0.0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/*
+* Log-linear (HDR style) histogram of nanosecond values. Every power of two is split into
+* 2^HISTOGRAM_SUB_BITS linear sub-buckets, so any recorded value is reported with a relative
+* error below 1 / 2^HISTOGRAM_SUB_BITS while the whole 64-bit range fits in a fixed array.
+*/
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT)
+
+typedef struct {
+    atomic_uint_fast64_t counts[HISTOGRAM_BUCKETS];
+    atomic_uint_fast64_t total;
+    atomic_uint_fast64_t sum;
+    atomic_uint_fast64_t max;
+} histogram_t;
+
+void histogram_reset(histogram_t *h);
+
+/*
+* @brief Record one value. Lock-free, safe to call from any thread.
+*/
+void histogram_record(histogram_t *h, uint64_t value);
+
+/*
+* @brief Record one value into a histogram that only the calling thread writes to.
+* @note Wait-free: plain relaxed loads and stores, no read-modify-write. Other threads may
+* still read (or merge) the histogram concurrently.
+*/
+void histogram_record_local(histogram_t *h, uint64_t value);
+
+/*
+* @brief Add every count of `src` to `dst`.
+*/
+void histogram_merge(histogram_t *dst, histogram_t *src);
+
+/*
+* @brief Value at percentile `p` (0..100), or 0 if the histogram is empty.
+* @note The upper bound of the bucket is returned, clamped to the largest recorded value.
+*/
+uint64_t histogram_percentile(histogram_t *h, double p);
+
+/*
+* @brief Number of recorded values whose bucket lies entirely at or below `value`.
+* @note Used to re-bucket into fixed bounds (e.g. Prometheus `le`); values sharing a bucket
+* with `value` are only counted once `value` reaches the bucket's upper bound.
+*/
+uint64_t histogram_count_at_or_below(histogram_t *h, uint64_t value);
+
+uint64_t histogram_count(histogram_t *h);
+uint64_t histogram_sum(histogram_t *h);
+double histogram_mean(histogram_t *h);
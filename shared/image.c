@@ -5,12 +5,11 @@
 #include<stdio.h>
 #include<errno.h> 
 #include<stdatomic.h>
+#include<string.h>
+#include<stdint.h>
 
 #include "macros.h"
 
-extern volatile sig_atomic_t stop_flag;
-extern atomic_size_t total_images_discarded;
-
 // #######################################
 // # Add Object Interface for image_chunk_t
 // #######################################
@@ -32,7 +31,10 @@ void clear_image_chunk(image_chunk_t *chunk) {
         return;
 
     free(chunk->original_image_name);
+    if (chunk->pixel_data != NULL)
+        stats_add(COUNTER_INFLIGHT_BYTES, -(int64_t)chunk->data_size_bytes);
     free(chunk->pixel_data);
+    image_job_release(chunk->job);
 }
 
 void free_image_chunk(image_chunk_t *chunk) {
@@ -43,15 +45,214 @@ void free_image_chunk(image_chunk_t *chunk) {
     free(chunk);
 }
 
+// #######################################
+// # Pixel formats
+// #######################################
+
+#define DEFINE_CONVERT(NAME, FROM, TO, EXPR)                                    \
+static void NAME(const FROM* restrict in, TO* restrict out, size_t count) {     \
+    for (size_t i = 0; i < count; i++) {                                        \
+        FROM v = in[i];                                                         \
+        out[i] = (EXPR);                                                        \
+    }                                                                           \
+}
+
+DEFINE_CONVERT(u8_to_u16,  uint8_t,  uint16_t, (uint16_t)(v * 257))
+DEFINE_CONVERT(u8_to_f32,  uint8_t,  float,    v * (1.0f / 255))
+DEFINE_CONVERT(u16_to_u8,  uint16_t, uint8_t,  (uint8_t)((v + 128) / 257)) // v * 255 / 65535, rounded
+DEFINE_CONVERT(u16_to_f32, uint16_t, float,    v * (1.0f / 65535))
+DEFINE_CONVERT(f32_to_u8,  float,    uint8_t,  (uint8_t)(v > 0? (v < 1? v * 255 + 0.5f: 255): 0)) // NaN becomes 0
+DEFINE_CONVERT(f32_to_u16, float,    uint16_t, (uint16_t)(v > 0? (v < 1? v * 65535 + 0.5f: 65535): 0))
+
+void convert_samples(const void* src, pixel_format_t from, void* dst, pixel_format_t to, size_t count) {
+    switch (from * 3 + to) {
+        case PIXEL_FORMAT_U8 * 3 + PIXEL_FORMAT_U16:  u8_to_u16(src, dst, count); break;
+        case PIXEL_FORMAT_U8 * 3 + PIXEL_FORMAT_F32:  u8_to_f32(src, dst, count); break;
+        case PIXEL_FORMAT_U16 * 3 + PIXEL_FORMAT_U8:  u16_to_u8(src, dst, count); break;
+        case PIXEL_FORMAT_U16 * 3 + PIXEL_FORMAT_F32: u16_to_f32(src, dst, count); break;
+        case PIXEL_FORMAT_F32 * 3 + PIXEL_FORMAT_U8:  f32_to_u8(src, dst, count); break;
+        case PIXEL_FORMAT_F32 * 3 + PIXEL_FORMAT_U16: f32_to_u16(src, dst, count); break;
+        default: memcpy(dst, src, count * pixel_format_size(from)); break;
+    }
+}
+
+int image_set_format(image_t* image, pixel_format_t format) {
+    if (image->format == format)
+        return EXIT_SUCCESS;
+
+    image_t target = *image;
+    target.format = format;
+    target.pixel_data = malloc(image_size_bytes(&target));
+    if (target.pixel_data == NULL) {
+        FPRINTF(stderr, "Error: Out of memory converting an image\n");
+        return EXIT_FAILURE;
+    }
+    convert_samples(image->pixel_data, image->format, target.pixel_data, format, image->width * image->height * image->channels);
+
+    stats_add(COUNTER_INFLIGHT_BYTES, (int64_t)image_size_bytes(&target) - (int64_t)image_size_bytes(image));
+    free(image->pixel_data);
+    *image = target;
+    return EXIT_SUCCESS;
+}
+
+// #######################################
+// # Layouts
+// #######################################
+
+static inline size_t round_up(size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+unsigned char* chunk_alloc_pixels(size_t size) {
+    return aligned_alloc(CHUNK_ALIGNMENT, round_up(size > 0? size: 1, CHUNK_ALIGNMENT));
+}
+
+size_t chunk_row_stride(size_t row_bytes) {
+    return round_up(row_bytes, CHUNK_ALIGNMENT);
+}
+
+void chunk_set_geometry(image_chunk_t* chunk, chunk_layout_t layout) {
+    chunk->layout = layout;
+    size_t sample = pixel_format_size(chunk->format);
+    if (layout == CHUNK_LAYOUT_PLANAR) {
+        chunk->stride = chunk_row_stride(chunk->width * sample);
+        chunk->plane_size = chunk->stride * chunk->height;
+        chunk->data_size_bytes = chunk->plane_size * chunk->channels;
+    } else {
+        chunk->stride = chunk_row_stride(chunk->width * chunk->channels * sample);
+        chunk->plane_size = 0;
+        chunk->data_size_bytes = chunk->stride * chunk->height;
+    }
+}
+
+/*
+* One row, with `channels` a constant at every call site below, so that each case compiles to its own
+* loop of fixed-stride loads and stores.
+*/
+static inline void deinterleave_row(const unsigned char* restrict src, unsigned char* restrict planes, size_t plane_size,
+                                    size_t width, int channels) {
+    for (int c = 0; c < channels; c++) {
+        unsigned char* plane = planes + c * plane_size;
+        for (size_t x = 0; x < width; x++)
+            plane[x] = src[x * channels + c];
+    }
+}
+
+static inline void interleave_row(const unsigned char* restrict planes, size_t plane_size, unsigned char* restrict dst,
+                                  size_t width, int channels) {
+    for (int c = 0; c < channels; c++) {
+        const unsigned char* plane = planes + c * plane_size;
+        for (size_t x = 0; x < width; x++)
+            dst[x * channels + c] = plane[x];
+    }
+}
+
+void deinterleave_rows(const unsigned char* src, size_t src_stride, size_t width, size_t height, int channels,
+                       unsigned char* planes, size_t stride, size_t plane_size) {
+    for (size_t y = 0; y < height; y++) {
+        const unsigned char* row = src + y * src_stride;
+        unsigned char* out = planes + y * stride;
+        switch (channels) {
+            case 1:  deinterleave_row(row, out, plane_size, width, 1); break;
+            case 2:  deinterleave_row(row, out, plane_size, width, 2); break;
+            case 3:  deinterleave_row(row, out, plane_size, width, 3); break;
+            case 4:  deinterleave_row(row, out, plane_size, width, 4); break;
+            default: deinterleave_row(row, out, plane_size, width, channels); break;
+        }
+        for (int c = 0; c < channels; c++)
+            memset(out + c * plane_size + width, 0, stride - width);
+    }
+}
+
+void interleave_rows(const unsigned char* planes, size_t stride, size_t plane_size, size_t width, size_t height, int channels,
+                     unsigned char* dst, size_t dst_stride) {
+    for (size_t y = 0; y < height; y++) {
+        const unsigned char* in = planes + y * stride;
+        unsigned char* row = dst + y * dst_stride;
+        switch (channels) {
+            case 1:  interleave_row(in, plane_size, row, width, 1); break;
+            case 2:  interleave_row(in, plane_size, row, width, 2); break;
+            case 3:  interleave_row(in, plane_size, row, width, 3); break;
+            case 4:  interleave_row(in, plane_size, row, width, 4); break;
+            default: interleave_row(in, plane_size, row, width, channels); break;
+        }
+    }
+}
+
+int chunk_set_format(image_chunk_t* chunk, pixel_format_t format) {
+    if (chunk->format == format)
+        return EXIT_SUCCESS;
+
+    image_chunk_t target = *chunk;
+    target.format = format;
+    chunk_set_geometry(&target, chunk->layout);
+
+    unsigned char* pixels = chunk_alloc_pixels(target.data_size_bytes);
+    if (pixels == NULL) {
+        FPRINTF(stderr, "Error: Out of memory converting chunk %d of %s\n", chunk->chunk_id, chunk->original_image_name);
+        return EXIT_FAILURE;
+    }
+
+    // the planes of a planar tile are `channels` blocks of `height` rows, so both layouts are just rows here
+    bool planar = chunk->layout == CHUNK_LAYOUT_PLANAR;
+    size_t rows = planar? chunk->height * chunk->channels: chunk->height;
+    size_t samples = planar? chunk->width: chunk->width * chunk->channels;
+    size_t row_bytes = samples * pixel_format_size(format);
+    for (size_t y = 0; y < rows; y++) {
+        unsigned char* row = pixels + y * target.stride;
+        convert_samples(chunk->pixel_data + y * chunk->stride, chunk->format, row, format, samples);
+        memset(row + row_bytes, 0, target.stride - row_bytes);
+    }
+
+    stats_add(COUNTER_INFLIGHT_BYTES, (int64_t)target.data_size_bytes - (int64_t)chunk->data_size_bytes);
+    free(chunk->pixel_data);
+    target.pixel_data = pixels;
+    *chunk = target;
+    return EXIT_SUCCESS;
+}
+
+int chunk_set_layout(image_chunk_t* chunk, chunk_layout_t layout) {
+    if (chunk->layout == layout)
+        return EXIT_SUCCESS;
+
+    image_chunk_t target = *chunk;
+    chunk_set_geometry(&target, layout);
+
+    unsigned char* pixels = chunk_alloc_pixels(target.data_size_bytes);
+    if (pixels == NULL) {
+        FPRINTF(stderr, "Error: Out of memory rearranging chunk %d of %s\n", chunk->chunk_id, chunk->original_image_name);
+        return EXIT_FAILURE;
+    }
+
+    if (layout == CHUNK_LAYOUT_PLANAR)
+        deinterleave_rows(chunk->pixel_data, chunk->stride, chunk->width, chunk->height, chunk->channels,
+                          pixels, target.stride, target.plane_size);
+    else {
+        size_t row = (size_t)chunk->width * chunk->channels;
+        interleave_rows(chunk->pixel_data, chunk->stride, chunk->plane_size, chunk->width, chunk->height, chunk->channels,
+                        pixels, target.stride);
+        for (size_t y = 0; y < (size_t)chunk->height; y++) memset(pixels + y * target.stride + row, 0, target.stride - row);
+    }
+
+    stats_add(COUNTER_INFLIGHT_BYTES, (int64_t)target.data_size_bytes - (int64_t)chunk->data_size_bytes);
+    free(chunk->pixel_data);
+    target.pixel_data = pixels;
+    *chunk = target;
+    return EXIT_SUCCESS;
+}
+
 // #######################################
 // # Chunk Queue Implementation
 // #######################################
-int chunk_queue_init(chunk_queue_t* q) {
-    if (q == NULL) 
+int chunk_queue_init(chunk_queue_t* q, pipeline_queue_t id, chunk_queue_policy_t policy, volatile sig_atomic_t* stop) {
+    if (q == NULL || stop == NULL) 
         return EINVAL; 
 
-    q->head = NULL;
-    q->tail = NULL;
+    q->lanes = NULL;
+    q->policy = policy;
+    q->id = id;
+    q->stop = stop;
+    atomic_init(&q->depth, 0);
 
     if (pthread_mutex_init(&q->lock, NULL) != 0) {
         perror("chunk_queue_init: Failed to initialize mutex");
@@ -67,6 +268,63 @@ int chunk_queue_init(chunk_queue_t* q) {
     return 0;
 }
 
+// The class takes the top bits, so any chunk of a more urgent class sorts before every image sequence number.
+static inline uint64_t lane_key(chunk_queue_t* q, const image_chunk_t* chunk) {
+    uint64_t key = (uint64_t)chunk->priority << 56;
+    if (q->policy == CHUNK_QUEUE_OLDEST_IMAGE)
+        key |= chunk->image_seq & ((UINT64_C(1) << 56) - 1);
+    return key;
+}
+
+/*
+* @brief Append `node` to the lane for its key, creating the lane in sorted position if needed.
+* @note Caller holds `q->lock`. Only a handful of images are in flight at once, so a linear walk is enough.
+*/
+static int lane_push(chunk_queue_t* q, chunk_queue_node_t* node) {
+    uint64_t key = lane_key(q, node->chunk);
+
+    chunk_queue_lane_t** link = &q->lanes;
+    while (*link != NULL && (*link)->key < key)
+        link = &(*link)->next;
+
+    chunk_queue_lane_t* lane = *link;
+    if (lane == NULL || lane->key != key) {
+        lane = (chunk_queue_lane_t*)malloc(sizeof(chunk_queue_lane_t));
+        if (lane == NULL) {
+            perror("chunk_enqueue: Failed to allocate memory for image lane");
+            return -1;
+        }
+
+        lane->key = key;
+        lane->head = NULL;
+        lane->tail = NULL;
+        lane->next = *link;
+        *link = lane;
+    }
+
+    if (lane->tail == NULL)
+        lane->head = node;
+    else
+        lane->tail->next = node;
+    lane->tail = node;
+
+    return 0;
+}
+
+// Take the first chunk of the head lane; the lane is dropped once it runs empty.
+static chunk_queue_node_t* lane_pop(chunk_queue_t* q) {
+    chunk_queue_lane_t* lane = q->lanes;
+    chunk_queue_node_t* node = lane->head;
+
+    lane->head = node->next;
+    if (lane->head == NULL) {
+        q->lanes = lane->next;
+        free(lane);
+    }
+
+    return node;
+}
+
 int chunk_enqueue(chunk_queue_t* q, image_chunk_t* c) {
     if (q == NULL || c == NULL) 
         return EINVAL;
@@ -81,25 +339,15 @@ int chunk_enqueue(chunk_queue_t* q, image_chunk_t* c) {
     new_node->chunk = c; 
 
     pthread_mutex_lock(&q->lock);
+    new_node->enqueued_ns = now_ns();
 
-    if (q->tail == NULL) { 
-        // very rare
-        if (q->head != NULL) {
-            FPRINTF(stderr, "chunk_enqueue: Queue inconsistency detected (tail is NULL, head is not)\n");
-            pthread_mutex_unlock(&q->lock);
-            free(new_node);
-            return -1; 
-        }
-        
-        q->head = new_node;
-        q->tail = new_node;
-    } 
-    
-    else { 
-        q->tail->next = new_node;
-        q->tail = new_node;
+    if (lane_push(q, new_node) != 0) {
+        pthread_mutex_unlock(&q->lock);
+        free(new_node);
+        return -1;
     }
 
+    atomic_store_explicit(&q->depth, atomic_load_explicit(&q->depth, memory_order_relaxed) + 1, memory_order_relaxed);
     pthread_cond_signal(&q->cond_not_empty);
     pthread_mutex_unlock(&q->lock);
 
@@ -113,24 +361,22 @@ image_chunk_t* chunk_dequeue(chunk_queue_t* q) {
         return NULL;
 
     pthread_mutex_lock(&q->lock);
-    while (q->head == NULL && !stop_flag) 
+    while (q->lanes == NULL && !*q->stop) 
         pthread_cond_wait(&q->cond_not_empty, &q->lock);
 
-    if (stop_flag && q->head == NULL) {
+    if (*q->stop && q->lanes == NULL) {
         pthread_mutex_unlock(&q->lock);
         PRINTF("chunk_dequeue: Stop flag detected, returning NULL.\n"); 
         return NULL;
     }
 
-    chunk_queue_node_t* dequeue_node = q->head;
+    chunk_queue_node_t* dequeue_node = lane_pop(q);
     image_chunk_t* chunk = dequeue_node->chunk; 
 
-    q->head = dequeue_node->next;
-
-    if (q->head == NULL) 
-        q->tail = NULL;
-
+    atomic_store_explicit(&q->depth, atomic_load_explicit(&q->depth, memory_order_relaxed) - 1, memory_order_relaxed);
     pthread_mutex_unlock(&q->lock);
+
+    stats_record_queue_wait(q->id, now_ns() - dequeue_node->enqueued_ns);
     free(dequeue_node); 
 
     //PRINTF("Chunk dequeued successfully (ID: %d)\n", chunk->chunk_id); 
@@ -144,83 +390,30 @@ void broadcast_chunk_queue(chunk_queue_t* q) {
     pthread_mutex_unlock(&q->lock);
 }
 
+size_t chunk_queue_depth(chunk_queue_t* q) {
+    return atomic_load_explicit(&q->depth, memory_order_relaxed);
+}
+
 void chunk_queue_destroy(chunk_queue_t* q) {
     if (q == NULL) 
         return;
 
-    chunk_queue_node_t* curr = q->head;
+    chunk_queue_node_t* curr;
     chunk_queue_node_t* temp;
 
-    while(curr != NULL) {
-        free_image_chunk(curr->chunk);
-        temp = curr;
-        curr = curr->next;
-        free(temp);     
+    while (q->lanes != NULL) {
+        chunk_queue_lane_t* lane = q->lanes;
+        for (curr = lane->head; curr != NULL; curr = temp) {
+            temp = curr->next;
+            free_image_chunk(curr->chunk);
+            free(curr);
+        }
+        q->lanes = lane->next;
+        free(lane);
     }
 
-    q->head = NULL;
-    q->tail = NULL;
-
     pthread_mutex_destroy(&q->lock);
     pthread_cond_destroy(&q->cond_not_empty);
 
     PRINTF("Chunk queue destroyed successfully\n");
 }
-
-discarded_image_entry_t* discarded_images_head = NULL;
-pthread_mutex_t discarded_images_lock;
-
-int discarded_images_init(void) {
-    if (pthread_mutex_init(&discarded_images_lock, NULL) != 0) {
-        perror("discard_images_init - Cannot initialize mutex");
-        return -1;
-    }
-}
-
-int discarded_images_table_add(const char *filename) {
-    discarded_image_entry_t* entry;
-
-    pthread_mutex_lock(&discarded_images_lock);
-    HASH_FIND_STR(discarded_images_head, filename, entry);
-
-    if (entry == NULL) {
-        entry = (discarded_image_entry_t*)malloc(sizeof(discarded_image_entry_t));
-        if (!entry) {
-            perror("discarded_images_table_add - Failed to allocate memory for hash entry");
-            return -1;
-        }     
-
-        strncpy(entry->name, filename, sizeof(entry->name) - 1);
-        entry->name[sizeof(entry->name) - 1] = '\0';
-
-        HASH_ADD_STR(discarded_images_head, name, entry);
-        atomic_fetch_add_explicit(&total_images_discarded, 1, memory_order_relaxed);
-    }
-
-    pthread_mutex_unlock(&discarded_images_lock);
-
-    return 0;
-}
-
-bool discarded_images_table_contains(const char *filename) {
-    discarded_image_entry_t* entry;
-
-    pthread_mutex_lock(&discarded_images_lock);
-    HASH_FIND_STR(discarded_images_head, filename, entry);
-    pthread_mutex_unlock(&discarded_images_lock);
-
-    return entry != NULL;
-}
-
-void free_discarded_images_table(void) {
-    discarded_image_entry_t* current_entry, *tmp;
-
-    pthread_mutex_lock(&discarded_images_lock);
-    HASH_ITER(hh, discarded_images_head, current_entry, tmp) {
-        HASH_DEL(discarded_images_head, current_entry); 
-        free(current_entry); 
-    }
-
-    pthread_mutex_unlock(&discarded_images_lock);
-    pthread_mutex_destroy(&discarded_images_lock);
-}
\ No newline at end of file
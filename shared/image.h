@@ -5,8 +5,11 @@
 #include<pthread.h> // For pthread types
 #include<uthash.h>
 #include<stdbool.h>
+#include<signal.h>
 
 #include "Object.h" // For Object type
+#include "stats.h"
+#include "priority.h"
 
 typedef enum {
     CHUNK_STATUS_CREATED,
@@ -14,65 +17,189 @@ typedef enum {
     CHUNK_STATUS_ERROR,
 } chunk_processing_status_t;
 
+#define CHUNK_ALIGNMENT 64 // bytes: a cache line, and a multiple of every SIMD register width
+
+/*
+* What a sample (one channel of one pixel) is. Images are decoded at their own depth: 16-bit PNGs as u16 and
+* Radiance HDR files as f32, everything else as u8. Effects that are not specialized for u16 and f32 (see
+* `high_depth` in `effect_graph.h`) get the tile converted to u8 first, and it stays u8 from there on.
+*/
+typedef enum {
+    PIXEL_FORMAT_U8,  // 0..255
+    PIXEL_FORMAT_U16, // 0..65535
+    PIXEL_FORMAT_F32, // linear, 1.0 being nominal white; HDR highlights go above
+} pixel_format_t;
+
+static inline size_t pixel_format_size(pixel_format_t format) {
+    return format == PIXEL_FORMAT_U8? 1: format == PIXEL_FORMAT_U16? 2: 4;
+}
+
+/*
+* @brief Convert `count` samples from `from` to `to` (which may be the same). u16 and u8 map their full
+* ranges onto each other and onto 0..1 in f32; f32 is clamped to 0..1 on the way to an integer format.
+*/
+void convert_samples(const void* src, pixel_format_t from, void* dst, pixel_format_t to, size_t count);
+
+/*
+* How a tile's pixels are arranged in `pixel_data`. Interleaved tiles are what the decoder produces and the
+* encoder takes. Planar tiles keep one plane per channel, so that kernels working on one channel at a time
+* read contiguous bytes and need no shuffles. Tiles are deinterleaved once for a run of effects that can work
+* on planes (see `effect_graph.h`), and re-interleaved once when needed, at the latest in reconstruction.
+*
+* In both layouts `pixel_data`, every plane and every row start on a CHUNK_ALIGNMENT boundary: rows are
+* padded to `stride`, so a 128-pixel RGB row takes 384 bytes and a 37-pixel one 128. The padding holds no
+* pixels but is always initialized, so kernels may use aligned loads and run to the end of a row (or over
+* whole planes, for pointwise ones) without a scalar loop for the last few pixels.
+*/
+typedef enum {
+    CHUNK_LAYOUT_INTERLEAVED, // RGBRGB...: row y at y * stride, with width * channels bytes of pixels
+    CHUNK_LAYOUT_PLANAR,      // RR..GG..BB..: channel c's row y at c * plane_size + y * stride
+} chunk_layout_t;
+
+struct image_job; // see engine.h
+
 typedef struct {
     int chunk_id;
     char* original_image_name;
-    size_t offset_x;
+    size_t offset_x;         // position of the tile's first pixel (halo included) in the original image
     size_t offset_y;
-    size_t width;
+    size_t width;            // size of `pixel_data`, halo included
     size_t height;
+    size_t halo_left;        // border rows/columns read from the neighbouring tiles, for neighbourhood effects;
+    size_t halo_top;         // only the pixels inside them belong to this tile's output
+    size_t halo_right;
+    size_t halo_bottom;
     unsigned char* pixel_data;
     size_t data_size_bytes;
     int channels;
+    pixel_format_t format;   // what a sample is; planar tiles are always u8
+    chunk_layout_t layout;
+    size_t stride;           // bytes from a row to the next (within a plane when planar), a multiple of CHUNK_ALIGNMENT
+    size_t plane_size;       // planar: bytes from a plane to the next; 0 when interleaved
     int original_image_num_chunks;
+    int tile_columns;        // the image's tile grid: `chunk_id` is row * tile_columns + column, and every tile's own
+    int tile_rows;           // pixels (halo excluded) span tile_width x tile_height, less in the last column and row
+    size_t tile_width;
+    size_t tile_height;
     int original_image_width;
     int original_image_height;
     int processing_status;
+    uint64_t image_start_ns; // when a chunker thread picked up the original image
+    uint64_t image_seq;      // arrival order of the original image, used for scheduling
+    priority_t priority;     // class of the original image, see `priority.h`
+    int branch;              // output branch of the effect graph the chunk belongs to
+    void* resume;            // global or local effect the chunk was parked at, see `effect_graph.h` (NULL: not parked)
+    struct image_job* job;   // the original image's job, which the chunk holds a reference to (NULL outside a pipeline)
 } image_chunk_t;
 
 typedef struct chunk_queue_node {
     struct chunk_queue_node* next;
     image_chunk_t* chunk;
+    uint64_t enqueued_ns;
 } chunk_queue_node_t;
 
 extern DType chunk_dtype; // Declare the DType for image_chunk_t
 DEFINE_TYPE_PROTO(image_chunk, chunk_dtype, image_chunk_t)
 
+// Release the pixels, the name and the job reference.
 void clear_image_chunk(image_chunk_t* chunk);
 void free_image_chunk(image_chunk_t *chunk);
 
+// Take or drop a reference to a job (see engine.h); both accept NULL.
+void image_job_retain(struct image_job* job);
+void image_job_release(struct image_job* job);
+
+/*
+* @brief Allocate pixel memory aligned to CHUNK_ALIGNMENT (`size` is rounded up to a multiple of it); release it with free().
+*/
+unsigned char* chunk_alloc_pixels(size_t size);
+
+// Stride of rows holding `row_bytes` bytes of pixels: the next multiple of CHUNK_ALIGNMENT.
+size_t chunk_row_stride(size_t row_bytes);
+
+/*
+* @brief Set `layout`, `stride`, `plane_size` and `data_size_bytes` for the chunk's width, height, channels and
+* format; `pixel_data` is left alone.
+*/
+void chunk_set_geometry(image_chunk_t* chunk, chunk_layout_t layout);
+
+/*
+* @brief Convert `chunk`'s samples to `format`; nothing to do if they already are.
+* @return EXIT_SUCCESS, or EXIT_FAILURE if out of memory (the chunk is then unchanged).
+*/
+int chunk_set_format(image_chunk_t* chunk, pixel_format_t format);
+
+static inline unsigned char* chunk_plane(const image_chunk_t* chunk, int channel) {
+    return chunk->pixel_data + (size_t)channel * chunk->plane_size;
+}
+
+/*
+* @brief Split `height` interleaved rows of `width` pixels into `channels` planes, zeroing the padding of every plane row.
+*/
+void deinterleave_rows(const unsigned char* src, size_t src_stride, size_t width, size_t height, int channels,
+                       unsigned char* planes, size_t stride, size_t plane_size);
+
+// The reverse of `deinterleave_rows`; what follows each row in `dst` is left alone (it may be the rest of an image row).
+void interleave_rows(const unsigned char* planes, size_t stride, size_t plane_size, size_t width, size_t height, int channels,
+                     unsigned char* dst, size_t dst_stride);
+
+/*
+* @brief Rearrange `chunk`'s pixels into `layout`; nothing to do if they already are.
+* @return EXIT_SUCCESS, or EXIT_FAILURE if out of memory (the chunk is then unchanged).
+*/
+int chunk_set_layout(image_chunk_t* chunk, chunk_layout_t layout);
+
 typedef struct {
     unsigned char *pixel_data;
 
     size_t width, height;
     uint32_t channels;
+    pixel_format_t format;
 } image_t;
 
+// Bytes of `image`'s pixels: rows are packed.
+static inline size_t image_size_bytes(const image_t* image) {
+    return image->width * image->height * image->channels * pixel_format_size(image->format);
+}
+
+/*
+* @brief Convert `image`'s samples to `format`; nothing to do if they already are.
+* @return EXIT_SUCCESS, or EXIT_FAILURE if out of memory (the image is then unchanged).
+*/
+int image_set_format(image_t* image, pixel_format_t format);
+
+/*
+* Chunks of a more urgent priority class always leave first; the policy orders chunks within a class.
+*/
+typedef enum {
+    CHUNK_QUEUE_FIFO,         // chunks leave in the order they were enqueued
+    CHUNK_QUEUE_OLDEST_IMAGE, // all queued chunks of the oldest image leave before any chunk of a newer one
+} chunk_queue_policy_t;
+
+/*
+* A FIFO sub-queue. Lanes are kept sorted by `key`, so the head lane is always served first:
+* the key is the priority class (FIFO) or the class followed by the image's `image_seq` (OLDEST_IMAGE).
+*/
+typedef struct chunk_queue_lane {
+    struct chunk_queue_lane* next;
+    uint64_t key;
+    chunk_queue_node_t* head;
+    chunk_queue_node_t* tail;
+} chunk_queue_lane_t;
+
 typedef struct {
-    chunk_queue_node_t *head;
-    chunk_queue_node_t *tail;
+    chunk_queue_lane_t *lanes;
+    chunk_queue_policy_t policy;
     pthread_mutex_t lock;
     pthread_cond_t cond_not_empty;
+    atomic_size_t depth;
+    pipeline_queue_t id; // which queue-wait histogram dequeues record into
+    volatile sig_atomic_t* stop; // set when the pipeline stops: dequeues stop waiting
 } chunk_queue_t;
 
-int chunk_queue_init(chunk_queue_t* q);
+int chunk_queue_init(chunk_queue_t* q, pipeline_queue_t id, chunk_queue_policy_t policy, volatile sig_atomic_t* stop);
 int chunk_enqueue(chunk_queue_t* q, image_chunk_t* c);
 image_chunk_t* chunk_dequeue(chunk_queue_t* q);
 void broadcast_chunk_queue(chunk_queue_t* q);
+size_t chunk_queue_depth(chunk_queue_t* q);
 void chunk_queue_destroy(chunk_queue_t* q);
-
-extern chunk_queue_t chunker_filtering_queue;
-extern chunk_queue_t filtering_reconstruction_queue;
-
-typedef struct {
-    char name[256];
-    UT_hash_handle hh;
-} discarded_image_entry_t;
-
-extern pthread_mutex_t discarded_images_lock;
-extern discarded_image_entry_t *discarded_images_head;
-
-int discarded_images_init(void);
-int discarded_images_table_add(const char *filename);
-bool discarded_images_table_contains(const char *filename);
-void free_discarded_images_table(void);
\ No newline at end of file
@@ -0,0 +1,299 @@
+#define _GNU_SOURCE
+
+#include "metrics_server.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <netdb.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "image.h"
+#include "image_queue.h"
+#include "engine.h"
+#include "macros.h"
+
+// Fixed `le` bounds (seconds) the log-linear histograms are re-bucketed into.
+static const double bucket_bounds[] = {
+    0.00001, 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01,
+    0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0,
+};
+
+// Prints a label value with `\`, `"` and newlines escaped as the text format requires.
+static void print_label_value(FILE* out, const char* value) {
+    for (const char* c = value; *c; c++) {
+        if (*c == '\\' || *c == '"') fputc('\\', out);
+        if (*c == '\n') { fputs("\\n", out); continue; }
+        fputc(*c, out);
+    }
+}
+
+static void print_header(FILE* out, const char* name, const char* type, const char* help) {
+    fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void print_histogram(FILE* out, const char* name, const char* label, const char* label_value, histogram_t* h) {
+    char labels[128] = "";
+    if (label != NULL)
+        snprintf(labels, sizeof(labels), "%s=\"%s\",", label, label_value);
+
+    for (size_t i = 0; i < sizeof(bucket_bounds) / sizeof(bucket_bounds[0]); i++)
+        fprintf(out, "%s_bucket{%sle=\"%g\"} %llu\n", name, labels, bucket_bounds[i],
+            (unsigned long long)histogram_count_at_or_below(h, (uint64_t)(bucket_bounds[i] * 1e9)));
+    fprintf(out, "%s_bucket{%sle=\"+Inf\"} %llu\n", name, labels, (unsigned long long)histogram_count(h));
+
+    if (label != NULL) labels[strlen(labels) - 1] = '\0'; // drop the trailing comma
+    const char* open = (label != NULL)? "{": "";
+    const char* close = (label != NULL)? "}": "";
+    fprintf(out, "%s_sum%s%s%s %.9f\n", name, open, labels, close, histogram_sum(h) / 1e9);
+    fprintf(out, "%s_count%s%s%s %llu\n", name, open, labels, close, (unsigned long long)histogram_count(h));
+}
+
+char* metrics_render(const metrics_server_config_t* config) {
+    stats_snapshot_t* snapshot = malloc(sizeof(stats_snapshot_t));
+    if (snapshot == NULL)
+        return NULL;
+    stats_snapshot(snapshot);
+
+    char* buffer = NULL;
+    size_t length = 0;
+    FILE* out = open_memstream(&buffer, &length);
+    if (out == NULL) {
+        free(snapshot);
+        return NULL;
+    }
+
+    ppxl_engine_t* engine = config->engine;
+
+    print_header(out, "ppxl_images_read_total", "counter", "Images found in the input directory, or submitted.");
+    fprintf(out, "ppxl_images_read_total %zu\n", (size_t)atomic_load(&engine->images_read));
+
+    print_header(out, "ppxl_images_processed_total", "counter", "Images whose every output was written or handed to a callback.");
+    fprintf(out, "ppxl_images_processed_total %zu\n", (size_t)atomic_load(&engine->images_processed));
+
+    print_header(out, "ppxl_input_bytes_total", "counter", "Size of the decoded input files.");
+    fprintf(out, "ppxl_input_bytes_total %lld\n", (long long)snapshot->counters[COUNTER_INPUT_BYTES]);
+
+    // One series per output name (the effect graph branch), summed over every spec that has a branch of that name.
+    static const struct { size_t offset; const char* name; const char* help; } output_counters[] = {
+        { offsetof(engine_output_t, written), "ppxl_outputs_written_total",  "Outputs written or handed to a callback, per output." },
+        { offsetof(engine_output_t, bytes),   "ppxl_output_bytes_total",     "Size of the outputs (encoded, or packed samples for frames), per output." },
+        { offsetof(engine_output_t, pixels),  "ppxl_pixels_processed_total", "Pixels of the outputs, per output." },
+    };
+    pthread_mutex_lock(&engine->graphs_lock); // submissions may add outputs
+    for (size_t i = 0; i < sizeof(output_counters) / sizeof(output_counters[0]); i++) {
+        print_header(out, output_counters[i].name, "counter", output_counters[i].help);
+        for (engine_output_t* output = engine->outputs; output != NULL; output = output->hh.next) {
+            const atomic_size_t* value = (const atomic_size_t*)((const char*)output + output_counters[i].offset);
+            fprintf(out, "%s{output=\"", output_counters[i].name);
+            print_label_value(out, output->name);
+            fprintf(out, "\"} %zu\n", (size_t)atomic_load(value));
+        }
+    }
+    pthread_mutex_unlock(&engine->graphs_lock);
+
+    print_header(out, "ppxl_images_discarded_total", "counter", "Images dropped from the pipeline, per reason.");
+    for (int reason = 0; reason < DISCARD_REASON_COUNT; reason++)
+        fprintf(out, "ppxl_images_discarded_total{reason=\"%s\"} %llu\n",
+            stats_discard_reason_name(reason), (unsigned long long)snapshot->discards[reason]);
+
+    print_header(out, "ppxl_decode_retries_total", "counter", "Decodes postponed because the input looked incomplete or failed to decode.");
+    fprintf(out, "ppxl_decode_retries_total %lld\n", (long long)snapshot->counters[COUNTER_DECODE_RETRIES]);
+
+    print_header(out, "ppxl_deadline_misses_total", "counter", "Images taken off the ingestion queue after their deadline.");
+    fprintf(out, "ppxl_deadline_misses_total %lld\n", (long long)snapshot->counters[COUNTER_DEADLINE_MISSES]);
+
+    print_header(out, "ppxl_queue_depth", "gauge", "Items currently waiting in each queue.");
+    fprintf(out, "ppxl_queue_depth{queue=\"%s\"} %zu\n", stats_queue_name(QUEUE_NAMES), image_name_queue_depth(&engine->name_queue));
+    fprintf(out, "ppxl_queue_depth{queue=\"%s\"} %zu\n", stats_queue_name(QUEUE_CHUNKS), chunk_queue_depth(&engine->chunker_filtering_queue));
+    fprintf(out, "ppxl_queue_depth{queue=\"%s\"} %zu\n", stats_queue_name(QUEUE_FILTERED), chunk_queue_depth(&engine->filtering_reconstruction_queue));
+
+    print_header(out, "ppxl_inflight_bytes", "gauge", "Decoded, chunk and reassembled pixel buffers currently alive.");
+    fprintf(out, "ppxl_inflight_bytes %lld\n", (long long)snapshot->counters[COUNTER_INFLIGHT_BYTES]);
+
+    print_header(out, "ppxl_pool_workers", "gauge", "Workers of the encoder thread pool.");
+    fprintf(out, "ppxl_pool_workers %zu\n", config->pool_workers);
+    print_header(out, "ppxl_pool_active_workers", "gauge", "Encoder pool workers currently running a task.");
+    fprintf(out, "ppxl_pool_active_workers %lld\n", (long long)snapshot->counters[COUNTER_POOL_ACTIVE]);
+
+    print_header(out, "ppxl_stage_threads", "gauge", "Threads working on each stage; rate(ppxl_stage_busy_seconds_total) / this is the utilization.");
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+        fprintf(out, "ppxl_stage_threads{stage=\"%s\"} %zu\n", stats_stage_name(stage), config->stage_threads[stage]);
+    print_header(out, "ppxl_stage_busy_seconds_total", "counter", "Time spent in each stage, summed over its threads.");
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+        fprintf(out, "ppxl_stage_busy_seconds_total{stage=\"%s\"} %.9f\n", stats_stage_name(stage), histogram_sum(&snapshot->stage[stage]) / 1e9);
+
+    print_header(out, "ppxl_stage_duration_seconds", "histogram", "Duration of one unit of work per stage (one image, or one chunk for filter).");
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+        print_histogram(out, "ppxl_stage_duration_seconds", "stage", stats_stage_name(stage), &snapshot->stage[stage]);
+
+    print_header(out, "ppxl_queue_wait_seconds", "histogram", "Time items spent waiting in each queue.");
+    for (int queue = 0; queue < QUEUE_COUNT; queue++)
+        print_histogram(out, "ppxl_queue_wait_seconds", "queue", stats_queue_name(queue), &snapshot->queue_wait[queue]);
+
+    print_header(out, "ppxl_image_latency_seconds", "histogram", "Time from a chunker picking an image up until its output is written.");
+    print_histogram(out, "ppxl_image_latency_seconds", NULL, NULL, &snapshot->image_latency);
+
+    fclose(out);
+    free(snapshot);
+    return buffer;
+}
+
+int metrics_server_listen(const char* address) {
+    if (strncmp(address, "unix:", 5) == 0) {
+        const char* path = address + 5;
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        if (strlen(path) >= sizeof(addr.sun_path)) {
+            fprintf(stderr, "metrics_server: Unix socket path too long: %s\n", path);
+            return -1;
+        }
+        strcpy(addr.sun_path, path);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            perror("metrics_server - socket failed");
+            return -1;
+        }
+
+        unlink(path); // stale socket from a previous run
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+            perror("metrics_server - Cannot listen on Unix socket");
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    const char* colon = strrchr(address, ':');
+    char host[256] = "127.0.0.1";
+    const char* port = address;
+    if (colon != NULL) {
+        size_t host_length = colon - address;
+        if (host_length > 0 && host_length < sizeof(host)) {
+            memcpy(host, address, host_length);
+            host[host_length] = '\0';
+        }
+        port = colon + 1;
+    }
+
+    // getaddrinfo() silently truncates numeric ports to 16 bits; service names are left to it.
+    if (*port >= '0' && *port <= '9') {
+        char* end = NULL;
+        unsigned long number = strtoul(port, &end, 10);
+        if (*end != '\0' || number == 0 || number > 65535) {
+            fprintf(stderr, "metrics_server: Invalid port in '%s'\n", address);
+            return -1;
+        }
+    }
+
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = AI_PASSIVE };
+    struct addrinfo* result = NULL;
+    int error = getaddrinfo(host, port, &hints, &result);
+    if (error != 0) {
+        fprintf(stderr, "metrics_server: Cannot resolve '%s': %s\n", address, gai_strerror(error));
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo* ai = result; ai != NULL; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+
+        int yes = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 16) == 0)
+            break;
+
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+
+    if (fd < 0)
+        fprintf(stderr, "metrics_server: Cannot listen on '%s'\n", address);
+    return fd;
+}
+
+void metrics_server_close(int listener, const char* address) {
+    close(listener);
+    if (strncmp(address, "unix:", 5) == 0)
+        unlink(address + 5);
+}
+
+static void write_all(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = send(fd, data, length, MSG_NOSIGNAL);
+        if (written <= 0) {
+            if (written < 0 && errno == EINTR) continue;
+            return;
+        }
+        data += written;
+        length -= written;
+    }
+}
+
+static void serve_client(int client, const metrics_server_config_t* config) {
+    // Read the request head; anything that does not ask for /metrics (or /) gets a 404.
+    char request[2048];
+    size_t length = 0;
+    request[0] = '\0';
+    while (length < sizeof(request) - 1 && !strstr(request, "\r\n\r\n")) {
+        struct pollfd pfd = { .fd = client, .events = POLLIN };
+        if (poll(&pfd, 1, 1000) <= 0) break;
+
+        ssize_t received = recv(client, request + length, sizeof(request) - 1 - length, 0);
+        if (received <= 0) break;
+        length += received;
+        request[length] = '\0';
+    }
+    request[length] = '\0';
+
+    bool found = strncmp(request, "GET /metrics", 12) == 0 || strncmp(request, "GET / ", 6) == 0;
+    char* body = found? metrics_render(config): NULL;
+
+    char header[256];
+    if (body != NULL) {
+        size_t body_length = strlen(body);
+        int header_length = snprintf(header, sizeof(header),
+            "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+            "Content-Length: %zu\r\nConnection: close\r\n\r\n", body_length);
+        write_all(client, header, header_length);
+        write_all(client, body, body_length);
+        free(body);
+    } else {
+        const char* not_found = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        write_all(client, not_found, strlen(not_found));
+    }
+}
+
+void* metrics_server_thread(void* arg) {
+    const metrics_server_config_t* config = (const metrics_server_config_t*)arg;
+
+    int listener = config->listener;
+    PRINTF("Serving metrics on %s\n", config->listen);
+
+    while (!config->engine->stop_flag) {
+        // Poll with a timeout so that shutdown is noticed without a wake-up connection.
+        struct pollfd pfd = { .fd = listener, .events = POLLIN };
+        if (poll(&pfd, 1, 200) <= 0)
+            continue;
+
+        int client = accept(listener, NULL, NULL);
+        if (client < 0)
+            continue;
+
+        serve_client(client, config);
+        close(client);
+    }
+
+    metrics_server_close(listener, config->listen);
+    return NULL;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "stats.h"
+
+struct ppxl_engine;
+
+typedef struct {
+    struct ppxl_engine* engine;         // whose queues and counters are served
+    const char* listen;                 // "host:port", ":port" (loopback) or "unix:/path/to.sock"
+    int listener;                       // from metrics_server_listen(`listen`); the thread closes it
+    size_t stage_threads[STAGE_COUNT];  // threads working on each stage
+    size_t pool_workers;                // workers of the encoder thread pool
+} metrics_server_config_t;
+
+/*
+* @brief Open a listening socket for "unix:/path", "host:port" or ":port".
+* @return The socket descriptor, or -1 on failure.
+* @note Called before any thread starts so that an address that cannot be served fails startup.
+*/
+int metrics_server_listen(const char* address);
+
+/*
+* @brief Close a listener from metrics_server_listen() and remove its Unix socket file, if any.
+*/
+void metrics_server_close(int listener, const char* address);
+
+/*
+* @brief Thread entry point: serve the Prometheus text exposition format (version 0.0.4) over
+* HTTP on `config->listener` until the engine stops.
+* @param arg A `metrics_server_config_t*` that must outlive the thread.
+* @note The server only reads what the workers record (per-thread histograms and counters,
+* queue depths); it never takes a lock a worker could be waiting on. The one it takes, around the
+* per-output counters, is only held by submissions parsing a spec they are the first to use.
+*/
+void* metrics_server_thread(void* arg);
+
+/*
+* @brief Render every metric into a newly allocated, NUL terminated string.
+* @note The caller owns the returned buffer.
+*/
+char* metrics_render(const metrics_server_config_t* config);
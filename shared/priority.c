@@ -0,0 +1,201 @@
+#include "priority.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/xattr.h>
+
+typedef enum {
+    RULE_DIRECTORY,
+    RULE_PREFIX,
+} rule_kind_t;
+
+typedef struct priority_rule {
+    struct priority_rule* next;
+    rule_kind_t kind;
+    priority_t priority;
+    char* value;
+} priority_rule_t;
+
+// Configured from the command line before any thread starts, read-only afterwards.
+static priority_rule_t* rules = NULL;
+static const char* xattr_name = NULL;
+static uint64_t deadlines_ns[PRIORITY_COUNT];
+
+static const char* priority_names[PRIORITY_COUNT] = { "high", "normal", "low" };
+
+const char* priority_name(priority_t priority) {
+    return (priority >= 0 && priority < PRIORITY_COUNT)? priority_names[priority]: "unknown";
+}
+
+int priority_from_name(const char* name, priority_t* priority) {
+    for (int i = 0; i < PRIORITY_COUNT; i++) {
+        if (strcmp(name, priority_names[i]) == 0) {
+            *priority = (priority_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int priority_parse_policy(const char* spec, priority_policy_t* policy) {
+    if (strcmp(spec, "strict") == 0) {
+        policy->mode = PRIORITY_STRICT;
+        return 0;
+    }
+
+    if (strncmp(spec, "weighted", 8) != 0)
+        return -1;
+
+    policy->mode = PRIORITY_WEIGHTED;
+    if (spec[8] == '\0')
+        return 0;
+    if (spec[8] != ':')
+        return -1;
+
+    // exactly three weights separated by commas, in class order, and nothing else
+    unsigned weights[PRIORITY_COUNT];
+    const char* cursor = spec + 9;
+    for (int i = 0; i < PRIORITY_COUNT; i++) {
+        if (*cursor < '0' || *cursor > '9')
+            return -1; // strtoul would take a sign or leading spaces
+        char* end;
+        unsigned long weight = strtoul(cursor, &end, 10);
+        if (weight == 0 || weight > PRIORITY_MAX_WEIGHT)
+            return -1; // a zero weight would starve the class forever
+        if (*end != ((i < PRIORITY_COUNT - 1)? ',': '\0'))
+            return -1;
+        weights[i] = (unsigned)weight;
+        cursor = end + 1;
+    }
+
+    memcpy(policy->weights, weights, sizeof(weights));
+    return 0;
+}
+
+int priority_add_rule(const char* spec) {
+    const char* kind_start = strchr(spec, ':');
+    if (kind_start == NULL)
+        return -1;
+    const char* value_start = strchr(kind_start + 1, ':');
+    if (value_start == NULL || value_start[1] == '\0')
+        return -1;
+
+    char class_name[16];
+    size_t class_length = kind_start - spec;
+    if (class_length >= sizeof(class_name))
+        return -1;
+    memcpy(class_name, spec, class_length);
+    class_name[class_length] = '\0';
+
+    priority_rule_t* rule = malloc(sizeof(priority_rule_t));
+    if (rule == NULL) {
+        perror("priority_add_rule - Cannot allocate rule");
+        return -1;
+    }
+
+    size_t kind_length = value_start - (kind_start + 1);
+    if (priority_from_name(class_name, &rule->priority) != 0) {
+        free(rule);
+        return -1;
+    }
+    if (kind_length == 3 && strncmp(kind_start + 1, "dir", 3) == 0) {
+        rule->kind = RULE_DIRECTORY;
+    } else if (kind_length == 6 && strncmp(kind_start + 1, "prefix", 6) == 0) {
+        rule->kind = RULE_PREFIX;
+    } else {
+        free(rule);
+        return -1;
+    }
+
+    rule->value = strdup(value_start + 1);
+    if (rule->value == NULL) {
+        free(rule);
+        return -1;
+    }
+
+    // Strip a trailing slash so that `dir:uploads/` and `dir:uploads` behave the same.
+    size_t length = strlen(rule->value);
+    if (rule->kind == RULE_DIRECTORY && length > 1 && rule->value[length - 1] == '/')
+        rule->value[length - 1] = '\0';
+
+    // Append, so that rules keep their command-line order.
+    priority_rule_t** link = &rules;
+    while (*link != NULL)
+        link = &(*link)->next;
+    rule->next = NULL;
+    *link = rule;
+
+    return 0;
+}
+
+void priority_set_xattr(const char* name) {
+    xattr_name = name;
+}
+
+int priority_set_deadline(const char* spec) {
+    const char* colon = strchr(spec, ':');
+    if (colon == NULL || colon - spec >= 16 || colon[1] < '0' || colon[1] > '9')
+        return -1;
+
+    char class_name[16];
+    memcpy(class_name, spec, colon - spec);
+    class_name[colon - spec] = '\0';
+    priority_t priority;
+    if (priority_from_name(class_name, &priority) != 0)
+        return -1;
+
+    char* end;
+    unsigned long ms = strtoul(colon + 1, &end, 10);
+    if (*end != '\0' || ms > 24ul * 3600 * 1000)
+        return -1;
+
+    deadlines_ns[priority] = (uint64_t)ms * 1000000ull;
+    return 0;
+}
+
+uint64_t priority_deadline_ns(priority_t priority) {
+    return (priority >= 0 && priority < PRIORITY_COUNT)? deadlines_ns[priority]: 0;
+}
+
+static bool rule_matches(const priority_rule_t* rule, const char* relative_path) {
+    const char* slash = strrchr(relative_path, '/');
+    const char* filename = slash? slash + 1: relative_path;
+
+    if (rule->kind == RULE_PREFIX)
+        return strncmp(filename, rule->value, strlen(rule->value)) == 0;
+
+    // RULE_DIRECTORY: the file lives in the subdirectory (or below it).
+    size_t length = strlen(rule->value);
+    return slash != NULL && strncmp(relative_path, rule->value, length) == 0 && relative_path[length] == '/';
+}
+
+priority_t priority_classify(const char* path, const char* relative_path) {
+    if (xattr_name != NULL) {
+        char value[16];
+        ssize_t size = getxattr(path, xattr_name, value, sizeof(value) - 1);
+        if (size > 0) {
+            value[size] = '\0';
+            priority_t priority;
+            if (priority_from_name(value, &priority) == 0)
+                return priority;
+        }
+    }
+
+    for (const priority_rule_t* rule = rules; rule != NULL; rule = rule->next) {
+        if (rule_matches(rule, relative_path))
+            return rule->priority;
+    }
+
+    return PRIORITY_NORMAL;
+}
+
+void priority_cleanup(void) {
+    memset(deadlines_ns, 0, sizeof(deadlines_ns));
+    while (rules != NULL) {
+        priority_rule_t* next = rules->next;
+        free(rules->value);
+        free(rules);
+        rules = next;
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+Priority classes for incoming images.
+
+An image's class is decided once, when the watcher finds it, and travels with the image through
+every queue: the name queue dequeues according to the configured policy, and the chunk queues and
+the encoder pool always serve a more urgent class first.
+
+A class may also have a deadline. Every image of the class is stamped with its own deadline when it
+enters the name queue. An image still queued past its deadline is taken next, whatever the policy,
+earliest deadline first, and carries on as `high` through the rest of the pipeline.
+*/
+
+typedef enum {
+    PRIORITY_HIGH,
+    PRIORITY_NORMAL,
+    PRIORITY_LOW,
+    PRIORITY_COUNT,
+} priority_t;
+
+typedef enum {
+    PRIORITY_STRICT,    // always serve the most urgent non-empty class
+    PRIORITY_WEIGHTED,  // serve classes in proportion to their weights (smooth weighted round-robin)
+} priority_mode_t;
+
+typedef struct {
+    priority_mode_t mode;
+    unsigned weights[PRIORITY_COUNT]; // only used by PRIORITY_WEIGHTED
+} priority_policy_t;
+
+#define PRIORITY_DEFAULT_POLICY { PRIORITY_STRICT, { 8, 4, 1 } }
+#define PRIORITY_MAX_WEIGHT 1000
+
+const char* priority_name(priority_t priority);
+int priority_from_name(const char* name, priority_t* priority);
+
+/*
+* @brief Parse `strict` or `weighted[:high,normal,low]` (e.g. `weighted:8,4,1`), weights from 1 to PRIORITY_MAX_WEIGHT.
+* @return 0 on success, -1 if the spec is malformed.
+*/
+int priority_parse_policy(const char* spec, priority_policy_t* policy);
+
+/*
+* @brief Add a classification rule `<class>:dir:<subdirectory>` or `<class>:prefix:<filename prefix>`.
+* @note Rules are tried in the order they were added; the first match wins.
+*/
+int priority_add_rule(const char* spec);
+
+/*
+* @brief Read the class from the extended attribute `name` (value `high`, `normal` or `low`);
+* an attribute that is present overrides every rule.
+*/
+void priority_set_xattr(const char* name);
+
+/*
+* @brief Set a class's deadline from `<class>:<ms>`, counted from when an image is queued (0 for none, the default).
+*/
+int priority_set_deadline(const char* spec);
+
+// The deadline of the class, in nanoseconds after an image is queued; 0 for none.
+uint64_t priority_deadline_ns(priority_t priority);
+
+/*
+* @brief Classify an image.
+* @param path Full path of the file (used for the xattr lookup).
+* @param relative_path Path relative to the input directory (used by the rules).
+*/
+priority_t priority_classify(const char* path, const char* relative_path);
+
+void priority_cleanup(void);
@@ -0,0 +1,143 @@
+#include "stats.h"
+
+#include <time.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+/*
+Each recording thread lazily allocates its own set of histograms and links it into a global
+list. Recording only ever touches the calling thread's set (see `histogram_record_local`),
+readers walk the list and merge. Sets outlive their threads so nothing recorded is lost.
+*/
+typedef struct thread_stats {
+    histogram_t stage[STAGE_COUNT];
+    histogram_t queue_wait[QUEUE_COUNT];
+    histogram_t image_latency;
+    atomic_uint_fast64_t counters[COUNTER_COUNT];
+    atomic_uint_fast64_t discards[DISCARD_REASON_COUNT];
+    struct thread_stats* next;
+} thread_stats_t;
+
+static thread_stats_t* all_thread_stats = NULL;
+static pthread_mutex_t all_thread_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local thread_stats_t* local_stats = NULL;
+
+static const char* stage_names[STAGE_COUNT] = {
+    [STAGE_DECODE]      = "decode",
+    [STAGE_CHUNK]       = "chunk",
+    [STAGE_FILTER]      = "filter",
+    [STAGE_RECONSTRUCT] = "reconstruct",
+    [STAGE_ENCODE]      = "encode",
+};
+
+static const char* queue_names[QUEUE_COUNT] = {
+    [QUEUE_NAMES]    = "names",
+    [QUEUE_CHUNKS]   = "chunks",
+    [QUEUE_FILTERED] = "filtered",
+};
+
+static const char* discard_reason_names[DISCARD_REASON_COUNT] = {
+    [DISCARD_DECODE]   = "decode",
+    [DISCARD_CHUNKING] = "chunking",
+    [DISCARD_SHUTDOWN] = "shutdown",
+    [DISCARD_EFFECT] = "effect",
+    [DISCARD_ENCODE] = "encode",
+};
+
+static thread_stats_t* get_local_stats(void) {
+    if (local_stats != NULL)
+        return local_stats;
+
+    thread_stats_t* stats = calloc(1, sizeof(thread_stats_t));
+    if (stats == NULL)
+        return NULL;
+
+    pthread_mutex_lock(&all_thread_stats_lock);
+    stats->next = all_thread_stats;
+    all_thread_stats = stats;
+    pthread_mutex_unlock(&all_thread_stats_lock);
+
+    local_stats = stats;
+    return stats;
+}
+
+uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void stats_record_stage(pipeline_stage_t stage, uint64_t ns) {
+    thread_stats_t* stats = get_local_stats();
+    if (stats) histogram_record_local(&stats->stage[stage], ns);
+}
+
+void stats_record_queue_wait(pipeline_queue_t queue, uint64_t ns) {
+    thread_stats_t* stats = get_local_stats();
+    if (stats) histogram_record_local(&stats->queue_wait[queue], ns);
+}
+
+void stats_record_image_latency(uint64_t ns) {
+    thread_stats_t* stats = get_local_stats();
+    if (stats) histogram_record_local(&stats->image_latency, ns);
+}
+
+// Single-writer add: only the owning thread stores, so no read-modify-write is needed.
+static inline void add_local(atomic_uint_fast64_t* counter, uint64_t delta) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + delta, memory_order_relaxed);
+}
+
+void stats_add(stats_counter_t counter, int64_t delta) {
+    thread_stats_t* stats = get_local_stats();
+    if (stats) add_local(&stats->counters[counter], (uint64_t)delta); // wraps, the merged sum is exact
+}
+
+void stats_record_discard(discard_reason_t reason) {
+    thread_stats_t* stats = get_local_stats();
+    if (stats) add_local(&stats->discards[reason], 1);
+}
+
+void stats_snapshot(stats_snapshot_t* snapshot) {
+    for (int i = 0; i < STAGE_COUNT; i++) histogram_reset(&snapshot->stage[i]);
+    for (int i = 0; i < QUEUE_COUNT; i++) histogram_reset(&snapshot->queue_wait[i]);
+    histogram_reset(&snapshot->image_latency);
+
+    uint64_t counters[COUNTER_COUNT] = {0};
+    for (int i = 0; i < DISCARD_REASON_COUNT; i++) snapshot->discards[i] = 0;
+
+    pthread_mutex_lock(&all_thread_stats_lock);
+    for (thread_stats_t* stats = all_thread_stats; stats != NULL; stats = stats->next) {
+        for (int i = 0; i < STAGE_COUNT; i++) histogram_merge(&snapshot->stage[i], &stats->stage[i]);
+        for (int i = 0; i < QUEUE_COUNT; i++) histogram_merge(&snapshot->queue_wait[i], &stats->queue_wait[i]);
+        histogram_merge(&snapshot->image_latency, &stats->image_latency);
+        for (int i = 0; i < COUNTER_COUNT; i++) counters[i] += atomic_load_explicit(&stats->counters[i], memory_order_relaxed);
+        for (int i = 0; i < DISCARD_REASON_COUNT; i++) snapshot->discards[i] += atomic_load_explicit(&stats->discards[i], memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&all_thread_stats_lock);
+
+    for (int i = 0; i < COUNTER_COUNT; i++) snapshot->counters[i] = (int64_t)counters[i];
+}
+
+void stats_cleanup(void) {
+    pthread_mutex_lock(&all_thread_stats_lock);
+    thread_stats_t* stats = all_thread_stats;
+    while (stats != NULL) {
+        thread_stats_t* next = stats->next;
+        free(stats);
+        stats = next;
+    }
+    all_thread_stats = NULL;
+    pthread_mutex_unlock(&all_thread_stats_lock);
+}
+
+const char* stats_stage_name(pipeline_stage_t stage) {
+    return stage_names[stage];
+}
+
+const char* stats_queue_name(pipeline_queue_t queue) {
+    return queue_names[queue];
+}
+
+const char* stats_discard_reason_name(discard_reason_t reason) {
+    return discard_reason_names[reason];
+}
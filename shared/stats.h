@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include "histogram.h"
+
+// Stages of the pipeline whose run time is recorded.
+typedef enum {
+    STAGE_DECODE,
+    STAGE_CHUNK,
+    STAGE_FILTER,       // one sample per chunk
+    STAGE_RECONSTRUCT,
+    STAGE_ENCODE,
+    STAGE_COUNT,
+} pipeline_stage_t;
+
+// Queues between the stages; the time every item spends waiting in them is recorded.
+typedef enum {
+    QUEUE_NAMES,        // watcher -> chunker
+    QUEUE_CHUNKS,       // chunker -> filter
+    QUEUE_FILTERED,     // filter -> reconstruction
+    QUEUE_COUNT,
+} pipeline_queue_t;
+
+// Plain counters. Gauges are counters that also go down; their per-thread parts may be
+// negative (memory allocated on one thread and freed on another) but the sum is exact.
+typedef enum {
+    COUNTER_INPUT_BYTES,        // size of the decoded input files
+    COUNTER_INFLIGHT_BYTES,     // gauge: pixel buffers currently alive in the pipeline
+    COUNTER_POOL_ACTIVE,        // gauge: encoder pool workers currently running a task
+    COUNTER_DECODE_RETRIES,     // decodes postponed because the file looked incomplete or failed to decode
+    COUNTER_DEADLINE_MISSES,    // images taken off the name queue after their deadline (see `priority.h`)
+    COUNTER_COUNT,
+} stats_counter_t;
+
+// Why an image was dropped from the pipeline.
+typedef enum {
+    DISCARD_DECODE,             // the file could not be decoded
+    DISCARD_CHUNKING,           // allocating or enqueueing its chunks failed
+    DISCARD_SHUTDOWN,           // the pipeline stopped while it was being chunked
+    DISCARD_EFFECT,             // an effect failed on one of its tiles or outputs
+    DISCARD_ENCODE,             // one of its outputs could not be encoded or written
+    DISCARD_REASON_COUNT,
+} discard_reason_t;
+
+/*
+* Merged view over the histograms and counters of every thread that has recorded something so far.
+*/
+typedef struct {
+    histogram_t stage[STAGE_COUNT];
+    histogram_t queue_wait[QUEUE_COUNT];
+    histogram_t image_latency;
+    int64_t counters[COUNTER_COUNT];
+    uint64_t discards[DISCARD_REASON_COUNT];
+} stats_snapshot_t;
+
+/*
+* @brief Monotonic clock reading in nanoseconds.
+*/
+uint64_t now_ns(void);
+
+/*
+* @brief Record that `stage` took `ns` nanoseconds on the calling thread.
+* @note Every thread records into its own histograms, so this is wait-free; the sum of a
+* stage histogram is the busy time of that stage over all its threads.
+*/
+void stats_record_stage(pipeline_stage_t stage, uint64_t ns);
+void stats_record_queue_wait(pipeline_queue_t queue, uint64_t ns);
+
+/*
+* @brief Record the time an image spent in the pipeline, from the moment a chunker thread
+* picked it up until its output file was written.
+*/
+void stats_record_image_latency(uint64_t ns);
+
+/*
+* @brief Add `delta` to a counter (or gauge) on the calling thread. Wait-free.
+*/
+void stats_add(stats_counter_t counter, int64_t delta);
+void stats_record_discard(discard_reason_t reason);
+
+/*
+* @brief Merge the histograms of all threads into `snapshot` (which is overwritten).
+*/
+void stats_snapshot(stats_snapshot_t* snapshot);
+
+/*
+* @brief Free the per-thread histograms. Only call once all recording threads have exited.
+*/
+void stats_cleanup(void);
+
+const char* stats_stage_name(pipeline_stage_t stage);
+const char* stats_queue_name(pipeline_queue_t queue);
+const char* stats_discard_reason_name(discard_reason_t reason);
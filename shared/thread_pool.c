@@ -1,4 +1,6 @@
 #include "thread_pool.h"
+#include "stats.h"
+#include "trace.h"
 
 void task_destroy(void* ptr) {
     task_t* task = (task_t*)ptr;
@@ -10,6 +12,7 @@ DEFINE_TYPE(task, task_type, task_t)
 
 void* worker_thread(void* arg) {
     thread_pool_t *pool = (thread_pool_t *)arg;
+    trace_thread_name("pool worker");
 
     while (1) {
         pthread_mutex_lock(pool->lock);
@@ -32,7 +35,9 @@ void* worker_thread(void* arg) {
         pthread_mutex_unlock(pool->lock);
         
         task_t *task = get_task(task_obj);
+        stats_add(COUNTER_POOL_ACTIVE, 1);
         task->function(task->arg);
+        stats_add(COUNTER_POOL_ACTIVE, -1);
         destroy(task_obj); // this will (should!) call task_destroy() and free the task
     }
 
@@ -72,13 +77,27 @@ thread_pool_t* thread_pool_create(int num_threads) {
 }
 
 void thread_pool_add_task(thread_pool_t* pool, void (*function)(Object), Object arg) {
+    thread_pool_add_task_priority(pool, function, arg, 0);
+}
+
+void thread_pool_add_task_priority(thread_pool_t* pool, void (*function)(Object), Object arg, int priority) {
     Object task_obj = let_task(NULL);
     task_t* task = get_task(task_obj);
     task->function = function;
     task->arg = ref(arg); // take ownership
+    task->priority = priority;
 
     pthread_mutex_lock(pool->lock);
-    dlist_insert_last(&pool->task_queue, task_obj); // insert takes ownership
+
+    // find the first waiting task that is less urgent; the queue stays sorted by priority
+    size_t index = 0;
+    dlist_node_t* node = pool->task_queue.head;
+    while (node != NULL && get_task(node->data)->priority <= priority) {
+        node = node->next;
+        index++;
+    }
+
+    dlist_insert_at(&pool->task_queue, index, task_obj); // insert takes ownership
     pthread_cond_signal(pool->cond);
     pthread_mutex_unlock(pool->lock);
 
@@ -92,7 +111,7 @@ void thread_pool_destroy(thread_pool_t* pool) {
     pthread_mutex_unlock(pool->lock);
 
     // this will join all threads because of custom destroy function
-    darray_clear(&pool->threads); 
+    darray_destroy(&pool->threads);
     // this will free all tasks in the queue (all will be destroyed)
     dlist_destroy(&pool->task_queue);
 
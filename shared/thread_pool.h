@@ -14,6 +14,7 @@ typedef struct
 {
     void (*function)(Object);
     Object arg;
+    int priority; // lower runs first
 } task_t;
 
 extern DType task_type;
@@ -34,4 +35,10 @@ typedef struct
 
 thread_pool_t *thread_pool_create(int num_threads);
 void thread_pool_destroy(thread_pool_t *pool);
-void thread_pool_add_task(thread_pool_t *pool, void (*function)(Object), Object arg);
\ No newline at end of file
+void thread_pool_add_task(thread_pool_t *pool, void (*function)(Object), Object arg);
+
+/*
+* @brief Queue a task ahead of every waiting task with a larger `priority` value;
+* tasks of equal priority run in the order they were added.
+*/
+void thread_pool_add_task_priority(thread_pool_t *pool, void (*function)(Object), Object arg, int priority);
\ No newline at end of file
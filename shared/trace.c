@@ -0,0 +1,209 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "stats.h"
+
+typedef struct {
+    const char* name;       // static string
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    int chunk_id;
+    char phase;             // 'X' (complete) or 'i' (instant)
+    char image[TRACE_IMAGE_NAME_LENGTH];
+} trace_event_t;
+
+typedef struct trace_buffer {
+    trace_event_t* events;
+    size_t capacity;
+    size_t written;         // total events ever recorded; the ring holds the last `capacity`
+    int tid;
+    char thread_name[32];
+    struct trace_buffer* next;
+} trace_buffer_t;
+
+bool trace_enabled = false;
+
+static size_t buffer_capacity = TRACE_DEFAULT_EVENTS_PER_THREAD;
+static uint64_t trace_start_ns = 0;
+static trace_buffer_t* all_buffers = NULL;
+static int next_tid = 1;
+static pthread_mutex_t all_buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local trace_buffer_t* local_buffer = NULL;
+
+int trace_init(size_t events_per_thread) {
+    if (events_per_thread == 0)
+        return -1;
+
+    buffer_capacity = events_per_thread;
+    trace_start_ns = now_ns();
+    trace_enabled = true;
+    return 0;
+}
+
+static trace_buffer_t* get_local_buffer(void) {
+    if (local_buffer != NULL)
+        return local_buffer;
+
+    trace_buffer_t* buffer = calloc(1, sizeof(trace_buffer_t));
+    if (buffer == NULL)
+        return NULL;
+
+    buffer->events = malloc(buffer_capacity * sizeof(trace_event_t));
+    if (buffer->events == NULL) {
+        free(buffer);
+        return NULL;
+    }
+    buffer->capacity = buffer_capacity;
+
+    pthread_mutex_lock(&all_buffers_lock);
+    buffer->tid = next_tid++;
+    snprintf(buffer->thread_name, sizeof(buffer->thread_name), "thread %d", buffer->tid);
+    buffer->next = all_buffers;
+    all_buffers = buffer;
+    pthread_mutex_unlock(&all_buffers_lock);
+
+    local_buffer = buffer;
+    return buffer;
+}
+
+void trace_thread_name(const char* name) {
+    if (!trace_enabled)
+        return;
+
+    trace_buffer_t* buffer = get_local_buffer();
+    if (buffer == NULL)
+        return;
+
+    snprintf(buffer->thread_name, sizeof(buffer->thread_name), "%s %d", name, buffer->tid);
+}
+
+static trace_event_t* next_event(void) {
+    trace_buffer_t* buffer = get_local_buffer();
+    if (buffer == NULL)
+        return NULL;
+
+    return &buffer->events[buffer->written++ % buffer->capacity];
+}
+
+// Keep the tail of the path: the file name is what identifies an image in the viewer.
+static void copy_image_name(char* dst, const char* image) {
+    if (image == NULL) {
+        dst[0] = '\0';
+        return;
+    }
+
+    const char* slash = strrchr(image, '/');
+    const char* base = slash? slash + 1: image;
+    size_t length = strlen(base);
+    if (length >= TRACE_IMAGE_NAME_LENGTH)
+        base += length - (TRACE_IMAGE_NAME_LENGTH - 1);
+
+    strncpy(dst, base, TRACE_IMAGE_NAME_LENGTH - 1);
+    dst[TRACE_IMAGE_NAME_LENGTH - 1] = '\0';
+}
+
+void trace_complete(const char* name, const char* image, int chunk_id, uint64_t start_ns, uint64_t end_ns) {
+    trace_event_t* event = next_event();
+    if (event == NULL)
+        return;
+
+    event->name = name;
+    event->phase = 'X';
+    event->start_ns = start_ns;
+    event->duration_ns = end_ns - start_ns;
+    event->chunk_id = chunk_id;
+    copy_image_name(event->image, image);
+}
+
+void trace_instant(const char* name, const char* image, int chunk_id) {
+    trace_event_t* event = next_event();
+    if (event == NULL)
+        return;
+
+    event->name = name;
+    event->phase = 'i';
+    event->start_ns = now_ns();
+    event->duration_ns = 0;
+    event->chunk_id = chunk_id;
+    copy_image_name(event->image, image);
+}
+
+static void print_json_string(FILE* out, const char* str) {
+    fputc('"', out);
+    for (const unsigned char* c = (const unsigned char*)str; *c; c++) {
+        if (*c == '"' || *c == '\\') fprintf(out, "\\%c", *c);
+        else if (*c < 0x20) fprintf(out, "\\u%04x", *c);
+        else fputc(*c, out);
+    }
+    fputc('"', out);
+}
+
+static void print_event(FILE* out, const trace_event_t* event, int tid) {
+    double ts = (event->start_ns >= trace_start_ns)? (event->start_ns - trace_start_ns) / 1e3: 0.0;
+
+    fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"ppxl\",\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f",
+        event->name, event->phase, tid, ts);
+    if (event->phase == 'X')
+        fprintf(out, ",\"dur\":%.3f", event->duration_ns / 1e3);
+    else
+        fprintf(out, ",\"s\":\"t\"");
+
+    fprintf(out, ",\"args\":{\"image\":");
+    print_json_string(out, event->image);
+    if (event->chunk_id >= 0)
+        fprintf(out, ",\"chunk\":%d", event->chunk_id);
+    fprintf(out, "}}");
+}
+
+int trace_write(const char* path) {
+    FILE* out = fopen(path, "w");
+    if (out == NULL) {
+        perror("trace_write - Cannot open trace file");
+        return -1;
+    }
+
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"ppxl\"}}");
+
+    size_t dropped = 0;
+    pthread_mutex_lock(&all_buffers_lock);
+    for (trace_buffer_t* buffer = all_buffers; buffer != NULL; buffer = buffer->next) {
+        fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", buffer->tid);
+        print_json_string(out, buffer->thread_name);
+        fprintf(out, "}}");
+
+        // Oldest surviving event first.
+        size_t count = (buffer->written < buffer->capacity)? buffer->written: buffer->capacity;
+        size_t first = buffer->written - count;
+        dropped += first;
+        for (size_t i = first; i < buffer->written; i++)
+            print_event(out, &buffer->events[i % buffer->capacity], buffer->tid);
+    }
+    pthread_mutex_unlock(&all_buffers_lock);
+
+    fprintf(out, "\n]}\n");
+    int status = (fclose(out) == 0)? 0: -1;
+
+    if (dropped > 0)
+        fprintf(stderr, "trace: %zu oldest events were overwritten; raise --trace-buffer to keep them.\n", dropped);
+
+    return status;
+}
+
+void trace_cleanup(void) {
+    pthread_mutex_lock(&all_buffers_lock);
+    trace_buffer_t* buffer = all_buffers;
+    while (buffer != NULL) {
+        trace_buffer_t* next = buffer->next;
+        free(buffer->events);
+        free(buffer);
+        buffer = next;
+    }
+    all_buffers = NULL;
+    pthread_mutex_unlock(&all_buffers_lock);
+    trace_enabled = false;
+}
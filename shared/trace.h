@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+Event tracing in the Chrome trace format (opens in Perfetto / chrome://tracing).
+
+Every thread appends events to its own fixed-size ring buffer, so recording is lock-free
+and never blocks; when a buffer is full the oldest events of that thread are overwritten.
+The buffers are written out once at shutdown, after all recording threads have been joined.
+*/
+
+#define TRACE_DEFAULT_EVENTS_PER_THREAD (1 << 16)
+#define TRACE_IMAGE_NAME_LENGTH 48
+
+extern bool trace_enabled;
+
+/*
+* @brief Enable tracing with room for `events_per_thread` events in every thread's buffer.
+*/
+int trace_init(size_t events_per_thread);
+
+/*
+* @brief Name the calling thread in the trace (e.g. "chunker"); no-op when tracing is off.
+*/
+void trace_thread_name(const char* name);
+
+/*
+* @brief Record a span from `start_ns` to `end_ns` (`now_ns()` clock).
+* @param image Name of the image the work belongs to, or NULL.
+* @param chunk_id Chunk the work belongs to, or -1.
+*/
+void trace_complete(const char* name, const char* image, int chunk_id, uint64_t start_ns, uint64_t end_ns);
+
+/*
+* @brief Record a point in time, e.g. an item entering or leaving a queue.
+*/
+void trace_instant(const char* name, const char* image, int chunk_id);
+
+/*
+* @brief Write every recorded event to `path` as a Chrome trace JSON document.
+*/
+int trace_write(const char* path);
+void trace_cleanup(void);
+
+// Skip the call (and evaluating the arguments) entirely while tracing is off.
+#define TRACE_COMPLETE(...) do { if (trace_enabled) trace_complete(__VA_ARGS__); } while (0)
+#define TRACE_INSTANT(...) do { if (trace_enabled) trace_instant(__VA_ARGS__); } while (0)